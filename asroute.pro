@@ -86,6 +86,14 @@ HEADERS = \
           src/version.h \
           src/helpview.h \
           src/as-db-manager.h \
+          src/node-store.h \
+          src/geo-cache.h \
+          src/geo-generation.h \
+          src/road-graph.h \
+          src/route-search.h \
+          src/route-hierarchy.h \
+          src/isochrone.h \
+          src/way-geometry.h \
           src/navi-global.h \
           src/navi-types.h \
           src/route-cell-menus.h \
@@ -103,6 +111,14 @@ SOURCES = \
           src/version.cpp \
           src/helpview.cpp \
           src/as-db-manager.cpp \
+          src/node-store.cpp \
+          src/geo-cache.cpp \
+          src/geo-generation.cpp \
+          src/road-graph.cpp \
+          src/route-search.cpp \
+          src/route-hierarchy.cpp \
+          src/isochrone.cpp \
+          src/way-geometry.cpp \
           src/navi-global.cpp \
           src/navi-types.cpp \
           src/route-cell-menus.cpp \
@@ -75,8 +75,27 @@ HEADERS = \
           src/version.h \
           src/helpview.h \
           src/db-manager.h \
+          src/node-store.h \
+          src/geo-cache.h \
+          src/geo-generation.h \
+          src/id-filter.h \
+          src/road-graph.h \
+          src/road-graph-builder.h \
+          src/route-search.h \
+          src/route-hierarchy.h \
+          src/hierarchy-builder.h \
+          src/isochrone.h \
+          src/navi-pack.h \
+          src/way-geometry.h \
           src/navi-global.h \
           src/navi-types.h \
+          src/osm-batch.h \
+          src/osm-reader.h \
+          src/osm-xml-reader.h \
+          src/osm-pbf-reader.h \
+          src/osm-batch-writer.h \
+          src/bounded-queue.h \
+          src/ingest-pipeline.h \
 
 
 SOURCES = \
@@ -89,6 +108,23 @@ SOURCES = \
           src/version.cpp \
           src/helpview.cpp \
           src/db-manager.cpp \
+          src/node-store.cpp \
+          src/geo-cache.cpp \
+          src/geo-generation.cpp \
+          src/id-filter.cpp \
+          src/road-graph.cpp \
+          src/road-graph-builder.cpp \
+          src/route-search.cpp \
+          src/route-hierarchy.cpp \
+          src/hierarchy-builder.cpp \
+          src/isochrone.cpp \
+          src/navi-pack.cpp \
+          src/way-geometry.cpp \
           src/navi-global.cpp \
           src/navi-types.cpp \
+          src/osm-reader.cpp \
+          src/osm-xml-reader.cpp \
+          src/osm-pbf-reader.cpp \
+          src/osm-batch-writer.cpp \
+          src/ingest-pipeline.cpp \
 
@@ -27,4 +27,4 @@ TEMPLATE = subdirs
 
 #SUBDIRS = collect.pro nvroute.pro asroute.pro
 #SUBDIRS = asroute.pro ascollect.pro
-SUBDIRS = collect.pro asroute.pro
+SUBDIRS = collect.pro asroute.pro nvmatrix.pro
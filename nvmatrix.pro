@@ -0,0 +1,78 @@
+#
+# Travel time matrix for navi, no GUI
+#
+
+#/****************************************************************
+# * This file is distributed under the following license:
+# *
+# * Copyright (C) 2010, Bernd Stramm
+# *
+# *  This program is free software; you can redistribute it and/or
+# *  modify it under the terms of the GNU General Public License
+# *  as published by the Free Software Foundation; either version 2
+# *  of the License, or (at your option) any later version.
+# *
+# *  This program is distributed in the hope that it will be useful,
+# *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+# *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# *  GNU General Public License for more details.
+# *
+# *  You should have received a copy of the GNU General Public License
+# *  along with this program; if not, write to the Free Software
+# *  Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+# *  Boston, MA  02110-1301, USA.
+# ****************************************************************/
+
+MYNAME = nvmatrix
+
+TEMPLATE = app
+
+QT += core gui
+CONFIG += console debug_and_release
+
+MAKEFILE = Make_$${MYNAME}
+
+CONFIG(debug, debug|release) {
+  DEFINES += DELIBERATE_DEBUG=1
+  TARGET = bin/$${MYNAME}_d
+  OBJECTS_DIR = tmp/debug/obj
+  message ("DEBUG cxx-flags used $${QMAKE_CXXFLAGS_DEBUG}")
+  message ("DEBUG c-flags used $${QMAKE_CFLAGS_DEBUG}")
+} else {
+  DEFINES += DELIBERATE_DEBUG=0
+  TARGET = bin/$${MYNAME}
+  OBJECTS_DIR = tmp/release/obj
+  QMAKE_CXXFLAGS_RELEASE -= -g
+  QMAKE_CFLAGS_RELEASE -= -g
+  message ("RELEASE cxx-flags used $${QMAKE_CXXFLAGS_RELEASE}")
+  message ("RELEASE c-flags used $${QMAKE_CFLAGS_RELEASE}")
+}
+
+
+
+MOC_DIR = tmp/moc
+
+HEADERS = \
+          src/cmdoptions.h \
+          src/deliberate.h \
+          src/road-graph.h \
+          src/route-search.h \
+          src/way-geometry.h \
+          src/route-hierarchy.h \
+          src/distance-matrix.h \
+          src/navi-types.h \
+          src/navi-global.h \
+
+
+SOURCES = \
+          src/$${MYNAME}-main.cpp \
+          src/cmdoptions.cpp \
+          src/deliberate.cpp \
+          src/road-graph.cpp \
+          src/route-search.cpp \
+          src/way-geometry.cpp \
+          src/route-hierarchy.cpp \
+          src/distance-matrix.cpp \
+          src/navi-types.cpp \
+          src/navi-global.cpp \
+
@@ -80,6 +80,13 @@ HEADERS = \
           src/version.h \
           src/helpview.h \
           src/db-manager.h \
+          src/node-store.h \
+          src/geo-cache.h \
+          src/geo-generation.h \
+          src/id-filter.h \
+          src/road-graph.h \
+          src/navi-pack.h \
+          src/way-geometry.h \
           src/navi-global.h \
           src/route-cell-menus.h \
           src/sqlite-runner.h \
@@ -95,6 +102,13 @@ SOURCES = \
           src/version.cpp \
           src/helpview.cpp \
           src/db-manager.cpp \
+          src/node-store.cpp \
+          src/geo-cache.cpp \
+          src/geo-generation.cpp \
+          src/id-filter.cpp \
+          src/road-graph.cpp \
+          src/navi-pack.cpp \
+          src/way-geometry.cpp \
           src/navi-global.cpp \
           src/route-cell-menus.cpp \
           src/sqlite-runner.h \
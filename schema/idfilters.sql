@@ -0,0 +1,7 @@
+CREATE TABLE "idfilters" (
+  "type" TEXT PRIMARY KEY NOT NULL,
+  "count" INTEGER NOT NULL,
+  "capacity" INTEGER NOT NULL,
+  "hashes" INTEGER NOT NULL,
+  "bits" BLOB NOT NULL
+);
@@ -0,0 +1,5 @@
+CREATE TABLE "navimeta" (
+  "key" TEXT NOT NULL,
+  "value" TEXT,
+   UNIQUE ("key") ON CONFLICT REPLACE
+);
@@ -0,0 +1 @@
+CREATE INDEX "nodeparcelindex" on "nodeparcels" (parcelid, nodeid);
@@ -0,0 +1,3 @@
+CREATE VIRTUAL TABLE "noderect" USING rtree_i32 (
+  nodeid, minlat, maxlat, minlon, maxlon
+);
@@ -1,5 +1,6 @@
 CREATE TABLE "nodes" (
   "nodeid" INTEGER  CONSTRAINT "nodeid" UNIQUE ON CONFLICT REPLACE,
-  "lat" REAL NOT NULL,
-  "lon" REAL NOT NULL
+  "lat" INTEGER NOT NULL,
+  "lon" INTEGER NOT NULL,
+  "version" INTEGER NOT NULL DEFAULT 0
 );
@@ -1,6 +1,6 @@
 CREATE TABLE "nodetags" (
-  "nodeid" INTEGER PRIMARY KEY NOT NULL,
-  "key" TEXT NOT NULL ,
-  "value" TEXT NOT NULL, 
-  UNIQUE ( "nodeid","key") ON CONFLICT REPLACE
-);
\ No newline at end of file
+  "nodeid" INTEGER NOT NULL,
+  "keyid" INTEGER NOT NULL,
+  "valueid" INTEGER NOT NULL,
+  PRIMARY KEY ("nodeid","keyid") ON CONFLICT REPLACE
+) WITHOUT ROWID;
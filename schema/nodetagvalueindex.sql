@@ -0,0 +1 @@
+CREATE INDEX "nodetagvalueindex" on "nodetags" (keyid, valueid);
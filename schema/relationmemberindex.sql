@@ -0,0 +1 @@
+CREATE INDEX "relationmemberindex" on "relationparts" (othertype, otherid, relationid);
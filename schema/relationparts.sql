@@ -1,6 +1,7 @@
 CREATE TABLE "relationparts" (
-  "relationid" INTEGER PRIMARY KEY NOT NULL,
+  "relationid" INTEGER NOT NULL,
+  "seq" INTEGER NOT NULL,
   "othertype" TEXT NOT NULL,
   "otherid" INTEGER NOT NULL,
-   UNIQUE ("relationid","otherid") ON CONFLICT IGNORE
-);
+  PRIMARY KEY ("relationid","seq") ON CONFLICT REPLACE
+) WITHOUT ROWID;
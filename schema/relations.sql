@@ -1,3 +1,4 @@
 CREATE TABLE "relations" (
-  "relationid" INTEGER CONSTRAINT "relationid" UNIQUE  ON CONFLICT IGNORE
+  "relationid" INTEGER CONSTRAINT "relationid" UNIQUE  ON CONFLICT IGNORE,
+  "version" INTEGER NOT NULL DEFAULT 0
 );
@@ -1,6 +1,6 @@
 CREATE TABLE "relationtags" (
-  "relationid" INTEGER PRIMARY KEY NOT NULL,
-  "key" TEXT NOT NULL,
-  "value" TEXT NOT NULL,
-  UNIQUE ("relationid","key") ON CONFLICT REPLACE
-);
+  "relationid" INTEGER NOT NULL,
+  "keyid" INTEGER NOT NULL,
+  "valueid" INTEGER NOT NULL,
+  PRIMARY KEY ("relationid","keyid") ON CONFLICT REPLACE
+) WITHOUT ROWID;
@@ -0,0 +1 @@
+CREATE INDEX "relationtagvalueindex" on "relationtags" (keyid, valueid);
@@ -0,0 +1,4 @@
+CREATE TABLE "tagkeys" (
+  "keyid" INTEGER PRIMARY KEY,
+  "key" TEXT NOT NULL UNIQUE
+);
@@ -0,0 +1,4 @@
+CREATE TABLE "tagvalues" (
+  "valueid" INTEGER PRIMARY KEY,
+  "value" TEXT NOT NULL UNIQUE
+);
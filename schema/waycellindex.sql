@@ -0,0 +1 @@
+CREATE INDEX "waycellindex" on "waycells" (level, cellid, wayid);
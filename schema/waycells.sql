@@ -0,0 +1,6 @@
+CREATE TABLE "waycells" (
+  "wayid" INTEGER NOT NULL,
+  "level" INTEGER NOT NULL,
+  "cellid" INTEGER NOT NULL,
+   UNIQUE ("wayid") ON CONFLICT REPLACE
+);
@@ -0,0 +1,8 @@
+CREATE TABLE "waygeoms" (
+  "wayid" INTEGER PRIMARY KEY,
+  "minlat" INTEGER NOT NULL,
+  "maxlat" INTEGER NOT NULL,
+  "minlon" INTEGER NOT NULL,
+  "maxlon" INTEGER NOT NULL,
+  "geom" BLOB NOT NULL
+);
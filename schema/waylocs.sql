@@ -2,6 +2,6 @@ CREATE TABLE "waylocs" (
   "wayid" INTEGER  ,
    "nodeid" INTEGER,
   "seq" INTEGER,
-  "lat" REAL NOT NULL,
-  "lon" REAL NOT NULL
+  "lat" INTEGER NOT NULL,
+  "lon" INTEGER NOT NULL
 );
@@ -0,0 +1,2 @@
+CREATE INDEX "waylocwayindex" on "waylocs" (wayid, seq);
+
@@ -0,0 +1 @@
+CREATE INDEX "waynodeindex" on "waynodes" (nodeid, wayid);
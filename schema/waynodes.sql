@@ -1,5 +1,5 @@
 CREATE TABLE "waynodes" (
   "wayid" INTEGER NOT NULL,
-  "nodeid" TEXT NOT NULL,
+  "nodeid" INTEGER NOT NULL,
    UNIQUE ("wayid","nodeid") ON CONFLICT IGNORE
 );
@@ -0,0 +1 @@
+CREATE INDEX "wayparcelindex" on "wayparcels" (parcelid, wayid);
@@ -0,0 +1,3 @@
+CREATE VIRTUAL TABLE "wayrect" USING rtree_i32 (
+  wayid, minlat, maxlat, minlon, maxlon
+);
@@ -1,3 +1,4 @@
 CREATE TABLE "ways" (
-  "wayid" INTEGER CONSTRAINT "wayid" UNIQUE  ON CONFLICT IGNORE
+  "wayid" INTEGER CONSTRAINT "wayid" UNIQUE  ON CONFLICT IGNORE,
+  "version" INTEGER NOT NULL DEFAULT 0
 );
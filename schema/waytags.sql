@@ -1,6 +1,6 @@
 CREATE TABLE "waytags" (
   "wayid" INTEGER NOT NULL,
-  "key" TEXT NOT NULL,
-  "value" TEXT NOT NULL,
-  UNIQUE ("wayid","key") ON CONFLICT REPLACE
-);
\ No newline at end of file
+  "keyid" INTEGER NOT NULL,
+  "valueid" INTEGER NOT NULL,
+  PRIMARY KEY ("wayid","keyid") ON CONFLICT REPLACE
+) WITHOUT ROWID;
@@ -0,0 +1 @@
+CREATE INDEX "waytagvalueindex" on "waytags" (keyid, valueid);
@@ -29,8 +29,10 @@
 #include <QByteArray>
 #include <QStringList>
 #include "deliberate.h"
+#include "navi-global.h"
 #include "sql-run-database.h"
 #include "sql-run-query.h"
+#include "way-geometry.h"
 
 #include <QDebug>
 
@@ -42,7 +44,9 @@ namespace navi
 AsDbManager::AsDbManager (QObject *parent)
   :QObject (parent),
    geoBase (0),
-   nextRequest (111)
+   nextRequest (111),
+   haveRtree (false),
+   tagKeysPending (false)
 {
 qDebug () << "AsDbManager in thread " << QThread::currentThread();
   runner = new SqlRunner;
@@ -76,6 +80,7 @@ AsDbManager::Start ()
   geoBaseName = Settings().simpleValue ("database/geobase",geoBaseName)
                                     .toString();
   Settings().setSimpleValue ("database/geobase",geoBaseName);
+  geoBaseFile = geoBaseName;
   
   QStringList  geoElements;
   geoElements   << "nodes"
@@ -90,12 +95,30 @@ AsDbManager::Start ()
                 << "wayparcels"
                 << "relations"
                 << "relationparts"
-                << "relationtags";
+                << "relationtags"
+                << "navimeta"
+                << "waylocwayindex"
+                << "noderect"
+                << "wayrect"
+                << "nodeparcelindex"
+                << "wayparcelindex"
+                << "waycells"
+                << "waycellindex"
+                << "tagkeys"
+                << "tagvalues"
+                << "nodetagvalueindex"
+                << "waytagvalueindex"
+                << "relationtagvalueindex"
+                << "waygeoms"
+                << "relationmemberindex"
+                << "waynodeindex"
+                << "idfilters";
 
   runner->Start ();
   geoBase = StartDB (geoBaseName);
 qDebug () << " stated DB " << geoBase;
   CheckDBComplete (geoBase, geoElements);
+  StartWatch (geoBaseName);
 }
 
 void
@@ -120,6 +143,50 @@ AsDbManager::Stop ()
 {
   qDebug () << " AsDbManager Stop";
   runner->Stop ();
+  if (!watchCon.isEmpty ()) {
+    generation.Stop ();
+    watchBase.close ();
+    watchBase = QSqlDatabase ();
+    QSqlDatabase::removeDatabase (watchCon);
+    watchCon.clear ();
+  }
+}
+
+/** @brief The queries go through the runner thread, but the node
+  * store and the cache answer here without it. A small read only
+  * connection of this thread tells them when another connection has
+  * written to the geobase, see GeoGeneration.
+  */
+
+void
+AsDbManager::StartWatch (const QString & dbname)
+{
+  watchCon = QString ("asGeoWatchCon%1").arg (quintptr (this));
+  watchBase = QSqlDatabase::addDatabase ("QSQLITE", watchCon);
+  watchBase.setConnectOptions ("QSQLITE_OPEN_READONLY");
+  watchBase.setDatabaseName (dbname);
+  if (watchBase.open ()) {
+    generation.Start (watchBase);
+  } else {
+    qDebug () << "AsDbManager cannot watch " << dbname;
+  }
+}
+
+/** @brief the node store is mapped again only when the writer left
+  * it current in navimeta, the cache starts over
+  */
+
+void
+AsDbManager::CheckOtherWriters ()
+{
+  if (!generation.OthersWrote ()) {
+    return;
+  }
+  nodeStore.Close ();
+  if (generation.MetaValue ("nodestore") == "1") {
+    nodeStore.Open (NodeStore::FileName (geoBaseFile));
+  }
+  cache.Clear ();
 }
 
 SqlRunDatabase*
@@ -217,12 +284,24 @@ qDebug () << " Finishe type " << type;
   case Query_AskWayTurnList:
      ReturnWayTurnList (query, ok);
      break;
+  case Query_AskWayGeoms:
+     ReturnWayGeoms (query, ok);
+     break;
+  case Query_AskWayGeometries:
+     ReturnWayGeometries (query, ok);
+     break;
   case Query_RangeNodeTags:
      ReturnRangeNodeTags (query, ok);
      break;
   case Query_CreateTemp:
      ReturnTemp (query, ok);
      break;
+  case Query_SchemaVersion:
+     CheckSchemaVersion (query, ok);
+     break;
+  case Query_TagKeys:
+     LoadTagKeys (query, ok);
+     break;
   default:
      qDebug () << " Finishe Not Handling Query " << type;
      break;
@@ -237,6 +316,87 @@ AsDbManager::ContinueCheck (SqlRunDatabase * db)
   if (!dbCheckList[db].isEmpty()) {
     QString element = dbCheckList[db].takeFirst();
     AskElementType (db, element);
+  } else if (dbMap[db].checkInProgress) {
+    dbMap[db].checkInProgress = false;
+    AskSchemaVersion (db);
+    AskTagKeys (db);
+  }
+}
+
+void
+AsDbManager::AskSchemaVersion (SqlRunDatabase * db)
+{
+  QueryState qstate;
+  qstate.finished = false;
+  qstate.type = Query_SchemaVersion;
+  qstate.db = db;
+  SqlRunQuery * query = runner->newQuery (db);
+  queryMap[query] = qstate;
+  query->exec ("select key, value from navimeta where "
+               " key in (\"schemaversion\", \"spatialindex\", "
+               "         \"nodestore\")");
+}
+
+/** @brief The geobase is only migrated by DbManager, so an older file
+  * has to go through collect once before it can be read here.
+  * The R*Tree tables and the node store are only used once 
+  * DbManager has filled them.
+  */
+
+void
+AsDbManager::CheckSchemaVersion (SqlRunQuery *query, bool ok)
+{
+  int version (0);
+  haveRtree = false;
+  while (ok && query->next ()) {
+    QString key = query->value(0).toString();
+    if (key == "schemaversion") {
+      version = query->value(1).toInt();
+    } else if (key == "spatialindex") {
+      haveRtree = (query->value(1).toString() == "1");
+    } else if (key == "nodestore" && query->value(1).toString() == "1") {
+      QString storeName = NodeStore::FileName 
+                              (dbMap[queryMap[query].db].name);
+      nodeStore.Open (storeName);
+    }
+  }
+  if (version < GeoBaseVersion) {
+    QString name = dbMap[queryMap[query].db].name;
+    qDebug () << "AsDbManager geobase " << name << " is version " << version
+              << " need " << GeoBaseVersion;
+    QMessageBox::warning (0, tr ("Old Geobase"),
+                  tr ("%1 uses an older layout, run collect once "
+                      "to upgrade it").arg (name));
+  }
+}
+
+/** @brief Tag keys are few, so all of them are kept here and tag
+  * lists only need to join the values. A key missing from the cache
+  * was added after it was loaded, so it gets loaded again.
+  */
+
+void
+AsDbManager::AskTagKeys (SqlRunDatabase * db)
+{
+  if (tagKeysPending) {
+    return;
+  }
+  tagKeysPending = true;
+  QueryState qstate;
+  qstate.finished = false;
+  qstate.type = Query_TagKeys;
+  qstate.db = db;
+  SqlRunQuery * query = runner->newQuery (db);
+  queryMap[query] = qstate;
+  query->exec ("select keyid, key from tagkeys");
+}
+
+void
+AsDbManager::LoadTagKeys (SqlRunQuery *query, bool ok)
+{
+  tagKeysPending = false;
+  while (ok && query->next ()) {
+    tagKeys[query->value(0).toLongLong()] = query->value(1).toString();
   }
 }
 
@@ -298,13 +458,23 @@ AsDbManager::AskRangeNodes (double south, double west,
                " lat >= %1 AND lat <= %2 "
                " AND "
                " lon >= %3 AND lon <= %4 ");
+  if (haveRtree) {
+    cmd = "select nodes.nodeid, lat, lon from noderect "
+          " join nodes on nodes.nodeid = noderect.nodeid where "
+          " minlat >= %1 AND maxlat <= %2 "
+          " AND "
+          " minlon >= %3 AND maxlon <= %4 ";
+  }
   QueryState qstate;
   qstate.type = Query_AskRangeNodes;
   int reqId = nextRequest++;
   qstate.reqId = reqId;
   qstate.db = geoBase;
   queryMap[query] = qstate;
-  query->exec (cmd.arg (south).arg(north).arg (west).arg(east));
+  query->exec (cmd.arg (CoordFromDegrees (south))
+                  .arg (CoordFromDegrees (north))
+                  .arg (CoordFromDegrees (west))
+                  .arg (CoordFromDegrees (east)));
   return reqId;
 }
 
@@ -324,53 +494,83 @@ qDebug () << " sent query " << cmd.arg(tablePrefix);
   return reqId;
 }
 
+/** @brief With a node store or a cached node the answer needs no
+  * query, but it is still delivered from the event loop, after the
+  * caller has noted the request id.
+  */
+
 int
-AsDbManager::AskLatLon (const QString & nodeid)
+AsDbManager::AskLatLon (NaviId nodeid)
 {
+  NaviCoord lat, lon;
+  CheckOtherWriters ();
+  if (nodeStore.Get (nodeid, lat, lon) || cache.Node (nodeid, lat, lon)) {
+    int reqId = nextRequest++;
+    storeRequests.append (qMakePair (reqId, 
+                             NaviNode::FromCoords (nodeid, lat, lon)));
+    if (storeRequests.count () == 1) {
+      QTimer::singleShot (0, this, SLOT (ReturnStoreLatLon ()));
+    }
+    return reqId;
+  }
   SqlRunQuery *query = runner->newQuery(geoBase);
   if (!query) {
     qDebug () << "QUery allocation failed";
     return -1;
   }
-  QString cmd ("select lat, lon from nodes where nodeid=\"%1\"");
+  QString cmd ("select lat, lon from nodes where nodeid=%1");
   QueryState qstate;
   qstate.type = Query_AskLatLon;
   int reqId = nextRequest++;
   qstate.reqId = reqId;
   qstate.db = geoBase;
+  qstate.data = nodeid;
   queryMap[query] = qstate;
   query->exec (cmd.arg(nodeid));
   return reqId;
 }
 
 int
-AsDbManager::AskNodeTagList (const QString & nodeid)
+AsDbManager::AskNodeTagList (NaviId nodeid)
 {
+  TagList tagList;
+  CheckOtherWriters ();
+  if (cache.Tags ("node", nodeid, tagList)) {
+    int reqId = nextRequest++;
+    cachedTags.append (qMakePair (reqId, tagList));
+    if (cachedTags.count () == 1) {
+      QTimer::singleShot (0, this, SLOT (ReturnCachedTags ()));
+    }
+    return reqId;
+  }
   SqlRunQuery *query = runner->newQuery(geoBase);
   if (!query) {
     qDebug () << "QUery allocation failed";
     return -1;
   }
-  QString cmd ("select key, value from nodetags where nodeid=\"%1\"");
+  QString cmd ("select keyid, value from nodetags "
+               " join tagvalues on tagvalues.valueid = nodetags.valueid "
+               " where nodeid=%1");
   QueryState qstate;
   qstate.type = Query_AskTagList;
   int reqId = nextRequest++;
   qstate.reqId = reqId;
   qstate.db = geoBase;
+  qstate.data = nodeid;
   queryMap[query] = qstate;
   query->exec (cmd.arg(nodeid));
   return reqId;
 }
 
 int
-AsDbManager::AskWaysByNode (const QString & nodeId)
+AsDbManager::AskWaysByNode (NaviId nodeId)
 {
   SqlRunQuery * query = runner->newQuery (geoBase);
   if (!query) {
     qDebug () << "Query allocation failure";
     return -1;
   }
-  QString cmd ("select wayid from waynodes where nodeid = \"%1\"");
+  QString cmd ("select wayid from waynodes where nodeid = %1");
   QueryState qstate;
   qstate.type = Query_AskWayList;
   int reqId = nextRequest++;
@@ -381,6 +581,68 @@ AsDbManager::AskWaysByNode (const QString & nodeId)
   return reqId;
 }
 
+/** @brief Ids are numbers, so a list of them goes into an IN list as
+  * text. Callers keep each list to a few hundred ids.
+  */
+
+static QString
+IdText (const NaviIdList & ids)
+{
+  QStringList text;
+  for (int i=0; i<ids.count(); i++) {
+    text.append (QString::number (ids.at(i)));
+  }
+  return text.join (",");
+}
+
+int
+AsDbManager::AskWaysByNodes (const NaviIdList & nodeIds)
+{
+  SqlRunQuery * query = runner->newQuery (geoBase);
+  if (!query) {
+    qDebug () << "Query allocation failure";
+    return -1;
+  }
+  QString cmd ("select distinct wayid from waynodes where nodeid in (%1)");
+  QueryState qstate (nextRequest++, Query_AskWayList, geoBase);
+  queryMap[query] = qstate;
+  query->exec (cmd.arg (IdText (nodeIds)));
+  return qstate.reqId;
+}
+
+int
+AsDbManager::AskTagsFor (const QString & type, const NaviIdList & ids)
+{
+  SqlRunQuery * query = runner->newQuery (geoBase);
+  if (!query) {
+    qDebug () << "Query allocation failure";
+    return -1;
+  }
+  QString cmd ("select t.%1id, k.key, v.value from %1tags t "
+               " join tagkeys k on k.keyid = t.keyid "
+               " join tagvalues v on v.valueid = t.valueid "
+               " where t.%1id in (%2)");
+  QueryState qstate (nextRequest++, Query_RangeNodeTags, geoBase);
+  queryMap[query] = qstate;
+  query->exec (cmd.arg (type).arg (IdText (ids)));
+  return qstate.reqId;
+}
+
+int
+AsDbManager::AskWayGeometries (const NaviIdList & wayIds)
+{
+  SqlRunQuery * query = runner->newQuery (geoBase);
+  if (!query) {
+    qDebug () << "Query allocation failure";
+    return -1;
+  }
+  QString cmd ("select wayid, geom from waygeoms where wayid in (%1)");
+  QueryState qstate (nextRequest++, Query_AskWayGeometries, geoBase);
+  queryMap[query] = qstate;
+  query->exec (cmd.arg (IdText (wayIds)));
+  return qstate.reqId;
+}
+
 int
 AsDbManager::AskWaysByTag (const QString & key, const QString & value,
                           bool regular)
@@ -391,7 +653,9 @@ AsDbManager::AskWaysByTag (const QString & key, const QString & value,
     return -1;
   }
   QString cmd ("select wayid from waytags where "
-               " key = \"%1\" AND value %2 \"%3\"");
+               " keyid = (select keyid from tagkeys where key = \"%1\") "
+               " AND valueid in (select valueid from tagvalues "
+               "                 where value %2 \"%3\")");
   QString op (regular ? "GLOB" : "=");
   QueryState qstate;
   qstate.type = Query_AskWayList;
@@ -414,43 +678,64 @@ AsDbManager::SetRange (QString & tablePrefix,
                " lat >= %1 AND lat <= %2 "
                " AND "
                " lon >= %3 AND lon <= %4 ");
+  if (haveRtree) {
+    createTmp = "create  temporary table %5 as "
+               " select nodes.nodeid, lat, lon from noderect "
+               " join nodes on nodes.nodeid = noderect.nodeid where "
+               " minlat >= %1 AND maxlat <= %2 "
+               " AND "
+               " minlon >= %3 AND maxlon <= %4 ";
+  }
   tablePrefix = QString ("TR%1").arg(tempnum++);
   QString tmpname (QString ("%1_nodes").arg (tablePrefix));
   SqlRunQuery * tmpCreate = runner->newQuery (geoBase);
   QueryState qstate (nextRequest++, Query_CreateTemp, geoBase);
   int reqId = qstate.reqId;
   queryMap[tmpCreate] = qstate;
-  QString realCmd = createTmp.arg (south).arg (north)
-                            .arg (west).arg (east)
+  QString realCmd = createTmp.arg (CoordFromDegrees (south))
+                            .arg (CoordFromDegrees (north))
+                            .arg (CoordFromDegrees (west))
+                            .arg (CoordFromDegrees (east))
                             .arg (tmpname);
 qDebug () << " real Command " << realCmd;
   tmpCreate->exec (realCmd);
   return reqId;
 }
 
+/** @brief Each way in the range comes back as one geometry blob,
+  * and only its points inside the range are turned into WayTurns.
+  * The prefix named the temporary table the locs used to be copied
+  * into, it is kept so callers need not change.
+  */
+
 int
 AsDbManager::GetRangeWays (const QString & prefix,
                          double south, double west, 
                       double north, double east)
 {
-  QString createTmp ("create temporary table %1 as "
-                     " select wayid, nodeid, seq, lat, lon from waylocs where "
-               " lat >= %2 AND lat <= %3 "
-               " AND "
-               " lon >= %4 AND lon <= %5 ");
-  QString tmpname (QString ("%1_waylocs").arg (prefix));
-  SqlRunQuery * tmpCreate = runner->newQuery (geoBase);
-  QueryState qstate1 (nextRequest++, Query_CreateTemp, geoBase);
-  queryMap[tmpCreate] = qstate1;
-
-  QString selectAll ("select wayid, nodeid, seq, lat, lon from %1");
-  SqlRunQuery * select = runner->newQuery (geoBase);
-  QueryState qstate2 (nextRequest++, Query_AskWayTurnList, geoBase);
-  queryMap[select] = qstate2;
-  int reqId = qstate2.reqId;
-  tmpCreate->exec (createTmp.arg (tmpname).arg (south).arg (north)
-                             .arg (west).arg(east));
-  select->exec (selectAll.arg (tmpname));
+  Q_UNUSED (prefix)
+  QString select ("select wayid, geom from waygeoms where ");
+  QString overlap (" maxlat >= %1 AND minlat <= %2 "
+                   " AND "
+                   " maxlon >= %3 AND minlon <= %4 ");
+  if (haveRtree) {
+    select += " wayid in (select wayid from wayrect where " 
+              + overlap + ")";
+  } else {
+    select += overlap;
+  }
+  QVariantList box;
+  box << CoordFromDegrees (south) << CoordFromDegrees (west)
+      << CoordFromDegrees (north) << CoordFromDegrees (east);
+  SqlRunQuery * query = runner->newQuery (geoBase);
+  QueryState qstate (nextRequest++, Query_AskWayGeoms, geoBase);
+  qstate.data = box;
+  queryMap[query] = qstate;
+  int reqId = qstate.reqId;
+  query->exec (select.arg (box.at(0).toInt())
+                     .arg (box.at(2).toInt())
+                     .arg (box.at(1).toInt())
+                     .arg (box.at(3).toInt()));
   return reqId;
 }
 
@@ -508,10 +793,10 @@ AsDbManager::ReturnRangeNodes (SqlRunQuery * query, bool ok)
   NaviNodeList nodeList;
   if (ok && query) {
     while (query->next()) {
-      QString id = query->value(0).toString();
-      double lat = query->value(1).toDouble();
-      double lon = query->value(2).toDouble();
-      nodeList.append (NaviNode (id, lat, lon));
+      NaviId id = query->value(0).toLongLong();
+      NaviCoord lat = query->value(1).toInt();
+      NaviCoord lon = query->value(2).toInt();
+      nodeList.append (NaviNode::FromCoords (id, lat, lon));
     }
   }
   int reqId = queryMap[query].reqId;
@@ -525,26 +810,62 @@ AsDbManager::ReturnLatLon (SqlRunQuery * query, bool ok)
   double lon (0.0);
   if (ok && query) {
     if (query->next()) {
-      lat = query->value(0).toDouble();
-      lon = query->value(1).toDouble();
+      NaviCoord latCoord = query->value(0).toInt();
+      NaviCoord lonCoord = query->value(1).toInt();
+      cache.PutNode (queryMap[query].data.toLongLong(), latCoord, lonCoord);
+      lat = DegreesFromCoord (latCoord);
+      lon = DegreesFromCoord (lonCoord);
     }
   }
   int reqId = queryMap[query].reqId;
   emit HaveLatLon (reqId, lat, lon);
 }
 
+void
+AsDbManager::ReturnStoreLatLon ()
+{
+  QList <QPair <int, NaviNode> > requests = storeRequests;
+  storeRequests.clear ();
+  for (int r=0; r<requests.count(); r++) {
+    emit HaveLatLon (requests.at(r).first, 
+                     requests.at(r).second.Lat(),
+                     requests.at(r).second.Lon());
+  }
+}
+
+void
+AsDbManager::ReturnCachedTags ()
+{
+  QList <QPair <int, TagList> > requests = cachedTags;
+  cachedTags.clear ();
+  for (int r=0; r<requests.count(); r++) {
+    emit HaveTagList (requests.at(r).first, requests.at(r).second);
+  }
+}
+
 void
 AsDbManager::ReturnTagList (SqlRunQuery * query, bool ok)
 {
   TagList tagList;
+  bool allKeys (true);
   if (ok && query) {
     while (query->next()) {
       TagItemType tag;
-      tag.first = query->value (0).toString();
+      qint64 keyId = query->value (0).toLongLong();
+      if (tagKeys.contains (keyId)) {
+        tag.first = tagKeys[keyId];
+      } else {
+        tag.first = QString ("#%1").arg (keyId);
+        allKeys = false;
+        AskTagKeys (geoBase);
+      }
       tag.second = query->value (1).toString ();
       tagList.append (tag);
     }
   }
+  if (ok && allKeys) {
+    cache.PutTags ("node", queryMap[query].data.toLongLong(), tagList);
+  }
   int reqId = queryMap[query].reqId;
 qDebug () << " return tag list for req " << reqId;
   emit HaveTagList (reqId, tagList);
@@ -553,10 +874,10 @@ qDebug () << " return tag list for req " << reqId;
 void
 AsDbManager::ReturnWayList (SqlRunQuery * query, bool ok)
 {
-  QStringList wayList;
+  NaviIdList wayList;
   if (ok && query) {
     while (query->next ()) {
-      wayList.append (query->value(0).toString());
+      wayList.append (query->value(0).toLongLong());
     }
   }
   int reqId = queryMap[query].reqId;
@@ -569,11 +890,12 @@ AsDbManager::ReturnWayTurnList (SqlRunQuery * query, bool ok)
   WayTurnList wayList;
   if (ok && query) {
     while (query->next ()) {
-      WayTurn turn (query->value(0).toString(),
-                    query->value(1).toString(),
+      WayTurn turn (query->value(0).toLongLong(),
+                    query->value(1).toLongLong(),
                     query->value(2).toInt(),
-                    query->value(3).toDouble(),
-                    query->value(4).toDouble ());
+                    0.0, 0.0);
+      turn.SetCoords (query->value(3).toInt(),
+                      query->value(4).toInt());
       wayList.append (turn);
     }
   }
@@ -581,13 +903,50 @@ AsDbManager::ReturnWayTurnList (SqlRunQuery * query, bool ok)
   emit HaveWayTurnList (reqId, wayList);
 }
 
+void
+AsDbManager::ReturnWayGeoms (SqlRunQuery * query, bool ok)
+{
+  WayTurnList wayList;
+  QVariantList box = queryMap[query].data.toList();
+  if (ok && query && box.count() == 4) {
+    NaviBox range (box.at(0).toInt(), box.at(1).toInt(),
+                   box.at(2).toInt(), box.at(3).toInt());
+    while (query->next ()) {
+      NaviId wayId = query->value(0).toLongLong();
+      WayGeometryReader reader (query->value(1).toByteArray());
+      while (reader.Next ()) {
+        if (range.Contains (reader.Lat(), reader.Lon())) {
+          WayTurn turn (wayId, reader.NodeId(), reader.Seq(), 0.0, 0.0);
+          turn.SetCoords (reader.Lat(), reader.Lon());
+          wayList.append (turn);
+        }
+      }
+    }
+  }
+  int reqId = queryMap[query].reqId;
+  emit HaveWayTurnList (reqId, wayList);
+}
+
+void
+AsDbManager::ReturnWayGeometries (SqlRunQuery * query, bool ok)
+{
+  WayGeomMap geoms;
+  if (ok && query) {
+    while (query->next ()) {
+      geoms[query->value(0).toLongLong()] = query->value(1).toByteArray();
+    }
+  }
+  int reqId = queryMap[query].reqId;
+  emit HaveWayGeometries (reqId, geoms);
+}
+
 void
 AsDbManager::ReturnRangeNodeTags (SqlRunQuery * query, bool ok)
 {
   TagRecordList list;
   if (ok && query) {
     while (query->next ()) {
-      list.append (TagRecord (query->value(0).toString(),
+      list.append (TagRecord (query->value(0).toLongLong(),
                               query->value(1).toString(),
                               query->value(2).toString()));
     }
@@ -602,46 +961,49 @@ AsDbManager::ReturnTemp (SqlRunQuery * query, bool ok)
 }
 
 void
-AsDbManager::WriteNode (const QString & nodeId,
+AsDbManager::WriteNode (NaviId nodeId,
                          double lat,
                          double lon)
 {
   SqlRunQuery *insert = runner->newQuery(geoBase);
   QString cmd ("insert or replace into nodes "
                " nodeid, lat, lon) "
-               " VALUES (\"%1\", %2, %3)");
-  insert->exec (cmd.arg(nodeId).arg(lat).arg(lon)); 
+               " VALUES (%1, %2, %3)");
+  insert->exec (cmd.arg(nodeId)
+                   .arg(CoordFromDegrees (lat))
+                   .arg(CoordFromDegrees (lon))); 
+  cache.ForgetNode (nodeId);
 }
 
 void
-AsDbManager::WriteWay (const QString & wayId)
+AsDbManager::WriteWay (NaviId wayId)
 {
   SqlRunQuery *insert = runner->newQuery(geoBase);
   QString cmd ("insert or replace into ways "
                " (wayid) "
-               " VALUES (\"%1\")");
+               " VALUES (%1)");
   insert->exec (cmd.arg(wayId)); 
 }
 
 void
-AsDbManager::WriteRelation (const QString & relationId)
+AsDbManager::WriteRelation (NaviId relationId)
 {
   SqlRunQuery *insert = runner->newQuery(geoBase);
   QString cmd ("insert or replace into relations "
-               " (relationid, lat, lon) "
-               " VALUES (\"%1\")");
+               " (relationid) "
+               " VALUES (%1)");
   insert->exec (cmd.arg(relationId)); 
 }
 
 void
-AsDbManager::WriteNodeParcel (const QString & nodeId, 
+AsDbManager::WriteNodeParcel (NaviId nodeId, 
                             quint64 parcelIndex)
 {
   WriteParcel ("node",nodeId, parcelIndex);
 }
 
 void
-AsDbManager::WriteWayParcel (const QString & wayId,
+AsDbManager::WriteWayParcel (NaviId wayId,
                            quint64 parcelIndex)
 {
   WriteParcel ("way", wayId, parcelIndex);
@@ -650,29 +1012,30 @@ AsDbManager::WriteWayParcel (const QString & wayId,
 
 void
 AsDbManager::WriteParcel (const QString & type,
-                        const QString & id,
+                        NaviId id,
                         quint64 parcelIndex)
 {
   QString cmd ("insert or replace into %1parcels "
                " (%1id, parcelid) "
-               " VALUES (\"%2\", \"%3\")");
+               " VALUES (%2, %3)");
   SqlRunQuery * insert = runner->newQuery (geoBase);
   insert->exec (cmd.arg (type).arg(id).arg(parcelIndex));
 }
 
 void
-AsDbManager::WriteWayNode (const QString & wayId,
-                         const QString & nodeId)
+AsDbManager::WriteWayNode (NaviId wayId,
+                         NaviId nodeId)
 {
   QString cmd ("insert or replace into waynodes "
                " (wayid, nodeid) "
-               " VALUES (\"%1\", \"%2\") ");
+               " VALUES (%1, %2) ");
   SqlRunQuery * insert = runner->newQuery (geoBase);
   insert->exec (cmd.arg(wayId).arg(nodeId));
+  cache.ForgetWayNodes (wayId);
 }
 
 void
-AsDbManager::WriteNodeTag (const QString & nodeId, 
+AsDbManager::WriteNodeTag (NaviId nodeId, 
                      const QString & key,
                      const QString & value)
 {
@@ -680,7 +1043,7 @@ AsDbManager::WriteNodeTag (const QString & nodeId,
 }
 
 void
-AsDbManager::WriteWayTag (const QString & wayId, 
+AsDbManager::WriteWayTag (NaviId wayId, 
                      const QString & key,
                      const QString & value)
 {
@@ -688,7 +1051,7 @@ AsDbManager::WriteWayTag (const QString & wayId,
 }
 
 void
-AsDbManager::WriteRelationTag (const QString & relId,
+AsDbManager::WriteRelationTag (NaviId relId,
                      const QString & key,
                      const QString & value)
 {
@@ -697,27 +1060,39 @@ AsDbManager::WriteRelationTag (const QString & relId,
 
 void
 AsDbManager::WriteTag (const QString & type,
-                     const QString & id,
+                     NaviId id,
                      const QString & key,
                      const QString & value)
 {
+  QString keyCmd ("insert or ignore into tagkeys (key) VALUES (\"%1\")");
+  SqlRunQuery *insertKey = runner->newQuery(geoBase);
+  insertKey->exec (keyCmd.arg (key));
+  QString valueCmd ("insert or ignore into tagvalues (value) "
+                    " VALUES (\"%1\")");
+  SqlRunQuery *insertValue = runner->newQuery(geoBase);
+  insertValue->exec (valueCmd.arg (value));
   QString cmd ("insert or replace into %1tags "
-               " (%1id, key, value) "
-               " VALUES (\"%2\", \"%3\", \"%4\")");
+               " (%1id, keyid, valueid) "
+               " VALUES (%2, "
+               "  (select keyid from tagkeys where key = \"%3\"), "
+               "  (select valueid from tagvalues where value = \"%4\"))");
   SqlRunQuery *insert = runner->newQuery(geoBase);
   insert->exec (cmd.arg (type).arg(id).arg(key).arg(value));
+  cache.ForgetTags (type, id);
 }
 
 void
-AsDbManager::WriteRelationMember (const QString & relId,
+AsDbManager::WriteRelationMember (NaviId relId,
+                                int seq,
                                 const QString & type,
-                                const QString & ref)
+                                NaviId ref)
 {
   QString cmd ("insert or replace into relationparts "
-               "  (relationid, othertype, otherid) "
-               " VALUES (\"%1\", \"%2\", \"%3\") ");
+               "  (relationid, seq, othertype, otherid) "
+               " VALUES (%1, %2, \"%3\", %4) ");
   SqlRunQuery *insert = runner->newQuery(geoBase);
-  insert->exec (cmd.arg(relId).arg(type).arg(ref));
+  insert->exec (cmd.arg(relId).arg(seq).arg(type).arg(ref));
+  cache.ForgetMembers (relId);
 }
 
 void
@@ -25,6 +25,11 @@
 
 #include "sql-runner.h"
 #include "navi-types.h"
+#include "node-store.h"
+#include "geo-cache.h"
+#include "geo-generation.h"
+#include "way-geometry.h"
+#include <QHash>
 
 using namespace deliberate;
 
@@ -46,29 +51,30 @@ public:
   void StartTransaction ();
   void CommitTransaction ();
 
-  void WriteNode (const QString & nodeId,
+  void WriteNode (NaviId nodeId,
                         double  lat,
                         double  lon);
 
-  void WriteWay (const QString & wayId);
-  void WriteRelation (const QString & relId);
-  void WriteWayNode (const QString & wayId,
-                     const QString & nodeId);
-  void WriteNodeTag (const QString & nodeId, 
+  void WriteWay (NaviId wayId);
+  void WriteRelation (NaviId relId);
+  void WriteWayNode (NaviId wayId,
+                     NaviId nodeId);
+  void WriteNodeTag (NaviId nodeId, 
                      const QString & key,
                      const QString & value);
-  void WriteWayTag (const QString & wayId,
+  void WriteWayTag (NaviId wayId,
                     const QString & key,
                     const QString & value);
-  void WriteRelationTag (const QString & relId,
+  void WriteRelationTag (NaviId relId,
                          const QString & key,
                          const QString & value);
-  void WriteRelationMember (const QString & relId,
+  void WriteRelationMember (NaviId relId,
+                            int seq,
                             const QString & type,
-                            const QString & ref);
-  void WriteNodeParcel (const QString & nodeId, 
+                            NaviId ref);
+  void WriteNodeParcel (NaviId nodeId, 
                    quint64 parcelIndex);
-  void WriteWayParcel (const QString & wayId,
+  void WriteWayParcel (NaviId wayId,
                   quint64 parcelIndex); 
   int SetRange (QString & tablePrefix, double south, double west, 
                       double north, double east);
@@ -77,11 +83,20 @@ public:
   void DropTemp (const QString & dbName);
   int AskRangeNodes (double south, double west, 
                       double north, double east);
-  int AskWaysByNode (const QString & nodeId);
+  int AskWaysByNode (NaviId nodeId);
+  /** @brief one query for a list of ids, the ways come back through
+    * HaveWayList and the tags through HaveRangeNodeTags
+    */
+  int AskWaysByNodes (const NaviIdList & nodeIds);
+  int AskTagsFor (const QString & type, const NaviIdList & ids);
+  /** @brief geometry blobs of the ways, they come back through
+    * HaveWayGeometries
+    */
+  int AskWayGeometries (const NaviIdList & wayIds);
   int AskWaysByTag (const QString & key, const QString & value, 
                     bool regular=false);
-  int AskLatLon (const QString & nodeId);
-  int AskNodeTagList (const QString & nodeId);
+  int AskLatLon (NaviId nodeId);
+  int AskNodeTagList (NaviId nodeId);
   int AskNodes (const QString & tablePrefix);
   int AskWays (const QString & tablePrefix);
   int AskRelations (const QString & tablePrefix);
@@ -90,20 +105,27 @@ public:
  
   int SetMark ();
 
+  /** @brief the objects read most recently, see GeoCache */
+  GeoCache & Cache () { return cache; }
+  QString GeoBaseFile () const { return geoBaseFile; }
+
 private slots:
 
   void CatchOpen (SqlRunDatabase* db, bool ok);
   void CatchClose (SqlRunDatabase *db);
   void CatchFinished (SqlRunQuery *query, bool ok);
   void CatchMark (int markId, bool ok);
+  void ReturnStoreLatLon ();
+  void ReturnCachedTags ();
 
 signals:
 
   void HaveRangeNodes (int requestId, const NaviNodeList & nodeList);
   void HaveLatLon (int requestId, double lat, double lon);
   void HaveTagList (int requestId, const TagList & tagList);
-  void HaveWayList (int requestId, const QStringList & wayList);
+  void HaveWayList (int requestId, const NaviIdList & wayList);
   void HaveWayTurnList (int requestId, const WayTurnList & wayTurnList);
+  void HaveWayGeometries (int requestId, const WayGeomMap & geoms);
   void HaveRangeNodeTags (int requestId, const TagRecordList & tagList);
   void HaveTemp (int requestId, int ok);
   void MarkReached (int markId);
@@ -112,11 +134,11 @@ signals:
 private:
 
   void WriteTag (const QString & type,
-                 const QString & id,
+                 NaviId id,
                     const QString & key,
                     const QString & value);
   void WriteParcel (const QString & type,
-                    const QString & id,
+                    NaviId id,
                     quint64 parcelIndex);
   void Connect ();
   SqlRunDatabase * StartDB (const QString & dbname);
@@ -126,14 +148,22 @@ private:
   void ContinueCheck (SqlRunDatabase * db);
   void AskElementType (SqlRunDatabase * db, const QString & eltName);
   void CheckElementType (SqlRunQuery *query, bool ok);
+  void AskSchemaVersion (SqlRunDatabase * db);
+  void CheckSchemaVersion (SqlRunQuery *query, bool ok);
+  void AskTagKeys (SqlRunDatabase * db);
+  void LoadTagKeys (SqlRunQuery *query, bool ok);
   void ReturnRangeNodes (SqlRunQuery *query, bool ok);
   void ReturnLatLon (SqlRunQuery *query, bool ok);
   void ReturnTagList (SqlRunQuery *query, bool ok);
   void ReturnWayList (SqlRunQuery *query, bool ok);
   void ReturnWayTurnList (SqlRunQuery *query, bool ok);
+  void ReturnWayGeoms (SqlRunQuery *query, bool ok);
+  void ReturnWayGeometries (SqlRunQuery *query, bool ok);
   void ReturnRangeNodeTags (SqlRunQuery *query, bool ok);
   void ReturnTemp (SqlRunQuery *query, bool ok);
   void MakeElement (SqlRunDatabase * db, const QString & elementName);
+  void StartWatch (const QString & dbname);
+  void CheckOtherWriters ();
 
   struct DbState {
     bool    open;
@@ -150,8 +180,12 @@ private:
     Query_AskTagList,
     Query_AskWayList,
     Query_AskWayTurnList,
+    Query_AskWayGeoms,
+    Query_AskWayGeometries,
     Query_RangeNodeTags,
-    Query_CreateTemp
+    Query_CreateTemp,
+    Query_SchemaVersion,
+    Query_TagKeys
   };
 
   struct QueryState {
@@ -180,6 +214,18 @@ private:
   SqlRunner       *runner;
   SqlRunDatabase  *geoBase;
   int    nextRequest;
+  bool   haveRtree;
+
+  NodeStore                        nodeStore;
+  QHash <qint64, QString>          tagKeys;
+  bool                             tagKeysPending;
+  QList <QPair <int, NaviNode> >   storeRequests;
+  QList <QPair <int, TagList> >    cachedTags;
+  GeoCache                         cache;
+  QString                          geoBaseFile;
+  QString                          watchCon;
+  QSqlDatabase                     watchBase;
+  GeoGeneration                    generation;
 };
 
 } // namespace
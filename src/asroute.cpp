@@ -43,6 +43,9 @@ AsRoute::AsRoute (QWidget *parent)
   :QMainWindow (parent),
    app (0),
    mapWidget (0),
+   routeSearch (0),
+   hierarchySearch (0),
+   isochrone (0),
    db (this),
    maxSend (1*1024),
    maxPending (2*1024),
@@ -80,6 +83,19 @@ AsRoute::Init (QApplication & qapp)
   Settings().setValue ("dbrun/maxpending",maxPending);
   Settings().sync();
   db.Start ();
+  if (graph.Open (RoadGraph::FileName (db.GeoBaseFile ()))) {
+    qDebug () << " AsRoute road graph " << graph.NodeCount () << " nodes "
+              << graph.EdgeCount () << " edges";
+    routeSearch = new RouteSearch (graph);
+    if (hierarchy.Open (RouteHierarchy::FileName (db.GeoBaseFile ()),
+                        graph)) {
+      qDebug () << " AsRoute route hierarchy " << hierarchy.UpCount ()
+                << " upward " << hierarchy.DownCount () << " downward edges";
+      hierarchySearch = new HierarchySearch (graph, hierarchy);
+    }
+    isochrone = new IsochroneSearch (graph,
+                                     hierarchy.IsOpen () ? &hierarchy : 0);
+  }
 }
 
 void
@@ -146,6 +162,10 @@ AsRoute::Connect ()
            this, SLOT (FindWays ()));
   connect (mainUi.featureButton, SIGNAL (clicked()),
            this, SLOT (FeatureButton ()));
+  connect (mainUi.routeButton, SIGNAL (clicked()),
+           this, SLOT (RouteButton ()));
+  connect (mainUi.reachButton, SIGNAL (clicked()),
+           this, SLOT (ReachButton ()));
 
   connect (mainUi.showmapButton, SIGNAL (clicked()),
            this, SLOT (ShowMap ()));
@@ -163,10 +183,12 @@ AsRoute::Connect ()
            this, SLOT (HandleLatLon (int, double, double)));
   connect (&db, SIGNAL (HaveTagList (int, const TagList &)),
            this, SLOT (HandleTagList (int, const TagList &)));
-  connect (&db, SIGNAL (HaveWayList (int, const QStringList &)),
-           this, SLOT (HandleWayList (int, const QStringList &)));
+  connect (&db, SIGNAL (HaveWayList (int, const NaviIdList &)),
+           this, SLOT (HandleWayList (int, const NaviIdList &)));
   connect (&db, SIGNAL (HaveWayTurnList (int, const WayTurnList &)),
            this, SLOT (HandleWayTurnList (int, const WayTurnList &)));
+  connect (&db, SIGNAL (HaveWayGeometries (int, const WayGeomMap &)),
+           this, SLOT (HandleWayGeometries (int, const WayGeomMap &)));
   connect (&db, SIGNAL (HaveRangeNodeTags (int, const TagRecordList &)),
            this, SLOT (HandleRangeNodeTags (int, const TagRecordList &)));
   connect (&db, SIGNAL (MarkReached (int)),
@@ -196,6 +218,10 @@ AsRoute::Clear ()
   nodeSet.clear ();
   requestInDB.clear ();
   requestToSend.clear ();
+  routeTurns.clear ();
+  routeShapeRequests.clear ();
+  routeGeoms.clear ();
+  reachAreas.clear ();
 }
 
 void
@@ -214,29 +240,136 @@ void
 AsRoute::DrawMap ()
 {
   mapWidget->ClearPoints ();
-  QMap <QString, QVector2D>::iterator mit;
+  QMap <NaviId, QPoint>::iterator mit;
   int np(0);
   for (mit=nodeCoords.begin(); mit!=nodeCoords.end(); mit++) {
-    mapWidget->AddPoint (mit->toPointF());
+    mapWidget->AddPoint (*mit);
     np++;
   }
+  for (int a=0; a<reachAreas.count(); a++) {
+    const QPolygon & ring = reachAreas.at(a);
+    QPolygon flipped;
+    for (int i=0; i<ring.count(); i++) {
+      flipped.append (QPoint (ring.at(i).x(), -ring.at(i).y()));
+    }
+    mapWidget->AddArea (flipped);
+  }
   int red = redWays.count ();
   for (int r=0; r<red; r++) {
      MakeRed (redWays.at(r));
   }
+  for (int t=0; t<routeTurns.count(); t++) {
+    mapWidget->AddPoint (QPoint (routeTurns.at(t).LonCoord(),
+                                 -routeTurns.at(t).LatCoord()), true);
+  }
   mapWidget->repaint ();
 }
 
 void
-AsRoute::MakeRed (const QString & wayId)
+AsRoute::MakeRed (NaviId wayId)
 {
-  multimap<QString, WayTurn>::iterator mmit;
+  multimap<NaviId, WayTurn>::iterator mmit;
   for (mmit=turnMap.lower_bound (wayId); 
        mmit != turnMap.end() && (*mmit).first == wayId; 
        mmit++) {
     WayTurn turn = (*mmit).second;
-    mapWidget->AddPoint (nodeCoords[turn.NodeId()].toPointF(), true);
+    mapWidget->AddPoint (nodeCoords[turn.NodeId()], true);
+  }
+}
+
+void
+AsRoute::RouteButton ()
+{
+  if (routeSearch == 0) {
+    mainUi.logDisplay->append ("No road graph, build one with collect");
+    return;
+  }
+  int from = graph.ParseNode (mainUi.routeFromEdit->text ());
+  int to = graph.ParseNode (mainUi.routeToEdit->text ());
+  if (from < 0 || to < 0) {
+    mainUi.logDisplay->append ("Route ends are not in the road graph");
+    return;
+  }
+  QTime clock;
+  clock.start ();
+  bool found;
+  quint32 cost;
+  int settled;
+  if (hierarchySearch) {
+    found = hierarchySearch->Route (from, to);
+    cost = hierarchySearch->Cost ();
+    settled = hierarchySearch->Settled ();
+  } else {
+    found = routeSearch->Route (from, to);
+    cost = routeSearch->Cost ();
+    settled = routeSearch->Settled ();
   }
+  int msecs = clock.elapsed ();
+  const NaviId * ids = graph.NodeIds ();
+  if (!found) {
+    routeShapeRequests.clear ();
+    mainUi.logDisplay->append (QString ("No route from %1 to %2, "
+                                        "%3 nodes in %4 msecs")
+                               .arg (ids[from]).arg (ids[to])
+                               .arg (settled)
+                               .arg (msecs));
+    return;
+  }
+  if (hierarchySearch) {
+    hierarchySearch->PathTurns (routeTurns);
+  } else {
+    routeSearch->PathTurns (routeTurns);
+  }
+  mainUi.logDisplay->append (QString ("Route from %1 to %2: %3 min, "
+                                      "%4 graph nodes, %5 settled "
+                                      "in %6 msecs")
+                             .arg (ids[from]).arg (ids[to])
+                             .arg (cost / 600.0, 0, 'f', 1)
+                             .arg (routeTurns.count ())
+                             .arg (settled)
+                             .arg (msecs));
+  AskRouteShape ();
+  DrawMap ();
+}
+
+/** @brief Area reachable from the route start within the minutes in
+  * the box, drawn on the map as a highlighted layer.
+  */
+
+void
+AsRoute::ReachButton ()
+{
+  if (isochrone == 0) {
+    mainUi.logDisplay->append ("No road graph, build one with collect");
+    return;
+  }
+  int from = graph.ParseNode (mainUi.routeFromEdit->text ());
+  if (from < 0) {
+    mainUi.logDisplay->append ("Route start is not in the road graph");
+    return;
+  }
+  int cellMeters (200);
+  cellMeters = Settings().value ("route/isochronecell",cellMeters).toInt();
+  Settings().setValue ("route/isochronecell",cellMeters);
+  quint32 limit = quint32 (mainUi.reachMinutesBox->value ()) * 600;
+  QTime clock;
+  clock.start ();
+  isochrone->Reach (from, limit);
+  isochrone->Outline (cellMeters, reachAreas);
+  int msecs = clock.elapsed ();
+  const NaviId * ids = graph.NodeIds ();
+  mainUi.logDisplay->append (QString ("Reach from %1 in %2 min: "
+                                      "%3 graph nodes, %4 rings "
+                                      "in %5 msecs %6")
+                             .arg (ids[from])
+                             .arg (mainUi.reachMinutesBox->value ())
+                             .arg (isochrone->Nodes().count ())
+                             .arg (reachAreas.count ())
+                             .arg (msecs)
+                             .arg (isochrone->UsesHierarchy ()
+                                   ? "by hierarchy sweep"
+                                   : "by graph search"));
+  DrawMap ();
 }
 
 void
@@ -245,6 +378,14 @@ AsRoute::CloseCleanup ()
   QSize currentSize = size();
   Settings().setValue ("sizes/main",currentSize);
   Settings().sync();
+  delete isochrone;
+  isochrone = 0;
+  delete hierarchySearch;
+  hierarchySearch = 0;
+  delete routeSearch;
+  routeSearch = 0;
+  hierarchy.Close ();
+  graph.Close ();
   db.Stop ();
 }
 
@@ -342,10 +483,8 @@ qDebug () << " HangleRangeNodes " << reqId;
   numNodes = nodes.count();
   mainUi.loadBar->setMaximum (numNodes);
   for (int n=0; n<numNodes; n++) {
-    QString id = nodes.at(n).Id();
-    double  lat = nodes.at(n).Lat();
-    double  lon = nodes.at(n).Lon();
-    nodeCoords [id] = QVector2D (lon, -lat);
+    NaviId  id = nodes.at(n).Id();
+    nodeCoords [id] = QPoint (nodes.at(n).LonCoord(), -nodes.at(n).LatCoord());
     nodeSet.insert (id);
   }
 qDebug () << " list count " << nodes.count() << " set count " << nodeSet.count();
@@ -373,11 +512,11 @@ AsRoute::HandleLatLon (int reqId, double lat, double lon)
 {
   int count (0);
   if (requestInDB.contains (reqId)) {
-    QString nodeId = requestInDB[reqId].id;
+    NaviId nodeId = requestInDB[reqId].id;
     requestInDB.remove (reqId);
-    QVector2D coord (lon, -lat);
+    QPoint coord (CoordFromDegrees (lon), -CoordFromDegrees (lat));
     nodeCoords [nodeId] = coord;
-    mapWidget->AddPoint (coord.toPointF());
+    mapWidget->AddPoint (coord);
     count++;
     if (count > 100) {
       mapWidget->update();
@@ -393,7 +532,7 @@ AsRoute::HandleTagList (int reqId, const TagList & tagList)
   if (!requestInDB.contains (reqId)) {
     return;
   }
-  QString id = requestInDB[reqId].id;
+  NaviId id = requestInDB[reqId].id;
   requestInDB.remove (reqId);
   for (int t=0; t<tagList.count(); t++) {
     tagMap[id] = tagList.at(t);;
@@ -405,7 +544,7 @@ AsRoute::HandleTagList (int reqId, const TagList & tagList)
 }
 
 void
-AsRoute::HandleWayList (int reqId, const QStringList & wayList)
+AsRoute::HandleWayList (int reqId, const NaviIdList & wayList)
 {
 qDebug () << "HandleWayList";
   if (!requestInDB.contains (reqId)) {
@@ -413,7 +552,7 @@ qDebug () << " unkown request " << reqId;
   } else {
     requestInDB.remove (reqId);
   }
-  QStringList::const_iterator sit;
+  NaviIdList::const_iterator sit;
   mainUi.logDisplay->append (QString ("matching ways: %1").arg(wayList.count()));
   for (sit = wayList.begin(); sit != wayList.end(); sit++) {
     waySet.insert (*sit);
@@ -437,21 +576,85 @@ qDebug () << " unkown request " << reqId;
   mainUi.logDisplay->append (QString("Way Turn list entries: %1").arg(nw));
   for (sit = wayList.begin(); sit != wayList.end(); sit++) {
     waySet.insert (sit->WayId());
-    turnMap.insert (pair<QString, WayTurn> (sit->WayId(), *sit));
+    turnMap.insert (pair<NaviId, WayTurn> (sit->WayId(), *sit));
     // FindWayDetails (wayItem, *sit);
   }
   UpdateLoad ();
 }
+
+/** @brief Node sets go to the database in lists of this many ids,
+  * one query each instead of one per node.
+  */
+
+static const int AskChunk (256);
+
+static QList <NaviIdList>
+IdChunks (const QSet <NaviId> & ids)
+{
+  QList <NaviIdList> chunks;
+  QSet <NaviId>::const_iterator it;
+  for (it=ids.constBegin(); it!=ids.constEnd(); it++) {
+    if (chunks.isEmpty () || chunks.last().count() >= AskChunk) {
+      chunks.append (NaviIdList ());
+    }
+    chunks.last().append (*it);
+  }
+  return chunks;
+}
+
+/** @brief The route is drawn through its graph nodes first, and
+  * again along its ways once their geometry is in.
+  */
+
+void
+AsRoute::AskRouteShape ()
+{
+  routeShapeRequests.clear ();
+  routeGeoms.clear ();
+  QSet <NaviId> wayIds;
+  for (int t=0; t<routeTurns.count(); t++) {
+    wayIds.insert (routeTurns.at(t).WayId ());
+  }
+  QList <NaviIdList> chunks = IdChunks (wayIds);
+  for (int c=0; c<chunks.count(); c++) {
+    routeShapeRequests.insert (db.AskWayGeometries (chunks.at(c)));
+  }
+}
+
+void
+AsRoute::HandleWayGeometries (int reqId, const WayGeomMap & geoms)
+{
+  if (!routeShapeRequests.remove (reqId)) {
+    return;
+  }
+  WayGeomMap::const_iterator git;
+  for (git=geoms.begin(); git!=geoms.end(); git++) {
+    routeGeoms.insert (git.key(), *git);
+  }
+  if (!routeShapeRequests.isEmpty ()) {
+    return;
+  }
+  if (hierarchySearch) {
+    hierarchySearch->PathTurns (routeTurns, routeGeoms);
+  } else if (routeSearch) {
+    routeSearch->PathTurns (routeTurns, routeGeoms);
+  }
+  DrawMap ();
+}
+
 void
 AsRoute::ListNodes ()
 {
-  QSet<QString>::iterator nit;
   mainUi.logDisplay->append (QString ("found %1 Notes").arg (nodeSet.count()));
   numNodeDetails = 0;
   mainUi.loadBar->setValue (numNodeDetails);
   QueueMark ("Start Ask Node Detais");
-  for (nit=nodeSet.begin(); nit!= nodeSet.end(); nit++) {
-    QueueAskNodeDetails (*nit);
+  QList <NaviIdList> chunks = IdChunks (nodeSet);
+  for (int c=0; c<chunks.count(); c++) {
+    ResponseStruct resp;
+    resp.type = Req_NodeTagList;
+    int reqId = db.AskTagsFor ("node", chunks.at(c));
+    requestInDB[reqId] = resp;
   }
   QueueMark ("Done Ask Node Details");
   KickRequestQueue ();
@@ -463,31 +666,13 @@ AsRoute::KickRequestQueue ()
   QTimer::singleShot (100, this, SLOT (SendSomeRequests()));
 }
 
-void
-AsRoute::QueueAskNodeDetails (const QString & id)
-{
-  #define NAVI_USE_LATLON 0
-  #define NAVI_USE_TAGS 0
-  #if NAVI_USE_LATLON
-  RequestStruct llReq;
-  llReq.type = Req_LatLon;
-  llReq.id = id;
-  requestToSend.append (llReq);
-  #endif
-  #if NAVI_USE_TAGS
-  RequestStruct tagReq;
-  tagReq.type = Req_NodeTagList;
-  tagReq.id = id;
-  requestToSend.append (tagReq);
-  #endif
-}
-
 void
 AsRoute::QueueMark (const QString & mark)
 {
   RequestStruct markReq;
   markReq.type = Req_Mark;
-  markReq.id = mark;
+  markReq.id = 0;
+  markReq.message = mark;
   requestToSend.append (markReq);
 }
 
@@ -512,7 +697,7 @@ AsRoute::SendSomeRequests ()
       batchSize++;
       break;
     case Req_Mark:
-      Mark (req.id);
+      Mark (req.message);
       break;
     default:
       break;
@@ -528,7 +713,7 @@ AsRoute::SendSomeRequests ()
 }
 
 void
-AsRoute::AskLatLon (const QString & nodeId)
+AsRoute::AskLatLon (NaviId nodeId)
 {
   ResponseStruct resp;
   resp.type = Req_LatLon;
@@ -538,7 +723,7 @@ AsRoute::AskLatLon (const QString & nodeId)
 }
 
 void
-AsRoute::AskNodeTagList (const QString & nodeId)
+AsRoute::AskNodeTagList (NaviId nodeId)
 {
   ResponseStruct resp;
   resp.type = Req_NodeTagList;
@@ -550,13 +735,13 @@ AsRoute::AskNodeTagList (const QString & nodeId)
 void
 AsRoute::FindWays ()
 {
-  QSet<QString>::iterator  nit;
-  for (nit = nodeSet.begin(); nit!=nodeSet.end(); nit++) {
+  QList <NaviIdList> chunks = IdChunks (nodeSet);
+  for (int c=0; c<chunks.count(); c++) {
     ResponseStruct resp;
     resp.type = Req_WayList;
-    int reqId = db.AskWaysByNode (*nit);
+    int reqId = db.AskWaysByNodes (chunks.at(c));
     requestInDB[reqId] = resp;
-qDebug () << " find way for node " << *nit;
+qDebug () << " find ways for " << chunks.at(c).count() << " nodes";
   }
   KickRequestQueue ();
 }
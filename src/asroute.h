@@ -6,6 +6,10 @@
 #include "config-edit.h"
 #include "helpview.h"
 #include "as-db-manager.h"
+#include "road-graph.h"
+#include "route-search.h"
+#include "route-hierarchy.h"
+#include "isochrone.h"
 #include "navi-types.h"
 #include "route-cell-menus.h"
 #include <QMainWindow>
@@ -55,23 +59,26 @@ private slots:
   void HandleRangeNodes (int reqId, const NaviNodeList & nodes);
   void HandleLatLon (int reqId, double lat, double lon);
   void HandleTagList (int reqId, const TagList & tagList);
-  void HandleWayList (int reqId, const QStringList & wayList);
+  void HandleWayList (int reqId, const NaviIdList & wayList);
   void HandleWayTurnList (int reqId, const WayTurnList & wayList);
+  void HandleWayGeometries (int reqId, const WayGeomMap & geoms);
   void HandleRangeNodeTags (int reqId, const TagRecordList & tagList);
   void ChangeMaxCount (int newmax);
   void FindWays ();
   void CatchMark (int markId);
+  void RouteButton ();
+  void ReachButton ();
 
 
 private:
 
-  void QueueAskNodeDetails (const QString & nodeId);
-  void AskLatLon (const QString & nodeId);
-  void AskNodeTagList (const QString & nodeId);
+  void AskLatLon (NaviId nodeId);
+  void AskNodeTagList (NaviId nodeId);
   void UpdateLoad ();
   void Mark (const QString & message = QString ("Mark"));
   void QueueMark (const QString & message = QString ("Queued Mark"));
-  void MakeRed (const QString & wayId);
+  void MakeRed (NaviId wayId);
+  void AskRouteShape ();
 
   enum CellType {
        Cell_NoType = 0,
@@ -103,12 +110,13 @@ private:
 
   struct ResponseStruct {
     RequestType          type;
-    QString           id;
+    NaviId            id;
   };
 
   struct RequestStruct {
     RequestType       type;
-    QString           id;
+    NaviId            id;
+    QString           message;
   };
    
   struct MarkStruct {
@@ -127,6 +135,15 @@ private:
 
   MapDisplay      *mapWidget;
   AsDbManager      db;
+  RoadGraph        graph;
+  RouteSearch     *routeSearch;
+  RouteHierarchy   hierarchy;
+  HierarchySearch *hierarchySearch;
+  IsochroneSearch *isochrone;
+  WayTurnList      routeTurns;
+  QSet <int>       routeShapeRequests;
+  WayGeomMap       routeGeoms;
+  QList <QPolygon> reachAreas;
 
   int              maxSend;
   int              maxPending;
@@ -137,9 +154,9 @@ private:
   RouteCellMenu  *cellMenu;
   QMap <CellType, QString > cellTypeName;
 
-  QSet <QString>  nodeSet;
-  QSet <QString>  waySet;
-  QMap <QString, TagItemType>  tagMap;
+  QSet <NaviId>   nodeSet;
+  QSet <NaviId>   waySet;
+  QMap <NaviId, TagItemType>   tagMap;
   
   QMap <int, ResponseStruct>  requestInDB;
   QList <RequestStruct>       requestToSend;
@@ -151,10 +168,10 @@ private:
   QTime  markClock;
   QMap <int, MarkStruct>  markMap;
 
-  multimap <QString, WayTurn>   turnMap;
-  QStringList                  redWays;
+  multimap <NaviId, WayTurn>    turnMap;
+  NaviIdList                   redWays;
 
-  QMap <QString, QVector2D>   nodeCoords;
+  QMap <NaviId, QPoint>       nodeCoords;
   QString   localPrefix;
 
 } ;
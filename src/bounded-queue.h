@@ -0,0 +1,111 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include <QQueue>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+namespace navi
+{
+
+/** @brief Fixed capacity queue between producer and consumer
+  * threads. Put blocks while the queue is full, Take blocks while
+  * it is empty. After Close, Put fails and Take drains what is left.
+  */
+
+template <typename T>
+class BoundedQueue
+{
+public:
+
+  BoundedQueue (int maxItems = 8)
+    :capacity (maxItems < 1 ? 1 : maxItems),
+     closed (false)
+    {}
+
+  bool Put (const T & item)
+    {
+      QMutexLocker lock (&mutex);
+      while (!closed && items.count () >= capacity) {
+        notFull.wait (&mutex);
+      }
+      if (closed) {
+        return false;
+      }
+      items.enqueue (item);
+      notEmpty.wakeOne ();
+      return true;
+    }
+
+  bool Take (T & item)
+    {
+      QMutexLocker lock (&mutex);
+      while (!closed && items.isEmpty ()) {
+        notEmpty.wait (&mutex);
+      }
+      if (items.isEmpty ()) {
+        return false;
+      }
+      item = items.dequeue ();
+      notFull.wakeOne ();
+      return true;
+    }
+
+  void Close ()
+    {
+      QMutexLocker lock (&mutex);
+      closed = true;
+      notFull.wakeAll ();
+      notEmpty.wakeAll ();
+    }
+
+  void Reopen (int maxItems)
+    {
+      QMutexLocker lock (&mutex);
+      items.clear ();
+      capacity = (maxItems < 1 ? 1 : maxItems);
+      closed = false;
+    }
+
+  int Count ()
+    {
+      QMutexLocker lock (&mutex);
+      return items.count ();
+    }
+
+  int Capacity () const { return capacity; }
+
+private:
+
+  QQueue <T>      items;
+  QMutex          mutex;
+  QWaitCondition  notFull;
+  QWaitCondition  notEmpty;
+  int             capacity;
+  bool            closed;
+};
+
+} // namespace
+
+#endif
@@ -26,7 +26,12 @@
 #include "version.h"
 #include "helpview.h"
 #include "navi-global.h"
+#include "navi-pack.h"
+#include "road-graph-builder.h"
+#include "hierarchy-builder.h"
+#include "isochrone.h"
 #include <QSize>
+#include <QSet>
 #include <QDebug>
 #include <QMessageBox>
 #include <QTimer>
@@ -58,7 +63,9 @@ Collect::Collect (QWidget *parent)
    network (this),
    latStep (1.0/60.0),   // 1 arc minute
    lonStep (1.0/60.0),    // 1 arc minute
-   autoGet (false)
+   autoGet (false),
+   batchWriter (db),
+   ingest (this)
 {
   mClock.start ();
   mainUi.setupUi (this);
@@ -130,6 +137,12 @@ Collect::Connect ()
            this, SLOT (License ()));
   connect (mainUi.actionRestart, SIGNAL (triggered()),
            this, SLOT (Restart ()));
+  connect (mainUi.actionExportPack, SIGNAL (triggered()),
+           this, SLOT (ExportPack ()));
+  connect (mainUi.actionBuildRoadGraph, SIGNAL (triggered()),
+           this, SLOT (BuildRoadGraph ()));
+  connect (mainUi.actionBuildHierarchy, SIGNAL (triggered()),
+           this, SLOT (BuildHierarchy ()));
   connect (mainUi.readButton, SIGNAL (clicked()),
            this, SLOT (ReadButton ()));
   connect (mainUi.saveButton, SIGNAL (clicked()),
@@ -141,6 +154,10 @@ Collect::Connect ()
 
   connect (&network, SIGNAL (finished (QNetworkReply*)),
            this, SLOT (HandleReply (QNetworkReply*)));
+  connect (&ingest, SIGNAL (Progress (const QString &)),
+           this, SLOT (IngestProgress (const QString &)));
+  connect (&ingest, SIGNAL (Finished (const QString &)),
+           this, SLOT (IngestFinished (const QString &)));
 }
 
 void
@@ -305,7 +322,11 @@ Collect::ProcessData (QByteArray & data)
   wayNodes.clear ();
   wayAttrMap.clear ();
   nodeAttrMap.clear ();
-  wayLocs.clear ();
+  relationAttrMap.clear ();
+  relationMembers.clear ();
+  nodeVersions.clear ();
+  wayVersions.clear ();
+  relationVersions.clear ();
   replyDoc.setContent (data);
   ProcessNodes (replyDoc);
   ProcessWays (replyDoc);
@@ -321,10 +342,14 @@ qDebug () << " node count " << nodes.count();
     QDomNode node = nodes.at(i);
     if (node.isElement ()) {
       QDomElement elt = node.toElement();
-      QString id = elt.attribute ("id");
+      NaviId id = elt.attribute ("id").toLongLong ();
       double dlat = elt.attribute ("lat").toDouble();
       double dlon = elt.attribute ("lon").toDouble();
       nodeMap[id] = NaviNode (id,dlat,dlon);
+      int version = elt.attribute ("version").toInt ();
+      if (version > 0) {
+        nodeVersions[id] = version;
+      }
       QDomNodeList kids = node.childNodes ();
       AttrList attrList;
       for (int k=0;k<kids.count();k++) {
@@ -371,18 +396,21 @@ qDebug () << " relations count " << relations.count ();
 void
 Collect::ProcessWay (const QDomNode & node)
 {
-  QString id;
+  NaviId id;
   if (node.isElement ()) {
     QDomElement elt = node.toElement();
-    id = elt.attribute ("id");
+    id = elt.attribute ("id").toLongLong ();
+    int version = elt.attribute ("version").toInt ();
+    if (version > 0) {
+      wayVersions[id] = version;
+    }
   } else {
     LogStatus  ("Way Node not an Element");
     return;
   }
   QDomNodeList kids = node.childNodes ();
-  QStringList nodeIdList;
+  NaviIdList nodeIdList;
   AttrList    attrList;
-  int seqNum(0);
   for (int k=0; k<kids.count(); k++) {
     QDomNode kid = kids.item(k);
     if (kid.isElement()) {
@@ -394,13 +422,8 @@ Collect::ProcessWay (const QDomNode & node)
         AttrType wayAttr (key,val);
         attrList.append (wayAttr);
       } else if (tagName == "nd") {
-        QString nodeId = kidElt.attribute ("ref");
+        NaviId nodeId = kidElt.attribute ("ref").toLongLong ();
         nodeIdList.append (nodeId);
-        if (nodeMap.contains (nodeId)) {
-          NaviNode node = nodeMap[nodeId];
-          WayTurn wayLoc (id, nodeId, seqNum++, node.Lat(), node.Lon());
-          wayLocs.append (wayLoc);
-        }
       }
     }
   }
@@ -411,15 +434,19 @@ Collect::ProcessWay (const QDomNode & node)
 void
 Collect::ProcessRelation (const QDomNode & node)
 {
-  QString id;
+  NaviId id;
   if (node.isElement ()) {
     QDomElement elt = node.toElement();
-    id = elt.attribute ("id");
+    id = elt.attribute ("id").toLongLong ();
+    int version = elt.attribute ("version").toInt ();
+    if (version > 0) {
+      relationVersions[id] = version;
+    }
   } else {
     LogStatus  ("Relation Node not an Element");
     return;
   }
-  AttrList  memberList;
+  MemberList  memberList;
   AttrList  tagList;
   QDomNodeList kids = node.childNodes ();
   for (int k=0; k<kids.count(); k++) {
@@ -431,8 +458,8 @@ Collect::ProcessRelation (const QDomNode & node)
     QString tagName = kidElt.tagName();
     if (tagName == "member") {
       QString type = kidElt.attribute ("type");
-      QString ref = kidElt.attribute ("ref");
-      AttrType member (type,ref);
+      NaviId ref = kidElt.attribute ("ref").toLongLong ();
+      MemberItemType member (type,ref);
       memberList.append (member);
     } else if (tagName == "tag") {
       QString key = kidElt.attribute ("k");
@@ -489,30 +516,134 @@ Collect::ReadNextXML ()
 {
   useNetwork = false;
   readingXML = true;
-  if (inputFiles.isEmpty () ) {
+  if (inputFiles.isEmpty () || ingest.Running ()) {
     return;
   }
-  QString filename = inputFiles.takeFirst();
+  int parsers = Settings().value ("ingest/parsers", 1).toInt();
+  Settings().setValue ("ingest/parsers", parsers);
+  int depth = Settings().value ("ingest/queuedepth", 8).toInt();
+  Settings().setValue ("ingest/queuedepth", depth);
+  bool bulk = Settings().value ("ingest/bulkload", false).toBool();
+  Settings().setValue ("ingest/bulkload", bulk);
+  int cacheKB = Settings().value ("ingest/bulkcachekb", 256*1024).toInt();
+  Settings().setValue ("ingest/bulkcachekb", cacheKB);
+  ingest.SetBulkLoad (bulk, cacheKB);
+  bool nodeStore = Settings().value ("ingest/nodestore", true).toBool();
+  Settings().setValue ("ingest/nodestore", nodeStore);
+  ingest.SetNodeStore (nodeStore);
+  LogStatus (QString ("Ingest %1 files with %2 parser threads")
+                      .arg (inputFiles.count()).arg (parsers));
+  currentFile = inputFiles.join (" ");
+  ingest.Start (inputFiles, DbManager::GeoBaseName (), parsers, depth);
+  inputFiles.clear ();
+}
+
+void
+Collect::IngestProgress (const QString & message)
+{
+  LogStatus (message);
+}
+
+void
+Collect::IngestFinished (const QString & summary)
+{
+  LogStatus (summary);
+  LogStatus (QString ("ALL DONE with files %1").arg (currentFile));
+  db.LoadIdFilters ();
+}
+
+void
+Collect::ExportPack ()
+{
+  QString filename = QFileDialog::getSaveFileName (this, "Export Pack",
+                              DbManager::GeoBaseName () + ".pack");
   if (filename.length() < 1) {
     return;
   }
-qDebug () << " next file " << filename;
-  LogStatus (QString ("Next file \"%1\"").arg(filename));
-  currentFile = filename;
-  QFile file (filename);
-  bool ok = file.open (QFile::ReadOnly);
-  if (!ok) {
-qDebug () << " canot open " << file.fileName();
+  QTime clock;
+  clock.start ();
+  if (!db.ExportPack (filename)) {
+    LogStatus (QString ("Export to %1 failed").arg (filename));
     return;
   }
-  readingXML = true;
-  responseBytes.clear ();
-  responseBytes = file.readAll();
-  file.close ();
-qDebug () << " file has " << responseBytes.size() << " bytes";
-  if (responseBytes.size() > 0) {
-    ProcessData (responseBytes);
-    QTimer::singleShot (100, this, SLOT (SaveSql()));
+  NaviPack pack;
+  pack.Open (filename);
+  LogStatus (QString ("Exported %1 nodes %2 ways %3 relations "
+                      "to %4 in %5 msecs")
+             .arg (pack.NodeCount ()).arg (pack.WayCount ())
+             .arg (pack.RelationCount ()).arg (filename)
+             .arg (clock.elapsed ()));
+}
+
+void
+Collect::BuildRoadGraph ()
+{
+  int threads = Settings().value ("graph/threads", 0).toInt();
+  Settings().setValue ("graph/threads", threads);
+  QString filename = RoadGraph::FileName (db.GeoBaseFile ());
+  LogStatus (QString ("Building road graph %1").arg (filename));
+  RoadGraphBuilder builder;
+  if (builder.Build (db, filename, threads)) {
+    LogStatus (builder.Report ());
+  } else {
+    LogStatus (QString ("Road graph failed: %1")
+                       .arg (builder.ErrorString ()));
+  }
+}
+
+/** @brief Contract the road graph of the geobase, then time random
+  * queries on the new hierarchy.
+  */
+
+void
+Collect::BuildHierarchy ()
+{
+  int threads = Settings().value ("graph/threads", 0).toInt();
+  Settings().setValue ("graph/threads", threads);
+  int queries = Settings().value ("graph/benchmarkqueries", 1000).toInt();
+  Settings().setValue ("graph/benchmarkqueries", queries);
+  int reachQueries = Settings().value ("graph/isochronequeries", 200).toInt();
+  Settings().setValue ("graph/isochronequeries", reachQueries);
+  int reachMinutes = Settings().value ("graph/isochroneminutes", 10).toInt();
+  Settings().setValue ("graph/isochroneminutes", reachMinutes);
+  int reachCell = Settings().value ("graph/isochronecell", 200).toInt();
+  Settings().setValue ("graph/isochronecell", reachCell);
+  QString graphName = RoadGraph::FileName (db.GeoBaseFile ());
+  RoadGraph graph;
+  if (!graph.Open (graphName)) {
+    LogStatus (QString ("No road graph %1, build one first")
+                       .arg (graphName));
+    return;
+  }
+  QString filename = RouteHierarchy::FileName (db.GeoBaseFile ());
+  LogStatus (QString ("Building route hierarchy %1").arg (filename));
+  HierarchyBuilder builder;
+  if (!builder.Build (graph, filename, threads)) {
+    LogStatus (QString ("Route hierarchy failed: %1")
+                       .arg (builder.ErrorString ()));
+    return;
+  }
+  LogStatus (builder.Report ());
+  RouteHierarchy hierarchy;
+  if (queries > 0 && hierarchy.Open (filename, graph)) {
+    QStringList report = HierarchySearch::Benchmark (graph, hierarchy,
+                                                     queries);
+    for (int r=0; r<report.count(); r++) {
+      LogStatus (report.at(r));
+    }
+  }
+  if (reachQueries > 0) {
+    quint32 limit = quint32 (reachMinutes) * 600;
+    QStringList report = IsochroneSearch::Benchmark (graph, 0, reachQueries,
+                                                     limit, reachCell,
+                                                     threads);
+    if (hierarchy.IsOpen ()) {
+      report += IsochroneSearch::Benchmark (graph, &hierarchy, reachQueries,
+                                            limit, reachCell, threads);
+    }
+    for (int r=0; r<report.count(); r++) {
+      LogStatus (report.at(r));
+    }
   }
 }
 
@@ -562,7 +693,8 @@ Collect::SaveSequence()
     QTimer::singleShot (100, this, SLOT (SaveRelationsSql ()));
     break;
   case Stage_Final:
-    LogStatus (QString ("done with %1").arg(lastUrl));
+    LogStatus (QString ("done with %1")
+                .arg (batchWriter.FileReport (SaveSource ())));
     ShowProgress ();
     if (autoGet && useNetwork) {
       QTimer::singleShot (100, this, SLOT (SendNext()));
@@ -585,33 +717,38 @@ Collect::ShowProgress ()
   mainUi.lonProgress->setValue (percentLon);
 }
 
+/** @brief The download is saved through OsmBatchWriter, one batch
+  * per stage, so a changed element replaces its stored node, member
+  * and tag lists, and stored ways using a moved node follow it.
+  */
+
+QString
+Collect::SaveSource () const
+{
+  return useNetwork ? lastUrl : currentFile;
+}
+
 void
 Collect::SaveNodesSql ()
 {
-  int saved (0);
-  db.StartTransaction ();
-  QTime clock;
-  clock.start ();
-  NodeMapType::iterator nit;
-  for (nit=nodeMap.begin(); nit!= nodeMap.end(); nit++) {
-    NaviNode node = *nit;
-    db.WriteNode (node.Id(), node.Lat(), node.Lon());
-    db.WriteNodeParcel (node.Id(), Parcel::Index (node.Lat(),node.Lon()));
-    saved++;
-  }
-  QMap <QString, AttrList>::iterator mit;
-  for (mit=nodeAttrMap.begin(); mit!= nodeAttrMap.end(); mit++) {
-    QString nodeId = mit.key();
-    int count = mit->count();
-    for (int a=0; a<count; a++) {
-      AttrType attr = mit->at(a);
-      db.WriteNodeTag (nodeId, attr.first, attr.second);
+  OsmBatch batch;
+  batch.source = SaveSource ();
+  batch.nodes = nodeMap.values ();
+  QMap <NaviId, AttrList>::const_iterator mit;
+  for (mit=nodeAttrMap.constBegin(); mit!=nodeAttrMap.constEnd(); mit++) {
+    if (!mit->isEmpty ()) {
+      batch.nodeTags [mit.key()] = *mit;
     }
   }
-  db.CommitTransaction ();
+  batch.nodeVersions = nodeVersions;
+  QTime clock;
+  clock.start ();
+  batchWriter.ResetCounts ();
+  batchWriter.Write (batch);
   int msecs = clock.elapsed();
-  LogStatus  (QString ("Saved %1 nodes in %2 msecs")
-                              .arg(saved)
+  LogStatus  (QString ("Saved %1 nodes %2 tags in %3 msecs")
+                              .arg (batchWriter.Nodes ())
+                              .arg (batchWriter.Tags ())
                               .arg (msecs));
   ContinueSequence ();
 }
@@ -619,115 +756,43 @@ Collect::SaveNodesSql ()
 void
 Collect::SaveWaysSql ()
 {
-  int savedid (0);
-  int savedtag (0);
-  int savednode (0);
+  OsmBatch batch;
+  batch.source = SaveSource ();
+  batch.wayNodes = wayNodes;
+  batch.wayTags = wayAttrMap;
+  batch.wayVersions = wayVersions;
   QTime clock;
   clock.start ();
-  db.StartTransaction ();
-  QMap<QString, QStringList>::iterator wit;
-  for (wit=wayNodes.begin(); wit!=wayNodes.end(); wit++) {
-    QString wayId = wit.key();
-    db.WriteWay (wayId);
-    savedid++;
-    BuildWayParcels (wayId, *wit);  
-    for (int n=0; n<wit->count(); n++) {
-      db.WriteWayNode (wayId, wit->at(n));
-      savednode++;
-    }
-  }
-  QMap<QString, AttrList>::iterator ait;
-  for (ait=wayAttrMap.begin(); ait!=wayAttrMap.end (); ait++) {
-    QString wayId = ait.key();
-    int count = ait->count();
-    for (int i=0; i<count; i++) {
-      AttrType  attr = ait->at(i);
-      db.WriteWayTag (wayId, attr.first, attr.second);
-      savedtag++;
-    }
-  }
-  db.CommitTransaction ();
-  db.StartTransaction ();
-  int nl = wayLocs.count();
-  for (int l=0;  l<nl; l++) {
-    WayTurn loc = wayLocs.at(l);
-    db.WriteWayLoc (loc.WayId(), loc.NodeId(), loc.Seq(), loc.Lat(), loc.Lon());
-  }
-  db.CommitTransaction ();
+  batchWriter.ResetCounts ();
+  batchWriter.Write (batch);
   int msecs = clock.elapsed ();
-  LogStatus  (QString ("wrote %1 ways "
-                                      "%2 tags %3 nodes %5 waylocs in %4 msecs")
-                            .arg (savedid)
-                            .arg (savedtag)
-                            .arg (savednode)
-                            .arg (msecs)
-                            .arg (nl));
+  LogStatus  (QString ("wrote %1 ways %2 tags in %3 msecs")
+                            .arg (batchWriter.Ways ())
+                            .arg (batchWriter.Tags ())
+                            .arg (msecs));
   ContinueSequence ();
 }
 
 void
 Collect::SaveRelationsSql ()
 {
-  QMap<QString, AttrList>::iterator ait;
-  int savedIds (0);
-  int savedTags (0);
-  int savedMems (0);
+  OsmBatch batch;
+  batch.source = SaveSource ();
+  batch.relationTags = relationAttrMap;
+  batch.relationMembers = relationMembers;
+  batch.relationVersions = relationVersions;
   QTime clock;
   clock.start ();
-  db.StartTransaction ();
-  for (ait=relationAttrMap.begin(); ait!=relationAttrMap.end (); ait++) {
-    QString relId = ait.key();
-    db.WriteRelation (relId);
-    savedIds++;
-    for (int a=0; a<ait->count(); a++) {
-      AttrType attr = ait->at(a);
-      db.WriteRelationTag (relId, attr.first, attr.second);
-      savedTags++;
-    }
-  }
-  for (ait=relationMembers.begin(); ait != relationMembers.end(); ait++) {
-    QString relId = ait.key();
-    db.WriteRelation (relId);
-    for (int a=0; a<ait->count(); a++) {
-      AttrType member = ait->at(a);
-      QString  type = member.first;
-      QString  ref = member.second;
-      db.WriteRelationMember (relId, type, ref);
-      savedMems++;
-    }
-  }
-  db.CommitTransaction ();
+  batchWriter.ResetCounts ();
+  batchWriter.Write (batch);
   int msecs = clock.elapsed ();
-  LogStatus  (QString ("wrote %1 relations "
-                                      "%2 tags %3 members in %4 msecs")
-                            .arg (savedIds)
-                            .arg (savedTags)
-                            .arg (savedMems)
+  LogStatus  (QString ("wrote %1 relations %2 tags in %3 msecs")
+                            .arg (batchWriter.Relations ())
+                            .arg (batchWriter.Tags ())
                             .arg (msecs));
   ContinueSequence ();
 }
 
-void
-Collect::BuildWayParcels (const QString & wayId, 
-                       const QStringList & nodeIdList)
-{
-  QStringList nodeList = wayNodes[wayId];
-  //db.StartTransaction ();
-  for (int n=0; n<nodeIdList.count (); n++) {
-    double lat, lon;
-    QString nodeId = nodeIdList.at(n);
-    if (nodeMap.contains (nodeId))  {
-      NaviNode node = nodeMap[nodeId];
-      lat = node.Lat();
-      lon = node.Lon();
-qDebug () << " way parcel node " << wayId << nodeId;
-      db.WriteWayParcel (wayId, Parcel::Index (lat, lon));
-    }
-  }
-  
-  //db.CommitTransaction ();
-}
-
 
 Collect::Highway::Highway ()
   :ishighway(false)
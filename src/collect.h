@@ -27,11 +27,14 @@
 #include "helpview.h"
 #include "db-manager.h"
 #include "navi-types.h"
+#include "ingest-pipeline.h"
+#include "osm-batch-writer.h"
 
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QDomNode>
 #include <QMap>
+#include <QSet>
 #include <QTime>
 
 class QApplication;
@@ -73,6 +76,11 @@ private slots:
   void SaveResponse ();
   void ReadXML ();
   void ReadNextXML ();
+  void IngestProgress (const QString & message);
+  void IngestFinished (const QString & summary);
+  void ExportPack ();
+  void BuildRoadGraph ();
+  void BuildHierarchy ();
   void SaveSql ();
   void SendNext ();
   
@@ -103,7 +111,7 @@ private:
     Stage_Done
   };
 
-  typedef QMap <QString, NaviNode>   NodeMapType;
+  typedef QMap <NaviId, NaviNode>    NodeMapType;
   typedef QPair <QString, QString>   AttrType;
   typedef QList <AttrType>           AttrList;
 
@@ -118,8 +126,7 @@ private:
   void ProcessWay (const QDomNode & node);
   void ProcessRelation (const QDomNode & node);
   void ProcessData (QByteArray & data);
-  void BuildWayParcels (const QString & wayId, 
-                        const QStringList & nodeIdList);
+  QString SaveSource () const;
   void ShowProgress ();
   void LogStatus (const QString & msg);
 
@@ -152,16 +159,21 @@ private:
 
   QByteArray                   responseBytes;
   NodeMapType                  nodeMap;
-  QMap <QString, AttrList>     wayAttrMap;
-  QMap <QString, AttrList>     nodeAttrMap;
-  QMap <QString, AttrList>     relationAttrMap;
-  QMap <QString, AttrList>     relationMembers;
-  QMap <QString, QStringList>  wayNodes;
-  QList <WayTurn>             wayLocs;
+  QMap <NaviId, AttrList>      wayAttrMap;
+  QMap <NaviId, AttrList>      nodeAttrMap;
+  QMap <NaviId, AttrList>      relationAttrMap;
+  QMap <NaviId, MemberList>    relationMembers;
+  QMap <NaviId, NaviIdList>    wayNodes;
+  QMap <NaviId, int>           nodeVersions;
+  QMap <NaviId, int>           wayVersions;
+  QMap <NaviId, int>           relationVersions;
+  OsmBatchWriter               batchWriter;
 
   QStringList                  inputFiles;
   QString                      currentFile;
   bool                         readingXML;
+
+  IngestPipeline               ingest;
 };
 
 } // namespace
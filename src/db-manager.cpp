@@ -22,6 +22,9 @@
  *****************************************************************/
 
 #include "deliberate.h"
+#include "navi-global.h"
+#include "navi-pack.h"
+#include "way-geometry.h"
 
 #include <QDesktopServices>
 #include <QDir>
@@ -31,11 +34,15 @@
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlError>
+#include <QSet>
+#include <QStringList>
 #include <QDateTime>
+#include <QTime>
 #include <QApplication>
 #include <QClipboard>
 #include <QMessageBox>
 #include <QTimer>
+#include <QtAlgorithms>
 #include <QDebug>
 
 using namespace deliberate;
@@ -45,8 +52,21 @@ namespace navi
 
 DbManager::DbManager (QObject *parent)
   :QObject (parent),
-   dbRunning (false)
+   dbRunning (false),
+   bulkCacheKB (256*1024),
+   haveRtree (false),
+   nodesChanged (false),
+   filtersChanged (false),
+   filtersTrusted (false),
+   inTransaction (false),
+   generationBumped (false)
 {
+  tagKeys.table = "tagkeys";
+  tagKeys.idColumn = "keyid";
+  tagKeys.textColumn = "key";
+  tagValues.table = "tagvalues";
+  tagValues.idColumn = "valueid";
+  tagValues.textColumn = "value";
 }
 
 void
@@ -56,8 +76,8 @@ DbManager::Connect ()
 }
 
 
-void
-DbManager::Start ()
+QString
+DbManager::GeoBaseName ()
 {
   QString dataDir = QDesktopServices::storageLocation
                     (QDesktopServices::DataLocation);
@@ -66,9 +86,26 @@ DbManager::Start ()
   geoBaseName = Settings().simpleValue ("database/geobase",geoBaseName)
                                     .toString();
   Settings().setSimpleValue ("database/geobase",geoBaseName);
-  
+  return geoBaseName;
+}
+
+void
+DbManager::Start ()
+{
+  Start ("geoBaseCon", GeoBaseName ());
+}
+
+/** @brief Start with an explicit connection name, so that a
+  * DbManager can be started in a thread other than the GUI thread
+  * without touching the settings there.
+  */
 
-  StartDB (geoBase, "geoBaseCon", geoBaseName);
+void
+DbManager::Start (const QString & conName, const QString & geoBaseName)
+{
+  geoBaseCon = conName;
+  geoBaseFile = geoBaseName;
+  StartDB (geoBase, conName, geoBaseName);
 
   QStringList  eventElements;
   eventElements << "nodes"
@@ -83,21 +120,87 @@ DbManager::Start ()
                 << "wayparcels"
                 << "relations"
                 << "relationparts"
-                << "relationtags";
+                << "relationtags"
+                << "navimeta"
+                << "waylocwayindex"
+                << "noderect"
+                << "wayrect"
+                << "nodeparcelindex"
+                << "wayparcelindex"
+                << "waycells"
+                << "waycellindex"
+                << "tagkeys"
+                << "tagvalues"
+                << "nodetagvalueindex"
+                << "waytagvalueindex"
+                << "relationtagvalueindex"
+                << "waygeoms"
+                << "relationmemberindex"
+                << "waynodeindex"
+                << "idfilters";
 
   CheckDBComplete (geoBase, eventElements);
 
   dbRunning = true;
+  CheckSchemaVersion ();
+  CheckSpatialIndex ();
+  generation.Start (geoBase);
+  if (InBulkLoad ()) {
+    qDebug () << " finishing interrupted bulk load in " << geoBaseName;
+    FinishBulkLoad ();
+  }
+  OpenNodeStore ();
+  LoadIdFilters ();
   qDebug () << " available drivers: " 
            << QSqlDatabase::drivers ();
 }
 
+/** @brief Meant for reader threads, which would otherwise each run
+  * the whole Start on the same file. Lookups that use the IdFilters
+  * go to SQL, since there are none to trust.
+  */
+
+bool
+DbManager::StartReadOnly (const QString & conName, 
+                          const QString & geoBaseName)
+{
+  geoBaseCon = conName;
+  geoBaseFile = geoBaseName;
+  geoBase = QSqlDatabase::addDatabase ("QSQLITE", conName);
+  geoBase.setConnectOptions ("QSQLITE_OPEN_READONLY");
+  geoBase.setDatabaseName (geoBaseName);
+  if (!geoBase.open ()) {
+    qDebug () << "DbManager cannot open " << geoBaseName << " read only "
+              << geoBase.lastError().text();
+    geoBase = QSqlDatabase ();
+    QSqlDatabase::removeDatabase (conName);
+    return false;
+  }
+  dbRunning = true;
+  haveRtree = ElementType (geoBase, "noderect").toUpper () == "TABLE"
+           && ElementType (geoBase, "wayrect").toUpper () == "TABLE"
+           && MetaValue ("spatialindex") == "1";
+  filtersTrusted = false;
+  generation.Start (geoBase);
+  return true;
+}
+
 void
 DbManager::Stop ()
 {
   if (dbRunning) {
+    if (filtersChanged) {
+      SaveIdFilters ();
+    }
     dbRunning = false;
+    nodeStore.Close ();
+    nodesChanged = false;
+    generation.Stop ();
+    ClearDictionaries ();
+    statements.clear ();
     geoBase.close ();
+    geoBase = QSqlDatabase ();
+    QSqlDatabase::removeDatabase (geoBaseCon);
   }
 }
 
@@ -177,455 +280,2264 @@ qDebug () << " tried " << ok << " to create element with "
           << query.executedQuery ();
 }
 
-void
-DbManager::WriteNodeTag (const QString & nodeId, 
-                     const QString & key,
-                     const QString & value)
+QString
+DbManager::ColumnType (const QString & table, const QString & column)
 {
-  WriteTag ("node",nodeId, key, value);
+  QSqlQuery query (geoBase);
+  bool ok = query.exec (QString ("pragma table_info (%1)").arg (table));
+  while (ok && query.next ()) {
+    if (query.value(1).toString() == column) {
+      return query.value(2).toString().toUpper();
+    }
+  }
+  return QString ();
 }
 
-void
-DbManager::WriteWayTag (const QString & wayId, 
-                     const QString & key,
-                     const QString & value)
+bool
+DbManager::HasRowid (const QString & table)
 {
-  WriteTag ("way",wayId, key, value);
+  QSqlQuery query (geoBase);
+  query.prepare ("select sql from main.sqlite_master where name = ?");
+  query.bindValue (0, QVariant (table));
+  if (query.exec () && query.next ()) {
+    return !query.value(0).toString().toUpper().contains ("WITHOUT ROWID");
+  }
+  return false;
 }
 
-void
-DbManager::WriteRelationTag (const QString & relId,
-                     const QString & key,
-                     const QString & value)
-{
-  WriteTag ("relation", relId, key, value);
-}
+/** @brief Bring an older geobase up to SchemaVersion, one step at a
+  * time. A missing version means the original layout. Each step
+  * records its version in the transaction that commits its changes,
+  * so an interrupted or failed upgrade resumes after the last step
+  * that went through; MigrateParcelKeys must not run twice.
+  */
 
 void
-DbManager::WriteTag (const QString & type,
-                     const QString & id,
-                     const QString & key,
-                     const QString & value)
+DbManager::CheckSchemaVersion ()
 {
-  QString cmd ("insert or replace into %1tags "
-               " (%1id, key, value) "
-               " VALUES (?, ?, ?)");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd.arg (type));
-  insert.bindValue (0,QVariant(id));
-  insert.bindValue (1,QVariant(key));
-  insert.bindValue (2,QVariant(value));
-  insert.exec ();
+  int version = MetaValue ("schemaversion").toInt ();
+  if (version >= GeoBaseVersion) {
+    return;
+  }
+  bool ok (true);
+  if (ok && version < 2) {
+    ok = MigrateIntegerIds ();
+  }
+  if (ok && version < 3) {
+    ok = MigrateFixedCoords ();
+  }
+  if (ok && version < 4) {
+    ok = MigrateParcelKeys ();
+  }
+  if (ok && version < 5) {
+    ok = MigrateWayCells ();
+  }
+  if (ok && version < 6) {
+    ok = MigrateTagDictionary ();
+  }
+  if (ok && version < 7) {
+    ok = MigrateWayGeoms ();
+  }
+  if (ok && version < 8) {
+    ok = MigrateClusteredTables ();
+  }
+  if (ok && version < 9) {
+    ok = MigrateElementVersions ();
+  }
+  cache.Clear ();
+  if (!ok) {
+    qDebug () << "DbManager schema migration from version " << version
+              << " failed";
+  }
 }
 
 void
-DbManager::WriteRelationMember (const QString & relId,
-                                const QString & type,
-                                const QString & ref)
+DbManager::SetSchemaVersion (int version)
 {
-  QString cmd ("insert or replace into relationparts "
-               "  (relationid, othertype, otherid) "
-               " VALUES (?, ?, ?) ");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd);
-  insert.bindValue (0,QVariant (relId));
-  insert.bindValue (1,QVariant (type));
-  insert.bindValue (2,QVariant (ref));
-  insert.exec ();
+  SetMetaValue ("schemaversion", QString::number (version));
 }
 
+/** @brief waynodes.nodeid used to be TEXT, so node ids were
+  * compared as strings. Copy the table into the INTEGER layout.
+  */
+
 bool
-DbManager::GetNodeTag (const QString & nodeId,
-                      const QString & tagKey,
-                            QString & tagValue)
+DbManager::MigrateIntegerIds ()
 {
-  return GetTag ("way",nodeId,tagKey,tagValue);
+  if (ColumnType ("waynodes", "nodeid") == "INTEGER") {
+    SetSchemaVersion (2);
+    return true;
+  }
+  qDebug () << "DbManager migrating waynodes to integer node ids";
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok = query.exec ("alter table waynodes rename to waynodes_old");
+  if (ok) {
+    MakeElement (geoBase, "waynodes");
+    ok = query.exec ("insert into waynodes (wayid, nodeid) "
+                     " select wayid, cast (nodeid as integer) "
+                     " from waynodes_old");
+  }
+  if (ok) {
+    ok = query.exec ("drop table waynodes_old");
+  }
+  if (ok && !InBulkLoad ()) {
+    MakeElement (geoBase, "waynodeindex");
+  }
+  if (ok) {
+    SetSchemaVersion (2);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager waynodes migration failed "
+              << query.lastError().text();
+    RollbackTransaction ();
+  }
+  return ok;
 }
 
-bool
-DbManager::GetWayTag (const QString & wayId,
-                      const QString & tagKey,
-                            QString & tagValue)
+/** @brief The R*Tree tables need the rtree module in the SQLite
+  * build. When they exist but have not been filled yet, which is
+  * the case for a geobase written before they were added, fill them
+  * from nodes and waygeoms once.
+  */
+
+void
+DbManager::CheckSpatialIndex ()
 {
-  return GetTag ("way",wayId,tagKey,tagValue);
+  haveRtree = ElementType (geoBase, "noderect").toUpper () == "TABLE"
+           && ElementType (geoBase, "wayrect").toUpper () == "TABLE";
+  if (!haveRtree) {
+    qDebug () << "DbManager no R*Tree support, bbox queries scan ranges";
+    return;
+  }
+  if (MetaValue ("spatialindex") == "1") {
+    return;
+  }
+  qDebug () << "DbManager filling spatial index";
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok = query.exec ("insert or replace into noderect "
+                        " select nodeid, lat, lat, lon, lon from nodes");
+  if (ok) {
+    ok = query.exec ("insert or replace into wayrect "
+                     " select wayid, minlat, maxlat, minlon, maxlon "
+                     " from waygeoms");
+  }
+  if (ok) {
+    SetMetaValue ("spatialindex", "1");
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager spatial index fill failed "
+              << query.lastError().text();
+    RollbackTransaction ();
+    haveRtree = false;
+  }
 }
 
+/** @brief nodes and waylocs used to keep lat/lon as REAL degrees,
+  * convert them to INTEGER units of 1e-7 degree. The lat/lon indexes
+  * go away with the old nodes table and are built again afterwards.
+  */
 
 bool
-DbManager::GetTag (const QString & type,
-                   const QString & id,
-                   const QString & key,
-                         QString & value)
+DbManager::MigrateFixedCoords ()
 {
-  QString cmd ("select value from %1tags where %1id=\"%2\" "
-                " AND key=\"%3\"");
-  QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg(type).arg(id).arg(key));
-  if (ok && select.next()) {
-    value = select.value(0).toString();
+  QStringList tables;
+  if (ColumnType ("nodes", "lat") != "INTEGER") {
+    tables << "nodes";
+  }
+  if (ColumnType ("waylocs", "lat") != "INTEGER") {
+    tables << "waylocs";
+  }
+  if (tables.isEmpty ()) {
+    SetSchemaVersion (3);
     return true;
   }
-  return false;
+  qDebug () << "DbManager migrating " << tables << " to fixed point";
+  QString copy ("insert into %1 (%2, lat, lon) "
+                " select %2, "
+                " cast (round (lat * %3) as integer), "
+                " cast (round (lon * %3) as integer) "
+                " from %1_old");
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok (true);
+  for (int t=0; ok && t<tables.count(); t++) {
+    QString table = tables.at(t);
+    QString columns (table == "nodes" ? "nodeid" : "wayid, nodeid, seq");
+    ok = query.exec (QString ("alter table %1 rename to %1_old").arg (table));
+    if (ok) {
+      MakeElement (geoBase, table);
+      ok = query.exec (copy.arg (table).arg (columns)
+                           .arg (NaviCoordPerDegree, 0, 'f', 1));
+    }
+    if (ok) {
+      ok = query.exec (QString ("drop table %1_old").arg (table));
+    }
+  }
+  if (ok && tables.contains ("nodes") && !InBulkLoad ()) {
+    MakeElement (geoBase, "nodelatindex");
+    MakeElement (geoBase, "nodelonindex");
+  }
+  if (ok) {
+    SetSchemaVersion (3);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager coordinate migration failed "
+              << query.lastError().text();
+    RollbackTransaction ();
+  }
+  return ok;
 }
 
-bool
-DbManager::GetNodeTags (const QString & nodeId,
-                              QList <QPair <QString, QString> > & tagList)
-{
-  return GetTags ("node", nodeId, tagList);
-}
+/** @brief parcel ids used to be (row << 32 | col). There are far
+  * fewer distinct parcels than rows, so map each old id once and
+  * update the parcel tables from the map.
+  */
 
 bool
-DbManager::GetWayTags (const QString & wayId,
-                              QList <QPair <QString, QString> > & tagList)
+DbManager::MigrateParcelKeys ()
 {
-  return GetTags ("way", wayId, tagList);
+  qDebug () << "DbManager migrating parcel ids to Hilbert keys";
+  static const char * types[] = { "node", "way", 0 };
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok = query.exec ("create temporary table parcelmap "
+                        " (oldid INTEGER PRIMARY KEY, newid INTEGER)");
+  for (int t=0; ok && types[t]; t++) {
+    QString type (types[t]);
+    ok = query.exec (QString ("select distinct parcelid from %1parcels "
+                              " where parcelid not in "
+                              " (select oldid from parcelmap)")
+                             .arg (type));
+    QVariantList oldIds, newIds;
+    while (ok && query.next ()) {
+      quint64 oldId = query.value(0).toULongLong();
+      oldIds.append (oldId);
+      newIds.append (Parcel::FromRowMajor (oldId));
+    }
+    if (ok && !oldIds.isEmpty ()) {
+      QSqlQuery insert (geoBase);
+      ok = insert.prepare ("insert into parcelmap (oldid, newid) "
+                           " VALUES (?, ?)");
+      insert.addBindValue (oldIds);
+      insert.addBindValue (newIds);
+      ok = ok && insert.execBatch ();
+    }
+    if (ok) {
+      ok = query.exec (QString ("update %1parcels set parcelid = "
+                                " (select newid from parcelmap "
+                                "  where oldid = %1parcels.parcelid)")
+                               .arg (type));
+    }
+  }
+  if (ok) {
+    ok = query.exec ("drop table parcelmap");
+  }
+  if (ok) {
+    SetSchemaVersion (4);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager parcel id migration failed "
+              << query.lastError().text();
+    RollbackTransaction ();
+  }
+  return ok;
 }
 
-bool
-DbManager::GetRelationTags (const QString & relId,
-                              QList <QPair <QString, QString> > & tagList)
+void
+DbManager::OpenNodeStore ()
 {
-  return GetTags ("relation", relId, tagList);
+  if (MetaValue ("nodestore") != "1") {
+    return;
+  }
+  if (nodeStore.Open (NodeStore::FileName (geoBaseFile))) {
+    qDebug () << "DbManager node store has " << nodeStore.NodeCount ()
+              << " nodes";
+  }
 }
 
-bool
-DbManager::GetTags (const QString & type,
-                    const QString & id,
-                          QList <QPair<QString, QString> > & list)
+/** @brief the first node write of a session makes the store stale,
+  * for the other connections too, see OtherWriters
+  */
+
+void
+DbManager::NodesChanged ()
 {
-  QString cmd ("select key,value from %1tags where %1id=\"%2\"");
-  QSqlQuery  select (geoBase);
-  bool ok = select.exec (cmd.arg (type).arg (id));
-  if (!ok) {
-    return false;
-  }
-  list.clear ();
-  while (select.next ()) {
-    QString key = select.value(0).toString();
-    QString value = select.value(1).toString();
-    QPair <QString,QString> entry (key,value);
-    list.append (entry);
+  if (nodesChanged) {
+    return;
   }
-  return true;
+  nodesChanged = true;
+  nodeStore.Close ();
+  SetMetaValue ("nodestore", "0");
 }
 
+/** @brief Called by every Write call before it writes. The generation
+  * is bumped once per transaction, or once per write outside of one.
+  * The writes of other connections are caught up with first, so the
+  * bumped generation covers them. False when the generation could not
+  * be written, the caller then leaves its write out, since the other
+  * connections would not notice it.
+  */
+
 bool
-DbManager::GetRelationMembers (const QString & relId,
-                              const QString & type,
-                              QStringList & refList)
+DbManager::Wrote ()
 {
-  QString cmd ("select otherid from relationparts "
-               " where relationid =\"%1\""
-               " AND othertype =\"%2\"");
-  QSqlQuery select (geoBase);
-  QString realCmd = cmd.arg(relId).arg(type);
-  bool ok = select.exec (realCmd);
-  if (!ok) {
-    return false;
+  if (generationBumped) {
+    return true;
   }
-  refList.clear ();
-  while (select.next()) {
-    refList.append (select.value(0).toString());
+  GeoGeneration::BumpResult bump;
+  while ((bump = generation.Bump ()) == GeoGeneration::Bump_Behind) {
+    OtherWriters ();
+  }
+  if (bump == GeoGeneration::Bump_Failed) {
+    return false;
   }
+  generationBumped = inTransaction;
   return true;
 }
 
 void
-DbManager::WriteNodeParcel (const QString & nodeId, 
-                            quint64 parcelIndex)
+DbManager::CheckOtherWriters ()
 {
-  WriteParcel ("node",nodeId, parcelIndex);
+  if (dbRunning && generation.OthersWrote ()) {
+    OtherWriters ();
+  }
 }
 
+/** @brief Another connection has written to the geobase. The node
+  * store mapping is only kept when navimeta still says it is
+  * current, a store rebuilt by the other connection is mapped again.
+  * The cache may hold rows the other connection replaced, so it
+  * starts over. The IdFilters miss the ids the other connection
+  * added, unless it saved its own filters at this generation; until
+  * some connection does, they are not trusted to rule ids out.
+  */
+
 void
-DbManager::WriteWayParcel (const QString & wayId,
-                           quint64 parcelIndex)
+DbManager::OtherWriters ()
 {
-  WriteParcel ("way", wayId, parcelIndex);
+  nodeStore.Close ();
+  nodesChanged = false;
+  OpenNodeStore ();
+  cache.Clear ();
+  filtersTrusted = RestoreIdFilters ();
+  filtersChanged = false;
 }
 
-void
-DbManager::WriteParcel (const QString & type,
-                        const QString & id,
-                        quint64 parcelIndex)
+IdFilter &
+DbManager::Filter (const QString & type)
 {
-  QString cmd ("insert or replace into %1parcels "
-               " (%1id, parcelid) "
-               " VALUES (?, ?)");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd.arg (type));
-  insert.bindValue (0,QVariant (id));
-  insert.bindValue (1,QVariant (parcelIndex));
-  bool ok = insert.exec ();
-  qDebug () << " write parcel " << ok << insert.executedQuery();
+  if (type == "node") {
+    return nodeFilter;
+  } else if (type == "way") {
+    return wayFilter;
+  }
+  return relationFilter;
 }
 
-void
-DbManager::WriteNode (const QString & nodeId,
-                            double lat,
-                            double lon)
+/** @brief The saved filters are only used when they were saved at
+  * the current generation, so they hold every id written so far.
+  */
+
+bool
+DbManager::RestoreIdFilters ()
 {
-  QString cmd ("insert or replace into nodes "
-               " (nodeid, lat, lon) "
-               " VALUES (?, ?, ?) ");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd);
-  insert.bindValue (0, QVariant(nodeId));
-  insert.bindValue (1, QVariant(lat));
-  insert.bindValue (2, QVariant(lon));
-  bool ok = insert.exec ();
-  qDebug () << " query " << ok << insert.executedQuery ();
+  static const char * types[] = { "node", "way", "relation", 0 };
+  if (MetaValue ("idfiltersgeneration") 
+      != QString::number (generation.Value ())) {
+    return false;
+  }
+  QSqlQuery select (geoBase);
+  select.prepare ("select count, capacity, hashes, bits from idfilters "
+                  " where type = ?");
+  bool ok (true);
+  for (int t=0; ok && types[t]; t++) {
+    QString type (types[t]);
+    select.bindValue (0, QVariant (type));
+    ok = select.exec () && select.next ()
+         && Filter (type).Restore (select.value(3).toByteArray(),
+                                   select.value(0).toLongLong(),
+                                   select.value(1).toLongLong(),
+                                   select.value(2).toInt());
+  }
+  return ok;
 }
 
 void
-DbManager::WriteWayLoc (const QString & wayId,
-                        const QString & nodeId,
-                            int seq,
-                            double lat,
-                            double lon)
+DbManager::LoadIdFilters ()
 {
-  QString cmd ("insert or replace into waylocs "
-               " (wayid, nodeid, seq, lat, lon) "
-               " VALUES (?, ?, ?, ?, ?) ");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd);
-  insert.bindValue (0, QVariant(wayId));
-  insert.bindValue (1, QVariant(nodeId));
-  insert.bindValue (2, QVariant (seq));
-  insert.bindValue (3, QVariant(lat));
-  insert.bindValue (4, QVariant(lon));
-  bool ok = insert.exec ();
-  qDebug () << " query " << ok << insert.executedQuery ();
+  static const char * types[] = { "node", "way", "relation", 0 };
+  CheckOtherWriters ();
+  if (RestoreIdFilters ()) {
+    filtersTrusted = true;
+    filtersChanged = false;
+    return;
+  }
+  for (int t=0; types[t]; t++) {
+    RebuildIdFilter (types[t]);
+  }
+  filtersTrusted = true;
+  SaveIdFilters ();
 }
 
+/** @brief sized for twice the ids there are now, so the filter has
+  * room to grow before it is overfull
+  */
+
 void
-DbManager::WriteWay (const QString & wayId)
+DbManager::RebuildIdFilter (const QString & type)
 {
-  QString cmd ("insert or replace into ways "
-               " (wayid) "
-               " VALUES (?) ");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd);
-  insert.bindValue (0, QVariant(wayId));
-  bool ok = insert.exec ();
-  qDebug () << " query " << ok << insert.executedQuery ();
+  QTime clock;
+  clock.start ();
+  IdFilter & filter = Filter (type);
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  qint64 count (0);
+  if (query.exec (QString ("select count(*) from %1s").arg (type))
+      && query.next ()) {
+    count = query.value(0).toLongLong();
+  }
+  filter.Reset (2 * count);
+  if (query.exec (QString ("select %1id from %1s").arg (type))) {
+    while (query.next ()) {
+      filter.Add (query.value(0).toLongLong());
+    }
+  }
+  qDebug () << "DbManager rebuilt " << type << " id filter with "
+            << filter.Count () << " ids in " << clock.elapsed ()
+            << " msecs";
 }
 
+/** @brief Filters that missed another connection's ids are not
+  * saved, the stored ones stay stale and are rebuilt on the next
+  * LoadIdFilters.
+  */
+
 void
-DbManager::WriteRelation (const QString & relId)
+DbManager::SaveIdFilters ()
 {
-  QString cmd ("insert or replace into relations "
-               " (relationid) "
-               " VALUES (?) ");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd);
-  insert.bindValue (0, QVariant(relId));
-  bool ok = insert.exec ();
-  qDebug () << " query " << ok << insert.executedQuery ();
+  static const char * types[] = { "node", "way", "relation", 0 };
+  CheckOtherWriters ();
+  if (!filtersTrusted) {
+    qDebug () << "DbManager id filters missed other writers, not saved";
+    return;
+  }
+  bool transaction = !inTransaction;
+  if (transaction) {
+    StartTransaction ();
+  }
+  QSqlQuery & insert = Statement ("insert or replace into idfilters "
+                          " (type, count, capacity, hashes, bits) "
+                          " VALUES (?, ?, ?, ?, ?)");
+  for (int t=0; types[t]; t++) {
+    QString type (types[t]);
+    if (Filter (type).Overfull ()) {
+      RebuildIdFilter (type);
+    }
+    const IdFilter & filter = Filter (type);
+    insert.bindValue (0, QVariant (type));
+    insert.bindValue (1, QVariant (filter.Count ()));
+    insert.bindValue (2, QVariant (filter.Capacity ()));
+    insert.bindValue (3, QVariant (filter.Hashes ()));
+    insert.bindValue (4, QVariant (filter.Bits ()));
+    Exec (insert);
+  }
+  SetMetaValue ("idfiltersgeneration", 
+                QString::number (generation.Value ()));
+  if (transaction) {
+    CommitTransaction ();
+  }
+  filtersChanged = false;
 }
 
+/** @brief the write has bumped the generation, which already makes
+  * the saved filters stale
+  */
+
 void
-DbManager::WriteWayNode (const QString & wayId,
-                         const QString & nodeId)
+DbManager::FiltersChanged ()
 {
-  QString cmd ("insert or replace into waynodes "
-               " (wayid, nodeid) "
-               " VALUES (?, ?) ");
-  QSqlQuery insert (geoBase);
-  insert.prepare (cmd);
-  insert.bindValue (0, QVariant (wayId));
-  insert.bindValue (1, QVariant (nodeId));
-  bool ok = insert.exec ();
-  qDebug () << " query " << ok << insert.executedQuery ();
+  filtersChanged = true;
 }
 
-bool
-DbManager::GetNode (const QString & nodeId,
-                    double & lat,
-                    double & lon)
-{
-  QString cmd ("select lat, lon from nodes where nodeid =\"%1\"");
-  QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg (nodeId));
-  if (ok && select.next()) {
-    lat = select.value (0).toDouble();
-    lon = select.value (1).toDouble();
-  }
-  return ok;
-}
+/** @brief false only when the id was never written */
 
 bool
-DbManager::HaveWay (const QString & wayId)
+DbManager::MayHave (const QString & type, NaviId id)
 {
-  QString cmd ("select count(wayid) from ways where wayid = \"%1\"");
-  QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg (wayId));
-  if (ok) {
-    int count = select.value(0).toInt();
-    return count > 0;
-  }
-  return false;
+  return !filtersTrusted || Filter (type).MayContain (id);
 }
 
+/** @brief OSM versions for nodes, ways and relations, so a download
+  * that brings the same version again can be skipped
+  */
+
 bool
-DbManager::HaveRelation (const QString & relId)
+DbManager::MigrateElementVersions ()
 {
-  QString cmd ("select count(relationid) from relations "
-              " where relationid = \"%1\"");
-  QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg (relId));
+  static const char * tables[] = { "nodes", "ways", "relations", 0 };
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok (true);
+  for (int t=0; ok && tables[t]; t++) {
+    QString table (tables[t]);
+    if (!ColumnType (table, "version").isEmpty ()) {
+      continue;
+    }
+    qDebug () << "DbManager adding versions to " << table;
+    ok = query.exec (QString ("alter table %1 add column "
+                              " version INTEGER NOT NULL DEFAULT 0")
+                             .arg (table));
+  }
   if (ok) {
-    int count = select.value(0).toInt();
-    return count > 0;
+    SetSchemaVersion (9);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager version migration failed "
+              << query.lastError().text();
+    RollbackTransaction ();
   }
-  return false;
+  return ok;
 }
 
 bool
-DbManager::GetWayNodes (const QString & wayId,
-                        QStringList & nodeIdList)
+DbManager::BuildNodeStore ()
 {
-  QString cmd ("select nodeid from waynodes where wayid = \"%1\"");
-  QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg (wayId));
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  bool ok = query.exec ("select max(nodeid) from nodes");
+  NaviId maxId (-1);
+  if (ok && query.next ()) {
+    maxId = query.value(0).toLongLong();
+  }
+  nodeStore.Close ();
+  NodeStoreWriter writer;
+  QString storeName (NodeStore::FileName (geoBaseFile));
+  ok = ok && writer.Start (storeName, maxId);
+  ok = ok && query.exec ("select nodeid, lat, lon from nodes "
+                         " where nodeid >= 0 order by nodeid");
+  while (ok && query.next ()) {
+    ok = writer.Add (query.value(0).toLongLong(), 
+                     query.value(1).toInt(),
+                     query.value(2).toInt());
+  }
+  ok = ok && writer.Finish ();
   if (!ok) {
+    qDebug () << "DbManager node store build failed " << writer.ErrorString ()
+              << query.lastError().text();
     return false;
   }
-  nodeIdList.clear ();
-  while (select.next()) {
-    QString nodeId (select.value(0).toString());
-    nodeIdList.append (nodeId);
+  SetMetaValue ("nodestore", "1");
+  if (!Wrote ()) {
+    return false;
   }
-  return true;
+  nodesChanged = false;
+  return nodeStore.Open (storeName);
 }
 
 bool
-DbManager::GetNodes (quint64 parcelIndex,
-                    QStringList & nodeIdList)
+DbManager::ExportPack (const QString & filename)
 {
-  return GetItems (parcelIndex,"node",nodeIdList);
+  NaviPackWriter writer;
+  return writer.Write (geoBase, filename);
 }
 
-bool
-DbManager::GetWays (quint64 parcelIndex,
-                    QStringList & wayIdList)
-{
-  return GetItems (parcelIndex,"way",wayIdList);
-}
+/** @brief The tag tables used to hold key and value text. Fill the
+  * dictionaries from them and copy them into the coded layout.
+  */
 
 bool
-DbManager::GetItems (quint64 parcelIndex,
-                    const QString & type,
-                    QStringList & idList)
+DbManager::MigrateTagDictionary ()
 {
-  QString cmd ("select %1id from %1parcels where parcelid=%2");
-  QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg(type).arg (parcelIndex));
-  if (!ok) {
-    return false;
+  static const char * types[] = { "node", "way", "relation", 0 };
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok (true);
+  for (int t=0; ok && types[t]; t++) {
+    QString type (types[t]);
+    if (ColumnType (type + "tags", "key").isEmpty ()) {
+      continue;
+    }
+    qDebug () << "DbManager migrating " << type << "tags to tag codes";
+    ok = query.exec (QString ("alter table %1tags rename to %1tags_old")
+                             .arg (type));
+    if (ok) {
+      MakeElement (geoBase, type + "tags");
+      ok = query.exec (QString ("insert or ignore into tagkeys (key) "
+                                " select distinct key from %1tags_old")
+                               .arg (type));
+    }
+    if (ok) {
+      ok = query.exec (QString ("insert or ignore into tagvalues (value) "
+                                " select distinct value from %1tags_old")
+                               .arg (type));
+    }
+    if (ok) {
+      ok = query.exec (QString ("insert into %1tags (%1id, keyid, valueid) "
+                  " select o.%1id, k.keyid, v.valueid from %1tags_old o "
+                  " join tagkeys k on k.key = o.key "
+                  " join tagvalues v on v.value = o.value")
+                  .arg (type));
+    }
+    if (ok) {
+      ok = query.exec (QString ("drop table %1tags_old").arg (type));
+    }
+    if (ok && !InBulkLoad ()) {
+      MakeElement (geoBase, type + "tagvalueindex");
+    }
   }
-  idList.clear ();
-  while (select.next()) {
-    idList.append (select.value(0).toString());
+  if (ok) {
+    SetSchemaVersion (6);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager tag migration failed "
+              << query.lastError().text();
+    RollbackTransaction ();
   }
-  return true;
+  ClearDictionaries ();
+  return ok;
 }
 
-void
-DbManager::GetByTag (QStringList & idList,
-                     const QString & tagKey,
+/** @brief Tag tables and relationparts become WITHOUT ROWID tables
+  * clustered on their key, so all tags of an element or all members
+  * of a relation are one range of the primary key. relationparts
+  * used to have relationid as INTEGER PRIMARY KEY, which kept one
+  * member per relation; whatever is there gets seq in rowid order.
+  */
+
+bool
+DbManager::MigrateClusteredTables ()
+{
+  static const char * tables[] = { "nodetags", "waytags", "relationtags", 
+                                   "relationparts", 0 };
+  static const char * indexes[] = { "nodetagvalueindex", "waytagvalueindex",
+                                    "relationtagvalueindex", 
+                                    "relationmemberindex", 0 };
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok (true);
+  for (int t=0; ok && tables[t]; t++) {
+    QString table (tables[t]);
+    if (!HasRowid (table)) {
+      continue;
+    }
+    qDebug () << "DbManager clustering " << table;
+    ok = query.exec (QString ("alter table %1 rename to %1_old").arg (table));
+    if (ok) {
+      MakeElement (geoBase, table);
+      if (table == "relationparts") {
+        ok = query.exec ("insert into relationparts "
+                 " (relationid, seq, othertype, otherid) "
+                 " select o.relationid, "
+                 "  (select count(*) from relationparts_old p "
+                 "    where p.relationid = o.relationid "
+                 "    AND p.rowid < o.rowid), "
+                 "  o.othertype, o.otherid from relationparts_old o");
+      } else {
+        QString type (table);
+        type.chop (4);
+        ok = query.exec (QString ("insert into %1tags (%1id, keyid, valueid) "
+                                  " select %1id, keyid, valueid "
+                                  " from %1tags_old").arg (type));
+      }
+    }
+    if (ok) {
+      ok = query.exec (QString ("drop table %1_old").arg (table));
+    }
+    if (ok && !InBulkLoad ()) {
+      MakeElement (geoBase, indexes[t]);
+    }
+  }
+  if (ok) {
+    SetSchemaVersion (8);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager clustered table migration failed "
+              << query.lastError().text();
+    RollbackTransaction ();
+  }
+  return ok;
+}
+
+qint64
+DbManager::DictionaryCode (TagDictionary & dict, const QString & text,
+                           bool create)
+{
+  QHash <QString, qint64>::const_iterator found = dict.codes.find (text);
+  if (found != dict.codes.end ()) {
+    return *found;
+  }
+  QString cmd ("select %1 from %2 where %3 = ?");
+  QSqlQuery & select = Statement (cmd.arg (dict.idColumn)
+                                     .arg (dict.table)
+                                     .arg (dict.textColumn));
+  select.bindValue (0, QVariant (text));
+  qint64 code (-1);
+  if (Exec (select) && select.next ()) {
+    code = select.value(0).toLongLong();
+  } else if (create) {
+    QString ins ("insert into %1 (%2) VALUES (?)");
+    QSqlQuery & insert = Statement (ins.arg (dict.table)
+                                       .arg (dict.textColumn));
+    insert.bindValue (0, QVariant (text));
+    if (Exec (insert)) {
+      code = insert.lastInsertId().toLongLong();
+    }
+  }
+  select.finish ();
+  if (code >= 0) {
+    dict.codes[text] = code;
+    dict.names[code] = text;
+  }
+  return code;
+}
+
+QString
+DbManager::DictionaryText (TagDictionary & dict, qint64 code)
+{
+  QHash <qint64, QString>::const_iterator found = dict.names.find (code);
+  if (found != dict.names.end ()) {
+    return *found;
+  }
+  QString cmd ("select %1 from %2 where %3 = ?");
+  QSqlQuery & select = Statement (cmd.arg (dict.textColumn)
+                                     .arg (dict.table)
+                                     .arg (dict.idColumn));
+  select.bindValue (0, QVariant (code));
+  QString text;
+  if (Exec (select) && select.next ()) {
+    text = select.value(0).toString();
+    dict.codes[text] = code;
+    dict.names[code] = text;
+  }
+  select.finish ();
+  return text;
+}
+
+/** @brief the dictionaries are also dropped when they get large, 
+  * the values one mostly holds names that are seldom seen twice
+  */
+
+void
+DbManager::ClearDictionaries ()
+{
+  tagKeys.codes.clear ();
+  tagKeys.names.clear ();
+  tagValues.codes.clear ();
+  tagValues.names.clear ();
+}
+
+/** @brief Encode the rows of waylocs into waygeoms, a few thousand
+  * ways at a time, then empty waylocs.
+  */
+
+bool
+DbManager::MigrateWayGeoms ()
+{
+  qDebug () << "DbManager moving waylocs into waygeoms";
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  bool ok = query.exec ("select wayid, nodeid, seq, lat, lon from waylocs "
+                        " order by wayid, seq");
+  QMap <NaviId, WayTurnList> ways;
+  while (ok && query.next ()) {
+    NaviId wayId = query.value(0).toLongLong();
+    if (ways.count () >= 5000 && !ways.contains (wayId)) {
+      WriteWayGeoms (ways);
+      ways.clear ();
+    }
+    WayTurn turn (wayId, query.value(1).toLongLong(), 
+                  query.value(2).toInt(), 0.0, 0.0);
+    turn.SetCoords (query.value(3).toInt(), query.value(4).toInt());
+    ways[wayId].append (turn);
+  }
+  WriteWayGeoms (ways);
+  if (ok) {
+    ok = query.exec ("delete from waylocs");
+  }
+  if (ok) {
+    SetSchemaVersion (7);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager waygeoms migration failed "
+              << query.lastError().text();
+    RollbackTransaction ();
+  }
+  return ok;
+}
+
+/** @brief fill waycells from the way boxes in waylocs */
+
+bool
+DbManager::MigrateWayCells ()
+{
+  qDebug () << "DbManager filling waycells";
+  StartTransaction ();
+  QSqlQuery query (geoBase);
+  bool ok = query.exec ("select wayid, min(lat), max(lat), min(lon), max(lon) "
+                        " from waylocs group by wayid");
+  QMap <NaviId, NaviBox> boxes;
+  while (ok && query.next ()) {
+    boxes[query.value(0).toLongLong()] = NaviBox (query.value(1).toInt(),
+                                                  query.value(3).toInt(),
+                                                  query.value(2).toInt(),
+                                                  query.value(4).toInt());
+  }
+  if (ok) {
+    WriteWayBoxes (boxes);
+    SetSchemaVersion (5);
+    CommitTransaction ();
+  } else {
+    qDebug () << "DbManager waycells fill failed "
+              << query.lastError().text();
+    RollbackTransaction ();
+  }
+  return ok;
+}
+
+void
+DbManager::WriteNodeTag (NaviId nodeId, 
+                     const QString & key,
+                     const QString & value)
+{
+  WriteTag ("node",nodeId, key, value);
+}
+
+void
+DbManager::WriteWayTag (NaviId wayId, 
+                     const QString & key,
+                     const QString & value)
+{
+  WriteTag ("way",wayId, key, value);
+}
+
+void
+DbManager::WriteRelationTag (NaviId relId,
+                     const QString & key,
+                     const QString & value)
+{
+  WriteTag ("relation", relId, key, value);
+}
+
+void
+DbManager::WriteTag (const QString & type,
+                     NaviId id,
+                     const QString & key,
+                     const QString & value)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  qint64 keyId = DictionaryCode (tagKeys, key, true);
+  qint64 valueId = DictionaryCode (tagValues, value, true);
+  QString cmd ("insert or replace into %1tags "
+               " (%1id, keyid, valueid) "
+               " VALUES (?, ?, ?)");
+  QSqlQuery & insert = Statement (cmd.arg (type));
+  insert.bindValue (0,QVariant(id));
+  insert.bindValue (1,QVariant(keyId));
+  insert.bindValue (2,QVariant(valueId));
+  Exec (insert);
+  cache.ForgetTags (type, id);
+}
+
+void
+DbManager::WriteRelationMember (NaviId relId,
+                                int seq,
+                                const QString & type,
+                                NaviId ref)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QString cmd ("insert or replace into relationparts "
+               "  (relationid, seq, othertype, otherid) "
+               " VALUES (?, ?, ?, ?) ");
+  QSqlQuery & insert = Statement (cmd);
+  insert.bindValue (0,QVariant (relId));
+  insert.bindValue (1,QVariant (seq));
+  insert.bindValue (2,QVariant (type));
+  insert.bindValue (3,QVariant (ref));
+  Exec (insert);
+  cache.ForgetMembers (relId);
+}
+
+bool
+DbManager::GetNodeTag (NaviId nodeId,
+                      const QString & tagKey,
+                            QString & tagValue)
+{
+  return GetTag ("way",nodeId,tagKey,tagValue);
+}
+
+bool
+DbManager::GetWayTag (NaviId wayId,
+                      const QString & tagKey,
+                            QString & tagValue)
+{
+  return GetTag ("way",wayId,tagKey,tagValue);
+}
+
+
+bool
+DbManager::GetTag (const QString & type,
+                   NaviId id,
+                   const QString & key,
+                         QString & value)
+{
+  qint64 keyId = DictionaryCode (tagKeys, key, false);
+  if (keyId < 0) {
+    return false;
+  }
+  QString cmd ("select valueid from %1tags where %1id=? AND keyid=?");
+  QSqlQuery & select = Statement (cmd.arg (type));
+  select.bindValue (0, QVariant (id));
+  select.bindValue (1, QVariant (keyId));
+  bool ok = Exec (select) && select.next ();
+  qint64 valueId = ok ? select.value(0).toLongLong() : -1;
+  select.finish ();
+  if (ok) {
+    value = DictionaryText (tagValues, valueId);
+  }
+  return ok;
+}
+
+bool
+DbManager::GetNodeTags (NaviId nodeId,
+                              QList <QPair <QString, QString> > & tagList)
+{
+  return GetTags ("node", nodeId, tagList);
+}
+
+bool
+DbManager::GetWayTags (NaviId wayId,
+                              QList <QPair <QString, QString> > & tagList)
+{
+  return GetTags ("way", wayId, tagList);
+}
+
+bool
+DbManager::GetRelationTags (NaviId relId,
+                              QList <QPair <QString, QString> > & tagList)
+{
+  return GetTags ("relation", relId, tagList);
+}
+
+bool
+DbManager::GetTags (const QString & type,
+                    NaviId id,
+                          QList <QPair<QString, QString> > & list)
+{
+  CheckOtherWriters ();
+  if (cache.Tags (type, id, list)) {
+    return true;
+  }
+  QString cmd ("select keyid,valueid from %1tags where %1id=? "
+               " order by keyid");
+  QSqlQuery  select (geoBase);
+  select.prepare (cmd.arg (type));
+  select.bindValue (0, QVariant (id));
+  bool ok = select.exec ();
+  if (!ok) {
+    return false;
+  }
+  list.clear ();
+  while (select.next ()) {
+    QString key = DictionaryText (tagKeys, select.value(0).toLongLong());
+    QString value = DictionaryText (tagValues, 
+                                    select.value(1).toLongLong());
+    QPair <QString,QString> entry (key,value);
+    list.append (entry);
+  }
+  cache.PutTags (type, id, list);
+  return true;
+}
+
+bool
+DbManager::GetRelationMembers (NaviId relId,
+                              const QString & type,
+                              NaviIdList & refList)
+{
+  CheckOtherWriters ();
+  if (cache.Members (relId, type, refList)) {
+    return true;
+  }
+  QString cmd ("select otherid from relationparts "
+               " where relationid = ? AND othertype = ? order by seq");
+  QSqlQuery select (geoBase);
+  select.prepare (cmd);
+  select.bindValue (0, QVariant (relId));
+  select.bindValue (1, QVariant (type));
+  bool ok = select.exec ();
+  if (!ok) {
+    return false;
+  }
+  refList.clear ();
+  while (select.next()) {
+    refList.append (select.value(0).toLongLong());
+  }
+  cache.PutMembers (relId, type, refList);
+  return true;
+}
+
+void
+DbManager::WriteNodeParcel (NaviId nodeId, 
+                            quint64 parcelIndex)
+{
+  WriteParcel ("node",nodeId, parcelIndex);
+}
+
+void
+DbManager::WriteWayParcel (NaviId wayId,
+                           quint64 parcelIndex)
+{
+  WriteParcel ("way", wayId, parcelIndex);
+}
+
+void
+DbManager::WriteParcel (const QString & type,
+                        NaviId id,
+                        quint64 parcelIndex)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QString cmd ("insert or replace into %1parcels "
+               " (%1id, parcelid) "
+               " VALUES (?, ?)");
+  QSqlQuery & insert = Statement (cmd.arg (type));
+  insert.bindValue (0,QVariant (id));
+  insert.bindValue (1,QVariant (parcelIndex));
+  Exec (insert);
+}
+
+void
+DbManager::WriteNode (NaviId nodeId,
+                            double lat,
+                            double lon,
+                            int version)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QString cmd ("insert or replace into nodes "
+               " (nodeid, lat, lon, version) "
+               " VALUES (?, ?, ?, ?) ");
+  QSqlQuery & insert = Statement (cmd);
+  insert.bindValue (0, QVariant(nodeId));
+  insert.bindValue (1, QVariant(CoordFromDegrees (lat)));
+  insert.bindValue (2, QVariant(CoordFromDegrees (lon)));
+  insert.bindValue (3, QVariant(version));
+  Exec (insert);
+  NodesChanged ();
+  FiltersChanged ();
+  nodeFilter.Add (nodeId);
+  cache.ForgetNode (nodeId);
+  if (haveRtree) {
+    QSqlQuery & rect = Statement ("insert or replace into noderect "
+                           " (nodeid, minlat, maxlat, minlon, maxlon) "
+                           " VALUES (?, ?, ?, ?, ?)");
+    rect.bindValue (0, QVariant (nodeId));
+    rect.bindValue (1, QVariant (CoordFromDegrees (lat)));
+    rect.bindValue (2, QVariant (CoordFromDegrees (lat)));
+    rect.bindValue (3, QVariant (CoordFromDegrees (lon)));
+    rect.bindValue (4, QVariant (CoordFromDegrees (lon)));
+    Exec (rect);
+  }
+}
+
+void
+DbManager::WriteWay (NaviId wayId, int version)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QString cmd ("insert or replace into ways "
+               " (wayid, version) "
+               " VALUES (?, ?) ");
+  QSqlQuery & insert = Statement (cmd);
+  insert.bindValue (0, QVariant(wayId));
+  insert.bindValue (1, QVariant(version));
+  Exec (insert);
+  FiltersChanged ();
+  wayFilter.Add (wayId);
+}
+
+void
+DbManager::WriteRelation (NaviId relId, int version)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QString cmd ("insert or replace into relations "
+               " (relationid, version) "
+               " VALUES (?, ?) ");
+  QSqlQuery & insert = Statement (cmd);
+  insert.bindValue (0, QVariant(relId));
+  insert.bindValue (1, QVariant(version));
+  Exec (insert);
+  FiltersChanged ();
+  relationFilter.Add (relId);
+}
+
+void
+DbManager::WriteWayNode (NaviId wayId,
+                         NaviId nodeId)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QString cmd ("insert or replace into waynodes "
+               " (wayid, nodeid) "
+               " VALUES (?, ?) ");
+  QSqlQuery & insert = Statement (cmd);
+  insert.bindValue (0, QVariant (wayId));
+  insert.bindValue (1, QVariant (nodeId));
+  Exec (insert);
+  cache.ForgetWayNodes (wayId);
+}
+
+bool
+DbManager::GetNode (NaviId nodeId,
+                    double & lat,
+                    double & lon)
+{
+  NaviCoord latCoord, lonCoord;
+  if (GetNode (nodeId, latCoord, lonCoord)) {
+    lat = DegreesFromCoord (latCoord);
+    lon = DegreesFromCoord (lonCoord);
+    return true;
+  }
+  return false;
+}
+
+bool
+DbManager::GetNode (NaviId nodeId,
+                    NaviCoord & lat,
+                    NaviCoord & lon)
+{
+  CheckOtherWriters ();
+  if (nodeStore.Get (nodeId, lat, lon)) {
+    return true;
+  }
+  if (cache.Node (nodeId, lat, lon)) {
+    return true;
+  }
+  QSqlQuery & select = Statement ("select lat, lon from nodes "
+                                  " where nodeid = ?");
+  select.bindValue (0, QVariant (nodeId));
+  bool ok = Exec (select);
+  if (ok && select.next()) {
+    lat = select.value (0).toInt();
+    lon = select.value (1).toInt();
+    cache.PutNode (nodeId, lat, lon);
+    return true;
+  }
+  return false;
+}
+
+bool
+DbManager::HaveNode (NaviId nodeId)
+{
+  return ElementVersion ("node", nodeId) >= 0;
+}
+
+bool
+DbManager::HaveWay (NaviId wayId)
+{
+  return ElementVersion ("way", wayId) >= 0;
+}
+
+bool
+DbManager::HaveRelation (NaviId relId)
+{
+  return ElementVersion ("relation", relId) >= 0;
+}
+
+int
+DbManager::ElementVersion (const QString & type, NaviId id)
+{
+  CheckOtherWriters ();
+  if (!MayHave (type, id)) {
+    return -1;
+  }
+  QString cmd ("select version from %1s where %1id = ?");
+  QSqlQuery & select = Statement (cmd.arg (type));
+  select.bindValue (0, QVariant (id));
+  int version (-1);
+  if (Exec (select) && select.next ()) {
+    version = select.value(0).toInt();
+  }
+  select.finish ();
+  return version;
+}
+
+bool
+DbManager::GetWayNodes (NaviId wayId,
+                        NaviIdList & nodeIdList)
+{
+  CheckOtherWriters ();
+  if (cache.WayNodes (wayId, nodeIdList)) {
+    return true;
+  }
+  QString cmd ("select nodeid from waynodes where wayid = ? "
+               " order by rowid");
+  QSqlQuery select (geoBase);
+  select.prepare (cmd);
+  select.bindValue (0, QVariant (wayId));
+  bool ok = select.exec ();
+  if (!ok) {
+    return false;
+  }
+  nodeIdList.clear ();
+  while (select.next()) {
+    nodeIdList.append (select.value(0).toLongLong());
+  }
+  cache.PutWayNodes (wayId, nodeIdList);
+  return true;
+}
+
+/** @brief one row read, decode with WayGeometryReader */
+
+bool
+DbManager::GetWayGeometry (NaviId wayId, QByteArray & geom)
+{
+  QSqlQuery & select = Statement ("select geom from waygeoms "
+                                  " where wayid = ?");
+  select.bindValue (0, QVariant (wayId));
+  bool ok = Exec (select) && select.next ();
+  if (ok) {
+    geom = select.value(0).toByteArray();
+  }
+  select.finish ();
+  return ok;
+}
+
+bool
+DbManager::GetNodes (quint64 parcelIndex,
+                    NaviIdList & nodeIdList)
+{
+  return GetItems (ParcelRange (parcelIndex, parcelIndex),"node",nodeIdList);
+}
+
+bool
+DbManager::GetWays (quint64 parcelIndex,
+                    NaviIdList & wayIdList)
+{
+  return GetItems (ParcelRange (parcelIndex, parcelIndex),"way",wayIdList);
+}
+
+bool
+DbManager::GetParcelCounts (const QString & type,
+                            QList <quint64> & parcels,
+                            QList <int> & counts)
+{
+  parcels.clear ();
+  counts.clear ();
+  QSqlQuery select (geoBase);
+  select.setForwardOnly (true);
+  bool ok = select.exec (QString ("select parcelid, count(*) "
+                                  " from %1parcels group by parcelid "
+                                  " order by parcelid").arg (type));
+  while (ok && select.next ()) {
+    parcels.append (quint64 (select.value(0).toLongLong()));
+    counts.append (select.value(1).toInt());
+  }
+  if (!ok) {
+    qDebug () << "DbManager parcel counts failed "
+              << select.lastError().text();
+  }
+  return ok;
+}
+
+bool
+DbManager::GetNodes (const ParcelRange & parcels,
+                     NaviIdList & nodeIdList)
+{
+  return GetItems (parcels, "node", nodeIdList);
+}
+
+bool
+DbManager::GetWays (const ParcelRange & parcels,
+                    NaviIdList & wayIdList)
+{
+  return GetItems (parcels, "way", wayIdList);
+}
+
+bool
+DbManager::GetNodesInBox (NaviIdList & nodeIdList,
+                          double south, double west,
+                          double north, double east,
+                          int maxLevel)
+{
+  NaviBox box (CoordFromDegrees (south), CoordFromDegrees (west),
+               CoordFromDegrees (north), CoordFromDegrees (east));
+  ParcelRangeList ranges = Parcel::BoxRanges (box, maxLevel);
+  nodeIdList.clear ();
+  for (int r=0; r<ranges.count(); r++) {
+    NaviIdList some;
+    if (!GetItems (ranges.at(r), "node", some)) {
+      return false;
+    }
+    nodeIdList += some;
+  }
+  return true;
+}
+
+/** @brief A way stored at level L is found by the level L cells of
+  * the box, so every level gets its own, coarser, set of runs.
+  */
+
+bool
+DbManager::GetWaysInBox (NaviIdList & wayIdList,
+                         double south, double west,
+                         double north, double east,
+                         int maxLevel)
+{
+  NaviBox box (CoordFromDegrees (south), CoordFromDegrees (west),
+               CoordFromDegrees (north), CoordFromDegrees (east));
+  ParcelRangeList ranges = Parcel::BoxRanges (box, maxLevel);
+  wayIdList.clear ();
+  QSqlQuery & select = Statement ("select wayid from waycells where "
+                                  " level = ? AND "
+                                  " cellid >= ? AND cellid <= ?");
+  for (int level=0; level<=Parcel::Levels; level++) {
+    ParcelRangeList cells = Parcel::AtLevel (ranges, level);
+    for (int c=0; c<cells.count(); c++) {
+      select.bindValue (0, QVariant (level));
+      select.bindValue (1, QVariant (qint64 (cells.at(c).first)));
+      select.bindValue (2, QVariant (qint64 (cells.at(c).second)));
+      if (!Exec (select)) {
+        return false;
+      }
+      while (select.next ()) {
+        wayIdList.append (select.value(0).toLongLong());
+      }
+    }
+  }
+  return true;
+}
+
+/** @brief one scan of the parcel index over a run of parcel keys */
+
+bool
+DbManager::GetItems (const ParcelRange & parcels,
+                    const QString & type,
+                    NaviIdList & idList)
+{
+  QString cmd ("select %1id from %1parcels "
+               " where parcelid >= ? AND parcelid <= ?");
+  QSqlQuery & select = Statement (cmd.arg (type));
+  select.bindValue (0, QVariant (qint64 (parcels.first)));
+  select.bindValue (1, QVariant (qint64 (parcels.second)));
+  bool ok = Exec (select);
+  if (!ok) {
+    return false;
+  }
+  idList.clear ();
+  while (select.next()) {
+    idList.append (select.value(0).toLongLong());
+  }
+  return true;
+}
+
+void
+DbManager::GetByTag (NaviIdList & idList,
+                     const QString & tagKey,
                      const QString & tagValue,
                      const QString & type,
                            bool regularExp)
 {
   idList.clear();
-  QString cmd ("select %1id from %1tags where key=\"%2\" "
-                  "and value %3 \"%4\"");
+  qint64 keyId = DictionaryCode (tagKeys, tagKey, false);
+  if (keyId < 0) {
+    return;
+  }
   QSqlQuery select (geoBase);
-  QString compareOp (regularExp ? " GLOB " : "=");
-  QString realCmd  = cmd .arg (type)
-                             .arg (tagKey)
-                             .arg (compareOp)
-                             .arg (tagValue) ;
-  bool ok = select.exec (realCmd);
+  if (regularExp) {
+    QString cmd ("select %1id from %1tags where keyid = ? "
+                 " AND valueid in "
+                 " (select valueid from tagvalues where value GLOB ?)");
+    select.prepare (cmd.arg (type));
+    select.bindValue (0, QVariant (keyId));
+    select.bindValue (1, QVariant (tagValue));
+  } else {
+    qint64 valueId = DictionaryCode (tagValues, tagValue, false);
+    if (valueId < 0) {
+      return;
+    }
+    QString cmd ("select %1id from %1tags where keyid = ? AND valueid = ?");
+    select.prepare (cmd.arg (type));
+    select.bindValue (0, QVariant (keyId));
+    select.bindValue (1, QVariant (valueId));
+  }
+  bool ok = select.exec ();
 qDebug () << "GetByTag query " << ok << select.executedQuery();
-  qDebug () << " query cmd was " << realCmd;
   qDebug () << "      last error " << select.lastError().text();
   if (ok) {
     while (select.next()) {
-      idList.append (select.value(0).toString());
+      idList.append (select.value(0).toLongLong());
     } 
   }
 }
 
 void
-DbManager::GetNodesByLatLon (QStringList & nodeList,
+DbManager::GetNodesByLatLon (NaviIdList & nodeList,
                             double south, double west,
                             double north, double east)
 {
   nodeList.clear ();
   QString cmd ("select nodeid from nodes where "
-               " lat >= %1 AND lat <= %2 "
+               " lat >= ? AND lat <= ? "
                " AND "
-               " lon >= %3 AND lon <= %4 ");
+               " lon >= ? AND lon <= ? ");
+  if (haveRtree) {
+    cmd = "select nodeid from noderect where "
+          " minlat >= ? AND maxlat <= ? "
+          " AND "
+          " minlon >= ? AND maxlon <= ? ";
+  }
   QSqlQuery select (geoBase);
-  QString realCmd = cmd.arg (south) . arg (north)
-                       .arg (west) . arg (east);
-  bool ok = select.exec (realCmd);
+  select.prepare (cmd);
+  select.bindValue (0, QVariant (CoordFromDegrees (south)));
+  select.bindValue (1, QVariant (CoordFromDegrees (north)));
+  select.bindValue (2, QVariant (CoordFromDegrees (west)));
+  select.bindValue (3, QVariant (CoordFromDegrees (east)));
+  bool ok = select.exec ();
   if (!ok) {
     return;
   }
   while (select.next ()) {
-    nodeList.append (select.value (0).toString());
+    nodeList.append (select.value (0).toLongLong());
   }
   return;
 }
 
+/** @brief ways whose bounding box overlaps the range; without the
+  * R*Tree this scans the boxes in waygeoms
+  */
+
 void
-DbManager::GetWaysByNode (QStringList & wayList,
-                          const QString & nodeId)
+DbManager::GetWaysByLatLon (NaviIdList & wayList,
+                            double south, double west,
+                            double north, double east)
 {
   wayList.clear ();
-  QString cmd ("select wayid from waynodes where nodeid=\"%1\"");
+  QString cmd ("select wayid from waygeoms where "
+               " maxlat >= ? AND minlat <= ? "
+               " AND "
+               " maxlon >= ? AND minlon <= ? ");
+  if (haveRtree) {
+    cmd = "select wayid from wayrect where "
+          " maxlat >= ? AND minlat <= ? "
+          " AND "
+          " maxlon >= ? AND minlon <= ? ";
+  }
   QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg(nodeId));
+  select.prepare (cmd);
+  select.bindValue (0, QVariant (CoordFromDegrees (south)));
+  select.bindValue (1, QVariant (CoordFromDegrees (north)));
+  select.bindValue (2, QVariant (CoordFromDegrees (west)));
+  select.bindValue (3, QVariant (CoordFromDegrees (east)));
+  bool ok = select.exec ();
+  if (!ok) {
+    return;
+  }
+  while (select.next ()) {
+    wayList.append (select.value (0).toLongLong());
+  }
+}
+
+void
+DbManager::GetWaysByNode (NaviIdList & wayList,
+                          NaviId nodeId)
+{
+  wayList.clear ();
+  QSqlQuery & select = Statement ("select wayid from waynodes "
+                                  " where nodeid = ?");
+  select.bindValue (0, QVariant (nodeId));
+  bool ok = Exec (select);
   if (!ok) {
     return;
   }
   while (select.next()) {
-    wayList.append (select.value(0).toString());
+    wayList.append (select.value(0).toLongLong());
   }
+  select.finish ();
 }
 
 void
-DbManager::GetRelationsByMember (QStringList & relIdList,
+DbManager::GetRelationsByMember (NaviIdList & relIdList,
                                  const QString & memType,
-                                 const QString & memId)
+                                 NaviId memId)
 {
   relIdList.clear ();
-  QString cmd ("select relationid from relationparts "
-               " where othertype=\"%1\" and otherid = \"%2\"");
-  QSqlQuery select (geoBase);
-  bool ok = select.exec (cmd.arg(memType).arg(memId));
+  QSqlQuery & select = Statement ("select distinct relationid "
+                                  " from relationparts "
+                                  " where othertype = ? and otherid = ?");
+  select.bindValue (0, QVariant (memType));
+  select.bindValue (1, QVariant (memId));
+  bool ok = Exec (select);
   if (!ok) {
     return;
   }
   while (select.next()) {
-    relIdList.append (select.value(0).toString());
+    relIdList.append (select.value(0).toLongLong());
+  }
+  select.finish ();
+}
+
+/** @brief Number of ids bound into one IN list, well under the
+  * SQLite limit on host parameters.
+  */
+
+static const int IdChunk (256);
+
+static QString
+IdPlaces ()
+{
+  QStringList places;
+  for (int i=0; i<IdChunk; i++) {
+    places.append ("?");
+  }
+  return places.join (",");
+}
+
+/** @brief Sorted and without repeats, so neighbouring ids land in the
+  * same chunk and each chunk walks the index in order.
+  */
+
+static NaviIdList
+SortedIds (const NaviIdList & ids)
+{
+  NaviIdList sorted = ids.toSet().toList();
+  qSort (sorted);
+  return sorted;
+}
+
+bool
+DbManager::GetNodes (const NaviIdList & nodeIds,
+                     QMap <NaviId, NaviNode> & nodes)
+{
+  CheckOtherWriters ();
+  nodes.clear ();
+  NaviIdList missing;
+  for (int n=0; n<nodeIds.count(); n++) {
+    NaviCoord lat, lon;
+    NaviId nodeId = nodeIds.at(n);
+    if (nodeStore.Get (nodeId, lat, lon) || cache.Node (nodeId, lat, lon)) {
+      nodes[nodeId] = NaviNode::FromCoords (nodeId, lat, lon);
+    } else {
+      missing.append (nodeId);
+    }
+  }
+  if (missing.isEmpty ()) {
+    return true;
+  }
+  missing = SortedIds (missing);
+  QSqlQuery & select = Statement (QString ("select nodeid, lat, lon "
+                                           " from nodes where nodeid in (%1)")
+                                     .arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<missing.count(); c+=IdChunk) {
+    ok = ExecIdChunk (select, missing, c);
+    while (ok && select.next ()) {
+      NaviId nodeId = select.value(0).toLongLong();
+      NaviCoord lat = select.value(1).toInt();
+      NaviCoord lon = select.value(2).toInt();
+      nodes[nodeId] = NaviNode::FromCoords (nodeId, lat, lon);
+      cache.PutNode (nodeId, lat, lon);
+    }
+  }
+  select.finish ();
+  return ok;
+}
+
+/** @brief Node lists come back in rowid order, with each node of a
+  * way once, so a closed way comes back rotated. The way's order is
+  * in its geometry, see GetWayGeometry.
+  */
+
+bool
+DbManager::GetWayNodes (const NaviIdList & wayIds,
+                        QMap <NaviId, NaviIdList> & nodesByWay)
+{
+  CheckOtherWriters ();
+  nodesByWay.clear ();
+  NaviIdList ids;
+  for (int w=0; w<wayIds.count(); w++) {
+    NaviIdList nodeList;
+    if (cache.WayNodes (wayIds.at(w), nodeList)) {
+      nodesByWay[wayIds.at(w)] = nodeList;
+    } else {
+      ids.append (wayIds.at(w));
+    }
+  }
+  ids = SortedIds (ids);
+  QSqlQuery & select = Statement (QString ("select wayid, nodeid "
+                                           " from waynodes where wayid in (%1)"
+                                           " order by wayid, rowid")
+                                     .arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<ids.count(); c+=IdChunk) {
+    ok = ExecIdChunk (select, ids, c);
+    while (ok && select.next ()) {
+      nodesByWay[select.value(0).toLongLong()]
+                 .append (select.value(1).toLongLong());
+    }
+  }
+  select.finish ();
+  for (int w=0; ok && w<ids.count(); w++) {
+    cache.PutWayNodes (ids.at(w), nodesByWay.value (ids.at(w)));
+  }
+  return ok;
+}
+
+bool
+DbManager::GetWayGeometries (const NaviIdList & wayIds,
+                             QMap <NaviId, QByteArray> & geoms)
+{
+  geoms.clear ();
+  NaviIdList ids = SortedIds (wayIds);
+  QSqlQuery & select = Statement (QString ("select wayid, geom "
+                                           " from waygeoms where wayid in (%1)")
+                                     .arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<ids.count(); c+=IdChunk) {
+    ok = ExecIdChunk (select, ids, c);
+    while (ok && select.next ()) {
+      geoms[select.value(0).toLongLong()] = select.value(1).toByteArray();
+    }
+  }
+  select.finish ();
+  return ok;
+}
+
+bool
+DbManager::GetWaysByNodes (const NaviIdList & nodeIds,
+                           QMap <NaviId, NaviIdList> & waysByNode)
+{
+  waysByNode.clear ();
+  NaviIdList ids = SortedIds (nodeIds);
+  QSqlQuery & select = Statement (QString ("select nodeid, wayid "
+                                           " from waynodes where nodeid in (%1)")
+                                     .arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<ids.count(); c+=IdChunk) {
+    ok = ExecIdChunk (select, ids, c);
+    while (ok && select.next ()) {
+      waysByNode[select.value(0).toLongLong()]
+                 .append (select.value(1).toLongLong());
+    }
+  }
+  select.finish ();
+  return ok;
+}
+
+bool
+DbManager::GetRelationsByMembers (const QString & memType,
+                                  const NaviIdList & memIds,
+                                  QMap <NaviId, NaviIdList> & relsByMember)
+{
+  relsByMember.clear ();
+  NaviIdList ids = SortedIds (memIds);
+  QSqlQuery & select = Statement (QString ("select distinct otherid, "
+                                           " relationid from relationparts "
+                                           " where othertype = ? "
+                                           " AND otherid in (%1)")
+                                     .arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<ids.count(); c+=IdChunk) {
+    select.bindValue (0, QVariant (memType));
+    ok = ExecIdChunk (select, ids, c, 1);
+    while (ok && select.next ()) {
+      relsByMember[select.value(0).toLongLong()]
+                 .append (select.value(1).toLongLong());
+    }
+  }
+  select.finish ();
+  return ok;
+}
+
+bool
+DbManager::GetRelationMembers (const NaviIdList & relIds,
+                               const QString & type,
+                               QMap <NaviId, NaviIdList> & refsByRelation)
+{
+  CheckOtherWriters ();
+  refsByRelation.clear ();
+  NaviIdList ids;
+  for (int r=0; r<relIds.count(); r++) {
+    NaviIdList refs;
+    if (!cache.Members (relIds.at(r), type, refs)) {
+      ids.append (relIds.at(r));
+    } else if (!refs.isEmpty ()) {
+      refsByRelation[relIds.at(r)] = refs;
+    }
+  }
+  ids = SortedIds (ids);
+  QSqlQuery & select = Statement (QString ("select relationid, otherid "
+                                           " from relationparts "
+                                           " where othertype = ? "
+                                           " AND relationid in (%1) "
+                                           " order by relationid, seq")
+                                     .arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<ids.count(); c+=IdChunk) {
+    select.bindValue (0, QVariant (type));
+    ok = ExecIdChunk (select, ids, c, 1);
+    while (ok && select.next ()) {
+      refsByRelation[select.value(0).toLongLong()]
+                 .append (select.value(1).toLongLong());
+    }
+  }
+  select.finish ();
+  for (int r=0; ok && r<ids.count(); r++) {
+    cache.PutMembers (ids.at(r), type, refsByRelation.value (ids.at(r)));
+  }
+  return ok;
+}
+
+bool
+DbManager::GetTagsFor (const QString & type,
+                       const NaviIdList & ids,
+                       QMap <NaviId, TagList> & tagsById)
+{
+  CheckOtherWriters ();
+  tagsById.clear ();
+  NaviIdList sorted;
+  for (int i=0; i<ids.count(); i++) {
+    TagList tagList;
+    if (!cache.Tags (type, ids.at(i), tagList)) {
+      sorted.append (ids.at(i));
+    } else if (!tagList.isEmpty ()) {
+      tagsById[ids.at(i)] = tagList;
+    }
+  }
+  sorted = SortedIds (sorted);
+  QSqlQuery & select = Statement (QString ("select %1id, keyid, valueid "
+                                           " from %1tags where %1id in (%2) "
+                                           " order by %1id, keyid")
+                                     .arg (type).arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<sorted.count(); c+=IdChunk) {
+    ok = ExecIdChunk (select, sorted, c);
+    while (ok && select.next ()) {
+      QString key = DictionaryText (tagKeys, select.value(1).toLongLong());
+      QString value = DictionaryText (tagValues,
+                                      select.value(2).toLongLong());
+      tagsById[select.value(0).toLongLong()].append (TagItemType (key, value));
+    }
+  }
+  select.finish ();
+  for (int i=0; ok && i<sorted.count(); i++) {
+    cache.PutTags (type, sorted.at(i), tagsById.value (sorted.at(i)));
+  }
+  return ok;
+}
+
+bool
+DbManager::GetVersions (const QString & type,
+                        const NaviIdList & ids,
+                        QMap <NaviId, int> & versions)
+{
+  versions.clear ();
+  CheckOtherWriters ();
+  NaviIdList sorted;
+  for (int i=0; i<ids.count(); i++) {
+    if (MayHave (type, ids.at(i))) {
+      sorted.append (ids.at(i));
+    }
+  }
+  sorted = SortedIds (sorted);
+  QSqlQuery & select = Statement (QString ("select %1id, version "
+                                           " from %1s where %1id in (%2)")
+                                     .arg (type).arg (IdPlaces ()));
+  bool ok (true);
+  for (int c=0; ok && c<sorted.count(); c+=IdChunk) {
+    ok = ExecIdChunk (select, sorted, c);
+    while (ok && select.next ()) {
+      versions[select.value(0).toLongLong()] = select.value(1).toInt();
+    }
+  }
+  select.finish ();
+  return ok;
+}
+
+/** @brief Prepared statements are kept per connection, keyed by
+  * their SQL text, so each insert is prepared only once.
+  */
+
+QSqlQuery &
+DbManager::Statement (const QString & cmd)
+{
+  QHash <QString, QSqlQuery>::iterator sit = statements.find (cmd);
+  if (sit == statements.end ()) {
+    QSqlQuery query (geoBase);
+    bool ok = query.prepare (cmd);
+    if (!ok) {
+      qDebug () << "DbManager cannot prepare " << cmd
+                << query.lastError().text();
+    }
+    sit = statements.insert (cmd, query);
+  }
+  return *sit;
+}
+
+bool
+DbManager::Exec (QSqlQuery & query)
+{
+  bool ok = query.exec ();
+  if (!ok) {
+    qDebug () << "DbManager query failed " << query.lastQuery ()
+              << query.lastError().text();
+  }
+  return ok;
+}
+
+/** @brief Bind the IdChunk ids from start on to the parameters of
+  * query beginning at first. A short last chunk repeats its last id,
+  * which the IN list ignores, so every chunk runs the same statement.
+  */
+
+bool
+DbManager::ExecIdChunk (QSqlQuery & query, const NaviIdList & ids, 
+                        int start, int first)
+{
+  int last = qMin (start + IdChunk, ids.count()) - 1;
+  for (int i=0; i<IdChunk; i++) {
+    query.bindValue (first + i, QVariant (ids.at (qMin (start + i, last))));
+  }
+  return Exec (query);
+}
+
+bool
+DbManager::ExecBatch (const QString & cmd,
+                      const QList <QVariantList> & columns)
+{
+  if (columns.isEmpty () || columns.first().isEmpty ()) {
+    return true;
   }
+  QSqlQuery & query = Statement (cmd);
+  for (int c=0; c<columns.count(); c++) {
+    query.bindValue (c, columns.at(c));
+  }
+  bool ok = query.execBatch ();
+  if (!ok) {
+    qDebug () << "DbManager batch failed " << cmd
+              << query.lastError().text();
+  }
+  return ok;
+}
+
+void
+DbManager::WriteNodes (const NaviNodeList & nodes,
+                       const QMap <NaviId, int> & versions)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList ids, lats, lons, parcels, nodeVersions;
+  NodesChanged ();
+  FiltersChanged ();
+  int nn = nodes.count ();
+  for (int n=0; n<nn; n++) {
+    const NaviNode & node = nodes.at (n);
+    cache.ForgetNode (node.Id());
+    nodeFilter.Add (node.Id());
+    ids.append (node.Id());
+    lats.append (node.LatCoord());
+    lons.append (node.LonCoord());
+    nodeVersions.append (versions.value (node.Id()));
+    parcels.append (Parcel::CoordIndex (node.LatCoord(), node.LonCoord()));
+  }
+  ExecBatch ("insert or replace into nodes "
+             " (nodeid, lat, lon, version) "
+             " VALUES (?, ?, ?, ?) ",
+             QList <QVariantList> () << ids << lats << lons
+                                     << nodeVersions);
+  ExecBatch ("insert or replace into nodeparcels "
+             " (nodeid, parcelid) "
+             " VALUES (?, ?)",
+             QList <QVariantList> () << ids << parcels);
+  if (haveRtree) {
+    ExecBatch ("insert or replace into noderect "
+               " (nodeid, minlat, maxlat, minlon, maxlon) "
+               " VALUES (?, ?, ?, ?, ?)",
+               QList <QVariantList> () << ids << lats << lats 
+                                       << lons << lons);
+  }
+}
+
+void
+DbManager::WriteWays (const NaviIdList & wayIds,
+                      const QMap <NaviId, int> & versions)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList ids, wayVersions;
+  FiltersChanged ();
+  for (int w=0; w<wayIds.count(); w++) {
+    ids.append (wayIds.at(w));
+    wayVersions.append (versions.value (wayIds.at(w)));
+    wayFilter.Add (wayIds.at(w));
+  }
+  ExecBatch ("insert or replace into ways "
+             " (wayid, version) "
+             " VALUES (?, ?) ",
+             QList <QVariantList> () << ids << wayVersions);
+}
+
+void
+DbManager::WriteRelations (const NaviIdList & relIds,
+                           const QMap <NaviId, int> & versions)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList ids, relVersions;
+  FiltersChanged ();
+  for (int r=0; r<relIds.count(); r++) {
+    ids.append (relIds.at(r));
+    relVersions.append (versions.value (relIds.at(r)));
+    relationFilter.Add (relIds.at(r));
+  }
+  ExecBatch ("insert or replace into relations "
+             " (relationid, version) "
+             " VALUES (?, ?) ",
+             QList <QVariantList> () << ids << relVersions);
+}
+
+/** @brief A way's node list replaces the one stored before, so
+  * nodes dropped from the way do not stay behind.
+  */
+
+void
+DbManager::WriteWayNodes (const QMap <NaviId, NaviIdList> & wayNodes)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList oldIds, wayIds, nodeIds;
+  QMap <NaviId, NaviIdList>::const_iterator wit;
+  for (wit=wayNodes.begin(); wit!=wayNodes.end(); wit++) {
+    cache.ForgetWayNodes (wit.key());
+    oldIds.append (wit.key());
+    for (int n=0; n<wit->count(); n++) {
+      wayIds.append (wit.key());
+      nodeIds.append (wit->at(n));
+    }
+  }
+  ExecBatch ("delete from waynodes where wayid = ?",
+             QList <QVariantList> () << oldIds);
+  ExecBatch ("insert or replace into waynodes "
+             " (wayid, nodeid) "
+             " VALUES (?, ?) ",
+             QList <QVariantList> () << wayIds << nodeIds);
+}
+
+static bool
+SeqLess (const WayTurn & a, const WayTurn & b)
+{
+  return a.Seq () < b.Seq ();
+}
+
+void
+DbManager::WriteWayLocs (const WayTurnList & locs)
+{
+  QMap <NaviId, WayTurnList> ways;
+  int nl = locs.count ();
+  for (int l=0; l<nl; l++) {
+    ways[locs.at(l).WayId()].append (locs.at(l));
+  }
+  WriteWayGeoms (ways);
+}
+
+void
+DbManager::WriteWayGeoms (const QMap <NaviId, WayTurnList> & ways)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList wayIds, minLats, maxLats, minLons, maxLons, geoms;
+  QMap <NaviId, NaviBox> boxes;
+  QMap <NaviId, WayTurnList>::const_iterator wit;
+  for (wit=ways.begin(); wit!=ways.end(); wit++) {
+    WayTurnList turns = *wit;
+    qStableSort (turns.begin (), turns.end (), SeqLess);
+    NaviBox & box = boxes[wit.key()];
+    for (int t=0; t<turns.count(); t++) {
+      box.Include (turns.at(t).LatCoord(), turns.at(t).LonCoord());
+    }
+    wayIds.append (wit.key());
+    minLats.append (box.minLat);
+    maxLats.append (box.maxLat);
+    minLons.append (box.minLon);
+    maxLons.append (box.maxLon);
+    geoms.append (WayGeometry::Encode (turns));
+  }
+  ExecBatch ("insert or replace into waygeoms "
+             " (wayid, minlat, maxlat, minlon, maxlon, geom) "
+             " VALUES (?, ?, ?, ?, ?, ?) ",
+             QList <QVariantList> () << wayIds << minLats << maxLats
+                                     << minLons << maxLons << geoms);
+  WriteWayBoxes (boxes);
+}
+
+/** @brief A way's waylocs arrive together, so its box is complete.
+  * The box goes into the waycells pyramid, and into wayrect when
+  * there is an R*Tree.
+  */
+
+void
+DbManager::WriteWayBoxes (const QMap <NaviId, NaviBox> & boxes)
+{
+  QVariantList ids, minLats, maxLats, minLons, maxLons;
+  QVariantList levels, cells;
+  QMap <NaviId, NaviBox>::const_iterator bit;
+  for (bit=boxes.begin(); bit!=boxes.end(); bit++) {
+    ids.append (bit.key());
+    minLats.append (bit->minLat);
+    maxLats.append (bit->maxLat);
+    minLons.append (bit->minLon);
+    maxLons.append (bit->maxLon);
+    quint64 cell;
+    levels.append (Parcel::BoxLevel (*bit, cell));
+    cells.append (qint64 (cell));
+  }
+  ExecBatch ("insert or replace into waycells "
+             " (wayid, level, cellid) "
+             " VALUES (?, ?, ?)",
+             QList <QVariantList> () << ids << levels << cells);
+  if (!haveRtree) {
+    return;
+  }
+  ExecBatch ("insert or replace into wayrect "
+             " (wayid, minlat, maxlat, minlon, maxlon) "
+             " VALUES (?, ?, ?, ?, ?)",
+             QList <QVariantList> () << ids << minLats << maxLats
+                                     << minLons << maxLons);
+}
+
+void
+DbManager::WriteWayParcels (const NaviIdList & wayIds,
+                            const QList <quint64> & parcels)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList ids, parcelIds;
+  int np = qMin (wayIds.count(), parcels.count());
+  for (int p=0; p<np; p++) {
+    ids.append (wayIds.at(p));
+    parcelIds.append (parcels.at(p));
+  }
+  ExecBatch ("insert or replace into wayparcels "
+             " (wayid, parcelid) "
+             " VALUES (?, ?)",
+             QList <QVariantList> () << ids << parcelIds);
+}
+
+/** @brief Each tag list replaces the one stored before, an empty
+  * list removes the element's tags.
+  */
+
+void
+DbManager::WriteTags (const QString & type,
+                      const QMap <NaviId, TagList> & tags)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList oldIds, ids, keys, values;
+  if (tagValues.codes.count () > 500000) {
+    ClearDictionaries ();
+  }
+  QMap <NaviId, TagList>::const_iterator tit;
+  for (tit=tags.begin(); tit!=tags.end(); tit++) {
+    cache.ForgetTags (type, tit.key());
+    oldIds.append (tit.key());
+    for (int t=0; t<tit->count(); t++) {
+      ids.append (tit.key());
+      keys.append (DictionaryCode (tagKeys, tit->at(t).first, true));
+      values.append (DictionaryCode (tagValues, tit->at(t).second, true));
+    }
+  }
+  ExecBatch (QString ("delete from %1tags where %1id = ?").arg (type),
+             QList <QVariantList> () << oldIds);
+  QString cmd ("insert or replace into %1tags "
+               " (%1id, keyid, valueid) "
+               " VALUES (?, ?, ?)");
+  ExecBatch (cmd.arg (type),
+             QList <QVariantList> () << ids << keys << values);
+}
+
+/** @brief A relation's member list replaces the one stored before,
+  * so a shorter list does not leave old members behind.
+  */
+
+void
+DbManager::WriteRelationMembers (const QMap <NaviId, MemberList> & members)
+{
+  if (!Wrote ()) {
+    return;
+  }
+  QVariantList oldIds, relIds, seqs, types, refs;
+  QMap <NaviId, MemberList>::const_iterator mit;
+  for (mit=members.begin(); mit!=members.end(); mit++) {
+    cache.ForgetMembers (mit.key());
+    oldIds.append (mit.key());
+    for (int m=0; m<mit->count(); m++) {
+      relIds.append (mit.key());
+      seqs.append (m);
+      types.append (mit->at(m).first);
+      refs.append (mit->at(m).second);
+    }
+  }
+  ExecBatch ("delete from relationparts where relationid = ?",
+             QList <QVariantList> () << oldIds);
+  ExecBatch ("insert or replace into relationparts "
+             "  (relationid, seq, othertype, otherid) "
+             " VALUES (?, ?, ?, ?) ",
+             QList <QVariantList> () << relIds << seqs << types << refs);
 }
 
+/** @brief Transactions begin immediate, so the generation read and
+  * bump in Wrote happen under the write lock, and two connections
+  * cannot both read and then both wait to upgrade.
+  */
+
 void
 DbManager::StartTransaction ()
 {
-  geoBase.transaction ();
+  QSqlQuery begin (geoBase);
+  if (!begin.exec ("begin immediate transaction")) {
+    qDebug () << "DbManager cannot begin transaction "
+              << begin.lastError().text();
+  }
+  inTransaction = true;
+  generationBumped = false;
 }
 
 void
 DbManager::CommitTransaction ()
 {
   geoBase.commit ();
+  inTransaction = false;
+  generationBumped = false;
+}
+
+void
+DbManager::RollbackTransaction ()
+{
+  geoBase.rollback ();
+  inTransaction = false;
+  generationBumped = false;
+}
+
+/// waynodeindex stays, OsmBatchWriter looks up the ways of moved
+/// nodes through it while the load runs
+
+static const char * bulkIndexes[] = { "nodelatindex", "nodelonindex", 
+                                      "waylocwayindex", "nodeparcelindex",
+                                      "wayparcelindex", "waycellindex", 
+                                      "nodetagvalueindex", 
+                                      "waytagvalueindex",
+                                      "relationtagvalueindex",
+                                      "relationmemberindex", 0 };
+
+void
+DbManager::StartBulkLoad (int cacheKB)
+{
+  bulkCacheKB = cacheKB;
+  StartTransaction ();
+  SetMetaValue ("bulkload", "1");
+  QSqlQuery drop (geoBase);
+  for (int i=0; bulkIndexes[i]; i++) {
+    drop.exec (QString ("drop index if exists %1").arg (bulkIndexes[i]));
+  }
+  CommitTransaction ();
+  SetBulkPragmas (true);
+}
+
+/** @brief Rebuild whatever indexes are missing, each CREATE INDEX is
+  * a single sorted pass over the table, then clear the marker and go
+  * back to durable settings. Safe to call more than once.
+  */
+
+void
+DbManager::FinishBulkLoad ()
+{
+  SetBulkPragmas (true);
+  QTime clock;
+  clock.start ();
+  for (int i=0; bulkIndexes[i]; i++) {
+    QString index (bulkIndexes[i]);
+    if (ElementType (geoBase, index).toUpper () != "INDEX") {
+      MakeElement (geoBase, index);
+    }
+  }
+  QSqlQuery analyze (geoBase);
+  analyze.exec ("analyze");
+  SetMetaValue ("bulkload", "0");
+  SetBulkPragmas (false);
+  qDebug () << " bulk load indexes rebuilt in " << clock.elapsed ()
+            << " msecs";
+}
+
+bool
+DbManager::InBulkLoad ()
+{
+  return MetaValue ("bulkload") == "1";
+}
+
+void
+DbManager::SetBulkPragmas (bool bulk)
+{
+  QStringList pragmas;
+  if (bulk) {
+    pragmas << "pragma journal_mode = TRUNCATE"
+            << "pragma synchronous = OFF"
+            << QString ("pragma cache_size = -%1").arg (bulkCacheKB)
+            << "pragma temp_store = MEMORY";
+  } else {
+    pragmas << "pragma journal_mode = DELETE"
+            << "pragma synchronous = FULL"
+            << "pragma cache_size = -2000"
+            << "pragma temp_store = DEFAULT";
+  }
+  for (int p=0; p<pragmas.count(); p++) {
+    QSqlQuery pragma (geoBase);
+    if (!pragma.exec (pragmas.at(p))) {
+      qDebug () << "DbManager " << pragmas.at(p) << " failed "
+                << pragma.lastError().text();
+    }
+  }
+}
+
+QString
+DbManager::MetaValue (const QString & key)
+{
+  QSqlQuery select (geoBase);
+  select.prepare ("select value from navimeta where key = ?");
+  select.bindValue (0, QVariant (key));
+  if (select.exec () && select.next ()) {
+    return select.value(0).toString();
+  }
+  return QString ();
+}
+
+void
+DbManager::SetMetaValue (const QString & key, const QString & value)
+{
+  QSqlQuery & insert = Statement ("insert or replace into navimeta "
+                                  " (key, value) VALUES (?, ?)");
+  insert.bindValue (0, QVariant (key));
+  insert.bindValue (1, QVariant (value));
+  Exec (insert);
 }
 
 
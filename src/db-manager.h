@@ -28,6 +28,16 @@
 #include <QObject>
 #include <QPair>
 #include <QList>
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+#include <QVariant>
+#include "navi-types.h"
+#include "navi-global.h"
+#include "node-store.h"
+#include "geo-cache.h"
+#include "id-filter.h"
+#include "geo-generation.h"
 
 namespace navi
 {
@@ -41,78 +51,219 @@ public:
   DbManager (QObject *parent=0);
 
   void Start ();
+  void Start (const QString & conName, const QString & geoBaseName);
+  /** @brief Open a geobase that a started DbManager has checked
+    * already, for reading only: no schema check or migration, no
+    * bulk load recovery, no node store and no IdFilters.
+    */
+  bool StartReadOnly (const QString & conName, 
+                      const QString & geoBaseName);
   void Stop ();
 
+  static QString GeoBaseName ();
+  QString GeoBaseFile () const { return geoBaseFile; }
+
   void StartTransaction ();
   void CommitTransaction ();
+  void RollbackTransaction ();
 
-  void WriteNode (const QString & nodeId,
-                        double  lat,
-                        double  lon);
+  /** @brief Bulk load: the secondary indexes are dropped and SQLite
+    * runs with fast, less durable settings until FinishBulkLoad
+    * rebuilds them over the whole geobase. That only pays off for a
+    * large load, so it is off by default. A marker in navimeta
+    * records an unfinished bulk load, so the next Start can complete
+    * it after a crash.
+    */
+  void StartBulkLoad (int cacheKB = 256*1024);
+  void FinishBulkLoad ();
+  bool InBulkLoad ();
+
+  /** @brief Write the node store file next to the geobase from the
+    * nodes table. GetNode uses it while it is current, any node
+    * written later marks it stale until the next build, also for
+    * the other connections to the geobase, see GeoGeneration.
+    */
+  bool BuildNodeStore ();
+
+  /** @brief write a read only navi pack snapshot, see NaviPack */
+  bool ExportPack (const QString & filename);
+
+  QString MetaValue (const QString & key);
+  void    SetMetaValue (const QString & key, const QString & value);
 
+  /** @brief read the IdFilters saved with the geobase, or rebuild
+    * them from the tables when they are missing or stale
+    */
+  void LoadIdFilters ();
+  /** @brief store the filters now, so other connections opening the
+    * geobase find them current. They are saved with the generation
+    * they cover, see GeoGeneration.
+    */
+  void SaveIdFilters ();
 
-  void WriteWayLoc (const QString & wayId,
-                    const QString & nodeId,
-                        int   seq,
+  void WriteNode (NaviId nodeId,
                         double  lat,
-                        double  lon);
-  void WriteWay (const QString & wayId);
-  void WriteRelation (const QString & relId);
-  void WriteWayNode (const QString & wayId,
-                     const QString & nodeId);
-  void WriteNodeTag (const QString & nodeId, 
+                        double  lon,
+                        int     version = 0);
+
+
+  void WriteWay (NaviId wayId, int version = 0);
+  void WriteRelation (NaviId relId, int version = 0);
+  void WriteWayNode (NaviId wayId,
+                     NaviId nodeId);
+  void WriteNodeTag (NaviId nodeId, 
                      const QString & key,
                      const QString & value);
-  void WriteWayTag (const QString & wayId,
+  void WriteWayTag (NaviId wayId,
                     const QString & key,
                     const QString & value);
-  void WriteRelationTag (const QString & relId,
+  void WriteRelationTag (NaviId relId,
                          const QString & key,
                          const QString & value);
-  void WriteRelationMember (const QString & relId,
+  void WriteRelationMember (NaviId relId,
+                            int seq,
                             const QString & type,
-                            const QString & ref);
-  void WriteNodeParcel (const QString & nodeId, 
+                            NaviId ref);
+  void WriteNodeParcel (NaviId nodeId, 
                    quint64 parcelIndex);
-  void WriteWayParcel (const QString & wayId,
+  void WriteWayParcel (NaviId wayId,
                   quint64 parcelIndex);
-  bool GetNode (const QString & nodeId, double & lat, double & lon);
-  bool HaveWay (const QString & wayId);
-  bool HaveRelation (const QString & relId);
-  bool GetWayNodes (const QString & wayId,
-                 QStringList & nodeIdList);
+
+  /** @brief bulk versions of the Write calls, each one runs a single
+    * cached statement over the whole list with execBatch. Ids not
+    * in versions are written with version 0. The node, tag and
+    * member lists replace what was stored for the same ids.
+    */
+  void WriteNodes (const NaviNodeList & nodes,
+                   const QMap <NaviId, int> & versions
+                                         = QMap <NaviId, int> ());
+  void WriteWays (const NaviIdList & wayIds,
+                  const QMap <NaviId, int> & versions
+                                         = QMap <NaviId, int> ());
+  void WriteRelations (const NaviIdList & relIds,
+                       const QMap <NaviId, int> & versions
+                                         = QMap <NaviId, int> ());
+  void WriteWayNodes (const QMap <NaviId, NaviIdList> & wayNodes);
+  /** @brief locations of whole ways, stored as one WayGeometry blob
+    * per way in waygeoms
+    */
+  void WriteWayLocs (const WayTurnList & locs);
+  void WriteWayParcels (const NaviIdList & wayIds,
+                        const QList <quint64> & parcels);
+  void WriteTags (const QString & type,
+                  const QMap <NaviId, TagList> & tags);
+  void WriteRelationMembers (const QMap <NaviId, MemberList> & members);
+  bool GetNode (NaviId nodeId, double & lat, double & lon);
+  bool GetNode (NaviId nodeId, NaviCoord & lat, NaviCoord & lon);
+  /** @brief Existence checks. An id the IdFilter of its type rules
+    * out is answered without a query.
+    */
+  bool HaveNode (NaviId nodeId);
+  bool HaveWay (NaviId wayId);
+  bool HaveRelation (NaviId relId);
+  /** @brief stored OSM version of a node, way or relation, 0 when it
+    * was written without one and -1 when it is not there
+    */
+  int  ElementVersion (const QString & type, NaviId id);
+  bool GetWayNodes (NaviId wayId,
+                 NaviIdList & nodeIdList);
+  bool GetWayGeometry (NaviId wayId, QByteArray & geom);
   bool GetNodes (quint64 parcelIndex,
-                QStringList & nodeIdList);
+                NaviIdList & nodeIdList);
   bool GetWays (quint64 parcelIndex,
-                QStringList & wayIdList);
-  bool GetNodeTag (const QString & nodeid,
+                NaviIdList & wayIdList);
+  bool GetNodes (const ParcelRange & parcels,
+                 NaviIdList & nodeIdList);
+  bool GetWays (const ParcelRange & parcels,
+                NaviIdList & wayIdList);
+  /** @brief the parcels holding nodes or ways of type, in order, with
+    * the number of elements in each
+    */
+  bool GetParcelCounts (const QString & type,
+                        QList <quint64> & parcels,
+                        QList <int> & counts);
+
+  /** @brief Everything with a parcel cell touching the box. Ways come
+    * from the waycells pyramid, so a way is found from any part of
+    * the box its cell covers. maxLevel limits how finely the box is
+    * cut into parcel runs, see Parcel::BoxRanges.
+    */
+  bool GetNodesInBox (NaviIdList & nodeIdList,
+                      double south, double west,
+                      double north, double east,
+                      int maxLevel = Parcel::Levels);
+  bool GetWaysInBox (NaviIdList & wayIdList,
+                     double south, double west,
+                     double north, double east,
+                     int maxLevel = Parcel::Levels);
+  bool GetNodeTag (NaviId nodeid,
                    const QString & tagKey,
                          QString & tagValue);
-  bool GetNodeTags (const QString & nodeId,
+  bool GetNodeTags (NaviId nodeId,
                          QList<QPair <QString,QString> > & tagList);
-  bool GetWayTag (const QString & wayId,
+  bool GetWayTag (NaviId wayId,
                   const QString & tagKey,
                         QString & tagValue);
-  bool GetWayTags (const QString & wayId,
+  bool GetWayTags (NaviId wayId,
                         QList <QPair <QString, QString> > & tagList);
-  bool GetRelationTags (const QString & relId,
+  bool GetRelationTags (NaviId relId,
                         QList <QPair <QString, QString> > & tagList);
-  bool GetRelationMembers (const QString & relId,
+  bool GetRelationMembers (NaviId relId,
                            const QString & type,
-                           QStringList & refList);
-  void GetByTag (QStringList & idList,
+                           NaviIdList & refList);
+  void GetByTag (NaviIdList & idList,
                  const QString & tagKey,
                  const QString & tagValue,
                  const QString & type,
                  bool regularExp = false);
-  void GetNodesByLatLon (QStringList & nodeList,
+  void GetNodesByLatLon (NaviIdList & nodeList,
                         double south, double west,
                         double north, double east);
-  void GetWaysByNode (QStringList & wayList,
-                      const QString & nodeId);
-  void GetRelationsByMember (QStringList & relIdList,
+  void GetWaysByLatLon (NaviIdList & wayList,
+                        double south, double west,
+                        double north, double east);
+
+  /** @brief true when the noderect/wayrect R*Tree tables exist
+    * and are filled, otherwise bbox queries scan lat/lon ranges
+    */
+  bool HaveSpatialIndex () const { return haveRtree; }
+
+  /** @brief the objects read most recently, see GeoCache */
+  GeoCache & Cache () { return cache; }
+  void GetWaysByNode (NaviIdList & wayList,
+                      NaviId nodeId);
+  void GetRelationsByMember (NaviIdList & relIdList,
                              const QString & memType,
-                             const QString & memId);
+                             NaviId memId);
+
+  /** @brief Set versions of the lookups above. The ids are sent to
+    * SQLite as fixed size IN lists, so a set of any size is a few
+    * statements, and the results are grouped by the id asked for.
+    * Ids without a result have no entry.
+    */
+  bool GetNodes (const NaviIdList & nodeIds,
+                 QMap <NaviId, NaviNode> & nodes);
+  bool GetWayNodes (const NaviIdList & wayIds,
+                    QMap <NaviId, NaviIdList> & nodesByWay);
+  bool GetWayGeometries (const NaviIdList & wayIds,
+                         QMap <NaviId, QByteArray> & geoms);
+  bool GetWaysByNodes (const NaviIdList & nodeIds,
+                       QMap <NaviId, NaviIdList> & waysByNode);
+  bool GetRelationsByMembers (const QString & memType,
+                              const NaviIdList & memIds,
+                              QMap <NaviId, NaviIdList> & relsByMember);
+  bool GetRelationMembers (const NaviIdList & relIds,
+                           const QString & type,
+                           QMap <NaviId, NaviIdList> & refsByRelation);
+  bool GetTagsFor (const QString & type,
+                   const NaviIdList & ids,
+                   QMap <NaviId, TagList> & tagsById);
+  /** @brief stored versions, see ElementVersion. Only the ids the
+    * IdFilter of type lets through are looked up.
+    */
+  bool GetVersions (const QString & type,
+                    const NaviIdList & ids,
+                    QMap <NaviId, int> & versions);
 
 public slots:
 
@@ -130,29 +281,96 @@ private:
                         const QStringList & elements);
   QString ElementType (QSqlDatabase & db, const QString & name);
   void    MakeElement (QSqlDatabase & db, const QString & element);
+  QString ColumnType (const QString & table, const QString & column);
+  void    CheckSchemaVersion ();
+  void    SetSchemaVersion (int version);
+  bool    MigrateIntegerIds ();
+  bool    MigrateFixedCoords ();
+  bool    MigrateParcelKeys ();
+  bool    MigrateWayCells ();
+  bool    MigrateTagDictionary ();
+  bool    MigrateWayGeoms ();
+  bool    MigrateClusteredTables ();
+  bool    HasRowid (const QString & table);
+  void    WriteWayGeoms (const QMap <NaviId, WayTurnList> & ways);
+  void    CheckSpatialIndex ();
+  void    WriteWayBoxes (const QMap <NaviId, NaviBox> & boxes);
+  void    OpenNodeStore ();
+  void    NodesChanged ();
+  bool    Wrote ();
+  void    CheckOtherWriters ();
+  void    OtherWriters ();
+  bool    MigrateElementVersions ();
+  IdFilter & Filter (const QString & type);
+  void    RebuildIdFilter (const QString & type);
+  bool    RestoreIdFilters ();
+  void    FiltersChanged ();
+  bool    MayHave (const QString & type, NaviId id);
   void Connect ();
 
   void WriteTag (const QString & type,
-                 const QString & id,
+                 NaviId id,
                     const QString & key,
                     const QString & value);
   void WriteParcel (const QString & type,
-                    const QString & id,
+                    NaviId id,
                     quint64 parcelIndex);
-  bool GetItems (quint64 parcelIndex,
+  bool GetItems (const ParcelRange & parcels,
                  const QString & type,
-                 QStringList & idList);
+                 NaviIdList & idList);
   bool GetTag (const QString & type,
-               const QString & id, 
+               NaviId id, 
                const QString & key,
                      QString & value);
   bool GetTags (const QString & type,
-                const QString & id,
+                NaviId id,
                       QList<QPair <QString, QString> >  & list);
+  /** @brief Tag keys and values are stored as codes. Each dictionary
+    * table is cached both ways in memory, so writes and lookups only
+    * go to SQL for text not seen before in this session.
+    */
+  struct TagDictionary {
+    QString  table;
+    QString  idColumn;
+    QString  textColumn;
+    QHash <QString, qint64>  codes;
+    QHash <qint64, QString>  names;
+  };
+
+  qint64  DictionaryCode (TagDictionary & dict, const QString & text,
+                          bool create);
+  QString DictionaryText (TagDictionary & dict, qint64 code);
+  void    ClearDictionaries ();
+
+  void SetBulkPragmas (bool bulk);
+  QSqlQuery & Statement (const QString & cmd);
+  bool Exec (QSqlQuery & query);
+  bool ExecIdChunk (QSqlQuery & query, const NaviIdList & ids,
+                    int start, int first = 0);
+  bool ExecBatch (const QString & cmd,
+                  const QList <QVariantList> & columns);
 
   QSqlDatabase  geoBase;
+  QString       geoBaseCon;
+  QHash <QString, QSqlQuery>  statements;
   int           geoBaseHandle;
   bool          dbRunning;
+  int           bulkCacheKB;
+  bool          haveRtree;
+  QString       geoBaseFile;
+  NodeStore     nodeStore;
+  GeoCache      cache;
+  bool          nodesChanged;
+  IdFilter      nodeFilter;
+  IdFilter      wayFilter;
+  IdFilter      relationFilter;
+  bool          filtersChanged;
+  bool          filtersTrusted;
+  GeoGeneration generation;
+  bool          inTransaction;
+  bool          generationBumped;
+  TagDictionary tagKeys;
+  TagDictionary tagValues;
 
 };
 
@@ -0,0 +1,324 @@
+#include "distance-matrix.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QtConcurrentMap>
+#include <QThread>
+#include <QTime>
+#include <QList>
+#include <QtAlgorithms>
+
+namespace navi
+{
+
+const quint32 DistanceMatrix::Unreachable (0xffffffff);
+
+struct MatrixChunk {
+  typedef void result_type;
+  MatrixChunk (DistanceMatrix * m) : matrix (m) {}
+  void operator() (int & chunk) { matrix->RunChunk (chunk); }
+  DistanceMatrix * matrix;
+};
+
+DistanceMatrix::Search::Search (int nodes)
+  :query (0)
+{
+  heap.Resize (nodes);
+  seen.fill (0, nodes);
+  done.fill (0, nodes);
+  dist.resize (nodes);
+  settled.reserve (1024);
+}
+
+/** @brief goalColumns marks the goal nodes with their column, the
+  * search stops after settling the last of them; without goals it
+  * runs until the heap is empty
+  */
+
+void
+DistanceMatrix::Search::Run (const quint32 * offsets,
+                             const quint32 * targets,
+                             const quint32 * weights, int source,
+                             const QVector <int> * goalColumns, int goals)
+{
+  query++;
+  if (query == 0) {
+    seen.fill (0);
+    done.fill (0);
+    query = 1;
+  }
+  heap.Clear ();
+  settled.resize (0);
+  seen[source] = query;
+  dist[source] = 0;
+  heap.Push (source, 0);
+  while (!heap.IsEmpty ()) {
+    int n = heap.Pop ();
+    done[n] = query;
+    Reached reached;
+    reached.node = n;
+    reached.dist = dist[n];
+    settled.append (reached);
+    if (goalColumns && goalColumns->at(n) >= 0) {
+      goals--;
+      if (goals <= 0) {
+        break;
+      }
+    }
+    quint32 base = dist[n];
+    for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+      int m = targets[e];
+      quint32 d = base + weights[e];
+      if (seen[m] != query) {
+        seen[m] = query;
+        dist[m] = d;
+        heap.Push (m, d);
+      } else if (done[m] != query && d < dist[m]) {
+        dist[m] = d;
+        heap.DecreaseKey (m, d);
+      }
+    }
+  }
+}
+
+DistanceMatrix::DistanceMatrix (const RoadGraph & roadGraph,
+                                const RouteHierarchy * routeHierarchy)
+  :graph (roadGraph),
+   hierarchy (routeHierarchy),
+   phase (Phase_Rows),
+   phaseItems (0),
+   chunkCount (1),
+   uniqueColumns (0),
+   rows (0),
+   columns (0),
+   threadCount (1),
+   msecs (0)
+{
+}
+
+DistanceMatrix::~DistanceMatrix ()
+{
+  qDeleteAll (searches);
+}
+
+bool
+DistanceMatrix::Compute (const QVector <int> & sources,
+                         const QVector <int> & targets,
+                         int threads)
+{
+  QTime clock;
+  clock.start ();
+  errorText.clear ();
+  int nodes = graph.NodeCount ();
+  for (int s=0; s<sources.count(); s++) {
+    if (sources.at(s) < 0 || sources.at(s) >= nodes) {
+      errorText = QString ("source %1 is not in the road graph").arg (s);
+      return false;
+    }
+  }
+  for (int t=0; t<targets.count(); t++) {
+    if (targets.at(t) < 0 || targets.at(t) >= nodes) {
+      errorText = QString ("target %1 is not in the road graph").arg (t);
+      return false;
+    }
+  }
+  threadCount = threads < 1 ? QThread::idealThreadCount () : threads;
+  rowNodes = sources;
+  columnNodes = targets;
+  rows = sources.count ();
+  columns = targets.count ();
+  costs.fill (Unreachable, rows * columns);
+  if (columnOf.count () != nodes) {
+    columnOf.fill (-1, nodes);
+    bucketStart.fill (-1, nodes);
+  }
+  firstColumn.resize (columns);
+  uniqueColumns = 0;
+  for (int c=0; c<columns; c++) {
+    int n = columnNodes.at(c);
+    if (columnOf.at(n) < 0) {
+      columnOf[n] = c;
+      uniqueColumns++;
+    }
+    firstColumn[c] = columnOf.at(n);
+  }
+  while (searches.count () < threadCount) {
+    searches.append (new Search (nodes));
+  }
+  if (hierarchy && hierarchy->IsOpen ()) {
+    targetBuckets.fill (QVector <BucketEntry> (), columns);
+    RunPhase (Phase_Buckets, columns);
+    MakeBuckets ();
+    RunPhase (Phase_Rows, rows);
+    for (int b=0; b<buckets.count(); b++) {
+      bucketStart[buckets.at(b).node] = -1;
+    }
+    buckets.clear ();
+  } else {
+    RunPhase (Phase_GraphRows, rows);
+  }
+  for (int c=0; c<columns; c++) {
+    columnOf[columnNodes.at(c)] = -1;
+  }
+  msecs = clock.elapsed ();
+  return true;
+}
+
+QString
+DistanceMatrix::Report () const
+{
+  return QString ("Distance matrix: %1 x %2 %3 in %4 msecs on %5 threads")
+             .arg (rows)
+             .arg (columns)
+             .arg (hierarchy && hierarchy->IsOpen () ? "by hierarchy buckets"
+                                                     : "by graph search")
+             .arg (msecs)
+             .arg (threadCount);
+}
+
+void
+DistanceMatrix::RunPhase (Phase newPhase, int items)
+{
+  phase = newPhase;
+  phaseItems = items;
+  chunkCount = qMin (threadCount, items);
+  if (chunkCount <= 1) {
+    chunkCount = 1;
+    RunChunk (0);
+    return;
+  }
+  QList <int> chunks;
+  for (int c=0; c<chunkCount; c++) {
+    chunks.append (c);
+  }
+  QtConcurrent::blockingMap (chunks, MatrixChunk (this));
+}
+
+/** @brief Items are dealt out round robin, so neighbouring rows, often
+  * of similar cost, land on different workers.
+  */
+
+void
+DistanceMatrix::RunChunk (int chunk)
+{
+  Search & search = *searches.at(chunk);
+  for (int i=chunk; i<phaseItems; i += chunkCount) {
+    switch (phase) {
+    case Phase_Buckets:
+      FillBuckets (i, search);
+      break;
+    case Phase_Rows:
+      HierarchyRow (i, search);
+      break;
+    case Phase_GraphRows:
+      GraphRow (i, search);
+      break;
+    }
+  }
+}
+
+/** @brief a target repeated in the list gets no buckets of its own,
+  * its column is copied from the first one
+  */
+
+void
+DistanceMatrix::FillBuckets (int column, Search & search)
+{
+  if (firstColumn.at(column) != column) {
+    return;
+  }
+  search.Run (hierarchy->DownOffsets (), hierarchy->DownTargets (),
+              hierarchy->DownWeights (), columnNodes.at(column), 0, 0);
+  const QVector <Reached> & settled = search.Settled ();
+  QVector <BucketEntry> & entries = targetBuckets[column];
+  entries.reserve (settled.count ());
+  BucketEntry entry;
+  entry.column = column;
+  for (int s=0; s<settled.count(); s++) {
+    entry.node = settled.at(s).node;
+    entry.dist = settled.at(s).dist;
+    entries.append (entry);
+  }
+}
+
+void
+DistanceMatrix::MakeBuckets ()
+{
+  int total (0);
+  for (int c=0; c<targetBuckets.count(); c++) {
+    total += targetBuckets.at(c).count ();
+  }
+  buckets.clear ();
+  buckets.reserve (total);
+  for (int c=0; c<targetBuckets.count(); c++) {
+    buckets += targetBuckets.at(c);
+  }
+  targetBuckets.clear ();
+  qSort (buckets);
+  for (int b=buckets.count()-1; b>=0; b--) {
+    bucketStart[buckets.at(b).node] = b;
+  }
+}
+
+void
+DistanceMatrix::HierarchyRow (int row, Search & search)
+{
+  search.Run (hierarchy->UpOffsets (), hierarchy->UpTargets (),
+              hierarchy->UpWeights (), rowNodes.at(row), 0, 0);
+  const QVector <Reached> & settled = search.Settled ();
+  quint32 * rowCosts = costs.data () + row * columns;
+  int bucketCount = buckets.count ();
+  for (int s=0; s<settled.count(); s++) {
+    quint32 node = settled.at(s).node;
+    for (int b=bucketStart.at(node);
+         b >= 0 && b < bucketCount && buckets.at(b).node == node; b++) {
+      const BucketEntry & entry = buckets.at(b);
+      quint32 cost = settled.at(s).dist + entry.dist;
+      if (cost < rowCosts[entry.column]) {
+        rowCosts[entry.column] = cost;
+      }
+    }
+  }
+  for (int c=0; c<columns; c++) {
+    rowCosts[c] = rowCosts[firstColumn.at(c)];
+  }
+}
+
+void
+DistanceMatrix::GraphRow (int row, Search & search)
+{
+  search.Run (graph.Offsets (), graph.Targets (), graph.Weights (),
+              rowNodes.at(row), &columnOf, uniqueColumns);
+  const QVector <Reached> & settled = search.Settled ();
+  quint32 * rowCosts = costs.data () + row * columns;
+  for (int s=0; s<settled.count(); s++) {
+    int column = columnOf.at (settled.at(s).node);
+    if (column >= 0) {
+      rowCosts[column] = settled.at(s).dist;
+    }
+  }
+  for (int c=0; c<columns; c++) {
+    rowCosts[c] = rowCosts[firstColumn.at(c)];
+  }
+}
+
+} // namespace
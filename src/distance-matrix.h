@@ -0,0 +1,142 @@
+#ifndef DISTANCE_MATRIX_H
+#define DISTANCE_MATRIX_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "road-graph.h"
+#include "route-hierarchy.h"
+#include "route-search.h"
+#include <QString>
+#include <QVector>
+
+namespace navi
+{
+
+/** @brief Travel times from every source to every target, as a dense
+  * row major matrix in tenths of a second.
+  *
+  * With a RouteHierarchy the matrix is computed with buckets: an
+  * upward search from every target over the downward edges leaves
+  * its distance in a bucket at every node it settles, then an upward
+  * search from every source combines its distances with the buckets
+  * of the nodes it settles. Without a hierarchy every row is a
+  * Dijkstra search on the road graph that stops when all targets are
+  * settled. Both phases run on the global thread pool, rows and
+  * targets dealt out to workers that each keep their own search
+  * state.
+  */
+
+class DistanceMatrix
+{
+public:
+
+  DistanceMatrix (const RoadGraph & roadGraph,
+                  const RouteHierarchy * routeHierarchy = 0);
+  ~DistanceMatrix ();
+
+  /** @brief sources and targets are graph nodes; false if one of
+    * them is not
+    */
+  bool Compute (const QVector <int> & sources,
+                const QVector <int> & targets,
+                int threads = 0);
+
+  int     Rows () const { return rows; }
+  int     Columns () const { return columns; }
+  quint32 Cost (int row, int column) const
+            { return costs.at (row * columns + column); }
+  const QVector <quint32> & Costs () const { return costs; }
+
+  QString ErrorString () const { return errorText; }
+  QString Report () const;
+
+  static const quint32 Unreachable;
+
+  /** @brief one worker's share of the current phase */
+  void RunChunk (int chunk);
+
+private:
+
+  struct Reached {
+    quint32  node;
+    quint32  dist;
+  };
+
+  struct BucketEntry {
+    quint32  node;
+    quint32  column;
+    quint32  dist;
+    bool operator < (const BucketEntry & other) const
+           { return node < other.node; }
+  };
+
+  /** @brief plain Dijkstra over one CSR edge list, from one node
+    * until the heap runs empty or the last goal is settled
+    */
+  class Search {
+  public:
+    Search (int nodes);
+    void Run (const quint32 * offsets, const quint32 * targets,
+              const quint32 * weights, int source,
+              const QVector <int> * goalColumns, int goals);
+    const QVector <Reached> & Settled () const { return settled; }
+  private:
+    QuadHeap           heap;
+    QVector <quint32>  seen;
+    QVector <quint32>  done;
+    QVector <quint32>  dist;
+    QVector <Reached>  settled;
+    quint32            query;
+  };
+
+  enum Phase { Phase_Buckets, Phase_Rows, Phase_GraphRows };
+
+  void RunPhase (Phase phase, int items);
+  void FillBuckets (int column, Search & search);
+  void HierarchyRow (int row, Search & search);
+  void GraphRow (int row, Search & search);
+  void MakeBuckets ();
+
+  const RoadGraph       & graph;
+  const RouteHierarchy  * hierarchy;
+  QVector <Search*>       searches;
+  QVector <int>           rowNodes;
+  QVector <int>           columnNodes;
+  QVector <int>           firstColumn;
+  QVector <int>           columnOf;
+  QVector <QVector <BucketEntry> >  targetBuckets;
+  QVector <BucketEntry>   buckets;
+  QVector <int>           bucketStart;
+  QVector <quint32>       costs;
+  Phase                   phase;
+  int                     phaseItems;
+  int                     chunkCount;
+  int                     uniqueColumns;
+  int                     rows;
+  int                     columns;
+  int                     threadCount;
+  int                     msecs;
+  QString                 errorText;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,185 @@
+#include "geo-cache.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+namespace navi
+{
+
+/** @brief Tag lists take most of the room, nodes are one unit each,
+  * so the budget is split in quarters and tags get two of them.
+  */
+
+GeoCache::GeoCache (int maxCost)
+{
+  SetMaxCost (maxCost);
+}
+
+void
+GeoCache::SetMaxCost (int maxCost)
+{
+  int quarter = qMax (maxCost / 4, 1);
+  nodes.setMaxCost (quarter);
+  tags.setMaxCost (2 * quarter);
+  wayNodes.setMaxCost (quarter / 2 + 1);
+  members.setMaxCost (quarter / 2 + 1);
+}
+
+void
+GeoCache::Clear ()
+{
+  nodes.clear ();
+  tags.clear ();
+  wayNodes.clear ();
+  members.clear ();
+}
+
+template <typename Key, typename T>
+bool
+GeoCache::Take (QCache <Key, T> & cache, const Key & key, T & value)
+{
+  T * found = cache.object (key);
+  if (found) {
+    value = *found;
+    counters.hits++;
+    return true;
+  }
+  counters.misses++;
+  return false;
+}
+
+/** @brief QCache drops least recently used entries without telling,
+  * so evictions are what the count is short of after the insert.
+  */
+
+template <typename Key, typename T>
+void
+GeoCache::Put (QCache <Key, T> & cache, const Key & key, const T & value,
+               int cost)
+{
+  int expect = cache.count () + (cache.contains (key) ? 0 : 1);
+  bool kept = cache.insert (key, new T (value), cost);
+  counters.evictions += expect - cache.count () - (kept ? 0 : 1);
+}
+
+bool
+GeoCache::Node (NaviId nodeId, NaviCoord & lat, NaviCoord & lon)
+{
+  LatLon latLon;
+  if (Take (nodes, nodeId, latLon)) {
+    lat = latLon.first;
+    lon = latLon.second;
+    return true;
+  }
+  return false;
+}
+
+void
+GeoCache::PutNode (NaviId nodeId, NaviCoord lat, NaviCoord lon)
+{
+  Put (nodes, nodeId, LatLon (lat, lon), 1);
+}
+
+void
+GeoCache::ForgetNode (NaviId nodeId)
+{
+  nodes.remove (nodeId);
+}
+
+bool
+GeoCache::Tags (const QString & type, NaviId id, TagList & tagList)
+{
+  return Take (tags, TypedId (type, id), tagList);
+}
+
+void
+GeoCache::PutTags (const QString & type, NaviId id, const TagList & tagList)
+{
+  Put (tags, TypedId (type, id), tagList, tagList.count () + 1);
+}
+
+void
+GeoCache::ForgetTags (const QString & type, NaviId id)
+{
+  tags.remove (TypedId (type, id));
+}
+
+bool
+GeoCache::WayNodes (NaviId wayId, NaviIdList & nodeList)
+{
+  return Take (wayNodes, wayId, nodeList);
+}
+
+void
+GeoCache::PutWayNodes (NaviId wayId, const NaviIdList & nodeList)
+{
+  Put (wayNodes, wayId, nodeList, nodeList.count () + 1);
+}
+
+void
+GeoCache::ForgetWayNodes (NaviId wayId)
+{
+  wayNodes.remove (wayId);
+}
+
+bool
+GeoCache::Members (NaviId relId, const QString & type, NaviIdList & refs)
+{
+  return Take (members, TypedId (type, relId), refs);
+}
+
+void
+GeoCache::PutMembers (NaviId relId, const QString & type, 
+                      const NaviIdList & refs)
+{
+  Put (members, TypedId (type, relId), refs, refs.count () + 1);
+}
+
+/** @brief member lists are kept per member type, a write may change
+  * any of them
+  */
+
+void
+GeoCache::ForgetMembers (NaviId relId)
+{
+  members.remove (TypedId ("node", relId));
+  members.remove (TypedId ("way", relId));
+  members.remove (TypedId ("relation", relId));
+}
+
+QString
+GeoCache::Report () const
+{
+  qint64 asked = counters.hits + counters.misses;
+  return QString ("cache: %1 hits %2 misses (%3%) %4 evictions, "
+                  "%5 nodes %6 tag lists %7 way lists %8 member lists")
+           .arg (counters.hits)
+           .arg (counters.misses)
+           .arg (asked > 0 ? (100.0 * counters.hits) / asked : 0.0, 
+                 0, 'f', 1)
+           .arg (counters.evictions)
+           .arg (nodes.count ())
+           .arg (tags.count ())
+           .arg (wayNodes.count ())
+           .arg (members.count ());
+}
+
+} // namespace
@@ -0,0 +1,98 @@
+#ifndef GEO_CACHE_H
+#define GEO_CACHE_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "navi-types.h"
+#include <QCache>
+#include <QPair>
+#include <QString>
+
+namespace navi
+{
+
+/** @brief Least recently used cache of what browsing asks for again
+  * and again: node coordinates, tag lists, way node lists and
+  * relation member lists. Each kind has its own QCache, the cost of
+  * an entry is the number of items in it, so maxCost bounds the
+  * number of ids and tags held in total. The Forget calls are made
+  * by the Write calls of the database managers, and the managers
+  * Clear it when another connection has written to the geobase.
+  */
+
+class GeoCache
+{
+public:
+
+  GeoCache (int maxCost = 256*1024);
+
+  void SetMaxCost (int maxCost);
+  void Clear ();
+
+  bool Node (NaviId nodeId, NaviCoord & lat, NaviCoord & lon);
+  void PutNode (NaviId nodeId, NaviCoord lat, NaviCoord lon);
+  void ForgetNode (NaviId nodeId);
+
+  bool Tags (const QString & type, NaviId id, TagList & tagList);
+  void PutTags (const QString & type, NaviId id, const TagList & tagList);
+  void ForgetTags (const QString & type, NaviId id);
+
+  bool WayNodes (NaviId wayId, NaviIdList & nodeList);
+  void PutWayNodes (NaviId wayId, const NaviIdList & nodeList);
+  void ForgetWayNodes (NaviId wayId);
+
+  bool Members (NaviId relId, const QString & type, NaviIdList & refs);
+  void PutMembers (NaviId relId, const QString & type, 
+                   const NaviIdList & refs);
+  void ForgetMembers (NaviId relId);
+
+  class Counters {
+  public:
+    Counters () : hits (0), misses (0), evictions (0) {}
+    qint64  hits;
+    qint64  misses;
+    qint64  evictions;
+  };
+
+  const Counters & Stats () const { return counters; }
+  QString Report () const;
+
+private:
+
+  typedef QPair <NaviCoord, NaviCoord>  LatLon;
+  typedef QPair <QString, NaviId>       TypedId;
+
+  template <typename Key, typename T>
+  bool Take (QCache <Key, T> & cache, const Key & key, T & value);
+  template <typename Key, typename T>
+  void Put (QCache <Key, T> & cache, const Key & key, const T & value,
+            int cost);
+
+  QCache <NaviId, LatLon>       nodes;
+  QCache <TypedId, TagList>     tags;
+  QCache <NaviId, NaviIdList>   wayNodes;
+  QCache <TypedId, NaviIdList>  members;
+  Counters                      counters;
+};
+
+} // namespace
+
+#endif
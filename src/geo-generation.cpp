@@ -0,0 +1,142 @@
+#include "geo-generation.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+#include <QVariant>
+
+namespace navi
+{
+
+GeoGeneration::GeoGeneration ()
+  :generation (0),
+   dataVersion (-1)
+{
+}
+
+const int GeoGeneration::CheckInterval;
+
+void
+GeoGeneration::Start (const QSqlDatabase & db)
+{
+  geoBase = db;
+  versionQuery = QSqlQuery (geoBase);
+  versionQuery.prepare ("pragma data_version");
+  storedQuery = QSqlQuery (geoBase);
+  storedQuery.prepare ("select value from navimeta "
+                       " where key = 'generation'");
+  checkClock = QTime ();
+  dataVersion = -1;
+  generation = Stored ();
+}
+
+void
+GeoGeneration::Stop ()
+{
+  versionQuery = QSqlQuery ();
+  storedQuery = QSqlQuery ();
+  geoBase = QSqlDatabase ();
+}
+
+/** @brief A driver without data_version returns no row, then the
+  * stored generation is read every time.
+  */
+
+bool
+GeoGeneration::OthersWrote ()
+{
+  if (!geoBase.isOpen ()) {
+    return false;
+  }
+  if (!checkClock.isNull () && checkClock.elapsed () < CheckInterval) {
+    return false;
+  }
+  checkClock.start ();
+  if (versionQuery.exec () && versionQuery.next ()) {
+    qint64 version = versionQuery.value(0).toLongLong();
+    versionQuery.finish ();
+    if (version == dataVersion) {
+      return false;
+    }
+    dataVersion = version;
+  } else {
+    versionQuery.finish ();
+  }
+  qint64 stored = Stored ();
+  if (stored == generation) {
+    return false;
+  }
+  generation = stored;
+  return true;
+}
+
+GeoGeneration::BumpResult
+GeoGeneration::Bump ()
+{
+  if (!geoBase.isOpen ()) {
+    return Bump_Done;
+  }
+  qint64 stored = Stored ();
+  if (stored != generation) {
+    generation = stored;
+    return Bump_Behind;
+  }
+  QSqlQuery update (geoBase);
+  update.prepare ("insert or replace into navimeta "
+                  " (key, value) VALUES ('generation', ?)");
+  update.bindValue (0, QVariant (QString::number (stored + 1)));
+  if (!update.exec ()) {
+    qDebug () << "GeoGeneration cannot write generation "
+              << update.lastError().text();
+    return Bump_Failed;
+  }
+  generation = stored + 1;
+  return Bump_Done;
+}
+
+QString
+GeoGeneration::MetaValue (const QString & key)
+{
+  QSqlQuery select (geoBase);
+  select.prepare ("select value from navimeta where key = ?");
+  select.bindValue (0, QVariant (key));
+  QString value;
+  if (select.exec () && select.next ()) {
+    value = select.value(0).toString();
+  }
+  return value;
+}
+
+qint64
+GeoGeneration::Stored ()
+{
+  qint64 stored (0);
+  if (storedQuery.exec () && storedQuery.next ()) {
+    stored = storedQuery.value(0).toLongLong();
+  }
+  storedQuery.finish ();
+  return stored;
+}
+
+} // namespace
@@ -0,0 +1,91 @@
+#ifndef GEO_GENERATION_H
+#define GEO_GENERATION_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QTime>
+
+namespace navi
+{
+
+/** @brief Write counter of a geobase shared by several connections.
+  * Each write transaction bumps the "generation" value in navimeta,
+  * and a connection holding state taken from the tables, such as the
+  * node store mapping, compares it with the value it saw last. The
+  * data_version pragma changes only when another connection commits,
+  * so while nobody else writes a check costs one pragma and no table
+  * read. The pragma and the generation read are prepared once, and
+  * checks closer together than CheckInterval milliseconds are skipped,
+  * so the lookups of a cache answer do not each run a statement.
+  */
+
+class GeoGeneration
+{
+public:
+
+  GeoGeneration ();
+
+  void Start (const QSqlDatabase & db);
+  void Stop ();
+
+  /** @brief true when another connection has written since the
+    * last call, or since Start. Within CheckInterval of the last
+    * check the answer is false without looking.
+    */
+  bool OthersWrote ();
+
+  enum BumpResult {
+    Bump_Done = 0,
+    Bump_Behind,
+    Bump_Failed
+  };
+
+  /** @brief note a write of this connection. Bump_Behind, and nothing
+    * written, when another connection has written since the last
+    * look; the caller catches up with that and bumps again.
+    * Bump_Failed when the new value could not be written, the
+    * generation then stays at the stored value.
+    */
+  BumpResult Bump ();
+
+  qint64  Value () const { return generation; }
+  QString MetaValue (const QString & key);
+
+private:
+
+  qint64 Stored ();
+
+  static const int CheckInterval = 100;
+
+  QSqlDatabase  geoBase;
+  QSqlQuery     versionQuery;
+  QSqlQuery     storedQuery;
+  QTime         checkClock;
+  qint64        generation;
+  qint64        dataVersion;
+};
+
+} // namespace
+
+#endif
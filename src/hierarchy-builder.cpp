@@ -0,0 +1,546 @@
+#include "hierarchy-builder.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QtConcurrentMap>
+#include <QThread>
+#include <QTime>
+#include <QFile>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <string.h>
+
+namespace navi
+{
+
+/** @brief nodes a witness search may settle before it gives up and
+  * the shortcut is added anyway. Priorities are only estimates, and
+  * recomputing them for the dense top of the hierarchy is most of the
+  * work, so their searches give up sooner.
+  */
+static const int WitnessSettleLimit (500);
+static const int PrioritySettleLimit (50);
+
+/** @brief below this many nodes a work list is not worth handing to
+  * the thread pool
+  */
+static const int SmallWork (64);
+
+struct HierarchyChunk {
+  typedef void result_type;
+  HierarchyChunk (HierarchyBuilder * b) : builder (b) {}
+  void operator() (int & chunk) { builder->RunChunk (chunk); }
+  HierarchyBuilder * builder;
+};
+
+HierarchyBuilder::WitnessSearch::WitnessSearch (int nodes)
+  :query (0)
+{
+  heap.Resize (nodes);
+  seen.fill (0, nodes);
+  done.fill (0, nodes);
+  dist.resize (nodes);
+  goal.fill (0, nodes);
+}
+
+void
+HierarchyBuilder::WitnessSearch::Run (const HierarchyBuilder & builder,
+                                      quint32 source, quint32 skip,
+                                      quint32 maxCost,
+                                      const ArcList & goals,
+                                      int maxSettled)
+{
+  query++;
+  if (query == 0) {
+    seen.fill (0);
+    done.fill (0);
+    goal.fill (0);
+    query = 1;
+  }
+  int goalsLeft (0);
+  for (int g=0; g<goals.count(); g++) {
+    quint32 x = goals.at(g).node;
+    if (x != source && goal[x] != query) {
+      goal[x] = query;
+      goalsLeft++;
+    }
+  }
+  heap.Clear ();
+  seen[source] = query;
+  dist[source] = 0;
+  heap.Push (source, 0);
+  int settled (0);
+  while (goalsLeft > 0 && !heap.IsEmpty () && heap.TopKey () <= maxCost
+         && settled < maxSettled) {
+    int n = heap.Pop ();
+    done[n] = query;
+    settled++;
+    if (goal[n] == query) {
+      goalsLeft--;
+    }
+    const ArcList & arcs = builder.out.at(n);
+    quint32 base = dist[n];
+    for (int a=0; a<arcs.count(); a++) {
+      quint32 m = arcs.at(a).node;
+      if (m == skip || builder.contracted.at(m)) {
+        continue;
+      }
+      quint32 d = base + arcs.at(a).weight;
+      if (seen[m] != query) {
+        seen[m] = query;
+        dist[m] = d;
+        heap.Push (m, d);
+      } else if (done[m] != query && d < dist[m]) {
+        dist[m] = d;
+        heap.DecreaseKey (m, d);
+      }
+    }
+  }
+}
+
+HierarchyBuilder::HierarchyBuilder ()
+  :workMode (Work_Priority),
+   nodeCount (0),
+   edgeCount (0),
+   shortcutCount (0),
+   rounds (0),
+   threadCount (1),
+   chunkCount (1),
+   buildMsecs (0)
+{
+}
+
+HierarchyBuilder::~HierarchyBuilder ()
+{
+  qDeleteAll (searches);
+}
+
+bool
+HierarchyBuilder::Build (const RoadGraph & graph, const QString & filename,
+                         int threads)
+{
+  QTime clock;
+  clock.start ();
+  if (!graph.IsOpen ()) {
+    return Fail ("no road graph");
+  }
+  threadCount = threads < 1 ? QThread::idealThreadCount () : threads;
+  nodeCount = graph.NodeCount ();
+  edgeCount = graph.EdgeCount ();
+  shortcutCount = 0;
+  rounds = 0;
+  out.fill (ArcList (), nodeCount);
+  in.fill (ArcList (), nodeCount);
+  up.fill (ArcList (), nodeCount);
+  down.fill (ArcList (), nodeCount);
+  contracted.fill (0, nodeCount);
+  priority.fill (0, nodeCount);
+  deleted.fill (0, nodeCount);
+  stamp.fill (0, nodeCount);
+  ranks.fill (0, nodeCount);
+  const quint32 * offsets = graph.Offsets ();
+  const quint32 * targets = graph.Targets ();
+  const quint32 * weights = graph.Weights ();
+  for (int n=0; n<nodeCount; n++) {
+    for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+      quint32 m = targets[e];
+      if (m != quint32 (n)) {
+        AddArc (out[n], m, weights[e], RouteHierarchy::NoMiddle);
+        AddArc (in[m], n, weights[e], RouteHierarchy::NoMiddle);
+      }
+    }
+  }
+  qDeleteAll (searches);
+  searches.clear ();
+  for (int t=0; t<threadCount; t++) {
+    searches.append (new WitnessSearch (nodeCount));
+  }
+  QList <quint32> remaining;
+  for (int n=0; n<nodeCount; n++) {
+    remaining.append (n);
+  }
+  work = remaining;
+  RunWork (Work_Priority);
+  int contractedCount (0);
+  while (!remaining.isEmpty ()) {
+    work.clear ();
+    for (int r=0; r<remaining.count(); r++) {
+      if (Independent (remaining.at(r))) {
+        work.append (remaining.at(r));
+      }
+    }
+    for (int w=0; w<work.count(); w++) {
+      contracted[work.at(w)] = 1;
+      ranks[work.at(w)] = contractedCount++;
+    }
+    RunWork (Work_Contract);
+    Contract (work);
+    RunWork (Work_Priority);
+    QList <quint32> left;
+    for (int r=0; r<remaining.count(); r++) {
+      if (!contracted.at (remaining.at(r))) {
+        left.append (remaining.at(r));
+      }
+    }
+    remaining = left;
+    rounds++;
+  }
+  qDeleteAll (searches);
+  searches.clear ();
+  out.clear ();
+  in.clear ();
+  bool ok = WriteFile (filename, graph);
+  buildMsecs = clock.elapsed ();
+  return ok;
+}
+
+QString
+HierarchyBuilder::Report () const
+{
+  int upCount (0), downCount (0);
+  for (int n=0; n<up.count(); n++) {
+    upCount += up.at(n).count ();
+    downCount += down.at(n).count ();
+  }
+  return QString ("Route hierarchy: %1 nodes, %2 graph edges, "
+                  "%3 shortcuts, %4 upward and %5 downward edges; "
+                  "%6 rounds on %7 threads in %8 msecs")
+             .arg (nodeCount)
+             .arg (edgeCount)
+             .arg (shortcutCount)
+             .arg (upCount)
+             .arg (downCount)
+             .arg (rounds)
+             .arg (threadCount)
+             .arg (buildMsecs);
+}
+
+bool
+HierarchyBuilder::Fail (const QString & message)
+{
+  errorText = message;
+  qDebug () << "HierarchyBuilder " << message;
+  return false;
+}
+
+/** @brief parallel arcs keep only the cheapest, true if the arc was
+  * added or made cheaper
+  */
+
+bool
+HierarchyBuilder::AddArc (ArcList & arcs, quint32 node, quint32 weight,
+                          quint32 middle)
+{
+  for (int a=0; a<arcs.count(); a++) {
+    if (arcs.at(a).node == node) {
+      if (weight >= arcs.at(a).weight) {
+        return false;
+      }
+      arcs[a].weight = weight;
+      arcs[a].middle = middle;
+      return true;
+    }
+  }
+  Arc arc;
+  arc.node = node;
+  arc.weight = weight;
+  arc.middle = middle;
+  arcs.append (arc);
+  return true;
+}
+
+void
+HierarchyBuilder::RemoveArc (ArcList & arcs, quint32 node)
+{
+  for (int a=0; a<arcs.count(); a++) {
+    if (arcs.at(a).node == node) {
+      arcs[a] = arcs.last ();
+      arcs.resize (arcs.count () - 1);
+      return;
+    }
+  }
+}
+
+/** @brief For every pair of a remaining neighbour u with an edge into
+  * the node and a remaining neighbour x with an edge out of it, a
+  * shortcut from u to x is needed unless a witness search from u finds
+  * a path to x that avoids the node and is no longer than the path
+  * through it. One search from u covers all of the x.
+  */
+
+void
+HierarchyBuilder::Shortcuts (quint32 node, WitnessSearch & search,
+                             int maxSettled,
+                             QVector <Shortcut> & result) const
+{
+  result.resize (0);
+  const ArcList & ins = in.at(node);
+  const ArcList & outs = out.at(node);
+  for (int i=0; i<ins.count(); i++) {
+    quint32 u = ins.at(i).node;
+    quint32 maxOut (0);
+    for (int o=0; o<outs.count(); o++) {
+      if (outs.at(o).node != u) {
+        maxOut = qMax (maxOut, outs.at(o).weight);
+      }
+    }
+    if (maxOut == 0) {
+      continue;
+    }
+    search.Run (*this, u, node, ins.at(i).weight + maxOut, outs,
+                maxSettled);
+    for (int o=0; o<outs.count(); o++) {
+      quint32 x = outs.at(o).node;
+      if (x == u) {
+        continue;
+      }
+      quint32 weight = ins.at(i).weight + outs.at(o).weight;
+      if (search.Distance (x) > weight) {
+        Shortcut shortcut;
+        shortcut.from = u;
+        shortcut.to = x;
+        shortcut.weight = weight;
+        shortcut.middle = node;
+        result.append (shortcut);
+      }
+    }
+  }
+}
+
+int
+HierarchyBuilder::Priority (quint32 node, WitnessSearch & search) const
+{
+  QVector <Shortcut> shortcuts;
+  Shortcuts (node, search, PrioritySettleLimit, shortcuts);
+  return shortcuts.count () - in.at(node).count () - out.at(node).count ()
+         + deleted.at(node);
+}
+
+/** @brief Priority work writes the priority of its own nodes, contract
+  * work the shortcuts of its own slot; neither touches the graph.
+  */
+
+void
+HierarchyBuilder::RunChunk (int chunk)
+{
+  WitnessSearch & search = *searches.at(chunk);
+  for (int w=chunk; w<work.count(); w += chunkCount) {
+    quint32 node = work.at(w);
+    if (workMode == Work_Priority) {
+      priority[node] = Priority (node, search);
+    } else {
+      Shortcuts (node, search, WitnessSettleLimit, workShortcuts[w]);
+    }
+  }
+}
+
+void
+HierarchyBuilder::RunWork (WorkMode mode)
+{
+  workMode = mode;
+  if (mode == Work_Contract) {
+    workShortcuts.fill (QVector <Shortcut> (), work.count ());
+  }
+  if (work.count () < SmallWork || threadCount == 1) {
+    chunkCount = 1;
+    RunChunk (0);
+    return;
+  }
+  chunkCount = threadCount;
+  QList <int> chunks;
+  for (int c=0; c<chunkCount; c++) {
+    chunks.append (c);
+  }
+  QtConcurrent::blockingMap (chunks, HierarchyChunk (this));
+}
+
+/** @brief ties in priority go to the lower node number */
+
+bool
+HierarchyBuilder::Independent (quint32 node) const
+{
+  int prio = priority.at(node);
+  const ArcList * lists[2] = { &out.at(node), &in.at(node) };
+  for (int l=0; l<2; l++) {
+    const ArcList & arcs = *lists[l];
+    for (int a=0; a<arcs.count(); a++) {
+      quint32 m = arcs.at(a).node;
+      int other = priority.at(m);
+      if (other < prio || (other == prio && m < node)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/** @brief The remaining edges of a contracted node are its edges in
+  * the hierarchy. They are taken out of the remaining graph, the
+  * shortcuts of the round go in, and the neighbours become the work
+  * list for new priorities.
+  */
+
+void
+HierarchyBuilder::Contract (const QList <quint32> & nodes)
+{
+  QList <quint32> neighbours;
+  for (int i=0; i<nodes.count(); i++) {
+    quint32 node = nodes.at(i);
+    up[node] = out.at(node);
+    down[node] = in.at(node);
+    const ArcList * lists[2] = { &up.at(node), &down.at(node) };
+    for (int l=0; l<2; l++) {
+      const ArcList & arcs = *lists[l];
+      for (int a=0; a<arcs.count(); a++) {
+        quint32 m = arcs.at(a).node;
+        RemoveArc (l == 0 ? in[m] : out[m], node);
+        if (stamp.at(m) != node + 1) {
+          stamp[m] = node + 1;
+          deleted[m]++;
+          neighbours.append (m);
+        }
+      }
+    }
+    out[node] = ArcList ();
+    in[node] = ArcList ();
+  }
+  for (int i=0; i<workShortcuts.count(); i++) {
+    const QVector <Shortcut> & shortcuts = workShortcuts.at(i);
+    for (int s=0; s<shortcuts.count(); s++) {
+      const Shortcut & shortcut = shortcuts.at(s);
+      if (AddArc (out[shortcut.from], shortcut.to, shortcut.weight,
+                  shortcut.middle)) {
+        shortcutCount++;
+      }
+      AddArc (in[shortcut.to], shortcut.from, shortcut.weight,
+              shortcut.middle);
+    }
+  }
+  workShortcuts.clear ();
+  qSort (neighbours);
+  work.clear ();
+  for (int n=0; n<neighbours.count(); n++) {
+    if (n == 0 || neighbours.at(n) != neighbours.at(n-1)) {
+      work.append (neighbours.at(n));
+    }
+  }
+}
+
+/** @brief append one column at the next 8 byte boundary */
+
+static bool
+WriteColumn (QFile & file, RouteHierarchy::SectionEntry & entry,
+             const QVector <quint32> & data)
+{
+  qint64 pos = file.pos ();
+  qint64 aligned = (pos + 7) & ~Q_INT64_C(7);
+  if (aligned > pos) {
+    if (file.write (QByteArray (aligned - pos, 0)) != aligned - pos) {
+      return false;
+    }
+  }
+  entry.offset = aligned;
+  entry.count = data.count ();
+  qint64 bytes = qint64 (data.count ()) * sizeof (quint32);
+  return bytes == 0
+      || file.write (reinterpret_cast <const char*> (data.constData ()),
+                     bytes) == bytes;
+}
+
+bool
+HierarchyBuilder::WriteFile (const QString & filename,
+                             const RoadGraph & graph)
+{
+  QVector <quint32> upOffsets, upTargets, upWeights, upMiddles;
+  QVector <quint32> downOffsets, downTargets, downWeights, downMiddles;
+  upOffsets.reserve (nodeCount + 1);
+  downOffsets.reserve (nodeCount + 1);
+  for (int n=0; n<nodeCount; n++) {
+    upOffsets.append (upTargets.count ());
+    const ArcList & ups = up.at(n);
+    for (int a=0; a<ups.count(); a++) {
+      upTargets.append (ups.at(a).node);
+      upWeights.append (ups.at(a).weight);
+      upMiddles.append (ups.at(a).middle);
+    }
+    downOffsets.append (downTargets.count ());
+    const ArcList & downs = down.at(n);
+    for (int a=0; a<downs.count(); a++) {
+      downTargets.append (downs.at(a).node);
+      downWeights.append (downs.at(a).weight);
+      downMiddles.append (downs.at(a).middle);
+    }
+  }
+  upOffsets.append (upTargets.count ());
+  downOffsets.append (downTargets.count ());
+
+  QFile file (filename + ".tmp");
+  if (!file.open (QFile::WriteOnly | QFile::Truncate)) {
+    return Fail (file.errorString ());
+  }
+  RouteHierarchy::Header header;
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, RouteHierarchy::Magic, sizeof (header.magic));
+  header.version = RouteHierarchy::Version;
+  header.sectionCount = RouteHierarchy::Sec_Count;
+  header.graphNodes = graph.NodeCount ();
+  header.graphEdges = graph.EdgeCount ();
+  RouteHierarchy::SectionEntry table[RouteHierarchy::Sec_Count];
+  memset (table, 0, sizeof (table));
+  bool ok = file.write (reinterpret_cast <const char*> (&header),
+                        sizeof (header)) == qint64 (sizeof (header))
+         && file.write (reinterpret_cast <const char*> (table),
+                        sizeof (table)) == qint64 (sizeof (table));
+
+#define HIERARCHY_COLUMN(sec, vec) \
+  ok = ok && WriteColumn (file, table[RouteHierarchy::sec], vec)
+
+  HIERARCHY_COLUMN (Sec_Ranks, ranks);
+  HIERARCHY_COLUMN (Sec_UpOffsets, upOffsets);
+  HIERARCHY_COLUMN (Sec_UpTargets, upTargets);
+  HIERARCHY_COLUMN (Sec_UpWeights, upWeights);
+  HIERARCHY_COLUMN (Sec_UpMiddles, upMiddles);
+  HIERARCHY_COLUMN (Sec_DownOffsets, downOffsets);
+  HIERARCHY_COLUMN (Sec_DownTargets, downTargets);
+  HIERARCHY_COLUMN (Sec_DownWeights, downWeights);
+  HIERARCHY_COLUMN (Sec_DownMiddles, downMiddles);
+
+#undef HIERARCHY_COLUMN
+
+  ok = ok && file.seek (sizeof (header))
+          && file.write (reinterpret_cast <const char*> (table),
+                         sizeof (table)) == qint64 (sizeof (table));
+  if (!ok) {
+    QString error = file.errorString ();
+    file.close ();
+    file.remove ();
+    return Fail (error);
+  }
+  file.close ();
+  QFile::remove (filename);
+  if (!file.rename (filename)) {
+    return Fail (file.errorString ());
+  }
+  return true;
+}
+
+} // namespace
@@ -0,0 +1,143 @@
+#ifndef HIERARCHY_BUILDER_H
+#define HIERARCHY_BUILDER_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "route-hierarchy.h"
+#include "road-graph.h"
+#include "route-search.h"
+#include <QString>
+#include <QList>
+#include <QVector>
+
+namespace navi
+{
+
+/** @brief Contracts a RoadGraph into a RouteHierarchy file.
+  *
+  * The priority of a node is its edge difference, the shortcuts its
+  * contraction would add less the edges it would remove, plus the
+  * number of its neighbours already contracted so the contraction
+  * spreads evenly. Each round contracts the nodes whose priority is
+  * lower than that of all their remaining neighbours; those nodes
+  * share no edges, so their witness searches and shortcuts are
+  * computed on the global thread pool, each worker with its own
+  * search state. Witness paths may not pass through any node of the
+  * round, as two nodes of one round could otherwise each take the
+  * other as the witness and both drop the shortcut. The shortcuts are then inserted and the priorities
+  * of the neighbours recomputed, again in parallel. The file is
+  * written under a temporary name and renamed when complete.
+  */
+
+class HierarchyBuilder
+{
+public:
+
+  HierarchyBuilder ();
+  ~HierarchyBuilder ();
+
+  bool Build (const RoadGraph & graph, const QString & filename,
+              int threads = 0);
+
+  QString ErrorString () const { return errorText; }
+  QString Report () const;
+
+  struct Arc {
+    quint32  node;
+    quint32  weight;
+    quint32  middle;
+  };
+
+  typedef QVector <Arc> ArcList;
+
+  struct Shortcut {
+    quint32  from;
+    quint32  to;
+    quint32  weight;
+    quint32  middle;
+  };
+
+  /** @brief bounded Dijkstra on the remaining graph that leaves out
+    * the node being contracted and the others of its round, and
+    * stops once all of the goals are settled
+    */
+  class WitnessSearch {
+  public:
+    WitnessSearch (int nodes);
+    void Run (const HierarchyBuilder & builder, quint32 source,
+              quint32 skip, quint32 maxCost, const ArcList & goals,
+              int maxSettled);
+    quint32 Distance (quint32 node) const
+      { return seen[node] == query ? dist[node] : 0xffffffff; }
+  private:
+    QuadHeap           heap;
+    QVector <quint32>  seen;
+    QVector <quint32>  done;
+    QVector <quint32>  dist;
+    QVector <quint32>  goal;
+    quint32            query;
+  };
+
+  enum WorkMode { Work_Priority, Work_Contract };
+
+  /** @brief one worker's share of the current work list */
+  void RunChunk (int chunk);
+
+private:
+
+  void Shortcuts (quint32 node, WitnessSearch & search, int maxSettled,
+                  QVector <Shortcut> & result) const;
+  int  Priority (quint32 node, WitnessSearch & search) const;
+  void RunWork (WorkMode mode);
+  bool Independent (quint32 node) const;
+  void Contract (const QList <quint32> & nodes);
+  static bool AddArc (ArcList & arcs, quint32 node, quint32 weight,
+                      quint32 middle);
+  static void RemoveArc (ArcList & arcs, quint32 node);
+  bool WriteFile (const QString & filename, const RoadGraph & graph);
+  bool Fail (const QString & message);
+
+  QString                      errorText;
+  QVector <ArcList>            out;
+  QVector <ArcList>            in;
+  QVector <ArcList>            up;
+  QVector <ArcList>            down;
+  QVector <char>               contracted;
+  QVector <int>                priority;
+  QVector <int>                deleted;
+  QVector <quint32>            stamp;
+  QVector <quint32>            ranks;
+  QVector <WitnessSearch*>     searches;
+  QList <quint32>              work;
+  WorkMode                     workMode;
+  QVector <QVector <Shortcut> > workShortcuts;
+  int                          nodeCount;
+  int                          edgeCount;
+  int                          shortcutCount;
+  int                          rounds;
+  int                          threadCount;
+  int                          chunkCount;
+  int                          buildMsecs;
+};
+
+} // namespace
+
+#endif
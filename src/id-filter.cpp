@@ -0,0 +1,118 @@
+#include "id-filter.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+
+namespace navi
+{
+
+const int IdFilter::BitsPerId;
+const int IdFilter::DefaultHashes;
+
+IdFilter::IdFilter ()
+  :numBits (0),
+   hashes (DefaultHashes),
+   count (0),
+   capacity (0)
+{
+}
+
+/** @brief room for at least a thousand ids, so a new geobase does
+  * not start out overfull
+  */
+
+void
+IdFilter::Reset (qint64 expectedIds)
+{
+  capacity = qMax (expectedIds, qint64 (1000));
+  numBits = quint64 (capacity) * BitsPerId;
+  numBits = (numBits + 63) & ~quint64 (63);
+  bits.fill (0, numBits / 8);
+  hashes = DefaultHashes;
+  count = 0;
+}
+
+bool
+IdFilter::Restore (const QByteArray & savedBits, qint64 savedCount,
+                   qint64 savedCapacity, int savedHashes)
+{
+  if (savedBits.isEmpty () || savedHashes < 1) {
+    return false;
+  }
+  bits = savedBits;
+  numBits = quint64 (bits.size ()) * 8;
+  count = savedCount;
+  capacity = savedCapacity;
+  hashes = savedHashes;
+  return true;
+}
+
+/** @brief the splitmix64 finalizer, OSM ids are dense so they need
+  * spreading out before they pick bits
+  */
+
+quint64
+IdFilter::Mix (quint64 x)
+{
+  x ^= x >> 30;
+  x *= Q_UINT64_C (0xbf58476d1ce4e5b9);
+  x ^= x >> 27;
+  x *= Q_UINT64_C (0x94d049bb133111eb);
+  x ^= x >> 31;
+  return x;
+}
+
+void
+IdFilter::Add (NaviId id)
+{
+  if (numBits == 0) {
+    Reset (0);
+  }
+  quint64 h1 = Mix (quint64 (id));
+  quint64 h2 = Mix (h1) | 1;
+  uchar * data = reinterpret_cast <uchar*> (bits.data ());
+  for (int h=0; h<hashes; h++) {
+    quint64 bit = (h1 + h * h2) % numBits;
+    data[bit >> 3] |= uchar (1 << (bit & 7));
+  }
+  count++;
+}
+
+bool
+IdFilter::MayContain (NaviId id) const
+{
+  if (numBits == 0) {
+    return false;
+  }
+  quint64 h1 = Mix (quint64 (id));
+  quint64 h2 = Mix (h1) | 1;
+  const uchar * data = reinterpret_cast <const uchar*> (bits.constData ());
+  for (int h=0; h<hashes; h++) {
+    quint64 bit = (h1 + h * h2) % numBits;
+    if ((data[bit >> 3] & (1 << (bit & 7))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
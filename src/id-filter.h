@@ -0,0 +1,73 @@
+#ifndef ID_FILTER_H
+#define ID_FILTER_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "navi-types.h"
+#include <QByteArray>
+
+namespace navi
+{
+
+/** @brief Bloom filter over element ids. MayContain is false only for
+  * ids that were never added, so a negative answer needs no query and
+  * a positive one still has to be checked. Sized for about 1% false
+  * positives at capacity; past that it still works, only with more
+  * false positives, until it is rebuilt larger.
+  */
+
+class IdFilter
+{
+public:
+
+  IdFilter ();
+
+  void Reset (qint64 expectedIds);
+  bool Restore (const QByteArray & bits, qint64 count, 
+                qint64 capacity, int hashes);
+
+  void Add (NaviId id);
+  bool MayContain (NaviId id) const;
+
+  bool       IsEmpty () const { return numBits == 0; }
+  bool       Overfull () const { return count > capacity; }
+  qint64     Count () const { return count; }
+  qint64     Capacity () const { return capacity; }
+  int        Hashes () const { return hashes; }
+  const QByteArray & Bits () const { return bits; }
+
+  static const int BitsPerId = 10;
+  static const int DefaultHashes = 7;
+
+private:
+
+  static quint64 Mix (quint64 x);
+
+  QByteArray  bits;
+  quint64     numBits;
+  int         hashes;
+  qint64      count;
+  qint64      capacity;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,279 @@
+#include "ingest-pipeline.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include "osm-reader.h"
+#include "osm-batch-writer.h"
+#include "db-manager.h"
+#include <QMutexLocker>
+#include <QTimer>
+#include <QDebug>
+
+namespace navi
+{
+
+void
+IngestParser::run ()
+{
+  QString filename;
+  while (pipeline->NextFile (filename)) {
+    OsmReader * reader = OsmReader::ForFile (filename);
+    if (!reader->Open (filename)) {
+      pipeline->FileMessage (reader->ErrorString ());
+      delete reader;
+      continue;
+    }
+    pipeline->FileMessage (QString ("Parsing \"%1\" %2 bytes")
+                             .arg (filename).arg (reader->Size ()));
+    int count (0);
+    QTime busy;
+    busy.start ();
+    OsmBatch batch;
+    bool queued (true);
+    while (reader->ReadBatch (batch)) {
+      pipeline->Parsed (batch.Count (), busy.elapsed ());
+      count += batch.Count ();
+      batch.source = filename;
+      queued = pipeline->queue.Put (batch);
+      if (!queued) {
+        break;
+      }
+      busy.restart ();
+    }
+    if (queued) {
+      batch.clear ();
+      batch.source = filename;
+      batch.endOfFile = true;
+      pipeline->queue.Put (batch);
+    }
+    if (reader->HasError ()) {
+      pipeline->FileMessage (QString ("%1: %2").arg (filename)
+                                     .arg (reader->ErrorString ()));
+    }
+    pipeline->FileMessage (QString ("Parsed \"%1\": %2 elements")
+                                  .arg (filename).arg (count));
+    reader->Close ();
+    delete reader;
+  }
+  pipeline->ParserDone ();
+}
+
+void
+IngestWriter::run ()
+{
+  DbManager db;
+  db.Start ("ingestWriterCon", pipeline->dbName);
+  if (pipeline->bulkLoad) {
+    db.StartBulkLoad (pipeline->bulkCacheKB);
+  }
+  OsmBatchWriter batchWriter (db);
+  OsmBatch batch;
+  QTime busy;
+  while (pipeline->queue.Take (batch)) {
+    if (batch.endOfFile) {
+      pipeline->FileMessage (batchWriter.FileReport (batch.source));
+      continue;
+    }
+    busy.start ();
+    batchWriter.Write (batch);
+    pipeline->Written (batch.Count (), busy.elapsed ());
+  }
+  if (pipeline->bulkLoad) {
+    pipeline->FileMessage ("Rebuilding indexes");
+    busy.start ();
+    db.FinishBulkLoad ();
+    pipeline->FileMessage (QString ("Indexes rebuilt in %1 msecs")
+                                   .arg (busy.elapsed ()));
+  }
+  if (pipeline->buildNodeStore) {
+    pipeline->FileMessage ("Building node store");
+    busy.start ();
+    bool built = db.BuildNodeStore ();
+    pipeline->FileMessage (QString ("Node store %1 in %2 msecs")
+                                   .arg (built ? "built" : "failed")
+                                   .arg (busy.elapsed ()));
+  }
+  db.Stop ();
+}
+
+IngestPipeline::IngestPipeline (QObject *parent)
+  :QObject (parent),
+   writer (0),
+   reportTimer (0),
+   parsersRunning (0),
+   running (false),
+   bulkLoad (false),
+   bulkCacheKB (0),
+   buildNodeStore (false)
+{
+  reportTimer = new QTimer (this);
+  connect (reportTimer, SIGNAL (timeout()), this, SLOT (ReportProgress()));
+}
+
+IngestPipeline::~IngestPipeline ()
+{
+  queue.Close ();
+  for (int p=0; p<parsers.count(); p++) {
+    parsers.at(p)->wait ();
+    delete parsers.at(p);
+  }
+  if (writer) {
+    writer->wait ();
+    delete writer;
+  }
+}
+
+bool
+IngestPipeline::Start (const QStringList & fileList,
+                       const QString & geoBaseName,
+                       int numParsers,
+                       int queueDepth)
+{
+  if (running) {
+    return false;
+  }
+  for (int p=0; p<parsers.count(); p++) {
+    delete parsers.at(p);
+  }
+  parsers.clear ();
+  delete writer;
+  writer = 0;
+  files = fileList;
+  dbName = geoBaseName;
+  messages.clear ();
+  parseStats = StageStats ();
+  writeStats = StageStats ();
+  queue.Reopen (queueDepth);
+  running = true;
+  clock.start ();
+
+  writer = new IngestWriter (this);
+  connect (writer, SIGNAL (finished()), this, SLOT (WriterFinished()));
+  writer->start ();
+  if (numParsers < 1) {
+    numParsers = 1;
+  }
+  parsersRunning = numParsers;
+  for (int p=0; p<numParsers; p++) {
+    IngestParser * parser = new IngestParser (this);
+    parsers.append (parser);
+    parser->start ();
+  }
+  reportTimer->start (2000);
+  return true;
+}
+
+bool
+IngestPipeline::NextFile (QString & filename)
+{
+  QMutexLocker locker (&lock);
+  if (files.isEmpty ()) {
+    return false;
+  }
+  filename = files.takeFirst ();
+  return true;
+}
+
+void
+IngestPipeline::ParserDone ()
+{
+  QMutexLocker locker (&lock);
+  parsersRunning--;
+  if (parsersRunning <= 0) {
+    queue.Close ();
+  }
+}
+
+void
+IngestPipeline::Parsed (int elements, int msecs)
+{
+  QMutexLocker locker (&lock);
+  parseStats.elements += elements;
+  parseStats.batches++;
+  parseStats.busyMsecs += msecs;
+}
+
+void
+IngestPipeline::Written (int elements, int msecs)
+{
+  QMutexLocker locker (&lock);
+  writeStats.elements += elements;
+  writeStats.batches++;
+  writeStats.busyMsecs += msecs;
+}
+
+void
+IngestPipeline::FileMessage (const QString & message)
+{
+  QMutexLocker locker (&lock);
+  messages.append (message);
+}
+
+QString
+IngestPipeline::StageLine (const QString & name, const StageStats & stats)
+{
+  return QString ("%1: %2 elements in %3 batches, %4 msecs busy, "
+                  "%5 elements/s")
+             .arg (name)
+             .arg (stats.elements)
+             .arg (stats.batches)
+             .arg (stats.busyMsecs)
+             .arg (stats.Rate (), 0, 'f', 0);
+}
+
+void
+IngestPipeline::ReportProgress ()
+{
+  QStringList report;
+  {
+    QMutexLocker locker (&lock);
+    report = messages;
+    messages.clear ();
+    report.append (StageLine ("parse", parseStats));
+    report.append (StageLine ("write", writeStats));
+  }
+  report.append (QString ("queue %1 of %2 batches")
+                   .arg (queue.Count ()).arg (queue.Capacity ()));
+  for (int r=0; r<report.count(); r++) {
+    emit Progress (report.at(r));
+  }
+}
+
+void
+IngestPipeline::WriterFinished ()
+{
+  reportTimer->stop ();
+  for (int p=0; p<parsers.count(); p++) {
+    parsers.at(p)->wait ();
+  }
+  ReportProgress ();
+  running = false;
+  double secs = clock.elapsed () / 1000.0;
+  emit Finished (QString ("ingest done: %1 elements in %2 secs, "
+                          "%3 elements/s overall")
+                   .arg (writeStats.elements)
+                   .arg (secs, 0, 'f', 1)
+                   .arg (secs > 0 ? writeStats.elements / secs : 0.0,
+                         0, 'f', 0));
+}
+
+} // namespace
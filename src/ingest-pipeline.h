@@ -0,0 +1,152 @@
+#ifndef INGEST_PIPELINE_H
+#define INGEST_PIPELINE_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "osm-batch.h"
+#include "bounded-queue.h"
+#include <QObject>
+#include <QThread>
+#include <QStringList>
+#include <QMutex>
+#include <QTime>
+#include <QList>
+
+class QTimer;
+
+namespace navi
+{
+
+class IngestPipeline;
+
+/** @brief Parser stage: takes files from the pipeline until none
+  * are left and puts the parsed batches on the queue, each file
+  * followed by an endOfFile batch.
+  */
+
+class IngestParser : public QThread
+{
+public:
+
+  IngestParser (IngestPipeline * pipe) : pipeline (pipe) {}
+
+protected:
+
+  void run ();
+
+private:
+
+  IngestPipeline  *pipeline;
+};
+
+/** @brief Writer stage: owns the only database connection used by
+  * the ingest, and writes batches in the order they were queued.
+  * At the end of each file it reports how many elements were new,
+  * updated or unchanged.
+  */
+
+class IngestWriter : public QThread
+{
+public:
+
+  IngestWriter (IngestPipeline * pipe) : pipeline (pipe) {}
+
+protected:
+
+  void run ();
+
+private:
+
+  IngestPipeline  *pipeline;
+};
+
+class IngestPipeline : public QObject
+{
+Q_OBJECT
+
+public:
+
+  IngestPipeline (QObject *parent=0);
+  ~IngestPipeline ();
+
+  bool Start (const QStringList & files,
+              const QString & geoBaseName,
+              int numParsers = 1,
+              int queueDepth = 8);
+  bool Running () const { return running; }
+  void SetBulkLoad (bool bulk, int cacheKB)
+    { bulkLoad = bulk; bulkCacheKB = cacheKB; }
+  void SetNodeStore (bool build) { buildNodeStore = build; }
+
+  class StageStats {
+  public:
+    StageStats () : elements (0), batches (0), busyMsecs (0) {}
+    qint64  elements;
+    qint64  batches;
+    qint64  busyMsecs;
+    double  Rate () const
+      { return busyMsecs > 0 ? (1000.0 * elements) / busyMsecs : 0.0; }
+  };
+
+signals:
+
+  void Progress (const QString & message);
+  void Finished (const QString & summary);
+
+private slots:
+
+  void ReportProgress ();
+  void WriterFinished ();
+
+private:
+
+  friend class IngestParser;
+  friend class IngestWriter;
+
+  bool    NextFile (QString & filename);
+  void    ParserDone ();
+  void    Parsed (int elements, int msecs);
+  void    Written (int elements, int msecs);
+  void    FileMessage (const QString & message);
+  QString StageLine (const QString & name, const StageStats & stats);
+
+  BoundedQueue <OsmBatch>   queue;
+  QList <IngestParser*>     parsers;
+  IngestWriter             *writer;
+  QTimer                   *reportTimer;
+
+  QMutex         lock;
+  QStringList    files;
+  QStringList    messages;
+  QString        dbName;
+  int            parsersRunning;
+  bool           running;
+  bool           bulkLoad;
+  int            bulkCacheKB;
+  bool           buildNodeStore;
+  StageStats     parseStats;
+  StageStats     writeStats;
+  QTime          clock;
+};
+
+} // namespace
+
+#endif
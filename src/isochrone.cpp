@@ -0,0 +1,480 @@
+#include "isochrone.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QtConcurrentMap>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMultiHash>
+#include <QtAlgorithms>
+#include <math.h>
+
+namespace navi
+{
+
+static const quint32 Unreached (0xffffffff);
+
+/** @brief an outline grid larger than this gets coarser cells */
+static const qint64 MaxCells (4000000);
+
+IsochroneSearch::IsochroneSearch (const RoadGraph & roadGraph,
+                                  const RouteHierarchy * routeHierarchy)
+  :graph (roadGraph),
+   hierarchy (routeHierarchy),
+   query (0),
+   limit (0)
+{
+  int count = graph.NodeCount ();
+  if (hierarchy && (!hierarchy->IsOpen ()
+                    || hierarchy->NodeCount () != count)) {
+    hierarchy = 0;
+  }
+  heap.Resize (count);
+  seen.fill (0, count);
+  done.fill (0, count);
+  dist.resize (count);
+  if (hierarchy) {
+    sweepOrder.resize (count);
+    const quint32 * ranks = hierarchy->Ranks ();
+    for (int n=0; n<count; n++) {
+      sweepOrder[count - 1 - ranks[n]] = n;
+    }
+  }
+}
+
+void
+IsochroneSearch::NewQuery ()
+{
+  query++;
+  if (query == 0) {
+    seen.fill (0);
+    done.fill (0);
+    query = 1;
+  }
+  heap.Clear ();
+  nodes.resize (0);
+  times.resize (0);
+}
+
+bool
+IsochroneSearch::Reach (int from, quint32 timeLimit)
+{
+  NewQuery ();
+  limit = timeLimit;
+  if (from < 0 || from >= graph.NodeCount ()) {
+    return false;
+  }
+  if (hierarchy) {
+    SweepReach (from);
+  } else {
+    GraphReach (from);
+  }
+  return true;
+}
+
+quint32
+IsochroneSearch::Time (int node) const
+{
+  bool reached = hierarchy ? seen[node] == query : done[node] == query;
+  return reached && dist[node] <= limit ? dist[node] : Unreached;
+}
+
+void
+IsochroneSearch::GraphReach (int from)
+{
+  const quint32 * offsets = graph.Offsets ();
+  const quint32 * targets = graph.Targets ();
+  const quint32 * weights = graph.Weights ();
+  seen[from] = query;
+  dist[from] = 0;
+  heap.Push (from, 0);
+  while (!heap.IsEmpty () && heap.TopKey () <= limit) {
+    int n = heap.Pop ();
+    done[n] = query;
+    nodes.append (n);
+    times.append (dist[n]);
+    quint32 base = dist[n];
+    for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+      int m = targets[e];
+      quint32 d = base + weights[e];
+      if (seen[m] != query) {
+        seen[m] = query;
+        dist[m] = d;
+        heap.Push (m, d);
+      } else if (done[m] != query && d < dist[m]) {
+        dist[m] = d;
+        heap.DecreaseKey (m, d);
+      }
+    }
+  }
+}
+
+/** @brief The upward search stops at the limit, as nothing beyond it
+  * can lead back under it. In the sweep every node pulls from the
+  * nodes above it over its downward edges; those come earlier in the
+  * sweep, so their times are final. seen marks the nodes with a time.
+  */
+
+void
+IsochroneSearch::SweepReach (int from)
+{
+  const quint32 * upOffsets = hierarchy->UpOffsets ();
+  const quint32 * upTargets = hierarchy->UpTargets ();
+  const quint32 * upWeights = hierarchy->UpWeights ();
+  seen[from] = query;
+  dist[from] = 0;
+  heap.Push (from, 0);
+  while (!heap.IsEmpty () && heap.TopKey () <= limit) {
+    int n = heap.Pop ();
+    done[n] = query;
+    quint32 base = dist[n];
+    for (quint32 e=upOffsets[n]; e<upOffsets[n+1]; e++) {
+      int m = upTargets[e];
+      quint32 d = base + upWeights[e];
+      if (seen[m] != query) {
+        seen[m] = query;
+        dist[m] = d;
+        heap.Push (m, d);
+      } else if (done[m] != query && d < dist[m]) {
+        dist[m] = d;
+        heap.DecreaseKey (m, d);
+      }
+    }
+  }
+  const quint32 * downOffsets = hierarchy->DownOffsets ();
+  const quint32 * downTargets = hierarchy->DownTargets ();
+  const quint32 * downWeights = hierarchy->DownWeights ();
+  int count = sweepOrder.count ();
+  for (int s=0; s<count; s++) {
+    int n = sweepOrder[s];
+    quint32 best = seen[n] == query ? dist[n] : Unreached;
+    for (quint32 e=downOffsets[n]; e<downOffsets[n+1]; e++) {
+      int u = downTargets[e];
+      if (seen[u] == query && dist[u] + downWeights[e] < best) {
+        best = dist[u] + downWeights[e];
+      }
+    }
+    if (best <= limit) {
+      seen[n] = query;
+      dist[n] = best;
+      nodes.append (n);
+      times.append (best);
+    } else {
+      seen[n] = 0;
+    }
+  }
+}
+
+/** @brief Cells of the outline, with a free border of one cell all
+  * around so every filled cell has four neighbours.
+  */
+
+struct CellGrid {
+  double          lonOrigin;
+  double          latOrigin;
+  double          lonStep;
+  double          latStep;
+  int             cols;
+  int             rows;
+  QVector <char>  cells;
+
+  void Mark (double lat, double lon)
+    {
+      int cx = int ((lon - lonOrigin) / lonStep);
+      int cy = int ((lat - latOrigin) / latStep);
+      if (cx > 0 && cy > 0 && cx < cols - 1 && cy < rows - 1) {
+        cells[cy * cols + cx] = 1;
+      }
+    }
+  bool Filled (int cx, int cy) const
+    { return cells.at (cy * cols + cx) != 0; }
+  int  Vertex (int vx, int vy) const { return vy * (cols + 1) + vx; }
+};
+
+struct GridEdge {
+  int  from;
+  int  to;
+};
+
+void
+IsochroneSearch::Outline (int cellMeters, QList <QPolygon> & rings) const
+{
+  rings.clear ();
+  if (nodes.isEmpty ()) {
+    return;
+  }
+  const NaviCoord * lats = graph.Lats ();
+  const NaviCoord * lons = graph.Lons ();
+  const quint32 * offsets = graph.Offsets ();
+  const quint32 * targets = graph.Targets ();
+  const quint32 * weights = graph.Weights ();
+  NaviCoord latLo (lats[nodes.at(0)]), latHi (latLo);
+  NaviCoord lonLo (lons[nodes.at(0)]), lonHi (lonLo);
+  for (int i=0; i<nodes.count(); i++) {
+    int n = nodes.at(i);
+    latLo = qMin (latLo, lats[n]);
+    latHi = qMax (latHi, lats[n]);
+    lonLo = qMin (lonLo, lons[n]);
+    lonHi = qMax (lonHi, lons[n]);
+    for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+      int m = targets[e];
+      latLo = qMin (latLo, lats[m]);
+      latHi = qMax (latHi, lats[m]);
+      lonLo = qMin (lonLo, lons[m]);
+      lonHi = qMax (lonHi, lons[m]);
+    }
+  }
+  double midLat = DegreesFromCoord (NaviCoord ((qint64 (latLo) + latHi) / 2));
+  CellGrid grid;
+  grid.latStep = qMax (1, cellMeters) / 111320.0 * NaviCoordPerDegree;
+  grid.lonStep = grid.latStep / qMax (0.01, cos (midLat * M_PI / 180.0));
+  while (true) {
+    grid.cols = int ((qint64 (lonHi) - lonLo) / grid.lonStep) + 3;
+    grid.rows = int ((qint64 (latHi) - latLo) / grid.latStep) + 3;
+    if (qint64 (grid.cols) * grid.rows <= MaxCells) {
+      break;
+    }
+    grid.latStep *= 2.0;
+    grid.lonStep *= 2.0;
+  }
+  grid.lonOrigin = double (lonLo) - grid.lonStep;
+  grid.latOrigin = double (latLo) - grid.latStep;
+  grid.cells.fill (0, grid.cols * grid.rows);
+
+  /** An edge out of a reached node is in the area as far as the time
+    * left at the node carries along it.
+    */
+  for (int i=0; i<nodes.count(); i++) {
+    int n = nodes.at(i);
+    quint32 left = limit - times.at(i);
+    grid.Mark (lats[n], lons[n]);
+    for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+      int m = targets[e];
+      double part = Time (m) != Unreached ? 1.0
+                  : double (left) / double (weights[e]);
+      if (part <= 0.0) {
+        continue;
+      }
+      part = qMin (part, 1.0);
+      double dLat = (double (lats[m]) - lats[n]) * part;
+      double dLon = (double (lons[m]) - lons[n]) * part;
+      int steps = int (2.0 * qMax (fabs (dLat) / grid.latStep,
+                                   fabs (dLon) / grid.lonStep)) + 1;
+      for (int s=1; s<=steps; s++) {
+        double f = double (s) / steps;
+        grid.Mark (lats[n] + f * dLat, lons[n] + f * dLon);
+      }
+    }
+  }
+
+  /** Every side between a filled and an empty cell becomes an edge
+    * with the filled cell on its left, so outer rings run
+    * counterclockwise and holes clockwise.
+    */
+  QVector <GridEdge> edges;
+  QMultiHash <int, int> outgoing;
+  for (int cy=1; cy<grid.rows-1; cy++) {
+    for (int cx=1; cx<grid.cols-1; cx++) {
+      if (!grid.Filled (cx, cy)) {
+        continue;
+      }
+      GridEdge sides[4];
+      bool open[4];
+      sides[0].from = grid.Vertex (cx, cy);
+      sides[0].to = grid.Vertex (cx+1, cy);
+      open[0] = !grid.Filled (cx, cy-1);
+      sides[1].from = grid.Vertex (cx+1, cy);
+      sides[1].to = grid.Vertex (cx+1, cy+1);
+      open[1] = !grid.Filled (cx+1, cy);
+      sides[2].from = grid.Vertex (cx+1, cy+1);
+      sides[2].to = grid.Vertex (cx, cy+1);
+      open[2] = !grid.Filled (cx, cy+1);
+      sides[3].from = grid.Vertex (cx, cy+1);
+      sides[3].to = grid.Vertex (cx, cy);
+      open[3] = !grid.Filled (cx-1, cy);
+      for (int s=0; s<4; s++) {
+        if (open[s]) {
+          outgoing.insert (sides[s].from, edges.count ());
+          edges.append (sides[s]);
+        }
+      }
+    }
+  }
+
+  /** Where two filled cells touch only at a corner, the walk turns
+    * left, so each cell keeps its own ring. Points in the middle of a
+    * straight run are dropped.
+    */
+  int width = grid.cols + 1;
+  QVector <char> used (edges.count (), 0);
+  for (int first=0; first<edges.count(); first++) {
+    if (used.at(first)) {
+      continue;
+    }
+    QVector <int> corners;
+    int start = edges.at(first).from;
+    int edge = first;
+    while (true) {
+      used[edge] = 1;
+      corners.append (edges.at(edge).from);
+      int at = edges.at(edge).to;
+      if (at == start) {
+        break;
+      }
+      int inX = at % width - edges.at(edge).from % width;
+      int inY = at / width - edges.at(edge).from / width;
+      int next (-1);
+      int bestTurn (-2);
+      QMultiHash <int, int>::const_iterator it = outgoing.find (at);
+      for (; it != outgoing.end() && it.key() == at; it++) {
+        int candidate = it.value ();
+        if (used.at(candidate)) {
+          continue;
+        }
+        int outX = edges.at(candidate).to % width - at % width;
+        int outY = edges.at(candidate).to / width - at / width;
+        int turn = inX * outY - inY * outX;
+        if (turn > bestTurn) {
+          bestTurn = turn;
+          next = candidate;
+        }
+      }
+      if (next < 0) {
+        break;
+      }
+      edge = next;
+    }
+    QPolygon ring;
+    int count = corners.count ();
+    for (int c=0; c<count; c++) {
+      int prev = corners.at ((c + count - 1) % count);
+      int here = corners.at(c);
+      int after = corners.at ((c + 1) % count);
+      int ax = here % width - prev % width;
+      int ay = here / width - prev / width;
+      int bx = after % width - here % width;
+      int by = after / width - here / width;
+      if (ax * by - ay * bx == 0) {
+        continue;
+      }
+      double lon = grid.lonOrigin + (here % width) * grid.lonStep;
+      double lat = grid.latOrigin + (here / width) * grid.latStep;
+      ring.append (QPoint (qRound (lon), qRound (lat)));
+    }
+    if (ring.count () >= 3) {
+      rings.append (ring);
+    }
+  }
+}
+
+struct IsochroneRun {
+  typedef void result_type;
+  IsochroneRun (QVector <IsochroneSearch*> & s, const QVector <int> & f,
+                quint32 l, int c, QVector <qint64> & t,
+                QVector <int> & r)
+    :searches (s), starts (f), limit (l), cellMeters (c),
+     nsecs (t), reached (r)
+    {}
+  void operator() (int & chunk)
+    {
+      IsochroneSearch & search = *searches[chunk];
+      QList <QPolygon> rings;
+      QElapsedTimer timer;
+      for (int q=chunk; q<starts.count(); q += searches.count()) {
+        timer.start ();
+        search.Reach (starts.at(q), limit);
+        search.Outline (cellMeters, rings);
+        nsecs[q] = timer.nsecsElapsed ();
+        reached[q] = search.Nodes().count ();
+      }
+    }
+  QVector <IsochroneSearch*> & searches;
+  const QVector <int>        & starts;
+  quint32                      limit;
+  int                          cellMeters;
+  QVector <qint64>           & nsecs;
+  QVector <int>              & reached;
+};
+
+QStringList
+IsochroneSearch::Benchmark (const RoadGraph & graph,
+                            const RouteHierarchy * hierarchy,
+                            int queries, quint32 limit,
+                            int cellMeters, int threads)
+{
+  QStringList report;
+  int count = graph.NodeCount ();
+  if (count == 0 || queries < 1) {
+    report.append ("isochrone benchmark: no graph");
+    return report;
+  }
+  if (threads < 1) {
+    threads = QThread::idealThreadCount ();
+  }
+  threads = qMin (threads, queries);
+  QVector <int> starts;
+  qsrand (4711);
+  for (int q=0; q<queries; q++) {
+    starts.append (qrand () % count);
+  }
+  QVector <IsochroneSearch*> searches;
+  for (int t=0; t<threads; t++) {
+    searches.append (new IsochroneSearch (graph, hierarchy));
+  }
+  QVector <qint64> nsecs (queries);
+  QVector <int> reached (queries);
+  QList <int> chunks;
+  for (int t=0; t<threads; t++) {
+    chunks.append (t);
+  }
+  QElapsedTimer wall;
+  wall.start ();
+  QtConcurrent::blockingMap (chunks, IsochroneRun (searches, starts, limit,
+                                                   cellMeters, nsecs,
+                                                   reached));
+  qint64 wallNsecs = qMax (wall.nsecsElapsed (), Q_INT64_C(1));
+  bool sweep = searches.at(0)->UsesHierarchy ();
+  qDeleteAll (searches);
+  qint64 reachedTotal (0);
+  for (int q=0; q<queries; q++) {
+    reachedTotal += reached.at(q);
+  }
+  qSort (nsecs);
+  report.append (QString ("isochrone %1, %2 min: %3 requests, p50 %4 ms, "
+                          "p90 %5 ms, p99 %6 ms, max %7 ms, "
+                          "%8 nodes per request")
+                   .arg (sweep ? "by hierarchy sweep" : "by graph search")
+                   .arg (limit / 600.0, 0, 'f', 1)
+                   .arg (queries)
+                   .arg (nsecs.at ((queries - 1) * 50 / 100) / 1e6, 0, 'f', 2)
+                   .arg (nsecs.at ((queries - 1) * 90 / 100) / 1e6, 0, 'f', 2)
+                   .arg (nsecs.at ((queries - 1) * 99 / 100) / 1e6, 0, 'f', 2)
+                   .arg (nsecs.last () / 1e6, 0, 'f', 2)
+                   .arg (reachedTotal / queries));
+  report.append (QString ("isochrone throughput %1 requests per minute "
+                          "on %2 threads")
+                   .arg (queries * 60.0e9 / wallNsecs, 0, 'f', 0)
+                   .arg (threads));
+  return report;
+}
+
+} // namespace
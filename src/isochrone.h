@@ -0,0 +1,105 @@
+#ifndef ISOCHRONE_H
+#define ISOCHRONE_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "road-graph.h"
+#include "route-hierarchy.h"
+#include "route-search.h"
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QPolygon>
+
+namespace navi
+{
+
+/** @brief Everything reachable from one graph node within a time
+  * limit, as the reached nodes and as outline polygons.
+  *
+  * Without a hierarchy this is a Dijkstra search on the road graph
+  * that stops at the limit. With a RouteHierarchy it is a PHAST
+  * sweep: an upward search from the start, then one pass over all
+  * nodes from the highest rank down that pulls distances over the
+  * downward edges. The sweep costs the same for any limit, so it pays
+  * off for the larger areas. Per node state is allocated once, so
+  * one search answers any number of requests; use one per thread.
+  */
+
+class IsochroneSearch
+{
+public:
+
+  IsochroneSearch (const RoadGraph & roadGraph,
+                   const RouteHierarchy * routeHierarchy = 0);
+
+  /** @brief limit in tenths of a second; false if from is not a
+    * graph node
+    */
+  bool Reach (int from, quint32 limit);
+
+  /** @brief reached graph nodes, and their travel times */
+  const QVector <int>     & Nodes () const { return nodes; }
+  const QVector <quint32> & Times () const { return times; }
+
+  /** @brief Outline of the last result on a grid of cells about
+    * cellMeters on a side. A cell is in the area if a reached node,
+    * or a reached part of an edge, passes through it. Rings are
+    * (lon, lat) in NaviCoord, outer rings counterclockwise and holes
+    * clockwise.
+    */
+  void Outline (int cellMeters, QList <QPolygon> & rings) const;
+
+  bool UsesHierarchy () const { return hierarchy != 0; }
+
+  /** @brief time requests from random nodes, nodes and outline, on
+    * all threads, and report latency percentiles and requests per
+    * minute
+    */
+  static QStringList Benchmark (const RoadGraph & graph,
+                                const RouteHierarchy * hierarchy,
+                                int queries, quint32 limit,
+                                int cellMeters, int threads = 0);
+
+private:
+
+  void    NewQuery ();
+  void    GraphReach (int from);
+  void    SweepReach (int from);
+  quint32 Time (int node) const;
+
+  const RoadGraph       & graph;
+  const RouteHierarchy  * hierarchy;
+  QuadHeap            heap;
+  QVector <quint32>   seen;
+  QVector <quint32>   done;
+  QVector <quint32>   dist;
+  QVector <quint32>   sweepOrder;
+  QVector <int>       nodes;
+  QVector <quint32>   times;
+  quint32             query;
+  quint32             limit;
+};
+
+} // namespace
+
+#endif
@@ -27,6 +27,7 @@
 #include "move-button.h"
 
 #include <QPainter>
+#include <QPainterPath>
 #include <QColor>
 #include <QSize>
 
@@ -42,10 +43,10 @@ namespace navi
 
 MapDisplay::MapDisplay (QWidget *parent)
   :QWidget (parent),
-   xLo (180.0),
-   yLo (90.0),
-   xHi (-180.0),
-   yHi (-90.0),
+   xLo (CoordFromDegrees (180.0)),
+   yLo (CoordFromDegrees (90.0)),
+   xHi (CoordFromDegrees (-180.0)),
+   yHi (CoordFromDegrees (-90.0)),
    fullView (true),
    zoomView (false),
    followMouse (false),
@@ -74,7 +75,7 @@ MapDisplay::MapDisplay (QWidget *parent)
 }
 
 void
-MapDisplay::AddPoint (const QPointF & p, bool special)
+MapDisplay::AddPoint (const QPoint & p, bool special)
 {
   if (special) {
     specialPoints.append (p);
@@ -87,24 +88,36 @@ MapDisplay::AddPoint (const QPointF & p, bool special)
   if (yHi < p.y()) { yHi = p.y(); }
 }
 
+void
+MapDisplay::AddArea (const QPolygon & ring)
+{
+  areas.append (ring);
+  QRect box = ring.boundingRect ();
+  if (xLo > box.left()) { xLo = box.left(); }
+  if (xHi < box.right()) { xHi = box.right(); }
+  if (yLo > box.top()) { yLo = box.top(); }
+  if (yHi < box.bottom()) { yHi = box.bottom(); }
+}
+
 void
 MapDisplay::ClearPoints ()
 {
   points.clear ();
   specialPoints.clear ();
-  xLo = 180.0;
-  yLo = 90.0;
-  xHi = -180.0;
-  yHi = -90.0;
+  areas.clear ();
+  xLo = CoordFromDegrees (180.0);
+  yLo = CoordFromDegrees (90.0);
+  xHi = CoordFromDegrees (-180.0);
+  yHi = CoordFromDegrees (-90.0);
 }
 
 void
 MapDisplay::SetRange ()
 {
-  xRange = xHi - xLo;
-  yRange = yHi - yLo;
-  xScale = double (size().width()) / xRange;
-  yScale = double (size().height())/ yRange;
+  xRange = qMax (qint64 (xHi) - qint64 (xLo), qint64 (1));
+  yRange = qMax (qint64 (yHi) - qint64 (yLo), qint64 (1));
+  xScale = double (size().width()) / double (xRange);
+  yScale = double (size().height())/ double (yRange);
 }
 
 void
@@ -206,6 +219,7 @@ MapDisplay::FullPaint ()
   int h = canvasSize.height();
 
   painter.save ();
+  PaintAreas (&painter);
   painter.setPen (QColor(0,0,0,255));
   PaintPoints (&painter, points);
   painter.setPen (QColor(255,0,0,255));
@@ -221,7 +235,7 @@ MapDisplay::ZoomPaint ()
 }
 
 void
-MapDisplay::PaintPoints (QPainter * painter, QList<QPointF> & plist)
+MapDisplay::PaintPoints (QPainter * painter, QList<QPoint> & plist)
 {
   if (!painter) {
     return;
@@ -233,11 +247,35 @@ MapDisplay::PaintPoints (QPainter * painter, QList<QPointF> & plist)
   }
 }
 
+void
+MapDisplay::PaintAreas (QPainter * painter)
+{
+  if (!painter || areas.isEmpty ()) {
+    return;
+  }
+  QPainterPath path;
+  path.setFillRule (Qt::OddEvenFill);
+  for (int a=0; a<areas.count(); a++) {
+    const QPolygon & ring = areas.at(a);
+    QPolygonF scaled;
+    for (int i=0; i<ring.count(); i++) {
+      scaled.append (Scale (ring.at(i)));
+    }
+    path.addPolygon (scaled);
+    path.closeSubpath ();
+  }
+  painter->save ();
+  painter->setPen (QColor (0,90,200,200));
+  painter->setBrush (QColor (0,120,255,60));
+  painter->drawPath (path);
+  painter->restore ();
+}
+
 QPointF
-MapDisplay::Scale (const QPointF p)
+MapDisplay::Scale (const QPoint & p)
 {
-  double x = (p.x() - xLo) * xScale * zoomScale;
-  double y = (p.y() - yLo) * yScale * zoomScale;
+  double x = double (qint64 (p.x()) - xLo) * xScale * zoomScale;
+  double y = double (qint64 (p.y()) - yLo) * yScale * zoomScale;
   return QPointF (x,y);
 }
 
@@ -249,8 +287,8 @@ MapDisplay::TimedMove ()
   dir.normalize();
   double moveLen (len > 70.0 ? 10.0 : 5.0);
   dir *= moveLen/(zoomScale * (xScale + yScale));
-  double dx = dir.x();
-  double dy = dir.y();
+  NaviCoord dx = qRound (dir.x());
+  NaviCoord dy = qRound (dir.y());
   xLo += dx;
   xHi += dx;
   yLo += dy;
@@ -25,8 +25,11 @@
 
 
 #include "ui_map-display.h"
+#include "navi-types.h"
 
+#include <QPoint>
 #include <QPointF>
+#include <QPolygon>
 #include <QList>
 #include <QTime>
 #include <QTimer>
@@ -49,7 +52,12 @@ public:
 
   MapDisplay (QWidget * parent=0);
 
-  void AddPoint (const QPointF & p, bool special=false);
+  /** @brief points are (lon, -lat) in fixed point coordinates */
+  void AddPoint (const QPoint & p, bool special=false);
+  /** @brief a ring of a highlighted area, in the same coordinates;
+    * rings are filled together, so holes stay clear
+    */
+  void AddArea (const QPolygon & ring);
   void ClearPoints ();
 
 private slots:
@@ -68,8 +76,9 @@ protected:
 
 private:
 
-  void PaintPoints (QPainter * painter, QList<QPointF> & plist);
-  QPointF Scale (const QPointF p);
+  void PaintPoints (QPainter * painter, QList<QPoint> & plist);
+  void PaintAreas (QPainter * painter);
+  QPointF Scale (const QPoint & p);
   void    SetRange ();
 
   void FullPaint ();
@@ -78,15 +87,16 @@ private:
   Ui_MapDisplay   ui;
   QTime           clock;
 
-  QList <QPointF>  points;
-  QList <QPointF>  specialPoints;
-  double           xLo;
-  double           yLo;
-  double           xHi;
-  double           yHi;
+  QList <QPoint>   points;
+  QList <QPoint>   specialPoints;
+  QList <QPolygon> areas;
+  NaviCoord        xLo;
+  NaviCoord        yLo;
+  NaviCoord        xHi;
+  NaviCoord        yHi;
 
-  double           xRange;
-  double           yRange;
+  qint64           xRange;
+  qint64           yRange;
   double           xScale;
   double           yScale;
 
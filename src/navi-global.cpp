@@ -21,6 +21,7 @@
  *  Boston, MA  02110-1301, USA.
  ****************************************************************/
 #include <QDebug>
+#include <QtAlgorithms>
 
 namespace navi
 {
@@ -32,18 +33,250 @@ Parcel::Index (double lat, double lon)
 {
   quint64 ilat = qRound64 ((lat + 180.0) * DegreeResolution);
   quint64 ilon = qRound64 ((lon + 180.0) * DegreeResolution);
-  quint64 result = (qint64(ilat) << 32) | qint64(ilon);
-  return result;
+  return CellIndex (ilat, ilon);
+}
+
+/** @brief Same index as Index, computed on the fixed point
+  * coordinates without going through double.
+  */
+
+quint64
+Parcel::CoordIndex (NaviCoord lat, NaviCoord lon)
+{
+  quint32 ilat, ilon;
+  CoordCell (lat, lon, ilat, ilon);
+  return CellIndex (ilat, ilon);
+}
+
+void
+Parcel::CoordCell (NaviCoord lat, NaviCoord lon,
+                   quint32 & row, quint32 & col)
+{
+  qint64 perDegree = qint64 (NaviCoordPerDegree);
+  qint64 offset = 180 * perDegree;
+  qint64 res = qint64 (DegreeResolution);
+  row = ((qint64 (lat) + offset) * res + perDegree/2) / perDegree;
+  col = ((qint64 (lon) + offset) * res + perDegree/2) / perDegree;
 }
 
 void
 Parcel::LatLon (quint64 parcelIndex, double & lat, double & lon)
 {
-  quint32 ilon = parcelIndex & Q_INT64_C(0xffffffff);
-  quint32 ilat = ((parcelIndex & Q_INT64_C(0xffffffff00000000)) >> 32) ;
+  quint32 ilat, ilon;
+  Cell (parcelIndex, ilat, ilon);
   lat = (double (ilat) / DegreeResolution) - 180.0;
   lon = (double (ilon) / DegreeResolution) - 180.0;
 }
 
+/** @brief Hilbert curve position of a cell, the usual xy-to-d walk
+  * from the top bit down. The grid is 2^16 cells on a side, which
+  * holds the 43200 cells of 360 degrees at the default resolution.
+  */
+
+quint64
+Parcel::CellIndex (quint32 row, quint32 col)
+{
+  quint64 x (col);
+  quint64 y (row);
+  quint64 d (0);
+  for (quint64 s = GridSide/2; s > 0; s /= 2) {
+    quint64 rx = (x & s) ? 1 : 0;
+    quint64 ry = (y & s) ? 1 : 0;
+    d += s * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = GridSide - 1 - x;
+        y = GridSide - 1 - y;
+      }
+      qSwap (x, y);
+    }
+  }
+  return d;
+}
+
+void
+Parcel::Cell (quint64 parcelIndex, quint32 & row, quint32 & col)
+{
+  quint64 x (0);
+  quint64 y (0);
+  quint64 t (parcelIndex);
+  for (quint64 s = 1; s < GridSide; s *= 2) {
+    quint64 rx = 1 & (t / 2);
+    quint64 ry = 1 & (t ^ rx);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      qSwap (x, y);
+    }
+    x += s * rx;
+    y += s * ry;
+    t /= 4;
+  }
+  row = y;
+  col = x;
+}
+
+quint32
+Parcel::ClampCell (qint64 cell)
+{
+  if (cell < 0) {
+    return 0;
+  }
+  if (cell >= qint64 (GridSide)) {
+    return GridSide - 1;
+  }
+  return cell;
+}
+
+quint64
+Parcel::Neighbour (quint64 parcelIndex, int rowStep, int colStep)
+{
+  quint32 row, col;
+  Cell (parcelIndex, row, col);
+  return CellIndex (ClampCell (qint64 (row) + rowStep),
+                    ClampCell (qint64 (col) + colStep));
+}
+
+ParcelRangeList
+Parcel::CellRanges (quint32 rowLo, quint32 colLo,
+                    quint32 rowHi, quint32 colHi)
+{
+  QList <quint64> keys;
+  for (quint32 row = rowLo; row <= rowHi; row++) {
+    for (quint32 col = colLo; col <= colHi; col++) {
+      keys.append (CellIndex (row, col));
+    }
+  }
+  ParcelRangeList ranges;
+  for (int k=0; k<keys.count(); k++) {
+    ranges.append (ParcelRange (keys.at(k), keys.at(k)));
+  }
+  MergeRanges (ranges);
+  return ranges;
+}
+
+void
+Parcel::MergeRanges (ParcelRangeList & ranges)
+{
+  qSort (ranges);
+  ParcelRangeList merged;
+  for (int r=0; r<ranges.count(); r++) {
+    const ParcelRange & range = ranges.at(r);
+    if (!merged.isEmpty () && range.first <= merged.last().second + 1) {
+      merged.last().second = qMax (merged.last().second, range.second);
+    } else {
+      merged.append (range);
+    }
+  }
+  ranges = merged;
+}
+
+ParcelRangeList
+Parcel::Ranges (quint64 parcelIndex, int extend)
+{
+  quint32 row, col;
+  Cell (parcelIndex, row, col);
+  return CellRanges (ClampCell (qint64 (row) - extend),
+                     ClampCell (qint64 (col) - extend),
+                     ClampCell (qint64 (row) + extend),
+                     ClampCell (qint64 (col) + extend));
+}
+
+quint64
+Parcel::FromRowMajor (quint64 oldIndex)
+{
+  quint32 col = oldIndex & Q_INT64_C(0xffffffff);
+  quint32 row = oldIndex >> 32;
+  return CellIndex (row, col);
+}
+
+int
+Parcel::BoxLevel (const NaviBox & box, quint64 & levelIndex)
+{
+  quint32 rowLo, colLo, rowHi, colHi;
+  CoordCell (box.minLat, box.minLon, rowLo, colLo);
+  CoordCell (box.maxLat, box.maxLon, rowHi, colHi);
+  int level (Levels);
+  while (level > 0 
+         && ((rowLo >> (Levels - level)) != (rowHi >> (Levels - level))
+          || (colLo >> (Levels - level)) != (colHi >> (Levels - level)))) {
+    level--;
+  }
+  levelIndex = CellIndex (rowLo, colLo) >> (2 * (Levels - level));
+  return level;
+}
+
+ParcelRange
+Parcel::LevelRange (int level, quint64 levelIndex)
+{
+  int shift = 2 * (Levels - level);
+  return ParcelRange (levelIndex << shift, 
+                      ((levelIndex + 1) << shift) - 1);
+}
+
+ParcelRangeList
+Parcel::AtLevel (const ParcelRangeList & parcels, int level)
+{
+  int shift = 2 * (Levels - level);
+  ParcelRangeList ranges;
+  for (int r=0; r<parcels.count(); r++) {
+    ranges.append (ParcelRange (parcels.at(r).first >> shift,
+                                parcels.at(r).second >> shift));
+  }
+  MergeRanges (ranges);
+  return ranges;
+}
+
+ParcelRangeList
+Parcel::BoxRanges (const NaviBox & box, int maxLevel)
+{
+  ParcelRangeList ranges;
+  if (box.IsEmpty ()) {
+    return ranges;
+  }
+  quint32 rowLo, colLo, rowHi, colHi;
+  CoordCell (box.minLat, box.minLon, rowLo, colLo);
+  CoordCell (box.maxLat, box.maxLon, rowHi, colHi);
+  AddBoxRanges (ranges, 0, 0, 0, rowLo, colLo, rowHi, colHi,
+                qBound (0, maxLevel, int (Levels)));
+  MergeRanges (ranges);
+  return ranges;
+}
+
+/** @brief row and col are the cell position at its own level */
+
+void
+Parcel::AddBoxRanges (ParcelRangeList & ranges,
+                      int level, quint32 row, quint32 col,
+                      quint32 rowLo, quint32 colLo,
+                      quint32 rowHi, quint32 colHi,
+                      int maxLevel)
+{
+  int shift = Levels - level;
+  quint64 firstRow = quint64 (row) << shift;
+  quint64 lastRow = ((quint64 (row) + 1) << shift) - 1;
+  quint64 firstCol = quint64 (col) << shift;
+  quint64 lastCol = ((quint64 (col) + 1) << shift) - 1;
+  if (firstRow > rowHi || lastRow < rowLo
+      || firstCol > colHi || lastCol < colLo) {
+    return;
+  }
+  bool inside = firstRow >= rowLo && lastRow <= rowHi
+             && firstCol >= colLo && lastCol <= colHi;
+  if (inside || level >= maxLevel) {
+    quint64 levelIndex = CellIndex (firstRow, firstCol) >> (2 * shift);
+    ranges.append (LevelRange (level, levelIndex));
+    return;
+  }
+  for (quint32 r=0; r<2; r++) {
+    for (quint32 c=0; c<2; c++) {
+      AddBoxRanges (ranges, level+1, 2*row + r, 2*col + c,
+                    rowLo, colLo, rowHi, colHi, maxLevel);
+    }
+  }
+}
+
 } // namespace
 
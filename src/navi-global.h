@@ -23,22 +23,106 @@
  ****************************************************************/
 
 #include <QtGlobal>
+#include <QPair>
+#include <QList>
+#include "navi-types.h"
 
 namespace navi
 {
 
+/** @brief version of the geobase layout, kept in navimeta.
+  * 2: all OSM ids are INTEGER columns
+  * 3: coordinates are INTEGER columns in units of 1e-7 degree
+  * 4: parcel ids are Hilbert curve keys
+  * 5: ways are indexed in the waycells parcel pyramid
+  * 6: tag keys and values are codes into tagkeys and tagvalues
+  * 7: way locations are geometry blobs in waygeoms, waylocs is empty
+  * 8: tag tables and relationparts are clustered WITHOUT ROWID tables
+  * 9: nodes, ways and relations keep their OSM version
+  */
+
+const int GeoBaseVersion (9);
+
+/** @brief first and last parcel index of a run of keys, inclusive */
+
+typedef QPair <quint64, quint64>  ParcelRange;
+typedef QList <ParcelRange>       ParcelRangeList;
+
+/** @brief Parcels are cells of a grid with Resolution cells per
+  * degree. A parcel index is the position of its cell along a
+  * Hilbert curve over the grid, so cells that are close on the map
+  * mostly have close indexes, and a block of cells is covered by a
+  * few runs of consecutive indexes.
+  */
+
 class Parcel
 {
 public:
 
   static quint64 Index (double lat, double lon);
+  static quint64 CoordIndex (NaviCoord lat, NaviCoord lon);
   static void    LatLon (quint64 parcelIndex, double &lat, double &lon);
 
+  static quint64 CellIndex (quint32 row, quint32 col);
+  static void    Cell (quint64 parcelIndex, quint32 & row, quint32 & col);
+  static quint64 Neighbour (quint64 parcelIndex, int rowStep, int colStep);
+
+  /** @brief index runs covering the cells from (rowLo, colLo) 
+    * to (rowHi, colHi), sorted and merged
+    */
+  static ParcelRangeList CellRanges (quint32 rowLo, quint32 colLo,
+                                     quint32 rowHi, quint32 colHi);
+
+  /** @brief index runs covering the (2*extend+1) square of cells
+    * around the parcel
+    */
+  static ParcelRangeList Ranges (quint64 parcelIndex, int extend);
+
+  /** @brief convert an index of the old (row << 32 | col) layout */
+  static quint64 FromRowMajor (quint64 oldIndex);
+
+  /** @brief Pyramid levels: a cell at level L covers 4^(Levels-L)
+    * parcels, and since every quadrant of a Hilbert curve is one
+    * run of it, the level L index of a parcel is its index shifted 
+    * right by 2*(Levels-L). Level Levels is the parcel itself.
+    */
+  static const int Levels = 16;
+
+  static void    CoordCell (NaviCoord lat, NaviCoord lon,
+                            quint32 & row, quint32 & col);
+
+  /** @brief the finest level with one cell holding the whole box */
+  static int     BoxLevel (const NaviBox & box, quint64 & levelIndex);
+
+  /** @brief parcel indexes covered by a cell of a level */
+  static ParcelRange LevelRange (int level, quint64 levelIndex);
+
+  /** @brief level indexes of the cells that hold some of the parcels */
+  static ParcelRangeList AtLevel (const ParcelRangeList & parcels, 
+                                  int level);
+
+  /** @brief Parcel index runs covering the box, found by walking the
+    * pyramid down to maxLevel. Cells still only partly inside the box
+    * at maxLevel are taken whole, so a lower maxLevel gives fewer,
+    * longer runs for a zoomed out view.
+    */
+  static ParcelRangeList BoxRanges (const NaviBox & box, 
+                                    int maxLevel = Levels);
+
   static double Resolution () { return DegreeResolution; }
 
 private:
 
+  static quint32 ClampCell (qint64 cell);
+  static void    AddBoxRanges (ParcelRangeList & ranges,
+                               int level, quint32 row, quint32 col,
+                               quint32 rowLo, quint32 colLo,
+                               quint32 rowHi, quint32 colHi,
+                               int maxLevel);
+  static void    MergeRanges (ParcelRangeList & ranges);
+
   static double DegreeResolution;
+  static const quint32 GridSide = 1 << 16;
 };
 
 } // namespace
@@ -0,0 +1,694 @@
+#include "navi-pack.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QSet>
+#include <QRegExp>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <string.h>
+#include "way-geometry.h"
+
+namespace navi
+{
+
+static const char  PackMagic[8] = { 'N','A','V','I','P','A','C','K' };
+static const quint32 PackVersion (1);
+
+/** @brief first entry of a (key, value) sorted tag order that is not
+  * less than (key, value)
+  */
+
+static int
+LowerTag (const quint32 * keys, const quint32 * values,
+          const quint32 * order, int count,
+          quint32 key, quint32 value)
+{
+  int lo (0);
+  int hi (count);
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    quint32 pos = order[mid];
+    if (keys[pos] < key || (keys[pos] == key && values[pos] < value)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+NaviPack::NaviPack ()
+  :base (0),
+   sections (0)
+{
+}
+
+NaviPack::~NaviPack ()
+{
+  Close ();
+}
+
+bool
+NaviPack::Open (const QString & filename)
+{
+  Close ();
+  file.setFileName (filename);
+  if (!file.open (QFile::ReadOnly)) {
+    return false;
+  }
+  qint64 size = file.size ();
+  qint64 tableEnd = sizeof (Header) + Sec_Count * sizeof (SectionEntry);
+  if (size < tableEnd) {
+    file.close ();
+    return false;
+  }
+  uchar * map = file.map (0, size);
+  if (map == 0) {
+    qDebug () << "NaviPack cannot map " << filename << file.errorString ();
+    file.close ();
+    return false;
+  }
+  const Header * header = reinterpret_cast <const Header*> (map);
+  const SectionEntry * table = reinterpret_cast <const SectionEntry*>
+                                  (map + sizeof (Header));
+  bool good = memcmp (header->magic, PackMagic, sizeof (PackMagic)) == 0
+           && header->version == PackVersion
+           && header->sectionCount == quint32 (Sec_Count);
+  for (int s=0; good && s<Sec_Count; s++) {
+    good = qint64 (table[s].offset) >= tableEnd 
+        && qint64 (table[s].offset) <= size;
+  }
+  if (!good) {
+    qDebug () << "NaviPack " << filename << " has the wrong layout";
+    file.unmap (map);
+    file.close ();
+    return false;
+  }
+  base = map;
+  sections = table;
+  return true;
+}
+
+void
+NaviPack::Close ()
+{
+  if (base) {
+    file.unmap (const_cast <uchar*> (base));
+    base = 0;
+  }
+  sections = 0;
+  if (file.isOpen ()) {
+    file.close ();
+  }
+}
+
+int
+NaviPack::FindId (Section section, NaviId id) const
+{
+  int count = Count (section);
+  if (count == 0) {
+    return -1;
+  }
+  const NaviId * ids = Column <NaviId> (section);
+  const NaviId * found = qBinaryFind (ids, ids + count, id);
+  return found == ids + count ? -1 : int (found - ids);
+}
+
+bool
+NaviPack::GetNode (NaviId nodeId, NaviCoord & lat, NaviCoord & lon) const
+{
+  int n = FindId (Sec_NodeIds, nodeId);
+  if (n < 0) {
+    return false;
+  }
+  lat = Column <NaviCoord> (Sec_NodeLats)[n];
+  lon = Column <NaviCoord> (Sec_NodeLons)[n];
+  return true;
+}
+
+bool
+NaviPack::GetNode (NaviId nodeId, double & lat, double & lon) const
+{
+  NaviCoord latCoord, lonCoord;
+  if (GetNode (nodeId, latCoord, lonCoord)) {
+    lat = DegreesFromCoord (latCoord);
+    lon = DegreesFromCoord (lonCoord);
+    return true;
+  }
+  return false;
+}
+
+const NaviId *
+NaviPack::WayNodes (NaviId wayId, int & count) const
+{
+  count = 0;
+  int w = FindId (Sec_WayIds, wayId);
+  if (w < 0) {
+    return 0;
+  }
+  const quint32 * start = Column <quint32> (Sec_WayNodeStart);
+  count = start[w+1] - start[w];
+  return Column <NaviId> (Sec_WayNodeRefs) + start[w];
+}
+
+bool
+NaviPack::GetWayNodes (NaviId wayId, NaviIdList & nodeIdList) const
+{
+  int count;
+  const NaviId * refs = WayNodes (wayId, count);
+  if (refs == 0) {
+    return false;
+  }
+  nodeIdList.clear ();
+  for (int r=0; r<count; r++) {
+    nodeIdList.append (refs[r]);
+  }
+  return true;
+}
+
+NaviPack::TagSections
+NaviPack::TagSectionsFor (const QString & type)
+{
+  TagSections tags;
+  if (type == "way") {
+    tags.ids = Sec_WayIds;
+    tags.start = Sec_WayTagStart;
+    tags.keys = Sec_WayTagKeys;
+    tags.values = Sec_WayTagValues;
+    tags.order = Sec_WayTagOrder;
+  } else if (type == "relation") {
+    tags.ids = Sec_RelIds;
+    tags.start = Sec_RelTagStart;
+    tags.keys = Sec_RelTagKeys;
+    tags.values = Sec_RelTagValues;
+    tags.order = Sec_RelTagOrder;
+  } else {
+    tags.ids = Sec_NodeIds;
+    tags.start = Sec_NodeTagStart;
+    tags.keys = Sec_NodeTagKeys;
+    tags.values = Sec_NodeTagValues;
+    tags.order = Sec_NodeTagOrder;
+  }
+  return tags;
+}
+
+bool
+NaviPack::GetTags (const TagSections & tags, NaviId id,
+                   TagList & tagList) const
+{
+  int e = FindId (tags.ids, id);
+  if (e < 0) {
+    return false;
+  }
+  const quint32 * start = Column <quint32> (tags.start);
+  const quint32 * keys = Column <quint32> (tags.keys);
+  const quint32 * values = Column <quint32> (tags.values);
+  tagList.clear ();
+  for (quint32 t=start[e]; t<start[e+1]; t++) {
+    tagList.append (TagItemType (String (keys[t]), String (values[t])));
+  }
+  return true;
+}
+
+bool
+NaviPack::GetNodeTags (NaviId nodeId, TagList & tagList) const
+{
+  return GetTags (TagSectionsFor ("node"), nodeId, tagList);
+}
+
+bool
+NaviPack::GetWayTags (NaviId wayId, TagList & tagList) const
+{
+  return GetTags (TagSectionsFor ("way"), wayId, tagList);
+}
+
+bool
+NaviPack::GetRelationTags (NaviId relId, TagList & tagList) const
+{
+  return GetTags (TagSectionsFor ("relation"), relId, tagList);
+}
+
+/** @brief The (key, value) order gives the run of tags with the key,
+  * or with the key and value, by binary search. An exact value is 
+  * one more search, a GLOB pattern is tried once per distinct value 
+  * code in the run.
+  */
+
+void
+NaviPack::GetByTag (NaviIdList & idList,
+                    const QString & tagKey,
+                    const QString & tagValue,
+                    const QString & type,
+                          bool regularExp) const
+{
+  idList.clear ();
+  int key = FindString (tagKey.toUtf8 ());
+  if (key < 0 || !IsOpen ()) {
+    return;
+  }
+  TagSections tags = TagSectionsFor (type);
+  const quint32 * keys = Column <quint32> (tags.keys);
+  const quint32 * values = Column <quint32> (tags.values);
+  const quint32 * order = Column <quint32> (tags.order);
+  const quint32 * start = Column <quint32> (tags.start);
+  const NaviId  * ids = Column <NaviId> (tags.ids);
+  int count = Count (tags.order);
+  int numIds = Count (tags.ids);
+  int lo, hi;
+  if (regularExp) {
+    lo = LowerTag (keys, values, order, count, key, 0);
+    hi = LowerTag (keys, values, order, count, key+1, 0);
+  } else {
+    int value = FindString (tagValue.toUtf8 ());
+    if (value < 0) {
+      return;
+    }
+    lo = LowerTag (keys, values, order, count, key, value);
+    hi = LowerTag (keys, values, order, count, key, value+1);
+  }
+  QRegExp pattern (tagValue, Qt::CaseSensitive, QRegExp::Wildcard);
+  QHash <quint32, bool> matches;
+  for (int o=lo; o<hi; o++) {
+    quint32 pos = order[o];
+    if (regularExp) {
+      if (!matches.contains (values[pos])) {
+        matches[values[pos]] = pattern.exactMatch (String (values[pos]));
+      }
+      if (!matches[values[pos]]) {
+        continue;
+      }
+    }
+    int e = qUpperBound (start, start + numIds + 1, pos) - start - 1;
+    idList.append (ids[e]);
+  }
+}
+
+void
+NaviPack::GetNodesByLatLon (NaviIdList & nodeList,
+                            double south, double west,
+                            double north, double east) const
+{
+  nodeList.clear ();
+  int count = Count (Sec_NodeLatOrder);
+  if (count == 0) {
+    return;
+  }
+  NaviCoord minLat = CoordFromDegrees (south);
+  NaviCoord maxLat = CoordFromDegrees (north);
+  NaviCoord minLon = CoordFromDegrees (west);
+  NaviCoord maxLon = CoordFromDegrees (east);
+  const quint32 * order = Column <quint32> (Sec_NodeLatOrder);
+  const NaviCoord * lats = Column <NaviCoord> (Sec_NodeLats);
+  const NaviCoord * lons = Column <NaviCoord> (Sec_NodeLons);
+  const NaviId * ids = Column <NaviId> (Sec_NodeIds);
+  int lo (0);
+  int hi (count);
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (lats[order[mid]] < minLat) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for (int o=lo; o<count && lats[order[o]] <= maxLat; o++) {
+    NaviCoord lon = lons[order[o]];
+    if (lon >= minLon && lon <= maxLon) {
+      nodeList.append (ids[order[o]]);
+    }
+  }
+}
+
+QString
+NaviPack::String (quint32 code) const
+{
+  if (int (code) + 1 >= Count (Sec_StringStart)) {
+    return QString ();
+  }
+  const quint32 * start = Column <quint32> (Sec_StringStart);
+  const char * data = Column <char> (Sec_StringData);
+  return QString::fromUtf8 (data + start[code], start[code+1] - start[code]);
+}
+
+int
+NaviPack::FindString (const QByteArray & utf8) const
+{
+  int count = Count (Sec_StringStart) - 1;
+  if (count <= 0) {
+    return -1;
+  }
+  const quint32 * start = Column <quint32> (Sec_StringStart);
+  const char * data = Column <char> (Sec_StringData);
+  int lo (0);
+  int hi (count);
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int len = start[mid+1] - start[mid];
+    int cmp = memcmp (data + start[mid], utf8.constData (), 
+                      qMin (len, utf8.size ()));
+    if (cmp == 0) {
+      cmp = len - utf8.size ();
+    }
+    if (cmp == 0) {
+      return mid;
+    } else if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return -1;
+}
+
+class LatLess
+{
+public:
+  LatLess (const QVector <NaviCoord> & l) : lats (l) {}
+  bool operator () (quint32 a, quint32 b) const 
+    { return lats[a] < lats[b]; }
+private:
+  const QVector <NaviCoord> & lats;
+};
+
+class TagLess
+{
+public:
+  TagLess (const QVector <quint32> & k, const QVector <quint32> & v) 
+    : keys (k), values (v) {}
+  bool operator () (quint32 a, quint32 b) const 
+    { 
+      return keys[a] < keys[b] 
+         || (keys[a] == keys[b] && values[a] < values[b]); 
+    }
+private:
+  const QVector <quint32> & keys;
+  const QVector <quint32> & values;
+};
+
+/** @brief turn per element counts into start offsets, count+1 long */
+
+static void
+CountsToStarts (QVector <quint32> & counts)
+{
+  quint32 sum (0);
+  for (int c=0; c<counts.count(); c++) {
+    quint32 here = counts[c];
+    counts[c] = sum;
+    sum += here;
+  }
+  counts.append (sum);
+}
+
+bool
+NaviPackWriter::Fail (const QString & message)
+{
+  errorText = message;
+  qDebug () << "NaviPackWriter " << message;
+  return false;
+}
+
+bool
+NaviPackWriter::ReadStrings (QSqlDatabase & geoBase)
+{
+  QStringList commands;
+  commands << "select key from tagkeys"
+           << "select value from tagvalues"
+           << "select distinct othertype from relationparts";
+  QSet <QByteArray> strings;
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  for (int c=0; c<commands.count(); c++) {
+    if (!query.exec (commands.at(c))) {
+      return Fail (query.lastError().text());
+    }
+    while (query.next ()) {
+      strings.insert (query.value(0).toString().toUtf8());
+    }
+  }
+  QList <QByteArray> sorted = strings.toList ();
+  qSort (sorted);
+  codes.clear ();
+  stringStart.clear ();
+  stringData.clear ();
+  for (int s=0; s<sorted.count(); s++) {
+    codes[sorted.at(s)] = s;
+    stringStart.append (stringData.size ());
+    stringData.append (sorted.at(s));
+  }
+  stringStart.append (stringData.size ());
+  return true;
+}
+
+bool
+NaviPackWriter::ReadNodes (QSqlDatabase & geoBase)
+{
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  if (!query.exec ("select nodeid, lat, lon from nodes order by nodeid")) {
+    return Fail (query.lastError().text());
+  }
+  while (query.next ()) {
+    nodeIds.append (query.value(0).toLongLong());
+    nodeLats.append (query.value(1).toInt());
+    nodeLons.append (query.value(2).toInt());
+  }
+  nodeLatOrder.resize (nodeIds.count ());
+  for (int n=0; n<nodeLatOrder.count(); n++) {
+    nodeLatOrder[n] = n;
+  }
+  qStableSort (nodeLatOrder.begin (), nodeLatOrder.end (), 
+               LatLess (nodeLats));
+  return true;
+}
+
+/** @brief waynodes keeps each node of a way once and has no sequence
+  * column, so a closed way would come out rotated. The node lists
+  * are taken from waygeoms, in seq order with repeated nodes kept,
+  * which covers the located nodes of each way.
+  */
+
+bool
+NaviPackWriter::ReadWays (QSqlDatabase & geoBase)
+{
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  if (!query.exec ("select wayid from ways order by wayid")) {
+    return Fail (query.lastError().text());
+  }
+  while (query.next ()) {
+    wayIds.append (query.value(0).toLongLong());
+  }
+  wayNodeStart.fill (0, wayIds.count ());
+  if (!query.exec ("select wayid, geom from waygeoms order by wayid")) {
+    return Fail (query.lastError().text());
+  }
+  while (query.next ()) {
+    NaviId wayId = query.value(0).toLongLong();
+    const NaviId * found = qBinaryFind (wayIds.constBegin (), 
+                                        wayIds.constEnd (), wayId);
+    if (found == wayIds.constEnd ()) {
+      continue;
+    }
+    WayGeometryReader reader (query.value(1).toByteArray());
+    while (reader.Next ()) {
+      wayNodeStart[found - wayIds.constBegin ()]++;
+      wayNodeRefs.append (reader.NodeId ());
+    }
+  }
+  CountsToStarts (wayNodeStart);
+  return true;
+}
+
+bool
+NaviPackWriter::ReadRelations (QSqlDatabase & geoBase)
+{
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  if (!query.exec ("select relationid from relations order by relationid")) {
+    return Fail (query.lastError().text());
+  }
+  while (query.next ()) {
+    relIds.append (query.value(0).toLongLong());
+  }
+  relMemberStart.fill (0, relIds.count ());
+  if (!query.exec ("select relationid, othertype, otherid "
+                   " from relationparts order by relationid, seq")) {
+    return Fail (query.lastError().text());
+  }
+  while (query.next ()) {
+    NaviId relId = query.value(0).toLongLong();
+    const NaviId * found = qBinaryFind (relIds.constBegin (), 
+                                        relIds.constEnd (), relId);
+    if (found != relIds.constEnd ()) {
+      relMemberStart[found - relIds.constBegin ()]++;
+      relMemberTypes.append (codes.value (query.value(1).toString()
+                                                  .toUtf8()));
+      relMemberRefs.append (query.value(2).toLongLong());
+    }
+  }
+  CountsToStarts (relMemberStart);
+  return true;
+}
+
+bool
+NaviPackWriter::ReadTags (QSqlDatabase & geoBase, const QString & type,
+                          const QVector <NaviId> & ids,
+                          QVector <quint32> & start,
+                          QVector <quint32> & keys,
+                          QVector <quint32> & values,
+                          QVector <quint32> & order)
+{
+  QSqlQuery query (geoBase);
+  query.setForwardOnly (true);
+  QString cmd ("select t.%1id, k.key, v.value from %1tags t "
+               " join tagkeys k on k.keyid = t.keyid "
+               " join tagvalues v on v.valueid = t.valueid "
+               " order by t.%1id");
+  if (!query.exec (cmd.arg (type))) {
+    return Fail (query.lastError().text());
+  }
+  start.fill (0, ids.count ());
+  while (query.next ()) {
+    NaviId id = query.value(0).toLongLong();
+    const NaviId * found = qBinaryFind (ids.constBegin (), 
+                                        ids.constEnd (), id);
+    if (found != ids.constEnd ()) {
+      start[found - ids.constBegin ()]++;
+      keys.append (codes.value (query.value(1).toString().toUtf8()));
+      values.append (codes.value (query.value(2).toString().toUtf8()));
+    }
+  }
+  CountsToStarts (start);
+  order.resize (keys.count ());
+  for (int t=0; t<order.count(); t++) {
+    order[t] = t;
+  }
+  qStableSort (order.begin (), order.end (), TagLess (keys, values));
+  return true;
+}
+
+/** @brief append one column at the next 8 byte boundary */
+
+static bool
+WriteColumn (QFile & file, NaviPack::SectionEntry & entry,
+             const void * data, int count, int elementSize)
+{
+  qint64 pos = file.pos ();
+  qint64 aligned = (pos + 7) & ~Q_INT64_C(7);
+  if (aligned > pos) {
+    if (file.write (QByteArray (aligned - pos, 0)) != aligned - pos) {
+      return false;
+    }
+  }
+  entry.offset = aligned;
+  entry.count = count;
+  qint64 bytes = qint64 (count) * elementSize;
+  return bytes == 0
+      || file.write (static_cast <const char*> (data), bytes) == bytes;
+}
+
+bool
+NaviPackWriter::Write (QSqlDatabase & geoBase, const QString & filename)
+{
+  static const char * tagTypes[3] = { "node", "way", "relation" };
+  bool ok = ReadStrings (geoBase)
+         && ReadNodes (geoBase)
+         && ReadWays (geoBase)
+         && ReadRelations (geoBase);
+  const QVector <NaviId> * tagIds[3] = { &nodeIds, &wayIds, &relIds };
+  for (int t=0; ok && t<3; t++) {
+    ok = ReadTags (geoBase, tagTypes[t], *tagIds[t], tagStart[t],
+                   tagKeys[t], tagValues[t], tagOrder[t]);
+  }
+  if (!ok) {
+    return false;
+  }
+  QFile file (filename + ".tmp");
+  if (!file.open (QFile::WriteOnly | QFile::Truncate)) {
+    return Fail (file.errorString ());
+  }
+  NaviPack::Header header;
+  memcpy (header.magic, PackMagic, sizeof (PackMagic));
+  header.version = PackVersion;
+  header.sectionCount = NaviPack::Sec_Count;
+  NaviPack::SectionEntry table[NaviPack::Sec_Count];
+  memset (table, 0, sizeof (table));
+  ok = file.write (reinterpret_cast <const char*> (&header), sizeof (header))
+          == qint64 (sizeof (header))
+    && file.write (reinterpret_cast <const char*> (table), sizeof (table))
+          == qint64 (sizeof (table));
+
+#define PACK_COLUMN(sec, vec) \
+  ok = ok && WriteColumn (file, table[NaviPack::sec], (vec).constData (), \
+                          (vec).count (), sizeof ((vec)[0]))
+
+  PACK_COLUMN (Sec_NodeIds, nodeIds);
+  PACK_COLUMN (Sec_NodeLats, nodeLats);
+  PACK_COLUMN (Sec_NodeLons, nodeLons);
+  PACK_COLUMN (Sec_NodeLatOrder, nodeLatOrder);
+  PACK_COLUMN (Sec_WayIds, wayIds);
+  PACK_COLUMN (Sec_WayNodeStart, wayNodeStart);
+  PACK_COLUMN (Sec_WayNodeRefs, wayNodeRefs);
+  PACK_COLUMN (Sec_RelIds, relIds);
+  PACK_COLUMN (Sec_RelMemberStart, relMemberStart);
+  PACK_COLUMN (Sec_RelMemberTypes, relMemberTypes);
+  PACK_COLUMN (Sec_RelMemberRefs, relMemberRefs);
+  PACK_COLUMN (Sec_NodeTagStart, tagStart[0]);
+  PACK_COLUMN (Sec_NodeTagKeys, tagKeys[0]);
+  PACK_COLUMN (Sec_NodeTagValues, tagValues[0]);
+  PACK_COLUMN (Sec_NodeTagOrder, tagOrder[0]);
+  PACK_COLUMN (Sec_WayTagStart, tagStart[1]);
+  PACK_COLUMN (Sec_WayTagKeys, tagKeys[1]);
+  PACK_COLUMN (Sec_WayTagValues, tagValues[1]);
+  PACK_COLUMN (Sec_WayTagOrder, tagOrder[1]);
+  PACK_COLUMN (Sec_RelTagStart, tagStart[2]);
+  PACK_COLUMN (Sec_RelTagKeys, tagKeys[2]);
+  PACK_COLUMN (Sec_RelTagValues, tagValues[2]);
+  PACK_COLUMN (Sec_RelTagOrder, tagOrder[2]);
+  PACK_COLUMN (Sec_StringStart, stringStart);
+  ok = ok && WriteColumn (file, table[NaviPack::Sec_StringData],
+                          stringData.constData (), stringData.size (), 1);
+
+#undef PACK_COLUMN
+
+  ok = ok && file.seek (sizeof (header))
+          && file.write (reinterpret_cast <const char*> (table), 
+                         sizeof (table)) == qint64 (sizeof (table));
+  if (!ok) {
+    QString error = file.errorString ();
+    file.close ();
+    file.remove ();
+    return Fail (error);
+  }
+  file.close ();
+  QFile::remove (filename);
+  if (!file.rename (filename)) {
+    return Fail (file.errorString ());
+  }
+  return true;
+}
+
+} // namespace
@@ -0,0 +1,208 @@
+#ifndef NAVI_PACK_H
+#define NAVI_PACK_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "navi-types.h"
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QSqlDatabase>
+
+namespace navi
+{
+
+/** @brief A navi pack is a read only, column oriented snapshot of a
+  * geobase in one file.
+  *
+  * Each section is a plain array, 8 byte aligned, listed in a table
+  * after the header:
+  *  - node ids (sorted), lat and lon columns, node positions by lat
+  *  - way ids (sorted), start of each way in the node ref column,
+  *    node refs in way order
+  *  - relation ids (sorted), member starts, member types and refs
+  *  - for each of nodes, ways and relations: tag starts, key and 
+  *    value columns, and the tag positions sorted by (key, value)
+  *  - the string dictionary, sorted by bytes: starts and UTF-8 data
+  * Tags and member types are dictionary codes. Counts are limited to
+  * 2^31 per column.
+  */
+
+class NaviPack
+{
+public:
+
+  enum Section {
+    Sec_NodeIds = 0,
+    Sec_NodeLats,
+    Sec_NodeLons,
+    Sec_NodeLatOrder,
+    Sec_WayIds,
+    Sec_WayNodeStart,
+    Sec_WayNodeRefs,
+    Sec_RelIds,
+    Sec_RelMemberStart,
+    Sec_RelMemberTypes,
+    Sec_RelMemberRefs,
+    Sec_NodeTagStart,
+    Sec_NodeTagKeys,
+    Sec_NodeTagValues,
+    Sec_NodeTagOrder,
+    Sec_WayTagStart,
+    Sec_WayTagKeys,
+    Sec_WayTagValues,
+    Sec_WayTagOrder,
+    Sec_RelTagStart,
+    Sec_RelTagKeys,
+    Sec_RelTagValues,
+    Sec_RelTagOrder,
+    Sec_StringStart,
+    Sec_StringData,
+    Sec_Count
+  };
+
+  struct Header {
+    char     magic[8];
+    quint32  version;
+    quint32  sectionCount;
+  };
+
+  struct SectionEntry {
+    quint64  offset;
+    quint64  count;
+  };
+
+  NaviPack ();
+  ~NaviPack ();
+
+  bool Open (const QString & filename);
+  void Close ();
+  bool IsOpen () const { return base != 0; }
+
+  int  NodeCount () const { return Count (Sec_NodeIds); }
+  int  WayCount () const { return Count (Sec_WayIds); }
+  int  RelationCount () const { return Count (Sec_RelIds); }
+
+  bool GetNode (NaviId nodeId, NaviCoord & lat, NaviCoord & lon) const;
+  bool GetNode (NaviId nodeId, double & lat, double & lon) const;
+
+  /** @brief the way's node refs inside the map, 0 if there is no
+    * such way
+    */
+  const NaviId * WayNodes (NaviId wayId, int & count) const;
+  bool GetWayNodes (NaviId wayId, NaviIdList & nodeIdList) const;
+
+  bool GetNodeTags (NaviId nodeId, TagList & tagList) const;
+  bool GetWayTags (NaviId wayId, TagList & tagList) const;
+  bool GetRelationTags (NaviId relId, TagList & tagList) const;
+
+  void GetByTag (NaviIdList & idList,
+                 const QString & tagKey,
+                 const QString & tagValue,
+                 const QString & type,
+                       bool regularExp = false) const;
+  void GetNodesByLatLon (NaviIdList & nodeList,
+                         double south, double west,
+                         double north, double east) const;
+
+  QString String (quint32 code) const;
+  int     FindString (const QByteArray & utf8) const;
+
+private:
+
+  struct TagSections {
+    Section  ids;
+    Section  start;
+    Section  keys;
+    Section  values;
+    Section  order;
+  };
+
+  template <typename T>
+  const T * Column (Section section) const
+    { 
+      return reinterpret_cast <const T*> (base + sections[section].offset);
+    }
+  int  Count (Section section) const
+    { return base ? int (sections[section].count) : 0; }
+  int  FindId (Section section, NaviId id) const;
+  bool GetTags (const TagSections & tags, NaviId id, 
+                TagList & tagList) const;
+  static TagSections TagSectionsFor (const QString & type);
+
+  QFile                file;
+  const uchar         *base;
+  const SectionEntry  *sections;
+};
+
+/** @brief Writes a navi pack from a geobase. The columns are built
+  * in memory, then written in one pass.
+  */
+
+class NaviPackWriter
+{
+public:
+
+  bool Write (QSqlDatabase & geoBase, const QString & filename);
+
+  QString ErrorString () const { return errorText; }
+
+private:
+
+  bool ReadStrings (QSqlDatabase & geoBase);
+  bool ReadNodes (QSqlDatabase & geoBase);
+  bool ReadWays (QSqlDatabase & geoBase);
+  bool ReadRelations (QSqlDatabase & geoBase);
+  bool ReadTags (QSqlDatabase & geoBase, const QString & type,
+                 const QVector <NaviId> & ids,
+                 QVector <quint32> & start,
+                 QVector <quint32> & keys,
+                 QVector <quint32> & values,
+                 QVector <quint32> & order);
+  bool Fail (const QString & message);
+
+  QString                   errorText;
+  QHash <QByteArray, quint32>  codes;
+  QVector <quint32>         stringStart;
+  QByteArray                stringData;
+
+  QVector <NaviId>     nodeIds;
+  QVector <NaviCoord>  nodeLats;
+  QVector <NaviCoord>  nodeLons;
+  QVector <quint32>    nodeLatOrder;
+  QVector <NaviId>     wayIds;
+  QVector <quint32>    wayNodeStart;
+  QVector <NaviId>     wayNodeRefs;
+  QVector <NaviId>     relIds;
+  QVector <quint32>    relMemberStart;
+  QVector <quint32>    relMemberTypes;
+  QVector <NaviId>     relMemberRefs;
+  QVector <quint32>    tagStart[3];
+  QVector <quint32>    tagKeys[3];
+  QVector <quint32>    tagValues[3];
+  QVector <quint32>    tagOrder[3];
+};
+
+} // namespace
+
+#endif
@@ -34,17 +34,22 @@ ParcelIndex (double lat, double lon)
 }
 
 WayTurn::WayTurn ()
+  :mWay (0),
+   mNode (0),
+   mSeq (0),
+   mLat (0),
+   mLon (0)
 {
 }
 
-WayTurn::WayTurn (const QString & wayId, const QString & nodeId,
+WayTurn::WayTurn (NaviId wayId, NaviId nodeId,
                   int seq, 
                   double lat, double lon)
   :mWay (wayId),
    mNode (nodeId),
    mSeq (seq),
-   mLat (lat),
-   mLon (lon)
+   mLat (CoordFromDegrees (lat)),
+   mLon (CoordFromDegrees (lon))
 {
 }
 
@@ -70,13 +75,13 @@ WayTurn::operator = (const WayTurn & other)
   return *this;
 }
 
-QString
+NaviId
 WayTurn::WayId () const
 {
   return mWay;
 }
 
-QString
+NaviId
 WayTurn::NodeId () const
 {
   return mNode;
@@ -91,23 +96,23 @@ WayTurn::Seq () const
 double
 WayTurn::Lat () const
 {
-  return mLat;
+  return DegreesFromCoord (mLat);
 }
 
 double
 WayTurn::Lon () const
 {
-  return mLon;
+  return DegreesFromCoord (mLon);
 }
 
 void
-WayTurn::SetWayId (const QString & id)
+WayTurn::SetWayId (NaviId id)
 {
   mWay = id;
 }
 
 void
-WayTurn::SetNodeId (const QString & nid)
+WayTurn::SetNodeId (NaviId nid)
 {
   mNode = nid;
 }
@@ -121,8 +126,8 @@ WayTurn::SetSeq (int s)
 void
 WayTurn::SetLatLon (double lt, double ln)
 {
-  mLat = lt;
-  mLon = ln;
+  mLat = CoordFromDegrees (lt);
+  mLon = CoordFromDegrees (ln);
 }
 
 
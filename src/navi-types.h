@@ -23,19 +23,46 @@
  ****************************************************************/
 #include <QString>
 #include <QPair>
+#include <QList>
 
 namespace navi
 {
 
+/** @brief OSM ids are 64 bit integers, in memory and in the geobase */
+
+typedef qint64  NaviId;
+
+/** @brief Coordinates are fixed point, in units of 1e-7 degree, which
+  * is the precision of OSM data. Doubles only appear at the edges.
+  */
+
+typedef qint32  NaviCoord;
+
+const double NaviCoordPerDegree (10000000.0);
+
+inline NaviCoord
+CoordFromDegrees (double degrees)
+{
+  return NaviCoord (qRound64 (degrees * NaviCoordPerDegree));
+}
+
+inline double
+DegreesFromCoord (NaviCoord coord)
+{
+  return double (coord) / NaviCoordPerDegree;
+}
+
 
 class NaviNode 
 {
 public:
 
   NaviNode ()
-    :lat(0.0),lon (0.0) {}
-  NaviNode (const QString & nodeId, double nodeLat, double nodeLon)
-    :id (nodeId), lat (nodeLat), lon (nodeLon) {}
+    :id (0), lat(0),lon (0) {}
+  NaviNode (NaviId nodeId, double nodeLat, double nodeLon)
+    :id (nodeId), 
+     lat (CoordFromDegrees (nodeLat)), 
+     lon (CoordFromDegrees (nodeLon)) {}
   NaviNode (const NaviNode &other)
     {
        id = other.id;
@@ -52,26 +79,82 @@ public:
        return *this;
     }
 
-  QString Id () const { return id; }
-  double  Lat () const { return lat; }
-  double  Lon () const { return lon; }
+  static NaviNode FromCoords (NaviId nodeId, NaviCoord lat, NaviCoord lon)
+    {
+      NaviNode node;
+      node.id = nodeId;
+      node.lat = lat;
+      node.lon = lon;
+      return node;
+    }
 
-  void SetLat (double l) { lat = l; }
-  void SetLon (double l) { lon = l; }
+  NaviId     Id () const { return id; }
+  double     Lat () const { return DegreesFromCoord (lat); }
+  double     Lon () const { return DegreesFromCoord (lon); }
+  NaviCoord  LatCoord () const { return lat; }
+  NaviCoord  LonCoord () const { return lon; }
+
+  void SetLat (double l) { lat = CoordFromDegrees (l); }
+  void SetLon (double l) { lon = CoordFromDegrees (l); }
 
 private:
 
-  QString id;
-  double  lat;
-  double  lon;
+  NaviId     id;
+  NaviCoord  lat;
+  NaviCoord  lon;
+
+};
+
+/** @brief Bounding box in fixed point coordinates, empty until the
+  * first point is included.
+  */
+
+class NaviBox
+{
+public:
+
+  NaviBox ()
+    :minLat (1), maxLat (0), minLon (1), maxLon (0) {}
+  NaviBox (NaviCoord south, NaviCoord west, NaviCoord north, NaviCoord east)
+    :minLat (south), maxLat (north), minLon (west), maxLon (east) {}
+
+  bool IsEmpty () const { return minLat > maxLat || minLon > maxLon; }
+
+  void Include (NaviCoord lat, NaviCoord lon)
+    {
+      if (IsEmpty ()) {
+        minLat = maxLat = lat;
+        minLon = maxLon = lon;
+      } else {
+        minLat = qMin (minLat, lat);
+        maxLat = qMax (maxLat, lat);
+        minLon = qMin (minLon, lon);
+        maxLon = qMax (maxLon, lon);
+      }
+    }
+  bool Contains (NaviCoord lat, NaviCoord lon) const
+    {
+      return lat >= minLat && lat <= maxLat 
+          && lon >= minLon && lon <= maxLon;
+    }
+  bool Intersects (const NaviBox & other) const
+    {
+      return !IsEmpty () && !other.IsEmpty ()
+          && minLat <= other.maxLat && maxLat >= other.minLat
+          && minLon <= other.maxLon && maxLon >= other.minLon;
+    }
 
+  NaviCoord  minLat;
+  NaviCoord  maxLat;
+  NaviCoord  minLon;
+  NaviCoord  maxLon;
 };
 
 class TagRecord {
 public:
 
-  TagRecord () {}
-  TagRecord (const QString & theId, 
+  TagRecord () :id (0) {}
+  TagRecord (NaviId theId,
              const QString & theKey, 
              const QString & theVal)
     :id (theId), key (theKey), value (theVal) {}
@@ -82,13 +165,13 @@ public:
       value = other.value;
     }
 
-  QString Id () const { return id; }
+  NaviId  Id () const { return id; }
   QString Key () const { return key; }
   QString Value () const { return value; }
 
 private:
 
-  QString id;
+  NaviId  id;
   QString key;
   QString value;
 };
@@ -97,37 +180,43 @@ class WayTurn {
 public:
 
   WayTurn ();
-  WayTurn (const QString & wayId,
-           const QString & nodeId,
+  WayTurn (NaviId wayId,
+           NaviId nodeId,
            int  seq,
            double lat,
            double lon);
   WayTurn (const WayTurn & other);
   WayTurn & operator = (const WayTurn & other);
 
-  QString WayId () const;
-  QString NodeId () const;
+  NaviId  WayId () const;
+  NaviId  NodeId () const;
   int     Seq() const;
   double  Lat () const;
   double  Lon () const;
+  NaviCoord  LatCoord () const { return mLat; }
+  NaviCoord  LonCoord () const { return mLon; }
 
-  void SetWayId (const QString & id);
-  void SetNodeId (const QString & nid);
+  void SetWayId (NaviId id);
+  void SetNodeId (NaviId nid);
   void SetSeq (int s);
   void SetLatLon (double lt, double ln);
+  void SetCoords (NaviCoord lt, NaviCoord ln) { mLat = lt; mLon = ln; }
 
 private:
 
-  QString  mWay;
-  QString  mNode;
-  int      mSeq;
-  double   mLat;
-  double   mLon;
+  NaviId   mWay;
+  NaviId   mNode;
+  int        mSeq;
+  NaviCoord  mLat;
+  NaviCoord  mLon;
 };
 
 
 typedef QPair <QString, QString>  TagItemType;
 typedef QList <TagItemType>       TagList;
+typedef QList <NaviId>            NaviIdList;
+typedef QPair <QString, NaviId>   MemberItemType;
+typedef QList <MemberItemType>    MemberList;
 typedef QList <NaviNode>          NaviNodeList;
 typedef QList <TagRecord>         TagRecordList;
 typedef QList <WayTurn>           WayTurnList;
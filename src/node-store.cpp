@@ -0,0 +1,218 @@
+#include "node-store.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+#include <string.h>
+
+namespace navi
+{
+
+static const char  StoreMagic[8] = { 'N','A','V','I','N','O','D','E' };
+static const quint32 StoreVersion (1);
+
+const int       NodeStore::BlockShift;
+const qint64    NodeStore::BlockSize;
+const qint64    NodeStore::BlockMask;
+const NaviCoord NodeStore::Missing;
+
+NodeStore::NodeStore ()
+  :base (0),
+   directory (0),
+   dirEntries (0),
+   nodeCount (0)
+{
+}
+
+NodeStore::~NodeStore ()
+{
+  Close ();
+}
+
+bool
+NodeStore::Open (const QString & filename)
+{
+  Close ();
+  file.setFileName (filename);
+  if (!file.open (QFile::ReadOnly)) {
+    return false;
+  }
+  qint64 size = file.size ();
+  if (size < qint64 (sizeof (Header))) {
+    file.close ();
+    return false;
+  }
+  uchar * map = file.map (0, size);
+  if (map == 0) {
+    qDebug () << "NodeStore cannot map " << filename << file.errorString ();
+    file.close ();
+    return false;
+  }
+  const Header * header = reinterpret_cast <const Header*> (map);
+  quint64 dirRoom = (quint64 (size) - sizeof (Header)) / sizeof (quint64);
+  bool good = memcmp (header->magic, StoreMagic, sizeof (StoreMagic)) == 0
+           && header->version == StoreVersion
+           && header->blockShift == quint32 (BlockShift)
+           && header->dirEntries <= dirRoom;
+  if (good) {
+    /// Find trusts the directory, so a truncated or damaged file
+    /// must not point it past the end of the map
+    const quint64 * dir = reinterpret_cast <const quint64*> 
+                                  (map + sizeof (Header));
+    quint64 blocksAt = sizeof (Header) + header->dirEntries * sizeof (quint64);
+    quint64 blockBytes = BlockSize * 2 * sizeof (NaviCoord);
+    for (quint64 d=0; good && d<header->dirEntries; d++) {
+      quint64 offset = dir[d];
+      good = offset == 0
+             || (offset >= blocksAt
+                 && offset % sizeof (NaviCoord) == 0
+                 && offset <= quint64 (size)
+                 && quint64 (size) - offset >= blockBytes);
+    }
+  }
+  if (!good) {
+    qDebug () << "NodeStore " << filename << " has the wrong layout";
+    file.unmap (map);
+    file.close ();
+    return false;
+  }
+  base = map;
+  directory = reinterpret_cast <const quint64*> (map + sizeof (Header));
+  dirEntries = header->dirEntries;
+  nodeCount = header->nodeCount;
+  return true;
+}
+
+void
+NodeStore::Close ()
+{
+  if (base) {
+    file.unmap (const_cast <uchar*> (base));
+    base = 0;
+  }
+  directory = 0;
+  dirEntries = 0;
+  nodeCount = 0;
+  if (file.isOpen ()) {
+    file.close ();
+  }
+}
+
+bool
+NodeStoreWriter::Start (const QString & filename, NaviId maxId)
+{
+  finalName = filename;
+  QFileInfo info (filename);
+  QDir ().mkpath (info.absolutePath ());
+  file.setFileName (filename + ".tmp");
+  if (!file.open (QFile::ReadWrite | QFile::Truncate)) {
+    errorText = file.errorString ();
+    return false;
+  }
+  directory.fill (0, maxId < 0 ? 0 : (maxId >> NodeStore::BlockShift) + 1);
+  block.clear ();
+  blockNum = -1;
+  nodeCount = 0;
+  qint64 blocksAt = sizeof (NodeStore::Header) 
+                    + directory.count () * sizeof (quint64);
+  if (!file.resize (blocksAt) || !file.seek (blocksAt)) {
+    errorText = file.errorString ();
+    return false;
+  }
+  return true;
+}
+
+bool
+NodeStoreWriter::Add (NaviId nodeId, NaviCoord lat, NaviCoord lon)
+{
+  qint64 num = nodeId >> NodeStore::BlockShift;
+  if (nodeId < 0 || num >= directory.count () || num < blockNum) {
+    return false;
+  }
+  if (num != blockNum) {
+    if (!FlushBlock ()) {
+      return false;
+    }
+    blockNum = num;
+    block.fill (NodeStore::Missing, 2 * NodeStore::BlockSize);
+  }
+  int slot = 2 * (nodeId & NodeStore::BlockMask);
+  block[slot] = lat;
+  block[slot+1] = lon;
+  nodeCount++;
+  return true;
+}
+
+bool
+NodeStoreWriter::FlushBlock ()
+{
+  if (blockNum < 0) {
+    return true;
+  }
+  directory[blockNum] = file.pos ();
+  qint64 bytes = block.count () * sizeof (NaviCoord);
+  if (file.write (reinterpret_cast <const char*> (block.constData ()), bytes)
+      != bytes) {
+    errorText = file.errorString ();
+    return false;
+  }
+  return true;
+}
+
+bool
+NodeStoreWriter::Finish ()
+{
+  if (!FlushBlock ()) {
+    file.close ();
+    file.remove ();
+    return false;
+  }
+  NodeStore::Header header;
+  memcpy (header.magic, StoreMagic, sizeof (StoreMagic));
+  header.version = StoreVersion;
+  header.blockShift = NodeStore::BlockShift;
+  header.dirEntries = directory.count ();
+  header.nodeCount = nodeCount;
+  qint64 dirBytes = directory.count () * sizeof (quint64);
+  bool ok = file.seek (0)
+         && file.write (reinterpret_cast <const char*> (&header), 
+                        sizeof (header)) == qint64 (sizeof (header))
+         && file.write (reinterpret_cast <const char*> 
+                           (directory.constData ()), dirBytes) == dirBytes;
+  if (!ok) {
+    errorText = file.errorString ();
+    file.close ();
+    file.remove ();
+    return false;
+  }
+  file.close ();
+  QFile::remove (finalName);
+  if (!file.rename (finalName)) {
+    errorText = file.errorString ();
+    return false;
+  }
+  return true;
+}
+
+} // namespace
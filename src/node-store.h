@@ -0,0 +1,139 @@
+#ifndef NODE_STORE_H
+#define NODE_STORE_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "navi-types.h"
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+namespace navi
+{
+
+/** @brief Flat file of node coordinates, indexed by node id.
+  *
+  * Ids are grouped in blocks of 2^BlockShift. A directory after the
+  * header holds the file offset of each block, 0 for a block with no
+  * nodes, so the high and sparse id ranges only cost a directory
+  * entry. A block is an array of (lat, lon) pairs, Missing for ids
+  * without a node. The file is mapped read only, so all processes
+  * reading it share the same pages.
+  */
+
+class NodeStore
+{
+public:
+
+  NodeStore ();
+  ~NodeStore ();
+
+  bool Open (const QString & filename);
+  void Close ();
+  bool IsOpen () const { return base != 0; }
+
+  /** @brief pointer to the (lat, lon) pair in the map, 0 if the
+    * node is not in the store
+    */
+  const NaviCoord * Find (NaviId nodeId) const
+    {
+      if (nodeId < 0 || quint64 (nodeId >> BlockShift) >= dirEntries) {
+        return 0;
+      }
+      quint64 offset = directory[nodeId >> BlockShift];
+      if (offset == 0) {
+        return 0;
+      }
+      const NaviCoord * pair = reinterpret_cast <const NaviCoord*> 
+                                  (base + offset)
+                             + 2 * (nodeId & BlockMask);
+      return pair[0] == Missing ? 0 : pair;
+    }
+
+  bool Get (NaviId nodeId, NaviCoord & lat, NaviCoord & lon) const
+    {
+      const NaviCoord * pair = Find (nodeId);
+      if (pair) {
+        lat = pair[0];
+        lon = pair[1];
+      }
+      return pair != 0;
+    }
+
+  quint64 NodeCount () const { return nodeCount; }
+
+  /** @brief the store lives next to the geobase it was built from */
+  static QString FileName (const QString & geoBaseName)
+    { return geoBaseName + QString (".nodes"); }
+
+  static const int       BlockShift = 16;
+  static const qint64    BlockSize = Q_INT64_C(1) << BlockShift;
+  static const qint64    BlockMask = BlockSize - 1;
+  static const NaviCoord Missing = -0x7fffffff - 1;
+
+  struct Header {
+    char     magic[8];
+    quint32  version;
+    quint32  blockShift;
+    quint64  dirEntries;
+    quint64  nodeCount;
+  };
+
+private:
+
+  QFile           file;
+  const uchar    *base;
+  const quint64  *directory;
+  quint64         dirEntries;
+  quint64         nodeCount;
+};
+
+/** @brief Writes a NodeStore file. Nodes have to be added in
+  * ascending id order. The file is written under a temporary name
+  * and renamed on Finish, so readers never see half a store.
+  */
+
+class NodeStoreWriter
+{
+public:
+
+  bool Start (const QString & filename, NaviId maxId);
+  bool Add (NaviId nodeId, NaviCoord lat, NaviCoord lon);
+  bool Finish ();
+
+  QString ErrorString () const { return errorText; }
+
+private:
+
+  bool FlushBlock ();
+
+  QFile               file;
+  QString             finalName;
+  QString             errorText;
+  QVector <quint64>   directory;
+  QVector <NaviCoord> block;
+  qint64              blockNum;
+  quint64             nodeCount;
+};
+
+} // namespace
+
+#endif
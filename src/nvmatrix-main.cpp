@@ -0,0 +1,199 @@
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QVector>
+#include "deliberate.h"
+#include "cmdoptions.h"
+#include "road-graph.h"
+#include "route-hierarchy.h"
+#include "distance-matrix.h"
+
+/** @brief Travel time matrix without the GUI.
+  *
+  * The sources and targets files have one route end per line, an OSM
+  * node id or lat,lon; empty lines and lines starting with # are
+  * skipped. The matrix is written as CSV, one row per source, in
+  * seconds, with an empty field where a target cannot be reached.
+  */
+
+static bool
+ReadEnds (const QString & filename,
+          const navi::RoadGraph & graph,
+          QVector <int> & nodes,
+          QStringList & labels,
+          QTextStream & err)
+{
+  QFile file (filename);
+  if (!file.open (QFile::ReadOnly)) {
+    err << filename << ": " << file.errorString () << endl;
+    return false;
+  }
+  QTextStream in (&file);
+  int lineNumber (0);
+  while (!in.atEnd ()) {
+    QString line = in.readLine ().trimmed ();
+    lineNumber++;
+    if (line.isEmpty () || line.startsWith ("#")) {
+      continue;
+    }
+    int node = graph.ParseNode (line);
+    if (node < 0) {
+      err << filename << ":" << lineNumber << ": " << line
+          << " is not in the road graph" << endl;
+      return false;
+    }
+    nodes.append (node);
+    labels.append (line);
+  }
+  return true;
+}
+
+static QString
+CsvField (const QString & text)
+{
+  if (text.contains (',') || text.contains ('"')) {
+    QString quoted (text);
+    quoted.replace ("\"", "\"\"");
+    return QString ("\"%1\"").arg (quoted);
+  }
+  return text;
+}
+
+int
+main (int argc, char *argv[])
+{
+  QCoreApplication::setOrganizationName ("BerndStramm");
+  QCoreApplication::setOrganizationDomain ("bernd-stramm.com");
+  QCoreApplication::setApplicationName ("navi");
+  deliberate::DSettings  settings;
+  deliberate::InitSettings ();
+  deliberate::SetSettings (settings);
+  deliberate::Settings().SetPrefix ("nvmatrix_");
+
+  deliberate::CmdOptions  opts ("nvmatrix");
+  opts.AddStringOption ("geobase","g",
+           QObject::tr("geobase file, the road graph is next to it"));
+  opts.AddStringOption ("sources","s",
+           QObject::tr("file of sources, node id or lat,lon per line"));
+  opts.AddStringOption ("targets","t",
+           QObject::tr("file of targets, default the sources"));
+  opts.AddStringOption ("output","o",
+           QObject::tr("CSV output file, default standard output"));
+  opts.AddIntOption ("threads","j",
+           QObject::tr("worker threads, default one per core"));
+  opts.AddSoloOption ("graphonly","G",
+           QObject::tr("search the road graph, not the hierarchy"));
+
+  bool optsOk = opts.Parse (argc, argv);
+  if (!optsOk) {
+    opts.Usage ();
+    exit (1);
+  }
+  if (opts.WantHelp ()) {
+    opts.Usage ();
+    exit (0);
+  }
+  if (opts.WantVersion ()) {
+    exit (0);
+  }
+  QCoreApplication  app (argc, argv);
+  QTextStream err (stderr);
+
+  QString geoBaseName = deliberate::Settings().simpleValue
+                              ("database/geobase").toString();
+  QString sourceFile, targetFile, outputFile;
+  int threads (0);
+  opts.SetStringOpt ("geobase", geoBaseName);
+  opts.SetStringOpt ("sources", sourceFile);
+  opts.SetStringOpt ("targets", targetFile);
+  opts.SetStringOpt ("output", outputFile);
+  opts.SetIntOpt ("threads", threads);
+  if (geoBaseName.isEmpty () || sourceFile.isEmpty ()) {
+    opts.Usage ();
+    exit (1);
+  }
+  if (targetFile.isEmpty ()) {
+    targetFile = sourceFile;
+  }
+
+  navi::RoadGraph graph;
+  if (!graph.Open (navi::RoadGraph::FileName (geoBaseName))) {
+    err << "no road graph for " << geoBaseName
+        << ", build one with collect" << endl;
+    return 2;
+  }
+  navi::RouteHierarchy hierarchy;
+  if (!opts.SeenOpt ("graphonly")) {
+    hierarchy.Open (navi::RouteHierarchy::FileName (geoBaseName), graph);
+  }
+  QVector <int> sources, targets;
+  QStringList sourceLabels, targetLabels;
+  if (!ReadEnds (sourceFile, graph, sources, sourceLabels, err)
+      || !ReadEnds (targetFile, graph, targets, targetLabels, err)) {
+    return 2;
+  }
+
+  navi::DistanceMatrix matrix (graph,
+                               hierarchy.IsOpen () ? &hierarchy : 0);
+  if (!matrix.Compute (sources, targets, threads)) {
+    err << matrix.ErrorString () << endl;
+    return 3;
+  }
+  err << matrix.Report () << endl;
+
+  QFile outFile;
+  bool opened;
+  if (outputFile.isEmpty ()) {
+    opened = outFile.open (stdout, QFile::WriteOnly);
+  } else {
+    outFile.setFileName (outputFile);
+    opened = outFile.open (QFile::WriteOnly | QFile::Truncate);
+  }
+  if (!opened) {
+    err << outputFile << ": " << outFile.errorString () << endl;
+    return 2;
+  }
+  QTextStream out (&outFile);
+  out << "source";
+  for (int c=0; c<targetLabels.count(); c++) {
+    out << "," << CsvField (targetLabels.at(c));
+  }
+  out << "\n";
+  for (int r=0; r<matrix.Rows(); r++) {
+    out << CsvField (sourceLabels.at(r));
+    for (int c=0; c<matrix.Columns(); c++) {
+      quint32 cost = matrix.Cost (r, c);
+      out << ",";
+      if (cost != navi::DistanceMatrix::Unreachable) {
+        out << QString::number (cost / 10.0, 'f', 1);
+      }
+    }
+    out << "\n";
+  }
+  out.flush ();
+  return 0;
+}
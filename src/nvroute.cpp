@@ -83,6 +83,10 @@ NvRoute::Init (QApplication &ap)
   connect (app, SIGNAL (lastWindowClosed()), this, SLOT (Exiting()));
   Settings().sync();
   db.Start ();
+  if (graph.Open (RoadGraph::FileName (db.GeoBaseFile ()))) {
+    qDebug () << " NvRoute road graph " << graph.NodeCount () << " nodes "
+              << graph.EdgeCount () << " edges";
+  }
   initDone = true;
 }
 
@@ -252,15 +256,10 @@ qDebug () << "ParcelButton " << parcel;
   wayList.clear ();
   
   findTimer->start (10000);
-  int round (0);
   int extend = mainUi.extendedSize->value();
-  for (qint64 i= -extend; i <= extend; i++) {
-    for (qint64 j= -extend; j <= extend; j++) {
-      qint64 latOffset = i * Q_INT64_C (0x0100000000);
-      qint64 lonOffset = j * Q_INT64_C (1);
-      FindParcel (parcel + latOffset + lonOffset, round);
-      round ++;
-    }
+  ParcelRangeList ranges = Parcel::Ranges (parcel, extend);
+  for (int r=0; r<ranges.count(); r++) {
+    FindParcel (ranges.at(r));
   }
   QTimer::singleShot (100,this, SLOT (FindThings()));
 }
@@ -280,26 +279,23 @@ NvRoute::LatLonButton ()
   mainUi.logDisplay->append ("FindButton ++++");
   waySet.clear ();
   relationSet.clear ();
-  QStringList idList;
+  NaviIdList idList;
   db.GetNodesByLatLon (idList, south, west, north, east);
   nodeSet = idList.toSet();
-  idList.clear();
-  QSet<QString>::iterator sit;
-  for (sit=nodeSet.begin(); sit!= nodeSet.end(); sit++) {
-    QStringList ways;
-    db.GetWaysByNode (ways, *sit);
-    waySet.unite (ways.toSet()); 
-    QStringList relations;
-    db.GetRelationsByMember (relations, "node", *sit);
-    relationSet.unite (relations.toSet());
-  }
-  for (sit=waySet.begin(); sit!= waySet.end(); sit++) {
-    QStringList relations;
-    db.GetRelationsByMember (relations, "way", *sit);
-  }
+  QMap <NaviId, NaviIdList> found;
+  db.GetWaysByNodes (idList, found);
+  UniteGroups (waySet, found);
+  db.GetRelationsByMembers ("node", idList, found);
+  UniteGroups (relationSet, found);
+  NaviIdList boxWays;
+  db.GetWaysInBox (boxWays, south, west, north, east);
+  waySet.unite (boxWays.toSet());
+  db.GetRelationsByMembers ("way", waySet.toList(), found);
+  UniteGroups (relationSet, found);
   ListNodes ();
   ListWays ();
   ListRelations ();
+  mainUi.logDisplay->append (db.Cache().Report ());
 }
 
 void
@@ -308,7 +304,7 @@ NvRoute::FeatureButton ()
   QString name = mainUi.featureEdit->text ();
   bool regular = mainUi.regularCheck->isChecked();
 qDebug () << "Feature Button " << name << regular;
-  QStringList idList;
+  NaviIdList idList;
   db.GetByTag (idList, "name", name, "node", regular);
   nodeSet = idList.toSet();
   db.GetByTag (idList, "name", name, "way", regular);
@@ -322,13 +318,12 @@ qDebug () << "Feature Button " << name << regular;
 }
 
 void
-NvRoute::FindParcel (quint64 parcel, int round)
+NvRoute::FindParcel (const ParcelRange & parcels)
 {
-  Q_UNUSED (round)
-  mainUi.logDisplay->append (QString ("looking for parcel %1")
-                               .arg (parcel));
-  indexList.append ( parcel);
-qDebug () << "FindParcel want index " << parcelIndex;
+  mainUi.logDisplay->append (QString ("looking for parcels %1 to %2")
+                               .arg (parcels.first).arg (parcels.second));
+  indexList.append (parcels);
+qDebug () << "FindParcel want range " << parcels.first << parcels.second;
 }
 
 void
@@ -339,29 +334,31 @@ NvRoute::FindThings ()
             << " entries";
   if (indexList.isEmpty()) {
     findTimer->stop ();
-    mainUi.logDisplay->append ("no more parcelIndex on list");
+    mainUi.logDisplay->append ("no more parcel ranges on list");
     qDebug () << " stopped findTimer";
     return;
   }
   mainUi.featureDisplay->clear();
   FindWays ();
-  QStringList nodeList;
-  parcelIndex = indexList.takeFirst();
-  qDebug () << " FindThings want index " << parcelIndex;
-  db.GetNodes (parcelIndex, nodeList);
-  QSet<QString> localNodes = nodeList.toSet();
+  NaviIdList nodeList;
+  parcelRange = indexList.takeFirst();
+  qDebug () << " FindThings want range " << parcelRange.first
+            << parcelRange.second;
+  db.GetNodes (parcelRange, nodeList);
+  QSet<NaviId> localNodes = nodeList.toSet();
   nodeSet += localNodes;
   mainUi.logDisplay->append (tr("Number nodes before relations %1")
                              .arg (nodeSet.count()));
   FindRelations ();
   FindNodes ();
+  LoadNodeDetails (nodeSet.toList());
   QTreeWidgetItem * nodeListItem = new QTreeWidgetItem (Cell_Header);
   QList <QTreeWidgetItem*> itemList;
   QTreeWidgetItem *nodeItem;
-  QSet <QString>::iterator nit;
+  QSet <NaviId>::iterator nit;
   for (nit=nodeSet.begin(); nit!= nodeSet.end(); nit++) {
     nodeItem = new QTreeWidgetItem (Cell_Node);
-    QString nodeId = *nit;
+    NaviId nodeId = *nit;
     ListNodeDetails (nodeItem, nodeId);
     itemList.append (nodeItem);
   } 
@@ -372,24 +369,37 @@ NvRoute::FindThings ()
                              .arg (nodeSet.count()));
   mainUi.logDisplay->append (tr("number parcels to go %1")
                              .arg (indexList.count()));
+  mainUi.logDisplay->append (db.Cache().Report ());
 }
 
 void
 NvRoute::FindWays ()
 {
 qDebug () << " FindWays";
-  bool ok = db.GetWays (parcelIndex,wayList);
+  bool ok = db.GetWays (parcelRange,wayList);
   int nways = wayList.count();
 qDebug () << " waylist count " << wayList.count();
   waySet += wayList.toSet();
   mainUi.logDisplay->append (QString ("GetWay was %1").arg(ok));
   mainUi.logDisplay->append (QString ("  have %1 ways:").arg(nways));
-  QSet<QString>::iterator wit;
-  for (wit=waySet.begin(); wit!= waySet.end(); wit++) {
-    QString wayId = *wit;
+  NaviIdList ways = waySet.toList();
+  QMap <NaviId, NaviIdList> nodesByWay;
+  QMap <NaviId, NaviIdList> relsByWay;
+  db.GetTagsFor ("way", ways, wayTags);
+  db.GetWayNodes (ways, nodesByWay);
+  db.GetRelationsByMembers ("way", ways, relsByWay);
+  NaviIdList wayNodes;
+  QMap <NaviId, NaviIdList>::const_iterator mit;
+  for (mit=nodesByWay.constBegin(); mit!=nodesByWay.constEnd(); mit++) {
+    wayNodes += *mit;
+  }
+  LoadNodeDetails (wayNodes);
+  for (int w=0; w<ways.count(); w++) {
+    NaviId wayId = ways.at(w);
     mainUi.logDisplay->append (QString ("  Way %1")
                               .arg(wayId));
-    ListWayDetails (wayId);
+    ListWayDetails (wayId, nodesByWay.value (wayId), 
+                    relsByWay.value (wayId));
   }
   FindRelations ();
   ListNodeRelations ();
@@ -399,62 +409,89 @@ qDebug () << " waylist count " << wayList.count();
 void
 NvRoute::FindRelations ()
 {
-  QSet<QString>::iterator  sit;
-  for (sit=nodeSet.begin(); sit!= nodeSet.end(); sit++) {
-    QStringList relationList;
-    db.GetRelationsByMember (relationList, "node", *sit);
-    relationSet += relationList.toSet();
-    qDebug () << QString (" node %1 in %2 relations")
-                 .arg (*sit).arg (relationList.count());
-  }
+  QMap <NaviId, NaviIdList> relsByNode;
+  db.GetRelationsByMembers ("node", nodeSet.toList(), relsByNode);
+  UniteGroups (relationSet, relsByNode);
+  qDebug () << QString (" %1 nodes in relations")
+                 .arg (relsByNode.count());
 }
 
 void
 NvRoute::FindNodes ()
 {
-  QSet<QString>::iterator sit;
-  for (sit=relationSet.begin(); sit!=relationSet.end(); sit++) {
-    QStringList nodeList;
-    db.GetRelationMembers (*sit, "node", nodeList);
-    nodeSet += nodeList.toSet();
+  QMap <NaviId, NaviIdList> nodesByRelation;
+  db.GetRelationMembers (relationSet.toList(), "node", nodesByRelation);
+  UniteGroups (nodeSet, nodesByRelation);
+}
+
+void
+NvRoute::UniteGroups (QSet <NaviId> & set, 
+                      const QMap <NaviId, NaviIdList> & groups)
+{
+  QMap <NaviId, NaviIdList>::const_iterator git;
+  for (git=groups.constBegin(); git!=groups.constEnd(); git++) {
+    set.unite (git->toSet());
+  }
+}
+
+/** @brief Locations and tags of a set of nodes in a few queries,
+  * ListNodeDetails uses them instead of asking for each node.
+  */
+
+void
+NvRoute::LoadNodeDetails (const NaviIdList & nodeIds)
+{
+  db.GetNodes (nodeIds, nodeDetails);
+  db.GetTagsFor ("node", nodeIds, nodeTags);
+}
+
+static bool
+TagValue (const TagList & tags, const QString & key, QString & value)
+{
+  for (int t=0; t<tags.count(); t++) {
+    if (tags.at(t).first == key) {
+      value = tags.at(t).second;
+      return true;
+    }
   }
+  return false;
 }
 
 void
-NvRoute::ListWayDetails (const QString & wayId)
+NvRoute::ListWayDetails (NaviId wayId,
+                         const NaviIdList & wayNodes,
+                         const NaviIdList & wayRelations)
 {
   QString name ("not named");
-  bool hasName = db.GetWayTag (wayId, "name",name);
+  const TagList tags = wayTags.value (wayId);
+  bool hasName = TagValue (tags, "name",name);
   if (!hasName) {
     return;
   }
   QTreeWidget *tree = mainUi.featureDisplay;
   QStringList labels;
-  labels << wayId;
+  labels << QString::number (wayId);
   labels << name;
   QString highwayType ("?");
-  db.GetWayTag (wayId, "highway", highwayType);
+  TagValue (tags, "highway", highwayType);
   labels << highwayType;
   QString houseNumber ("no number");
-  db.GetWayTag (wayId, "addr:housenumber", houseNumber);
+  TagValue (tags, "addr:housenumber", houseNumber);
   labels << houseNumber;
   
   QTreeWidgetItem *wayItem = new QTreeWidgetItem (tree, labels, Cell_Way);
-  QStringList wayNodes;
-  bool hasNodes = db.GetWayNodes (wayId, wayNodes);
+  bool hasNodes = !wayNodes.isEmpty ();
   if (hasNodes) {
     QList <QTreeWidgetItem*> itemList;
     QTreeWidgetItem *nodeItem;
     for (int n=0; n<wayNodes.count(); n++) {
       nodeItem = new QTreeWidgetItem (Cell_Node);
-      QString nodeId = wayNodes.at (n);
+      NaviId nodeId = wayNodes.at (n);
       ListNodeDetails (nodeItem, nodeId);
       itemList.append (nodeItem);
     } 
     wayItem->addChildren (itemList);
   }
-  QStringList wayRelations;
-  db.GetRelationsByMember (wayRelations, "way", wayId);
   mainUi.logDisplay->append (QString("found %1 way relations")
                              .arg (wayRelations.count()));
   if (wayRelations.count() > 0) {
@@ -474,24 +511,25 @@ NvRoute::ListWayDetails (const QString & wayId)
 void
 NvRoute::ListNodeRelations ()
 {
-  QSet<QString>::iterator nit;
-  for (nit=nodeSet.begin(); nit!= nodeSet.end(); nit++) {
-    QStringList nodeRelations;
-    db.GetRelationsByMember (nodeRelations, "node", *nit);
-    nodeSet += nodeRelations.toSet();
+  QMap <NaviId, NaviIdList> relsByNode;
+  db.GetRelationsByMembers ("node", nodeSet.toList(), relsByNode);
+  QMap <NaviId, NaviIdList>::const_iterator rit;
+  for (rit=relsByNode.constBegin(); rit!=relsByNode.constEnd(); rit++) {
     mainUi.logDisplay->append (QString("for Node %1 found %2 relations")
-                               .arg (*nit).arg (nodeRelations.count()));
+                               .arg (rit.key()).arg (rit->count()));
   }
+  UniteGroups (relationSet, relsByNode);
   ListRelations ();
 }
 
 void
 NvRoute::ListRelations ()
 {
-  QSet<QString>::iterator nit;
+  QSet<NaviId>::iterator nit;
   QTreeWidgetItem * listItem = new QTreeWidgetItem (Cell_Header);
   listItem->setText (0,QString ("found %1 Relations")
                         .arg (relationSet.count()));
+  db.GetTagsFor ("relation", relationSet.toList(), relationTags);
   QList <QTreeWidgetItem*> relList;
   for (nit=relationSet.begin(); nit!= relationSet.end(); nit++) {
     QTreeWidgetItem *relItem = new QTreeWidgetItem (Cell_Relation);
@@ -506,10 +544,11 @@ NvRoute::ListRelations ()
 void
 NvRoute::ListNodes ()
 {
-  QSet<QString>::iterator nit;
+  QSet<NaviId>::iterator nit;
   QTreeWidgetItem * listItem = new QTreeWidgetItem (Cell_Header);
   listItem->setText (0,QString ("found %1 Nodes")
                         .arg (nodeSet.count()));
+  LoadNodeDetails (nodeSet.toList());
   QList <QTreeWidgetItem*> nodeList;
   for (nit=nodeSet.begin(); nit!= nodeSet.end(); nit++) {
     QTreeWidgetItem *nodeItem = new QTreeWidgetItem (Cell_Node);
@@ -524,10 +563,11 @@ NvRoute::ListNodes ()
 void
 NvRoute::ListWays ()
 {
-  QSet<QString>::iterator nit;
+  QSet<NaviId>::iterator nit;
   QTreeWidgetItem * listItem = new QTreeWidgetItem (Cell_Header);
   listItem->setText (0,QString ("found %1 Ways")
                         .arg (waySet.count()));
+  db.GetTagsFor ("way", waySet.toList(), wayTags);
   QList <QTreeWidgetItem*> wayList ;
   for (nit=waySet.begin(); nit!= waySet.end(); nit++) {
     QTreeWidgetItem *wayItem = new QTreeWidgetItem (Cell_Way);
@@ -541,10 +581,9 @@ NvRoute::ListWays ()
 
 void
 NvRoute::ListRelationDetails (QTreeWidgetItem *relItem,
-                              const QString & relId)
+                              NaviId relId)
 {
-  QList <QPair <QString, QString> > tagList;
-  db.GetRelationTags (relId, tagList);
+  TagList tagList = relationTags.value (relId);
   QList <QTreeWidgetItem*> itemList;
   QList <QPair <QString, QString> >::iterator lit;
   for (lit=tagList.begin(); lit!=tagList.end(); lit++) {
@@ -558,10 +597,9 @@ NvRoute::ListRelationDetails (QTreeWidgetItem *relItem,
 
 void
 NvRoute::ListWayDetails (QTreeWidgetItem *wayItem,
-                              const QString & wayId)
+                              NaviId wayId)
 {
-  QList <QPair <QString, QString> > tagList;
-  db.GetWayTags (wayId, tagList);
+  TagList tagList = wayTags.value (wayId);
   QList <QTreeWidgetItem*> itemList;
   QList <QPair <QString, QString> >::iterator lit;
   for (lit=tagList.begin(); lit!=tagList.end(); lit++) {
@@ -575,17 +613,15 @@ NvRoute::ListWayDetails (QTreeWidgetItem *wayItem,
 
 void
 NvRoute::ListNodeDetails (QTreeWidgetItem * nodeItem,
-                          const QString & nodeId)
-{
-  nodeItem->setText (0,nodeId);
-  double lat, lon;
-  bool haveCoord = db.GetNode (nodeId, lat, lon);
-  if (haveCoord) {
-    nodeItem->setText (1,QString::number (lat));
-    nodeItem->setText (2,QString::number (lon));
+                          NaviId nodeId)
+{
+  nodeItem->setText (0,QString::number (nodeId));
+  QMap <NaviId, NaviNode>::const_iterator node = nodeDetails.constFind (nodeId);
+  if (node != nodeDetails.constEnd ()) {
+    nodeItem->setText (1,QString::number (node->Lat()));
+    nodeItem->setText (2,QString::number (node->Lon()));
   }
-  QList <QPair <QString, QString> > tagList;
-  db.GetNodeTags (nodeId, tagList);
+  TagList tagList = nodeTags.value (nodeId);
   QList <QPair <QString, QString> >::iterator lit;
   QList <QTreeWidgetItem*> itemList;
   mainUi.logDisplay->append (QString("Node %1 has %2 tags")
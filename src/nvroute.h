@@ -26,6 +26,7 @@
 #include "config-edit.h"
 #include "helpview.h"
 #include "db-manager.h"
+#include "road-graph.h"
 #include "navi-types.h"
 #include "route-cell-menus.h"
 
@@ -96,18 +97,23 @@ private:
   void Connect ();
   void CloseCleanup ();
   void SetDefaults ();
-  void ListWayDetails (const QString & wayId);
+  void ListWayDetails (NaviId wayId,
+                       const NaviIdList & wayNodes,
+                       const NaviIdList & wayRelations);
   void ListWayDetails (QTreeWidgetItem *item,
-                       const QString & wayId);
+                       NaviId wayId);
   void ListNodeDetails (QTreeWidgetItem * item,
-                        const QString & nodeId);
+                        NaviId nodeId);
   void ListRelationDetails (QTreeWidgetItem * relItem,
-                        const QString & nodeId);
+                        NaviId nodeId);
   void ListWays ();
   void ListNodes ();
   void ListRelations ();
   void ListNodeRelations ();
-  void FindParcel (quint64 parcel, int round);
+  void FindParcel (const ParcelRange & parcels);
+  void LoadNodeDetails (const NaviIdList & nodeIds);
+  void UniteGroups (QSet <NaviId> & set,
+                    const QMap <NaviId, NaviIdList> & groups);
   void CellMenuTop (QTreeWidgetItem *item,
                     int column);
   void CollectRelated (QTreeWidgetItem *item);
@@ -124,13 +130,19 @@ private:
   bool             runAgain;
 
   DbManager                    db;
-
-  QSet<QString>   nodeSet;
-  QSet<QString>   waySet;
-  QSet<QString>   relationSet;
-  QStringList     wayList;
-  quint64         parcelIndex;
-  QList<quint64>  indexList;
+  RoadGraph                    graph;
+
+  QSet<NaviId>    nodeSet;
+  QSet<NaviId>    waySet;
+  QSet<NaviId>    relationSet;
+  NaviIdList      wayList;
+
+  QMap <NaviId, NaviNode>  nodeDetails;
+  QMap <NaviId, TagList>   nodeTags;
+  QMap <NaviId, TagList>   wayTags;
+  QMap <NaviId, TagList>   relationTags;
+  ParcelRange      parcelRange;
+  ParcelRangeList  indexList;
   QTimer         *findTimer;
 
   QAction        *collectAction;
@@ -0,0 +1,333 @@
+#include "osm-batch-writer.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include "navi-global.h"
+#include "way-geometry.h"
+
+namespace navi
+{
+
+OsmBatchWriter::OsmBatchWriter (DbManager & dbm)
+  :db (dbm)
+{
+  ResetCounts ();
+}
+
+void
+OsmBatchWriter::ResetCounts ()
+{
+  savedNodes = 0;
+  savedWays = 0;
+  savedRelations = 0;
+  savedTags = 0;
+}
+
+QString
+OsmBatchWriter::FileReport (const QString & source)
+{
+  FileCounts counts = fileCounts.take (source);
+  return QString ("\"%1\": %2 new, %3 updated, %4 unchanged elements")
+            .arg (source)
+            .arg (counts.added)
+            .arg (counts.updated)
+            .arg (counts.skipped);
+}
+
+void
+OsmBatchWriter::Write (const OsmBatch & batch)
+{
+  batchNodeIndex.clear ();
+  int nn = batch.nodes.count ();
+  for (int n=0; n<nn; n++) {
+    batchNodeIndex [batch.nodes.at(n).Id()] = n;
+  }
+  OsmBatch changed;
+  db.StartTransaction ();
+  SelectChanged (batch, changed);
+  FetchStoredNodes (changed);
+  WriteNodes (changed);
+  WriteWays (changed, batch);
+  RefreshWays (changed, batch);
+  WriteRelations (changed);
+  db.CommitTransaction ();
+  storedNodes.clear ();
+  movedNodes.clear ();
+}
+
+/** @brief The nodes of a file come in earlier batches than its ways,
+  * so most node refs of the ways are in the geobase already. They are
+  * read before anything is written, with one set lookup.
+  */
+
+void
+OsmBatchWriter::FetchStoredNodes (const OsmBatch & changed)
+{
+  QSet <NaviId> missing;
+  QMap <NaviId, NaviIdList>::const_iterator wit;
+  for (wit=changed.wayNodes.begin(); wit!=changed.wayNodes.end(); wit++) {
+    for (int n=0; n<wit->count(); n++) {
+      if (!batchNodeIndex.contains (wit->at(n))) {
+        missing.insert (wit->at(n));
+      }
+    }
+  }
+  storedNodes.clear ();
+  if (!missing.isEmpty ()) {
+    db.GetNodes (missing.toList (), storedNodes);
+  }
+}
+
+/** @brief Copy what has to be written from batch into changed. The
+  * stored versions come from one set lookup per element type.
+  */
+
+void
+OsmBatchWriter::SelectChanged (const OsmBatch & batch, OsmBatch & changed)
+{
+  FileCounts & counts = fileCounts [batch.source];
+  QMap <NaviId, int> stored;
+  NaviIdList ids;
+  int nn = batch.nodes.count ();
+  for (int n=0; n<nn; n++) {
+    ids.append (batch.nodes.at(n).Id());
+  }
+  db.GetVersions ("node", ids, stored);
+  for (int n=0; n<nn; n++) {
+    const NaviNode & node = batch.nodes.at(n);
+    NaviId id = node.Id();
+    int version = batch.nodeVersions.value (id);
+    int have = stored.value (id, -1);
+    if (Unchanged (version, have, counts)) {
+      continue;
+    }
+    if (have >= 0) {
+      movedNodes.insert (id);
+    }
+    changed.nodes.append (node);
+    if (have >= 0 || batch.nodeTags.contains (id)) {
+      changed.nodeTags [id] = batch.nodeTags.value (id);
+    }
+    if (version > 0) {
+      changed.nodeVersions [id] = version;
+    }
+  }
+
+  ids = batch.wayNodes.keys ();
+  db.GetVersions ("way", ids, stored);
+  QMap <NaviId, NaviIdList>::const_iterator wit;
+  for (wit=batch.wayNodes.begin(); wit!=batch.wayNodes.end(); wit++) {
+    NaviId id = wit.key();
+    int version = batch.wayVersions.value (id);
+    int have = stored.value (id, -1);
+    if (Unchanged (version, have, counts)) {
+      continue;
+    }
+    changed.wayNodes [id] = *wit;
+    changed.wayTags [id] = batch.wayTags.value (id);
+    if (version > 0) {
+      changed.wayVersions [id] = version;
+    }
+  }
+
+  ids = batch.relationTags.keys ();
+  db.GetVersions ("relation", ids, stored);
+  for (int r=0; r<ids.count(); r++) {
+    NaviId id = ids.at(r);
+    int version = batch.relationVersions.value (id);
+    if (Unchanged (version, stored.value (id, -1), counts)) {
+      continue;
+    }
+    changed.relationTags [id] = batch.relationTags.value (id);
+    changed.relationMembers [id] = batch.relationMembers.value (id);
+    if (version > 0) {
+      changed.relationVersions [id] = version;
+    }
+  }
+}
+
+/** @brief stored is -1 for an element that is not there yet. An
+  * element without a version is always written.
+  */
+
+bool
+OsmBatchWriter::Unchanged (int version, int stored, FileCounts & counts)
+{
+  if (stored < 0) {
+    counts.added++;
+    return false;
+  }
+  if (version > 0 && version == stored) {
+    counts.skipped++;
+    return true;
+  }
+  counts.updated++;
+  return false;
+}
+
+void
+OsmBatchWriter::WriteNodes (const OsmBatch & batch)
+{
+  int nn = batch.nodes.count ();
+  db.WriteNodes (batch.nodes, batch.nodeVersions);
+  savedNodes += nn;
+  db.WriteTags ("node", batch.nodeTags);
+  savedTags += TagCount (batch.nodeTags);
+}
+
+void
+OsmBatchWriter::WriteWays (const OsmBatch & batch, const OsmBatch & located)
+{
+  NaviIdList      wayIds;
+  NaviIdList      parcelWays;
+  QList <quint64> parcels;
+  WayTurnList     locs;
+  QMap <NaviId, NaviIdList>::const_iterator wit;
+  for (wit=batch.wayNodes.begin(); wit!=batch.wayNodes.end(); wit++) {
+    NaviId wayId = wit.key();
+    wayIds.append (wayId);
+    int seqNum (0);
+    quint64 parcel (0);
+    for (int n=0; n<wit->count(); n++) {
+      NaviId nodeId = wit->at(n);
+      NaviCoord lat, lon;
+      if (FindNode (located, nodeId, lat, lon)) {
+        parcel = Parcel::CoordIndex (lat, lon);
+        WayTurn loc (wayId, nodeId, seqNum++, 0.0, 0.0);
+        loc.SetCoords (lat, lon);
+        locs.append (loc);
+      }
+    }
+    if (seqNum > 0) {
+      /// wayparcels keeps one row per way, the per-row inserts
+      /// ended up with the parcel of the last located node
+      parcelWays.append (wayId);
+      parcels.append (parcel);
+    }
+  }
+  db.WriteWays (wayIds, batch.wayVersions);
+  db.WriteWayNodes (batch.wayNodes);
+  db.WriteWayParcels (parcelWays, parcels);
+  db.WriteWayLocs (locs);
+  savedWays += wayIds.count ();
+  db.WriteTags ("way", batch.wayTags);
+  savedTags += TagCount (batch.wayTags);
+}
+
+/** @brief The ways written from this batch have their locations
+  * already. The other stored ways using a node the batch moved keep
+  * their geometry, with the moved points put in their new place.
+  */
+
+void
+OsmBatchWriter::RefreshWays (const OsmBatch & written, 
+                             const OsmBatch & located)
+{
+  if (movedNodes.isEmpty ()) {
+    return;
+  }
+  QMap <NaviId, NaviIdList> waysByNode;
+  db.GetWaysByNodes (movedNodes.toList (), waysByNode);
+  QSet <NaviId> wayIds;
+  QMap <NaviId, NaviIdList>::const_iterator wit;
+  for (wit=waysByNode.begin(); wit!=waysByNode.end(); wit++) {
+    for (int w=0; w<wit->count(); w++) {
+      if (!written.wayNodes.contains (wit->at(w))) {
+        wayIds.insert (wit->at(w));
+      }
+    }
+  }
+  WayGeomMap      geoms;
+  db.GetWayGeometries (wayIds.toList (), geoms);
+  NaviIdList      parcelWays;
+  QList <quint64> parcels;
+  WayTurnList     locs;
+  WayGeomMap::const_iterator git;
+  for (git=geoms.begin(); git!=geoms.end(); git++) {
+    NaviId wayId = git.key();
+    WayGeometryReader reader (*git);
+    quint64 parcel (0);
+    while (reader.Next ()) {
+      NaviId nodeId = reader.NodeId ();
+      NaviCoord lat = reader.Lat ();
+      NaviCoord lon = reader.Lon ();
+      if (movedNodes.contains (nodeId)) {
+        FindNode (located, nodeId, lat, lon);
+      }
+      parcel = Parcel::CoordIndex (lat, lon);
+      WayTurn loc (wayId, nodeId, reader.Seq (), 0.0, 0.0);
+      loc.SetCoords (lat, lon);
+      locs.append (loc);
+    }
+    if (reader.Count () > 0) {
+      parcelWays.append (wayId);
+      parcels.append (parcel);
+    }
+  }
+  db.WriteWayParcels (parcelWays, parcels);
+  db.WriteWayLocs (locs);
+}
+
+void
+OsmBatchWriter::WriteRelations (const OsmBatch & batch)
+{
+  NaviIdList relIds = batch.relationTags.keys ();
+  db.WriteRelations (relIds, batch.relationVersions);
+  savedRelations += relIds.count ();
+  db.WriteTags ("relation", batch.relationTags);
+  savedTags += TagCount (batch.relationTags);
+  db.WriteRelationMembers (batch.relationMembers);
+}
+
+int
+OsmBatchWriter::TagCount (const QMap <NaviId, TagList> & tags)
+{
+  int count (0);
+  QMap <NaviId, TagList>::const_iterator tit;
+  for (tit=tags.begin(); tit!=tags.end(); tit++) {
+    count += tit->count ();
+  }
+  return count;
+}
+
+bool
+OsmBatchWriter::FindNode (const OsmBatch & batch,
+                          NaviId nodeId,
+                          NaviCoord & lat, NaviCoord & lon)
+{
+  QHash <NaviId, int>::const_iterator nit = batchNodeIndex.find (nodeId);
+  if (nit != batchNodeIndex.end ()) {
+    const NaviNode & node = batch.nodes.at (*nit);
+    lat = node.LatCoord();
+    lon = node.LonCoord();
+    return true;
+  }
+  QMap <NaviId, NaviNode>::const_iterator sit = storedNodes.find (nodeId);
+  if (sit != storedNodes.end ()) {
+    lat = sit->LatCoord();
+    lon = sit->LonCoord();
+    return true;
+  }
+  return false;
+}
+
+} // namespace
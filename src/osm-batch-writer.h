@@ -0,0 +1,103 @@
+#ifndef OSM_BATCH_WRITER_H
+#define OSM_BATCH_WRITER_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "osm-batch.h"
+#include "db-manager.h"
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+namespace navi
+{
+
+/** @brief Saves an OsmBatch with the bulk DbManager calls, one
+  * batched statement per table inside a single transaction. Nodes
+  * referenced by a way but not in the batch are looked up in the
+  * database, since an earlier batch of the same file has already
+  * stored them.
+  *
+  * Elements whose stored version equals the one in the batch are
+  * left out. An updated element replaces its stored node, member and
+  * tag lists. Stored ways using a node the batch moved get their
+  * locations again from the stored geometry.
+  *
+  * The stored nodes and geometries a batch needs are read with one
+  * set lookup each, not one query per node ref.
+  */
+
+class OsmBatchWriter
+{
+public:
+
+  OsmBatchWriter (DbManager & dbm);
+
+  void Write (const OsmBatch & batch);
+
+  int  Nodes () const { return savedNodes; }
+  int  Ways () const { return savedWays; }
+  int  Relations () const { return savedRelations; }
+  int  Tags () const { return savedTags; }
+  void ResetCounts ();
+
+  /** @brief new, updated and skipped counts for one source file,
+    * which are dropped once reported
+    */
+  QString FileReport (const QString & source);
+
+  class FileCounts {
+  public:
+    FileCounts () : added (0), updated (0), skipped (0) {}
+    int  added;
+    int  updated;
+    int  skipped;
+  };
+
+private:
+
+  void SelectChanged (const OsmBatch & batch, OsmBatch & changed);
+  bool Unchanged (int version, int stored, FileCounts & counts);
+  void WriteNodes (const OsmBatch & batch);
+  void WriteWays (const OsmBatch & batch, const OsmBatch & located);
+  void RefreshWays (const OsmBatch & written, const OsmBatch & located);
+  void FetchStoredNodes (const OsmBatch & changed);
+  void WriteRelations (const OsmBatch & batch);
+  bool FindNode (const OsmBatch & batch,
+                 NaviId nodeId,
+                 NaviCoord & lat, NaviCoord & lon);
+  static int TagCount (const QMap <NaviId, TagList> & tags);
+
+  DbManager   & db;
+  QHash <NaviId, int>      batchNodeIndex;
+  QMap <NaviId, NaviNode>  storedNodes;
+  QSet <NaviId>            movedNodes;
+  QMap <QString, FileCounts>  fileCounts;
+
+  int  savedNodes;
+  int  savedWays;
+  int  savedRelations;
+  int  savedTags;
+};
+
+} // namespace
+
+#endif
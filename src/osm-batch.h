@@ -0,0 +1,84 @@
+#ifndef OSM_BATCH_H
+#define OSM_BATCH_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "navi-types.h"
+#include <QString>
+#include <QMap>
+
+namespace navi
+{
+
+/** @brief A batch of parsed OSM elements, in the same shape
+  * Collect keeps for a whole document. The readers fill one batch
+  * at a time, so memory depends on the batch size and not on the
+  * size of the input file.
+  *
+  * Versions are only kept for elements that carry one. The parser
+  * stage marks each batch with its source file, and follows the last
+  * batch of a file with an empty one that has endOfFile set.
+  */
+
+class OsmBatch
+{
+public:
+
+  OsmBatch () : endOfFile (false) {}
+
+  void clear ()
+    {
+      source.clear ();
+      endOfFile = false;
+      nodes.clear ();
+      nodeTags.clear ();
+      wayNodes.clear ();
+      wayTags.clear ();
+      relationTags.clear ();
+      relationMembers.clear ();
+      nodeVersions.clear ();
+      wayVersions.clear ();
+      relationVersions.clear ();
+    }
+
+  int Count () const
+    {
+      return nodes.count () + wayNodes.count () + relationTags.count ();
+    }
+
+  bool isEmpty () const { return Count () == 0; }
+
+  NaviNodeList                 nodes;
+  QMap <NaviId, TagList>       nodeTags;
+  QMap <NaviId, NaviIdList>    wayNodes;
+  QMap <NaviId, TagList>       wayTags;
+  QMap <NaviId, TagList>       relationTags;
+  QMap <NaviId, MemberList>    relationMembers;
+  QMap <NaviId, int>           nodeVersions;
+  QMap <NaviId, int>           wayVersions;
+  QMap <NaviId, int>           relationVersions;
+  QString                      source;
+  bool                         endOfFile;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,632 @@
+#include "osm-pbf-reader.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QtConcurrentMap>
+#include <QThread>
+#include <QStringList>
+#include <QDebug>
+
+namespace navi
+{
+
+/** @brief Cursor over one protobuf message. Only the wire types
+  * used by the OSM PBF format are understood.
+  */
+
+class PbfMessage
+{
+public:
+
+  enum WireType {
+    Wire_Varint = 0,
+    Wire_Fixed64 = 1,
+    Wire_Bytes = 2,
+    Wire_Fixed32 = 5
+  };
+
+  PbfMessage ()
+    :pos (0), end (0), field (0), wire (0), ok (true) {}
+  PbfMessage (const char * data, int len)
+    :pos (reinterpret_cast<const uchar*>(data)),
+     end (reinterpret_cast<const uchar*>(data) + len),
+     field (0), wire (0), ok (true) {}
+
+  bool AtEnd () const { return !ok || pos >= end; }
+
+  bool Next ()
+    {
+      if (AtEnd ()) {
+        return false;
+      }
+      quint64 key = Varint ();
+      field = int (key >> 3);
+      wire = int (key & 7);
+      return ok;
+    }
+
+  quint64 Varint ()
+    {
+      quint64 result (0);
+      int shift (0);
+      while (pos < end && shift < 64) {
+        uchar b = *pos++;
+        result |= quint64 (b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+          return result;
+        }
+        shift += 7;
+      }
+      ok = false;
+      return 0;
+    }
+
+  qint64 SVarint ()
+    {
+      quint64 v = Varint ();
+      return qint64 (v >> 1) ^ -qint64 (v & 1);
+    }
+
+  PbfMessage Message ()
+    {
+      quint64 len = Varint ();
+      if (!ok || len > quint64 (end - pos)) {
+        ok = false;
+        return PbfMessage ();
+      }
+      PbfMessage sub (reinterpret_cast<const char*>(pos), int (len));
+      pos += len;
+      return sub;
+    }
+
+  QByteArray Bytes ()
+    {
+      PbfMessage sub = Message ();
+      return QByteArray (reinterpret_cast<const char*>(sub.pos),
+                         sub.end - sub.pos);
+    }
+
+  void Skip ()
+    {
+      switch (wire) {
+      case Wire_Varint:
+        Varint ();
+        break;
+      case Wire_Fixed64:
+        pos += 8;
+        break;
+      case Wire_Bytes:
+        Message ();
+        break;
+      case Wire_Fixed32:
+        pos += 4;
+        break;
+      default:
+        ok = false;
+        break;
+      }
+      if (pos > end) {
+        ok = false;
+      }
+    }
+
+  const uchar  *pos;
+  const uchar  *end;
+  int           field;
+  int           wire;
+  bool          ok;
+};
+
+static QString
+PbfTagsTo (TagList & tags,
+           PbfMessage keys, PbfMessage vals,
+           const QStringList & strings)
+{
+  while (!keys.AtEnd () && !vals.AtEnd ()) {
+    quint64 k = keys.Varint ();
+    quint64 v = vals.Varint ();
+    if (k >= quint64 (strings.count ()) || v >= quint64 (strings.count ())) {
+      return QString ("string index out of range");
+    }
+    tags.append (TagItemType (strings.at (int (k)), strings.at (int (v))));
+  }
+  return QString ();
+}
+
+struct PbfBlockInfo {
+  QStringList  strings;
+  qint64       granularity;
+  qint64       latOffset;
+  qint64       lonOffset;
+
+  NaviCoord Lat (qint64 raw) const
+    { return Coord (latOffset + granularity * raw); }
+  NaviCoord Lon (qint64 raw) const
+    { return Coord (lonOffset + granularity * raw); }
+
+  /// nanodegrees to 1e-7 degree, rounded to nearest
+  static NaviCoord Coord (qint64 nano)
+    { return NaviCoord (nano >= 0 ? (nano + 50) / 100
+                                  : -((50 - nano) / 100)); }
+};
+
+/** @brief version out of an Info message, 0 if it has none */
+
+static int
+PbfInfoVersion (PbfMessage info)
+{
+  int version (0);
+  while (info.Next ()) {
+    if (info.field == 1) {
+      version = int (info.Varint ());
+    } else {
+      info.Skip ();
+    }
+  }
+  return version;
+}
+
+static QString
+PbfNode (PbfMessage msg, const PbfBlockInfo & info, OsmBatch & batch)
+{
+  qint64 id (0), lat (0), lon (0);
+  int version (0);
+  PbfMessage keys, vals;
+  while (msg.Next ()) {
+    switch (msg.field) {
+    case 1: id = msg.SVarint (); break;
+    case 2: keys = msg.Message (); break;
+    case 3: vals = msg.Message (); break;
+    case 4: version = PbfInfoVersion (msg.Message ()); break;
+    case 8: lat = msg.SVarint (); break;
+    case 9: lon = msg.SVarint (); break;
+    default: msg.Skip (); break;
+    }
+  }
+  batch.nodes.append (NaviNode::FromCoords (id, info.Lat (lat),
+                                                info.Lon (lon)));
+  TagList tags;
+  QString error = PbfTagsTo (tags, keys, vals, info.strings);
+  if (!tags.isEmpty ()) {
+    batch.nodeTags [id] = tags;
+  }
+  if (version > 0) {
+    batch.nodeVersions [id] = version;
+  }
+  return error;
+}
+
+static QString
+PbfDenseNodes (PbfMessage msg, const PbfBlockInfo & info, OsmBatch & batch)
+{
+  PbfMessage ids, lats, lons, keysVals, versions;
+  while (msg.Next ()) {
+    switch (msg.field) {
+    case 1: ids = msg.Message (); break;
+    case 5: {
+        /// DenseInfo, only its packed versions are used
+        PbfMessage info = msg.Message ();
+        while (info.Next ()) {
+          if (info.field == 1) {
+            versions = info.Message ();
+          } else {
+            info.Skip ();
+          }
+        }
+      }
+      break;
+    case 8: lats = msg.Message (); break;
+    case 9: lons = msg.Message (); break;
+    case 10: keysVals = msg.Message (); break;
+    default: msg.Skip (); break;
+    }
+  }
+  qint64 id (0), lat (0), lon (0);
+  while (!ids.AtEnd ()) {
+    if (lats.AtEnd () || lons.AtEnd ()) {
+      return QString ("dense node columns differ in length");
+    }
+    id += ids.SVarint ();
+    lat += lats.SVarint ();
+    lon += lons.SVarint ();
+    batch.nodes.append (NaviNode::FromCoords (id, info.Lat (lat),
+                                                info.Lon (lon)));
+    if (!versions.AtEnd ()) {
+      /// not delta coded, unlike the other DenseInfo columns
+      int version = int (versions.Varint ());
+      if (version > 0) {
+        batch.nodeVersions [id] = version;
+      }
+    }
+    TagList tags;
+    while (!keysVals.AtEnd ()) {
+      quint64 k = keysVals.Varint ();
+      if (k == 0) {
+        break;
+      }
+      quint64 v = keysVals.Varint ();
+      quint64 count = info.strings.count ();
+      if (k >= count || v >= count) {
+        return QString ("string index out of range");
+      }
+      tags.append (TagItemType (info.strings.at (int (k)),
+                                info.strings.at (int (v))));
+    }
+    if (!tags.isEmpty ()) {
+      batch.nodeTags [id] = tags;
+    }
+  }
+  return QString ();
+}
+
+static QString
+PbfWay (PbfMessage msg, const PbfBlockInfo & info, OsmBatch & batch)
+{
+  qint64 id (0);
+  int version (0);
+  PbfMessage keys, vals, refs;
+  while (msg.Next ()) {
+    switch (msg.field) {
+    case 1: id = qint64 (msg.Varint ()); break;
+    case 2: keys = msg.Message (); break;
+    case 3: vals = msg.Message (); break;
+    case 4: version = PbfInfoVersion (msg.Message ()); break;
+    case 8: refs = msg.Message (); break;
+    default: msg.Skip (); break;
+    }
+  }
+  NaviIdList nodeIds;
+  qint64 ref (0);
+  while (!refs.AtEnd ()) {
+    ref += refs.SVarint ();
+    nodeIds.append (ref);
+  }
+  TagList tags;
+  QString error = PbfTagsTo (tags, keys, vals, info.strings);
+  batch.wayNodes [id] = nodeIds;
+  batch.wayTags [id] = tags;
+  if (version > 0) {
+    batch.wayVersions [id] = version;
+  }
+  return error;
+}
+
+static QString
+PbfRelation (PbfMessage msg, const PbfBlockInfo & info, OsmBatch & batch)
+{
+  static const char * memberTypes[] = { "node", "way", "relation" };
+  qint64 id (0);
+  int version (0);
+  PbfMessage keys, vals, memIds, memTypes;
+  while (msg.Next ()) {
+    switch (msg.field) {
+    case 1: id = qint64 (msg.Varint ()); break;
+    case 2: keys = msg.Message (); break;
+    case 3: vals = msg.Message (); break;
+    case 4: version = PbfInfoVersion (msg.Message ()); break;
+    case 9: memIds = msg.Message (); break;
+    case 10: memTypes = msg.Message (); break;
+    default: msg.Skip (); break;
+    }
+  }
+  MemberList members;
+  qint64 ref (0);
+  while (!memIds.AtEnd () && !memTypes.AtEnd ()) {
+    ref += memIds.SVarint ();
+    quint64 type = memTypes.Varint ();
+    if (type > 2) {
+      return QString ("bad member type %1").arg (type);
+    }
+    members.append (MemberItemType (QString (memberTypes[type]), ref));
+  }
+  TagList tags;
+  QString error = PbfTagsTo (tags, keys, vals, info.strings);
+  batch.relationTags [id] = tags;
+  batch.relationMembers [id] = members;
+  if (version > 0) {
+    batch.relationVersions [id] = version;
+  }
+  return error;
+}
+
+static QString
+PbfPrimitiveBlock (PbfMessage block, OsmBatch & batch)
+{
+  PbfBlockInfo info;
+  info.granularity = 100;
+  info.latOffset = 0;
+  info.lonOffset = 0;
+  QList <PbfMessage> groups;
+  while (block.Next ()) {
+    switch (block.field) {
+    case 1: {
+        PbfMessage table = block.Message ();
+        while (table.Next ()) {
+          if (table.field == 1) {
+            info.strings.append (QString::fromUtf8 (table.Bytes ()));
+          } else {
+            table.Skip ();
+          }
+        }
+      }
+      break;
+    case 2:
+      groups.append (block.Message ());
+      break;
+    case 17: info.granularity = qint64 (block.Varint ()); break;
+    case 19: info.latOffset = qint64 (block.Varint ()); break;
+    case 20: info.lonOffset = qint64 (block.Varint ()); break;
+    default: block.Skip (); break;
+    }
+  }
+  if (!block.ok) {
+    return QString ("truncated PrimitiveBlock");
+  }
+  QString error;
+  for (int g=0; g<groups.count() && error.isEmpty(); g++) {
+    PbfMessage group = groups.at (g);
+    while (group.Next () && error.isEmpty ()) {
+      switch (group.field) {
+      case 1: error = PbfNode (group.Message (), info, batch); break;
+      case 2: error = PbfDenseNodes (group.Message (), info, batch); break;
+      case 3: error = PbfWay (group.Message (), info, batch); break;
+      case 4: error = PbfRelation (group.Message (), info, batch); break;
+      default: group.Skip (); break;
+      }
+    }
+    if (error.isEmpty () && !group.ok) {
+      error = QString ("truncated PrimitiveGroup");
+    }
+  }
+  return error;
+}
+
+/** @brief Unpack a Blob message. zlib data is handed to qUncompress,
+  * which wants the expected size as a 4 byte big-endian prefix.
+  */
+
+static QString
+PbfBlobData (const QByteArray & blob, QByteArray & data)
+{
+  PbfMessage msg (blob.constData (), blob.size ());
+  QByteArray zlibData;
+  quint32 rawSize (0);
+  bool haveRaw (false);
+  while (msg.Next ()) {
+    switch (msg.field) {
+    case 1: data = msg.Bytes (); haveRaw = true; break;
+    case 2: rawSize = quint32 (msg.Varint ()); break;
+    case 3: zlibData = msg.Bytes (); break;
+    case 4: case 5: case 6: case 7:
+      return QString ("unsupported blob compression %1").arg (msg.field);
+    default: msg.Skip (); break;
+    }
+  }
+  if (haveRaw) {
+    return QString ();
+  }
+  if (zlibData.isEmpty ()) {
+    return QString ("empty blob");
+  }
+  QByteArray sized;
+  sized.reserve (zlibData.size() + 4);
+  sized.append (char ((rawSize >> 24) & 0xff));
+  sized.append (char ((rawSize >> 16) & 0xff));
+  sized.append (char ((rawSize >> 8) & 0xff));
+  sized.append (char (rawSize & 0xff));
+  sized.append (zlibData);
+  data = qUncompress (sized);
+  if (quint32 (data.size ()) != rawSize) {
+    return QString ("zlib data does not match raw size %1").arg (rawSize);
+  }
+  return QString ();
+}
+
+OsmPbfReader::DecodedBlob
+OsmPbfReader::Decode (const RawBlob & raw)
+{
+  DecodedBlob result;
+  if (raw.type != "OSMData") {
+    return result;
+  }
+  QByteArray data;
+  result.error = PbfBlobData (raw.blob, data);
+  if (result.error.isEmpty ()) {
+    PbfMessage block (data.constData (), data.size ());
+    result.error = PbfPrimitiveBlock (block, result.batch);
+  }
+  return result;
+}
+
+OsmPbfReader::OsmPbfReader (int blobsPerRound)
+  :roundSize (blobsPerRound),
+   bytesRead (0),
+   done (true)
+{
+  if (roundSize < 1) {
+    roundSize = 2 * QThread::idealThreadCount ();
+  }
+  if (roundSize < 2) {
+    roundSize = 2;
+  }
+}
+
+OsmPbfReader::~OsmPbfReader ()
+{
+  Close ();
+}
+
+bool
+OsmPbfReader::Open (const QString & filename)
+{
+  Close ();
+  errorText.clear ();
+  bytesRead = 0;
+  file.setFileName (filename);
+  if (!file.open (QFile::ReadOnly)) {
+    errorText = QString ("cannot open %1").arg (filename);
+    return false;
+  }
+  RawBlob header;
+  if (!ReadRawBlob (header) || !CheckHeader (header)) {
+    if (errorText.isEmpty ()) {
+      errorText = QString ("%1 has no OSMHeader").arg (filename);
+    }
+    file.close ();
+    return false;
+  }
+  done = false;
+  return true;
+}
+
+void
+OsmPbfReader::Close ()
+{
+  if (file.isOpen ()) {
+    file.close ();
+  }
+  decoded.clear ();
+  done = true;
+}
+
+qint64
+OsmPbfReader::Size () const
+{
+  return file.size ();
+}
+
+bool
+OsmPbfReader::ReadRawBlob (RawBlob & raw)
+{
+  QByteArray lenBytes = file.read (4);
+  if (lenBytes.size () != 4) {
+    return false;
+  }
+  const uchar * lb = reinterpret_cast<const uchar*>(lenBytes.constData());
+  quint32 headerLen = (quint32 (lb[0]) << 24) | (quint32 (lb[1]) << 16)
+                    | (quint32 (lb[2]) << 8) | quint32 (lb[3]);
+  if (headerLen > 64*1024) {
+    errorText = QString ("BlobHeader too large: %1").arg (headerLen);
+    return false;
+  }
+  QByteArray header = file.read (headerLen);
+  if (header.size () != int (headerLen)) {
+    errorText = QString ("truncated BlobHeader");
+    return false;
+  }
+  PbfMessage msg (header.constData (), header.size ());
+  qint64 dataSize (-1);
+  raw.type.clear ();
+  while (msg.Next ()) {
+    switch (msg.field) {
+    case 1: raw.type = msg.Bytes (); break;
+    case 3: dataSize = qint64 (msg.Varint ()); break;
+    default: msg.Skip (); break;
+    }
+  }
+  if (!msg.ok || dataSize < 0 || dataSize > 32*1024*1024) {
+    errorText = QString ("bad BlobHeader");
+    return false;
+  }
+  raw.blob = file.read (dataSize);
+  if (raw.blob.size () != dataSize) {
+    errorText = QString ("truncated Blob");
+    return false;
+  }
+  bytesRead = file.pos ();
+  return true;
+}
+
+bool
+OsmPbfReader::CheckHeader (const RawBlob & raw)
+{
+  if (raw.type != "OSMHeader") {
+    return false;
+  }
+  QByteArray data;
+  errorText = PbfBlobData (raw.blob, data);
+  if (!errorText.isEmpty ()) {
+    return false;
+  }
+  QStringList known;
+  known << "OsmSchema-V0.6" << "DenseNodes";
+  PbfMessage msg (data.constData (), data.size ());
+  while (msg.Next ()) {
+    if (msg.field == 4) {
+      QString feature = QString::fromUtf8 (msg.Bytes ());
+      if (!known.contains (feature)) {
+        errorText = QString ("unsupported required feature %1")
+                            .arg (feature);
+        return false;
+      }
+    } else {
+      msg.Skip ();
+    }
+  }
+  return msg.ok;
+}
+
+void
+OsmPbfReader::DecodeRound ()
+{
+  QList <RawBlob> raws;
+  while (raws.count () < roundSize) {
+    RawBlob raw;
+    if (!ReadRawBlob (raw)) {
+      done = true;
+      break;
+    }
+    raws.append (raw);
+  }
+  if (raws.isEmpty ()) {
+    return;
+  }
+  decoded = QtConcurrent::blockingMapped <QList <DecodedBlob> >
+                              (raws, &OsmPbfReader::Decode);
+}
+
+bool
+OsmPbfReader::ReadBatch (OsmBatch & batch)
+{
+  batch.clear ();
+  while (batch.isEmpty ()) {
+    if (decoded.isEmpty ()) {
+      if (done) {
+        return false;
+      }
+      DecodeRound ();
+      continue;
+    }
+    DecodedBlob next = decoded.takeFirst ();
+    if (!next.error.isEmpty ()) {
+      errorText = next.error;
+      qDebug () << "OsmPbfReader " << errorText;
+      decoded.clear ();
+      done = true;
+      return false;
+    }
+    batch = next.batch;
+  }
+  return true;
+}
+
+} // namespace
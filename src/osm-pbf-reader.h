@@ -0,0 +1,84 @@
+#ifndef OSM_PBF_READER_H
+#define OSM_PBF_READER_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "osm-reader.h"
+#include <QFile>
+#include <QByteArray>
+#include <QList>
+
+namespace navi
+{
+
+/** @brief Reader for .osm.pbf files. Each OSMData blob is an
+  * independent PrimitiveBlock, so a group of blobs is read from the
+  * file and decoded on the global thread pool, and the decoded
+  * batches are handed out in file order.
+  */
+
+class OsmPbfReader : public OsmReader
+{
+public:
+
+  OsmPbfReader (int blobsPerRound = 0);
+  ~OsmPbfReader ();
+
+  bool Open (const QString & filename);
+  void Close ();
+
+  bool ReadBatch (OsmBatch & batch);
+
+  bool    AtEnd () const { return done && decoded.isEmpty(); }
+  bool    HasError () const { return !errorText.isEmpty(); }
+  QString ErrorString () const { return errorText; }
+  qint64  BytesRead () const { return bytesRead; }
+  qint64  Size () const;
+
+  struct RawBlob {
+    QByteArray  type;
+    QByteArray  blob;
+  };
+
+  struct DecodedBlob {
+    OsmBatch    batch;
+    QString     error;
+  };
+
+  static DecodedBlob Decode (const RawBlob & raw);
+
+private:
+
+  bool ReadRawBlob (RawBlob & raw);
+  bool CheckHeader (const RawBlob & raw);
+  void DecodeRound ();
+
+  QFile                file;
+  int                  roundSize;
+  qint64               bytesRead;
+  bool                 done;
+  QString              errorText;
+  QList <DecodedBlob>  decoded;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef OSM_READER_H
+#define OSM_READER_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "osm-batch.h"
+#include <QString>
+
+namespace navi
+{
+
+/** @brief Common interface of the OSM file readers. ReadBatch
+  * returns false once there is nothing more to hand out.
+  */
+
+class OsmReader
+{
+public:
+
+  virtual ~OsmReader () {}
+
+  virtual bool Open (const QString & filename) = 0;
+  virtual void Close () = 0;
+
+  virtual bool ReadBatch (OsmBatch & batch) = 0;
+
+  virtual bool    AtEnd () const = 0;
+  virtual bool    HasError () const = 0;
+  virtual QString ErrorString () const = 0;
+  virtual qint64  BytesRead () const = 0;
+  virtual qint64  Size () const = 0;
+
+  static OsmReader * ForFile (const QString & filename);
+};
+
+} // namespace
+
+#endif
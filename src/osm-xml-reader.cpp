@@ -0,0 +1,211 @@
+#include "osm-xml-reader.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QXmlStreamAttributes>
+#include <QDebug>
+
+namespace navi
+{
+
+OsmXmlReader::OsmXmlReader (int chunkBytes, int batchElements)
+  :chunkSize (chunkBytes),
+   batchSize (batchElements),
+   bytesRead (0),
+   done (true),
+   kind (Kind_None),
+   currentLat (0),
+   currentLon (0)
+{
+}
+
+OsmXmlReader::~OsmXmlReader ()
+{
+  Close ();
+}
+
+bool
+OsmXmlReader::Open (const QString & filename)
+{
+  Close ();
+  file.setFileName (filename);
+  bool ok = file.open (QFile::ReadOnly);
+  if (!ok) {
+    errorText = QString ("cannot open %1").arg (filename);
+    return false;
+  }
+  xml.clear ();
+  errorText.clear ();
+  bytesRead = 0;
+  done = false;
+  ClearCurrent ();
+  return true;
+}
+
+void
+OsmXmlReader::Close ()
+{
+  if (file.isOpen ()) {
+    file.close ();
+  }
+  xml.clear ();
+  done = true;
+}
+
+qint64
+OsmXmlReader::Size () const
+{
+  return file.size ();
+}
+
+bool
+OsmXmlReader::FeedChunk ()
+{
+  if (!file.isOpen () || file.atEnd ()) {
+    return false;
+  }
+  QByteArray chunk = file.read (chunkSize);
+  if (chunk.isEmpty ()) {
+    return false;
+  }
+  bytesRead += chunk.size ();
+  xml.addData (chunk);
+  return true;
+}
+
+bool
+OsmXmlReader::ReadBatch (OsmBatch & batch)
+{
+  batch.clear ();
+  while (!done && batch.Count () < batchSize) {
+    QXmlStreamReader::TokenType token = xml.readNext ();
+    if (xml.hasError ()) {
+      if (xml.error () == QXmlStreamReader::PrematureEndOfDocumentError) {
+        if (!FeedChunk ()) {
+          done = true;
+        }
+      } else {
+        errorText = QString ("XML error at line %1: %2")
+                     .arg (xml.lineNumber ())
+                     .arg (xml.errorString ());
+        qDebug () << "OsmXmlReader " << errorText;
+        done = true;
+      }
+      continue;
+    }
+    switch (token) {
+    case QXmlStreamReader::StartElement:
+      StartElement ();
+      break;
+    case QXmlStreamReader::EndElement:
+      EndElement (batch);
+      break;
+    case QXmlStreamReader::EndDocument:
+      done = true;
+      break;
+    default:
+      break;
+    }
+  }
+  return !batch.isEmpty ();
+}
+
+void
+OsmXmlReader::StartElement ()
+{
+  QStringRef name = xml.name ();
+  QXmlStreamAttributes attr = xml.attributes ();
+  if (name == QLatin1String ("node")) {
+    ClearCurrent ();
+    kind = Kind_Node;
+    currentId = attr.value ("id").toString ().toLongLong ();
+    currentVersion = attr.value ("version").toString ().toInt ();
+    currentLat = CoordFromDegrees (attr.value ("lat").toString ().toDouble ());
+    currentLon = CoordFromDegrees (attr.value ("lon").toString ().toDouble ());
+  } else if (name == QLatin1String ("way")) {
+    ClearCurrent ();
+    kind = Kind_Way;
+    currentId = attr.value ("id").toString ().toLongLong ();
+    currentVersion = attr.value ("version").toString ().toInt ();
+  } else if (name == QLatin1String ("relation")) {
+    ClearCurrent ();
+    kind = Kind_Relation;
+    currentId = attr.value ("id").toString ().toLongLong ();
+    currentVersion = attr.value ("version").toString ().toInt ();
+  } else if (kind == Kind_None) {
+    return;
+  } else if (name == QLatin1String ("tag")) {
+    currentTags.append (TagItemType (attr.value ("k").toString (),
+                                     attr.value ("v").toString ()));
+  } else if (name == QLatin1String ("nd") && kind == Kind_Way) {
+    currentNodes.append (attr.value ("ref").toString ().toLongLong ());
+  } else if (name == QLatin1String ("member") && kind == Kind_Relation) {
+    currentMembers.append (MemberItemType (attr.value ("type").toString (),
+                                attr.value ("ref").toString ().toLongLong ()));
+  }
+}
+
+void
+OsmXmlReader::EndElement (OsmBatch & batch)
+{
+  QStringRef name = xml.name ();
+  if (name == QLatin1String ("node") && kind == Kind_Node) {
+    batch.nodes.append (NaviNode::FromCoords (currentId,
+                                              currentLat, currentLon));
+    if (!currentTags.isEmpty ()) {
+      batch.nodeTags [currentId] = currentTags;
+    }
+    if (currentVersion > 0) {
+      batch.nodeVersions [currentId] = currentVersion;
+    }
+    ClearCurrent ();
+  } else if (name == QLatin1String ("way") && kind == Kind_Way) {
+    batch.wayNodes [currentId] = currentNodes;
+    batch.wayTags [currentId] = currentTags;
+    if (currentVersion > 0) {
+      batch.wayVersions [currentId] = currentVersion;
+    }
+    ClearCurrent ();
+  } else if (name == QLatin1String ("relation") && kind == Kind_Relation) {
+    batch.relationTags [currentId] = currentTags;
+    batch.relationMembers [currentId] = currentMembers;
+    if (currentVersion > 0) {
+      batch.relationVersions [currentId] = currentVersion;
+    }
+    ClearCurrent ();
+  }
+}
+
+void
+OsmXmlReader::ClearCurrent ()
+{
+  kind = Kind_None;
+  currentId = 0;
+  currentVersion = 0;
+  currentLat = 0;
+  currentLon = 0;
+  currentTags.clear ();
+  currentNodes.clear ();
+  currentMembers.clear ();
+}
+
+} // namespace
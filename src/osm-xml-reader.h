@@ -0,0 +1,88 @@
+#ifndef OSM_XML_READER_H
+#define OSM_XML_READER_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "osm-reader.h"
+#include <QFile>
+#include <QXmlStreamReader>
+
+namespace navi
+{
+
+/** @brief Pull parser for .osm XML files. The file is fed to
+  * the parser in fixed size chunks, and complete elements are
+  * handed out in batches of at most batchSize elements.
+  */
+
+class OsmXmlReader : public OsmReader
+{
+public:
+
+  OsmXmlReader (int chunkBytes = 64*1024, int batchElements = 2000);
+  ~OsmXmlReader ();
+
+  bool Open (const QString & filename);
+  void Close ();
+
+  bool ReadBatch (OsmBatch & batch);
+
+  bool    AtEnd () const { return done; }
+  bool    HasError () const { return !errorText.isEmpty(); }
+  QString ErrorString () const { return errorText; }
+  qint64  BytesRead () const { return bytesRead; }
+  qint64  Size () const;
+
+private:
+
+  enum ElementKind {
+    Kind_None = 0,
+    Kind_Node,
+    Kind_Way,
+    Kind_Relation
+  };
+
+  bool FeedChunk ();
+  void StartElement ();
+  void EndElement (OsmBatch & batch);
+  void ClearCurrent ();
+
+  QFile             file;
+  QXmlStreamReader  xml;
+  int               chunkSize;
+  int               batchSize;
+  qint64            bytesRead;
+  bool              done;
+  QString           errorText;
+
+  ElementKind       kind;
+  NaviId            currentId;
+  int               currentVersion;
+  NaviCoord         currentLat;
+  NaviCoord         currentLon;
+  TagList           currentTags;
+  NaviIdList        currentNodes;
+  MemberList        currentMembers;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,435 @@
+#include "road-graph-builder.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include "db-manager.h"
+#include "way-geometry.h"
+#include <QtConcurrentMap>
+#include <QThread>
+#include <QTime>
+#include <QMap>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <string.h>
+
+namespace navi
+{
+
+RoadGraphBuilder::RoadGraphBuilder ()
+  :partCount (0),
+   readMsecs (0),
+   buildMsecs (0)
+{
+}
+
+bool
+RoadGraphBuilder::Build (DbManager & db, const QString & filename,
+                         int threads)
+{
+  QTime clock;
+  clock.start ();
+  if (threads < 1) {
+    threads = QThread::idealThreadCount ();
+  }
+  QList <PartRequest> requests = Parts (db, threads);
+  partCount = requests.count ();
+  QList <GraphPart> parts = QtConcurrent::blockingMapped <QList <GraphPart> >
+                               (requests, &RoadGraphBuilder::ReadPart);
+  for (int p=0; p<parts.count(); p++) {
+    if (!parts.at(p).error.isEmpty ()) {
+      return Fail (parts.at(p).error);
+    }
+  }
+  readMsecs = clock.restart ();
+  JoinParts (parts);
+  parts.clear ();
+  MakeEdges ();
+  bool ok = WriteFile (filename);
+  buildMsecs = clock.elapsed ();
+  return ok;
+}
+
+QString
+RoadGraphBuilder::Report () const
+{
+  return QString ("Road graph: %1 ways, %2 nodes, %3 edges; "
+                  "read %4 parts in %5 msecs, built in %6 msecs")
+             .arg (ways.count ())
+             .arg (nodeIds.count ())
+             .arg (targets.count ())
+             .arg (partCount)
+             .arg (readMsecs)
+             .arg (buildMsecs);
+}
+
+bool
+RoadGraphBuilder::Fail (const QString & message)
+{
+  errorText = message;
+  qDebug () << "RoadGraphBuilder " << message;
+  return false;
+}
+
+/** @brief Cut the parcels with ways into ranges of about equal way
+  * counts, a few per thread so a dense range does not hold up the
+  * others.
+  */
+
+QList <RoadGraphBuilder::PartRequest>
+RoadGraphBuilder::Parts (DbManager & db, int threads)
+{
+  QList <PartRequest> requests;
+  QList <quint64> parcels;
+  QList <int>     counts;
+  if (!db.GetParcelCounts ("way", parcels, counts) || parcels.isEmpty ()) {
+    return requests;
+  }
+  qint64 total (0);
+  for (int c=0; c<counts.count(); c++) {
+    total += counts.at(c);
+  }
+  qint64 perPart = qMax (Q_INT64_C(1), total / (4 * threads));
+  PartRequest request;
+  request.geoBaseName = db.GeoBaseFile ();
+  request.parcels.first = parcels.first ();
+  qint64 inPart (0);
+  for (int p=0; p<parcels.count(); p++) {
+    inPart += counts.at(p);
+    if (inPart >= perPart || p == parcels.count() - 1) {
+      request.part = requests.count ();
+      request.parcels.second = parcels.at(p);
+      requests.append (request);
+      if (p + 1 < parcels.count()) {
+        request.parcels.first = parcels.at(p+1);
+      }
+      inPart = 0;
+    }
+  }
+  return requests;
+}
+
+RoadGraphBuilder::GraphPart
+RoadGraphBuilder::ReadPart (const PartRequest & request)
+{
+  GraphPart part;
+  DbManager db;
+  if (!db.StartReadOnly (QString ("roadGraphCon%1").arg (request.part),
+                         request.geoBaseName)) {
+    part.error = QString ("cannot open %1").arg (request.geoBaseName);
+    return part;
+  }
+  NaviIdList wayIds;
+  QMap <NaviId, TagList>    wayTags;
+  QMap <NaviId, QByteArray> geoms;
+  bool ok = db.GetWays (request.parcels, wayIds)
+         && db.GetTagsFor ("way", wayIds, wayTags);
+  NaviIdList roads;
+  QMap <NaviId, TagList>::const_iterator tit;
+  for (tit=wayTags.begin(); ok && tit!=wayTags.end(); tit++) {
+    const TagList & tags = *tit;
+    for (int t=0; t<tags.count(); t++) {
+      if (tags.at(t).first == "highway") {
+        GraphWay way;
+        way.id = tit.key();
+        way.speed = RoadSpeed (tags.at(t).second);
+        way.oneway = OneWay (tags, tags.at(t).second);
+        if (way.speed > 0) {
+          roads.append (way.id);
+          part.ways.append (way);
+        }
+        break;
+      }
+    }
+  }
+  ok = ok && db.GetWayGeometries (roads, geoms);
+  for (int w=0; ok && w<part.ways.count(); w++) {
+    GraphWay & way = part.ways[w];
+    WayGeometryReader reader (geoms.value (way.id));
+    way.nodes.reserve (reader.Count ());
+    while (reader.Next ()) {
+      way.nodes.append (reader.NodeId ());
+      part.locs.insert (reader.NodeId (), 
+                        LatLon (reader.Lat (), reader.Lon ()));
+    }
+  }
+  if (!ok) {
+    part.error = QString ("reading parcels %1 to %2 failed")
+                   .arg (request.parcels.first)
+                   .arg (request.parcels.second);
+  }
+  db.Stop ();
+  return part;
+}
+
+/** @brief ways of these highway values are in the graph, at the
+  * given km/h; links go at the speed of the road they belong to
+  */
+
+static const struct {
+  const char * highway;
+  int          speed;
+} roadSpeeds[] = {
+  { "motorway", 110 },
+  { "trunk", 90 },
+  { "primary", 70 },
+  { "secondary", 60 },
+  { "tertiary", 50 },
+  { "unclassified", 40 },
+  { "residential", 30 },
+  { "road", 30 },
+  { "service", 20 },
+  { "living_street", 10 },
+  { "track", 15 },
+  { "cycleway", 15 },
+  { "pedestrian", 5 },
+  { "footway", 5 },
+  { "path", 5 },
+  { "bridleway", 5 },
+  { "steps", 2 },
+  { 0, 0 }
+};
+
+int
+RoadGraphBuilder::RoadSpeed (const QString & highway)
+{
+  QString road (highway);
+  if (road.endsWith ("_link")) {
+    road.chop (5);
+  }
+  for (int r=0; roadSpeeds[r].highway; r++) {
+    if (road == QLatin1String (roadSpeeds[r].highway)) {
+      return roadSpeeds[r].speed;
+    }
+  }
+  return 0;
+}
+
+int
+RoadGraphBuilder::OneWay (const TagList & tags, const QString & highway)
+{
+  for (int t=0; t<tags.count(); t++) {
+    const QString & key = tags.at(t).first;
+    const QString & value = tags.at(t).second;
+    if (key == "oneway") {
+      if (value == "yes" || value == "true" || value == "1") {
+        return 1;
+      } else if (value == "-1" || value == "reverse") {
+        return -1;
+      } else if (value == "no") {
+        return 0;
+      }
+    } else if (key == "junction" && value == "roundabout") {
+      return 1;
+    }
+  }
+  return (highway == "motorway" || highway == "motorway_link") ? 1 : 0;
+}
+
+/** @brief Merge the parts. The way geometry only holds located nodes,
+  * so a way needs two of them to make an edge.
+  */
+
+void
+RoadGraphBuilder::JoinParts (const QList <GraphPart> & parts)
+{
+  ways.clear ();
+  locs.clear ();
+  for (int p=0; p<parts.count(); p++) {
+    const GraphPart & part = parts.at(p);
+    QHash <NaviId, LatLon>::const_iterator lit;
+    for (lit=part.locs.begin(); lit!=part.locs.end(); lit++) {
+      locs.insert (lit.key(), *lit);
+    }
+    for (int w=0; w<part.ways.count(); w++) {
+      if (part.ways.at(w).nodes.count() > 1) {
+        ways.append (part.ways.at(w));
+      }
+    }
+  }
+}
+
+/** @brief A node is a graph node if it ends a way or is on more than
+  * one way, counting a way that passes a node twice. Each stretch of
+  * way between two graph nodes is one edge, in each direction the way
+  * can be driven, weighted by its travel time.
+  */
+
+void
+RoadGraphBuilder::MakeEdges ()
+{
+  QHash <NaviId, int> uses;
+  for (int w=0; w<ways.count(); w++) {
+    const QVector <NaviId> & wayNodes = ways.at(w).nodes;
+    int last = wayNodes.count() - 1;
+    for (int n=0; n<=last; n++) {
+      uses[wayNodes.at(n)] += (n == 0 || n == last) ? 2 : 1;
+    }
+  }
+  nodeIds.clear ();
+  QHash <NaviId, int>::const_iterator uit;
+  for (uit=uses.begin(); uit!=uses.end(); uit++) {
+    if (*uit > 1) {
+      nodeIds.append (uit.key());
+    }
+  }
+  uses.clear ();
+  qSort (nodeIds);
+  QHash <NaviId, quint32> index;
+  index.reserve (nodeIds.count());
+  nodeLats.resize (nodeIds.count());
+  nodeLons.resize (nodeIds.count());
+  for (int n=0; n<nodeIds.count(); n++) {
+    index.insert (nodeIds.at(n), quint32 (n));
+    LatLon loc = locs.value (nodeIds.at(n));
+    nodeLats[n] = loc.first;
+    nodeLons[n] = loc.second;
+  }
+
+  QVector <Edge> edges;
+  for (int w=0; w<ways.count(); w++) {
+    const GraphWay & way = ways.at(w);
+    quint32 from = index.value (way.nodes.first());
+    LatLon prev = locs.value (way.nodes.first());
+    double meters (0.0);
+    for (int n=1; n<way.nodes.count(); n++) {
+      LatLon here = locs.value (way.nodes.at(n));
+      meters += RoadGraph::Meters (prev.first, prev.second,
+                                   here.first, here.second);
+      prev = here;
+      QHash <NaviId, quint32>::const_iterator found 
+                                = index.find (way.nodes.at(n));
+      if (found == index.end ()) {
+        continue;
+      }
+      quint32 to = *found;
+      if (to != from) {
+        /// meters / (km/h / 3.6) seconds, in tenths
+        Edge edge;
+        edge.weight = quint32 (qMax (1.0, 36.0 * meters / way.speed + 0.5));
+        edge.wayId = way.id;
+        if (way.oneway >= 0) {
+          edge.from = from;
+          edge.to = to;
+          edges.append (edge);
+        }
+        if (way.oneway <= 0) {
+          edge.from = to;
+          edge.to = from;
+          edges.append (edge);
+        }
+      }
+      from = to;
+      meters = 0.0;
+    }
+  }
+
+  int nodeCount = nodeIds.count ();
+  offsets.fill (0, nodeCount + 1);
+  for (int e=0; e<edges.count(); e++) {
+    offsets[edges.at(e).from + 1]++;
+  }
+  for (int n=0; n<nodeCount; n++) {
+    offsets[n+1] += offsets[n];
+  }
+  targets.resize (edges.count());
+  weights.resize (edges.count());
+  edgeWays.resize (edges.count());
+  QVector <quint32> next (offsets);
+  for (int e=0; e<edges.count(); e++) {
+    const Edge & edge = edges.at(e);
+    quint32 slot = next[edge.from]++;
+    targets[slot] = edge.to;
+    weights[slot] = edge.weight;
+    edgeWays[slot] = edge.wayId;
+  }
+}
+
+/** @brief append one column at the next 8 byte boundary */
+
+static bool
+WriteColumn (QFile & file, RoadGraph::SectionEntry & entry,
+             const void * data, int count, int elementSize)
+{
+  qint64 pos = file.pos ();
+  qint64 aligned = (pos + 7) & ~Q_INT64_C(7);
+  if (aligned > pos) {
+    if (file.write (QByteArray (aligned - pos, 0)) != aligned - pos) {
+      return false;
+    }
+  }
+  entry.offset = aligned;
+  entry.count = count;
+  qint64 bytes = qint64 (count) * elementSize;
+  return bytes == 0
+      || file.write (static_cast <const char*> (data), bytes) == bytes;
+}
+
+bool
+RoadGraphBuilder::WriteFile (const QString & filename)
+{
+  QFile file (filename + ".tmp");
+  if (!file.open (QFile::WriteOnly | QFile::Truncate)) {
+    return Fail (file.errorString ());
+  }
+  RoadGraph::Header header;
+  memcpy (header.magic, RoadGraph::Magic, sizeof (header.magic));
+  header.version = RoadGraph::Version;
+  header.sectionCount = RoadGraph::Sec_Count;
+  RoadGraph::SectionEntry table[RoadGraph::Sec_Count];
+  memset (table, 0, sizeof (table));
+  bool ok = file.write (reinterpret_cast <const char*> (&header), 
+                        sizeof (header)) == qint64 (sizeof (header))
+         && file.write (reinterpret_cast <const char*> (table), 
+                        sizeof (table)) == qint64 (sizeof (table));
+
+#define GRAPH_COLUMN(sec, vec) \
+  ok = ok && WriteColumn (file, table[RoadGraph::sec], (vec).constData (), \
+                          (vec).count (), sizeof ((vec)[0]))
+
+  GRAPH_COLUMN (Sec_NodeIds, nodeIds);
+  GRAPH_COLUMN (Sec_NodeLats, nodeLats);
+  GRAPH_COLUMN (Sec_NodeLons, nodeLons);
+  GRAPH_COLUMN (Sec_Offsets, offsets);
+  GRAPH_COLUMN (Sec_Targets, targets);
+  GRAPH_COLUMN (Sec_Weights, weights);
+  GRAPH_COLUMN (Sec_EdgeWays, edgeWays);
+
+#undef GRAPH_COLUMN
+
+  ok = ok && file.seek (sizeof (header))
+          && file.write (reinterpret_cast <const char*> (table), 
+                         sizeof (table)) == qint64 (sizeof (table));
+  if (!ok) {
+    QString error = file.errorString ();
+    file.close ();
+    file.remove ();
+    return Fail (error);
+  }
+  file.close ();
+  QFile::remove (filename);
+  if (!file.rename (filename)) {
+    return Fail (file.errorString ());
+  }
+  return true;
+}
+
+} // namespace
@@ -0,0 +1,125 @@
+#ifndef ROAD_GRAPH_BUILDER_H
+#define ROAD_GRAPH_BUILDER_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "road-graph.h"
+#include "navi-global.h"
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+
+namespace navi
+{
+
+class DbManager;
+
+/** @brief Builds a RoadGraph file from the highway tagged ways of a
+  * geobase.
+  *
+  * The parcels holding ways are cut into contiguous ranges with
+  * about the same number of ways, a few per thread. Every range is
+  * read on the global thread pool through its own read only
+  * DbManager connection: the ways, their tags and their geometry,
+  * which has the located nodes in way order with their locations.
+  * The parts are then joined, ways are split into edges at the
+  * nodes they share with other ways, and the edges are written in
+  * CSR order. The file is written under a temporary name and renamed
+  * when complete.
+  */
+
+class RoadGraphBuilder
+{
+public:
+
+  RoadGraphBuilder ();
+
+  bool Build (DbManager & db, const QString & filename, int threads = 0);
+
+  QString ErrorString () const { return errorText; }
+  QString Report () const;
+
+  /** @brief a routable way, with its nodes in way order */
+  struct GraphWay {
+    NaviId            id;
+    int               speed;
+    int               oneway;
+    QVector <NaviId>  nodes;
+  };
+
+  typedef QPair <NaviCoord, NaviCoord>  LatLon;
+
+  struct PartRequest {
+    QString      geoBaseName;
+    int          part;
+    ParcelRange  parcels;
+  };
+
+  struct GraphPart {
+    QList <GraphWay>         ways;
+    QHash <NaviId, LatLon>   locs;
+    QString                  error;
+  };
+
+  static GraphPart ReadPart (const PartRequest & request);
+
+  /** @brief km/h for a highway value, 0 for ways that are not driven
+    * or walked on
+    */
+  static int RoadSpeed (const QString & highway);
+  /** @brief 1 for one way along the way, -1 against it, 0 both ways */
+  static int OneWay (const TagList & tags, const QString & highway);
+
+private:
+
+  struct Edge {
+    quint32  from;
+    quint32  to;
+    quint32  weight;
+    NaviId   wayId;
+  };
+
+  QList <PartRequest> Parts (DbManager & db, int threads);
+  void JoinParts (const QList <GraphPart> & parts);
+  void MakeEdges ();
+  bool WriteFile (const QString & filename);
+  bool Fail (const QString & message);
+
+  QString                  errorText;
+  QList <GraphWay>         ways;
+  QHash <NaviId, LatLon>   locs;
+  QVector <NaviId>         nodeIds;
+  QVector <NaviCoord>      nodeLats;
+  QVector <NaviCoord>      nodeLons;
+  QVector <quint32>        offsets;
+  QVector <quint32>        targets;
+  QVector <quint32>        weights;
+  QVector <NaviId>         edgeWays;
+  int                      partCount;
+  int                      readMsecs;
+  int                      buildMsecs;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,257 @@
+#include "road-graph.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include "navi-global.h"
+#include <QStringList>
+#include <QPair>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <math.h>
+#include <string.h>
+
+namespace navi
+{
+
+const char    RoadGraph::Magic[8] = { 'N','A','V','I','G','R','P','H' };
+const quint32 RoadGraph::Version (1);
+
+RoadGraph::RoadGraph ()
+  :base (0),
+   sections (0),
+   rowLo (0),
+   rowHi (0),
+   colLo (0),
+   colHi (0)
+{
+}
+
+RoadGraph::~RoadGraph ()
+{
+  Close ();
+}
+
+bool
+RoadGraph::Open (const QString & filename)
+{
+  Close ();
+  file.setFileName (filename);
+  if (!file.open (QFile::ReadOnly)) {
+    return false;
+  }
+  qint64 size = file.size ();
+  qint64 tableEnd = sizeof (Header) + Sec_Count * sizeof (SectionEntry);
+  if (size < tableEnd) {
+    file.close ();
+    return false;
+  }
+  uchar * map = file.map (0, size);
+  if (map == 0) {
+    qDebug () << "RoadGraph cannot map " << filename << file.errorString ();
+    file.close ();
+    return false;
+  }
+  const Header * header = reinterpret_cast <const Header*> (map);
+  const SectionEntry * table = reinterpret_cast <const SectionEntry*>
+                                  (map + sizeof (Header));
+  bool good = memcmp (header->magic, Magic, sizeof (Magic)) == 0
+           && header->version == Version
+           && header->sectionCount == quint32 (Sec_Count);
+  for (int s=0; good && s<Sec_Count; s++) {
+    good = qint64 (table[s].offset) >= tableEnd 
+        && qint64 (table[s].offset) <= size;
+  }
+  quint64 nodes = good ? table[Sec_NodeIds].count : 0;
+  quint64 edges = good ? table[Sec_Targets].count : 0;
+  good = good
+      && table[Sec_NodeLats].count == nodes
+      && table[Sec_NodeLons].count == nodes
+      && table[Sec_Offsets].count == nodes + 1
+      && table[Sec_Weights].count == edges
+      && table[Sec_EdgeWays].count == edges
+      && reinterpret_cast <const quint32*> 
+           (map + table[Sec_Offsets].offset)[nodes] == edges;
+  if (!good) {
+    qDebug () << "RoadGraph " << filename << " has the wrong layout";
+    file.unmap (map);
+    file.close ();
+    return false;
+  }
+  base = map;
+  sections = table;
+  return true;
+}
+
+void
+RoadGraph::Close ()
+{
+  if (base) {
+    file.unmap (const_cast <uchar*> (base));
+    base = 0;
+  }
+  sections = 0;
+  cellKeys.clear ();
+  cellNodes.clear ();
+  if (file.isOpen ()) {
+    file.close ();
+  }
+}
+
+int
+RoadGraph::FindNode (NaviId osmId) const
+{
+  int count = NodeCount ();
+  if (count == 0) {
+    return -1;
+  }
+  const NaviId * ids = NodeIds ();
+  const NaviId * found = qBinaryFind (ids, ids + count, osmId);
+  return found == ids + count ? -1 : int (found - ids);
+}
+
+void
+RoadGraph::BuildCellIndex () const
+{
+  int count = NodeCount ();
+  const NaviCoord * lats = Lats ();
+  const NaviCoord * lons = Lons ();
+  QVector <QPair <quint64, quint32> > cells (count);
+  for (int n=0; n<count; n++) {
+    quint32 row, col;
+    Parcel::CoordCell (lats[n], lons[n], row, col);
+    if (n == 0) {
+      rowLo = rowHi = row;
+      colLo = colHi = col;
+    }
+    rowLo = qMin (rowLo, row);
+    rowHi = qMax (rowHi, row);
+    colLo = qMin (colLo, col);
+    colHi = qMax (colHi, col);
+    cells[n] = qMakePair (Parcel::CellIndex (row, col), quint32 (n));
+  }
+  qSort (cells);
+  cellKeys.resize (count);
+  cellNodes.resize (count);
+  for (int c=0; c<count; c++) {
+    cellKeys[c] = cells.at(c).first;
+    cellNodes[c] = cells.at(c).second;
+  }
+}
+
+void
+RoadGraph::NearestInCell (quint32 row, quint32 col,
+                          NaviCoord lat, NaviCoord lon,
+                          int & best, double & bestMeters) const
+{
+  quint64 key = Parcel::CellIndex (row, col);
+  const quint64 * first = qLowerBound (cellKeys.constBegin (),
+                                       cellKeys.constEnd (), key);
+  const NaviCoord * lats = Lats ();
+  const NaviCoord * lons = Lons ();
+  for (int c = first - cellKeys.constBegin ();
+       c < cellKeys.count () && cellKeys.at(c) == key; c++) {
+    int n = cellNodes.at(c);
+    double meters = Meters (lat, lon, lats[n], lons[n]);
+    if (best < 0 || meters < bestMeters) {
+      best = n;
+      bestMeters = meters;
+    }
+  }
+}
+
+/** @brief Search rings of parcel cells around the point, until the
+  * next ring is farther than the best node found. A node r rings out
+  * is at least r - 1 cells away, and a cell is narrowest east to west
+  * on its poleward side.
+  */
+
+int
+RoadGraph::NearestNode (double lat, double lon) const
+{
+  if (NodeCount () == 0) {
+    return -1;
+  }
+  if (cellKeys.isEmpty ()) {
+    BuildCellIndex ();
+  }
+  NaviCoord latCoord = CoordFromDegrees (lat);
+  NaviCoord lonCoord = CoordFromDegrees (lon);
+  quint32 row, col;
+  Parcel::CoordCell (latCoord, lonCoord, row, col);
+  qint64 maxRing = qMax (qMax (qint64 (row) - rowLo, qint64 (rowHi) - row),
+                         qMax (qint64 (col) - colLo, qint64 (colHi) - col));
+  int best (-1);
+  double bestMeters (0.0);
+  for (qint64 ring=0; ring<=maxRing; ring++) {
+    if (best >= 0 && ring > 1) {
+      double degrees = (ring - 1) / Parcel::Resolution ();
+      double poleward = qMin (90.0, fabs (lat) + degrees);
+      double ringMeters = 6371000.0 * degrees * M_PI / 180.0
+                          * cos (poleward * M_PI / 180.0);
+      if (ringMeters > bestMeters) {
+        break;
+      }
+    }
+    qint64 top = qMax (qint64 (row) - ring, qint64 (rowLo));
+    qint64 bottom = qMin (qint64 (row) + ring, qint64 (rowHi));
+    qint64 left = qint64 (col) - ring;
+    qint64 right = qint64 (col) + ring;
+    for (qint64 r=top; r<=bottom; r++) {
+      bool edgeRow = (r == qint64 (row) - ring || r == qint64 (row) + ring);
+      qint64 step = edgeRow ? 1 : qMax (qint64 (1), right - left);
+      for (qint64 c=left; c<=right; c+=step) {
+        if (c >= colLo && c <= colHi) {
+          NearestInCell (quint32 (r), quint32 (c), latCoord, lonCoord,
+                         best, bestMeters);
+        }
+      }
+    }
+  }
+  return best;
+}
+
+int
+RoadGraph::ParseNode (const QString & text) const
+{
+  QStringList parts = text.split (",");
+  if (parts.count () == 2) {
+    return NearestNode (parts.at(0).trimmed().toDouble(),
+                        parts.at(1).trimmed().toDouble());
+  }
+  return FindNode (text.trimmed().toLongLong ());
+}
+
+double
+RoadGraph::Meters (NaviCoord lat1, NaviCoord lon1,
+                   NaviCoord lat2, NaviCoord lon2)
+{
+  static const double earthRadius (6371000.0);
+  static const double radians (M_PI / 180.0);
+  double phi1 = DegreesFromCoord (lat1) * radians;
+  double phi2 = DegreesFromCoord (lat2) * radians;
+  double x = (DegreesFromCoord (lon2) - DegreesFromCoord (lon1)) * radians
+             * cos (0.5 * (phi1 + phi2));
+  double y = phi2 - phi1;
+  return earthRadius * sqrt (x*x + y*y);
+}
+
+} // namespace
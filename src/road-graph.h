@@ -0,0 +1,144 @@
+#ifndef ROAD_GRAPH_H
+#define ROAD_GRAPH_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "navi-types.h"
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+namespace navi
+{
+
+/** @brief Routable road network in compressed sparse row form,
+  * mapped read only from one file.
+  *
+  * Graph nodes are numbered in ascending OSM node id. The outgoing
+  * edges of node n are Targets()[Offsets()[n] .. Offsets()[n+1]-1],
+  * with their Weights() in tenths of a second of travel time and the
+  * OSM way each edge came from. Coordinates are the usual fixed point
+  * NaviCoord. The layout follows NaviPack: a header, a section table,
+  * and 8 byte aligned columns.
+  */
+
+class RoadGraph
+{
+public:
+
+  enum Section {
+    Sec_NodeIds = 0,
+    Sec_NodeLats,
+    Sec_NodeLons,
+    Sec_Offsets,
+    Sec_Targets,
+    Sec_Weights,
+    Sec_EdgeWays,
+    Sec_Count
+  };
+
+  struct Header {
+    char     magic[8];
+    quint32  version;
+    quint32  sectionCount;
+  };
+
+  struct SectionEntry {
+    quint64  offset;
+    quint64  count;
+  };
+
+  RoadGraph ();
+  ~RoadGraph ();
+
+  bool Open (const QString & filename);
+  void Close ();
+  bool IsOpen () const { return base != 0; }
+
+  int  NodeCount () const { return Count (Sec_NodeIds); }
+  int  EdgeCount () const { return Count (Sec_Targets); }
+
+  const NaviId    * NodeIds () const { return Column <NaviId> (Sec_NodeIds); }
+  const NaviCoord * Lats () const { return Column <NaviCoord> (Sec_NodeLats); }
+  const NaviCoord * Lons () const { return Column <NaviCoord> (Sec_NodeLons); }
+  const quint32   * Offsets () const { return Column <quint32> (Sec_Offsets); }
+  const quint32   * Targets () const { return Column <quint32> (Sec_Targets); }
+  const quint32   * Weights () const { return Column <quint32> (Sec_Weights); }
+  const NaviId    * EdgeWays () const 
+                      { return Column <NaviId> (Sec_EdgeWays); }
+
+  /** @brief graph node of an OSM node, -1 if it is not in the graph */
+  int  FindNode (NaviId osmId) const;
+  /** @brief graph node closest to the point, -1 for an empty graph.
+    * The first call sorts the nodes by parcel cell, later calls only
+    * look at the cells around the point.
+    */
+  int  NearestNode (double lat, double lon) const;
+  /** @brief graph node for an OSM node id, or for "lat,lon" the
+    * nearest one; -1 if there is none
+    */
+  int  ParseNode (const QString & text) const;
+
+  /** @brief great circle distance, by the equirectangular
+    * approximation that is good enough at road segment lengths
+    */
+  static double Meters (NaviCoord lat1, NaviCoord lon1,
+                        NaviCoord lat2, NaviCoord lon2);
+
+  /** @brief the graph lives next to the geobase it was built from */
+  static QString FileName (const QString & geoBaseName)
+    { return geoBaseName + QString (".graph"); }
+
+  static const char    Magic[8];
+  static const quint32 Version;
+
+private:
+
+  template <typename T>
+  const T * Column (Section section) const
+    { 
+      return base ? reinterpret_cast <const T*> 
+                         (base + sections[section].offset)
+                  : 0;
+    }
+  int  Count (Section section) const
+    { return base ? int (sections[section].count) : 0; }
+
+  void BuildCellIndex () const;
+  void NearestInCell (quint32 row, quint32 col,
+                      NaviCoord lat, NaviCoord lon,
+                      int & best, double & bestMeters) const;
+
+  QFile               file;
+  const uchar        *base;
+  const SectionEntry *sections;
+
+  /** @brief graph nodes sorted by Parcel::CoordIndex, with the
+    * row and column range of the cells holding them
+    */
+  mutable QVector <quint64>  cellKeys;
+  mutable QVector <quint32>  cellNodes;
+  mutable quint32            rowLo, rowHi, colLo, colHi;
+};
+
+} // namespace
+
+#endif
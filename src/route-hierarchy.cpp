@@ -0,0 +1,435 @@
+#include "route-hierarchy.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QElapsedTimer>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <string.h>
+
+namespace navi
+{
+
+const char    RouteHierarchy::Magic[8] = { 'N','A','V','I','H','I','E','R' };
+const quint32 RouteHierarchy::Version (1);
+const quint32 RouteHierarchy::NoMiddle (0xffffffff);
+
+RouteHierarchy::RouteHierarchy ()
+  :base (0),
+   sections (0)
+{
+}
+
+RouteHierarchy::~RouteHierarchy ()
+{
+  Close ();
+}
+
+bool
+RouteHierarchy::Open (const QString & filename, const RoadGraph & graph)
+{
+  Close ();
+  file.setFileName (filename);
+  if (!file.open (QFile::ReadOnly)) {
+    return false;
+  }
+  qint64 size = file.size ();
+  qint64 tableEnd = sizeof (Header) + Sec_Count * sizeof (SectionEntry);
+  if (size < tableEnd) {
+    file.close ();
+    return false;
+  }
+  uchar * map = file.map (0, size);
+  if (map == 0) {
+    qDebug () << "RouteHierarchy cannot map " << filename
+              << file.errorString ();
+    file.close ();
+    return false;
+  }
+  const Header * header = reinterpret_cast <const Header*> (map);
+  const SectionEntry * table = reinterpret_cast <const SectionEntry*>
+                                  (map + sizeof (Header));
+  bool good = memcmp (header->magic, Magic, sizeof (Magic)) == 0
+           && header->version == Version
+           && header->sectionCount == quint32 (Sec_Count);
+  for (int s=0; good && s<Sec_Count; s++) {
+    good = qint64 (table[s].offset) >= tableEnd
+        && qint64 (table[s].offset) <= size;
+  }
+  quint64 nodes = good ? table[Sec_Ranks].count : 0;
+  quint64 up = good ? table[Sec_UpTargets].count : 0;
+  quint64 down = good ? table[Sec_DownTargets].count : 0;
+  good = good
+      && table[Sec_UpOffsets].count == nodes + 1
+      && table[Sec_UpWeights].count == up
+      && table[Sec_UpMiddles].count == up
+      && table[Sec_DownOffsets].count == nodes + 1
+      && table[Sec_DownWeights].count == down
+      && table[Sec_DownMiddles].count == down
+      && reinterpret_cast <const quint32*>
+           (map + table[Sec_UpOffsets].offset)[nodes] == up
+      && reinterpret_cast <const quint32*>
+           (map + table[Sec_DownOffsets].offset)[nodes] == down;
+  if (!good) {
+    qDebug () << "RouteHierarchy " << filename << " has the wrong layout";
+    file.unmap (map);
+    file.close ();
+    return false;
+  }
+  if (header->graphNodes != quint64 (graph.NodeCount ())
+      || header->graphEdges != quint64 (graph.EdgeCount ())
+      || nodes != header->graphNodes) {
+    qDebug () << "RouteHierarchy " << filename
+              << " was built for another road graph";
+    file.unmap (map);
+    file.close ();
+    return false;
+  }
+  base = map;
+  sections = table;
+  return true;
+}
+
+void
+RouteHierarchy::Close ()
+{
+  if (base) {
+    file.unmap (const_cast <uchar*> (base));
+    base = 0;
+  }
+  sections = 0;
+  if (file.isOpen ()) {
+    file.close ();
+  }
+}
+
+HierarchySearch::HierarchySearch (const RoadGraph & roadGraph,
+                                  const RouteHierarchy & routeHierarchy)
+  :graph (roadGraph),
+   hierarchy (routeHierarchy),
+   query (0),
+   best (0),
+   meet (-1),
+   cost (0),
+   settled (0)
+{
+  int nodes = hierarchy.NodeCount ();
+  for (int side=0; side<2; side++) {
+    heap[side].Resize (nodes);
+    seen[side].fill (0, nodes);
+    done[side].fill (0, nodes);
+    dist[side].resize (nodes);
+    parent[side].resize (nodes);
+    parentEdge[side].resize (nodes);
+  }
+  stack.reserve (64);
+  path.reserve (1024);
+}
+
+void
+HierarchySearch::NewQuery ()
+{
+  query++;
+  if (query == 0) {
+    for (int side=0; side<2; side++) {
+      seen[side].fill (0);
+      done[side].fill (0);
+    }
+    query = 1;
+  }
+  heap[Forward].Clear ();
+  heap[Backward].Clear ();
+  path.resize (0);
+  best = 0xffffffff;
+  meet = -1;
+  cost = 0;
+  settled = 0;
+}
+
+/** @brief The forward side looks at upward edges, the backward side
+  * at downward ones; in both the targets rank above the node.
+  */
+
+void
+HierarchySearch::Settle (int side)
+{
+  int n = heap[side].Pop ();
+  done[side][n] = query;
+  settled++;
+  int other = 1 - side;
+  if (seen[other][n] == query) {
+    quint32 total = dist[side][n] + dist[other][n];
+    if (total < best) {
+      best = total;
+      meet = n;
+    }
+  }
+  const quint32 * offsets = side == Forward ? hierarchy.UpOffsets ()
+                                            : hierarchy.DownOffsets ();
+  const quint32 * targets = side == Forward ? hierarchy.UpTargets ()
+                                            : hierarchy.DownTargets ();
+  const quint32 * weights = side == Forward ? hierarchy.UpWeights ()
+                                            : hierarchy.DownWeights ();
+  QVector <quint32> & sideSeen = seen[side];
+  QVector <quint32> & sideDist = dist[side];
+  quint32 base = sideDist[n];
+  for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+    int m = targets[e];
+    quint32 d = base + weights[e];
+    if (sideSeen[m] != query) {
+      sideSeen[m] = query;
+      sideDist[m] = d;
+      parent[side][m] = n;
+      parentEdge[side][m] = e;
+      heap[side].Push (m, d);
+    } else if (done[side][m] != query && d < sideDist[m]) {
+      sideDist[m] = d;
+      parent[side][m] = n;
+      parentEdge[side][m] = e;
+      heap[side].DecreaseKey (m, d);
+    }
+  }
+}
+
+bool
+HierarchySearch::Route (int from, int to)
+{
+  NewQuery ();
+  int nodes = hierarchy.NodeCount ();
+  if (from < 0 || to < 0 || from >= nodes || to >= nodes) {
+    return false;
+  }
+  int ends[2] = { from, to };
+  for (int side=0; side<2; side++) {
+    seen[side][ends[side]] = query;
+    dist[side][ends[side]] = 0;
+    parent[side][ends[side]] = -1;
+    heap[side].Push (ends[side], 0);
+  }
+  while (true) {
+    bool forward = !heap[Forward].IsEmpty ()
+                && heap[Forward].TopKey () < best;
+    bool backward = !heap[Backward].IsEmpty ()
+                 && heap[Backward].TopKey () < best;
+    if (!forward && !backward) {
+      break;
+    }
+    if (forward && (!backward
+           || heap[Forward].TopKey () <= heap[Backward].TopKey ())) {
+      Settle (Forward);
+    } else {
+      Settle (Backward);
+    }
+  }
+  if (meet < 0) {
+    return false;
+  }
+  cost = best;
+  QVector <Step> steps;
+  Step step;
+  for (int n=meet; parent[Forward][n] >= 0; n = parent[Forward][n]) {
+    step.from = parent[Forward][n];
+    step.to = n;
+    step.middle = hierarchy.UpMiddles ()[parentEdge[Forward][n]];
+    steps.prepend (step);
+  }
+  for (int n=meet; parent[Backward][n] >= 0; n = parent[Backward][n]) {
+    step.from = n;
+    step.to = parent[Backward][n];
+    step.middle = hierarchy.DownMiddles ()[parentEdge[Backward][n]];
+    steps.append (step);
+  }
+  path.append (from);
+  for (int s=0; s<steps.count(); s++) {
+    Unpack (steps.at(s));
+  }
+  return true;
+}
+
+/** @brief Append the road graph nodes of one hierarchy edge after its
+  * first node. A shortcut from a to b via m stands for the edge from
+  * a down to m, stored with m as a downward edge to a, followed by
+  * the upward edge from m to b.
+  */
+
+void
+HierarchySearch::Unpack (const Step & step)
+{
+  const quint32 * upOffsets = hierarchy.UpOffsets ();
+  const quint32 * upTargets = hierarchy.UpTargets ();
+  const quint32 * upWeights = hierarchy.UpWeights ();
+  const quint32 * upMiddles = hierarchy.UpMiddles ();
+  const quint32 * downOffsets = hierarchy.DownOffsets ();
+  const quint32 * downTargets = hierarchy.DownTargets ();
+  const quint32 * downWeights = hierarchy.DownWeights ();
+  const quint32 * downMiddles = hierarchy.DownMiddles ();
+  stack.resize (0);
+  stack.append (step);
+  while (!stack.isEmpty ()) {
+    Step top = stack.last ();
+    stack.resize (stack.count () - 1);
+    if (top.middle == RouteHierarchy::NoMiddle) {
+      path.append (top.to);
+      continue;
+    }
+    quint32 m = top.middle;
+    Step first, second;
+    first.from = top.from;
+    first.to = m;
+    first.middle = RouteHierarchy::NoMiddle;
+    second.from = m;
+    second.to = top.to;
+    second.middle = RouteHierarchy::NoMiddle;
+    quint32 firstWeight (0xffffffff), secondWeight (0xffffffff);
+    for (quint32 e=downOffsets[m]; e<downOffsets[m+1]; e++) {
+      if (downTargets[e] == top.from && downWeights[e] < firstWeight) {
+        firstWeight = downWeights[e];
+        first.middle = downMiddles[e];
+      }
+    }
+    for (quint32 e=upOffsets[m]; e<upOffsets[m+1]; e++) {
+      if (upTargets[e] == top.to && upWeights[e] < secondWeight) {
+        secondWeight = upWeights[e];
+        second.middle = upMiddles[e];
+      }
+    }
+    stack.append (second);
+    stack.append (first);
+  }
+}
+
+/** @brief cheapest road graph edge between two nodes, -1 if none */
+
+int
+HierarchySearch::GraphEdge (int from, int to) const
+{
+  const quint32 * offsets = graph.Offsets ();
+  const quint32 * targets = graph.Targets ();
+  const quint32 * weights = graph.Weights ();
+  int found (-1);
+  for (quint32 e=offsets[from]; e<offsets[from+1]; e++) {
+    if (int (targets[e]) == to
+        && (found < 0 || weights[e] < weights[found])) {
+      found = e;
+    }
+  }
+  return found;
+}
+
+void
+HierarchySearch::PathTurns (WayTurnList & turns, 
+                            const WayGeomMap & geoms) const
+{
+  turns.clear ();
+  const NaviId * ids = graph.NodeIds ();
+  const NaviId * ways = graph.EdgeWays ();
+  for (int p=0; p<path.count(); p++) {
+    int n = path.at(p);
+    int edge (-1);
+    if (p > 0) {
+      edge = GraphEdge (path.at(p-1), n);
+    } else if (path.count () > 1) {
+      edge = GraphEdge (n, path.at(1));
+    }
+    WayTurn turn (edge >= 0 ? ways[edge] : 0, ids[n], p, 0.0, 0.0);
+    turn.SetCoords (graph.Lats()[n], graph.Lons()[n]);
+    turns.append (turn);
+  }
+  ShapeTurns (turns, geoms);
+}
+
+static QString
+LatencyLine (const QString & name, QVector <qint64> & nsecs,
+             qint64 settledTotal)
+{
+  if (nsecs.isEmpty ()) {
+    return QString ("%1: no queries").arg (name);
+  }
+  qSort (nsecs);
+  int count = nsecs.count ();
+  return QString ("%1: %2 queries, p50 %3 us, p90 %4 us, p99 %5 us, "
+                  "max %6 us, %7 settled per query")
+           .arg (name)
+           .arg (count)
+           .arg (nsecs.at ((count - 1) * 50 / 100) / 1000.0, 0, 'f', 1)
+           .arg (nsecs.at ((count - 1) * 90 / 100) / 1000.0, 0, 'f', 1)
+           .arg (nsecs.at ((count - 1) * 99 / 100) / 1000.0, 0, 'f', 1)
+           .arg (nsecs.last () / 1000.0, 0, 'f', 1)
+           .arg (settledTotal / count);
+}
+
+/** @brief A* is only run on the first pairs, at country scale it is
+  * what the hierarchy is there to avoid.
+  */
+
+QStringList
+HierarchySearch::Benchmark (const RoadGraph & graph,
+                            const RouteHierarchy & hierarchy,
+                            int queries)
+{
+  QStringList report;
+  int nodes = graph.NodeCount ();
+  if (nodes == 0 || hierarchy.NodeCount () != nodes) {
+    report.append ("benchmark: no graph or hierarchy");
+    return report;
+  }
+  HierarchySearch chSearch (graph, hierarchy);
+  RouteSearch aStar (graph);
+  int checked = qMin (queries, 100);
+  QVector <qint64> chTimes, aStarTimes;
+  chTimes.reserve (queries);
+  aStarTimes.reserve (checked);
+  qint64 chSettled (0), aStarSettled (0);
+  int found (0), mismatches (0);
+  qsrand (4711);
+  QElapsedTimer timer;
+  for (int q=0; q<queries; q++) {
+    int from = qrand () % nodes;
+    int to = qrand () % nodes;
+    timer.start ();
+    bool chFound = chSearch.Route (from, to);
+    chTimes.append (timer.nsecsElapsed ());
+    chSettled += chSearch.Settled ();
+    if (chFound) {
+      found++;
+    }
+    if (q < checked) {
+      timer.start ();
+      bool aFound = aStar.Route (from, to);
+      aStarTimes.append (timer.nsecsElapsed ());
+      aStarSettled += aStar.Settled ();
+      if (aFound != chFound
+          || (aFound && aStar.Cost () != chSearch.Cost ())) {
+        mismatches++;
+      }
+    }
+  }
+  report.append (LatencyLine ("hierarchy", chTimes, chSettled));
+  report.append (LatencyLine ("A*", aStarTimes, aStarSettled));
+  report.append (QString ("%1 of %2 pairs connected, %3 cost mismatches "
+                          "in %4 checked")
+                   .arg (found).arg (queries)
+                   .arg (mismatches).arg (checked));
+  return report;
+}
+
+} // namespace
@@ -0,0 +1,192 @@
+#ifndef ROUTE_HIERARCHY_H
+#define ROUTE_HIERARCHY_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "road-graph.h"
+#include "route-search.h"
+#include "navi-types.h"
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+namespace navi
+{
+
+/** @brief Contraction hierarchy over a RoadGraph, mapped read only
+  * from one file.
+  *
+  * Every graph node has a rank, the order it was contracted in. The
+  * upward edges of node n lead from n to nodes of higher rank, the
+  * downward edges of n come into n from nodes of higher rank and are
+  * stored with those nodes as targets, so both searches of a query
+  * only look upward. An edge with a middle node is a shortcut for the
+  * edge into the middle node followed by the edge out of it; edges
+  * of the road graph itself have NoMiddle. The layout is the one of
+  * RoadGraph, and the header records the size of the graph the
+  * hierarchy was built for.
+  */
+
+class RouteHierarchy
+{
+public:
+
+  enum Section {
+    Sec_Ranks = 0,
+    Sec_UpOffsets,
+    Sec_UpTargets,
+    Sec_UpWeights,
+    Sec_UpMiddles,
+    Sec_DownOffsets,
+    Sec_DownTargets,
+    Sec_DownWeights,
+    Sec_DownMiddles,
+    Sec_Count
+  };
+
+  struct Header {
+    char     magic[8];
+    quint32  version;
+    quint32  sectionCount;
+    quint64  graphNodes;
+    quint64  graphEdges;
+  };
+
+  typedef RoadGraph::SectionEntry SectionEntry;
+
+  RouteHierarchy ();
+  ~RouteHierarchy ();
+
+  /** @brief false if the file is missing or was built for another
+    * graph
+    */
+  bool Open (const QString & filename, const RoadGraph & graph);
+  void Close ();
+  bool IsOpen () const { return base != 0; }
+
+  int  NodeCount () const { return Count (Sec_Ranks); }
+  int  UpCount () const { return Count (Sec_UpTargets); }
+  int  DownCount () const { return Count (Sec_DownTargets); }
+
+  const quint32 * Ranks () const { return Column (Sec_Ranks); }
+  const quint32 * UpOffsets () const { return Column (Sec_UpOffsets); }
+  const quint32 * UpTargets () const { return Column (Sec_UpTargets); }
+  const quint32 * UpWeights () const { return Column (Sec_UpWeights); }
+  const quint32 * UpMiddles () const { return Column (Sec_UpMiddles); }
+  const quint32 * DownOffsets () const { return Column (Sec_DownOffsets); }
+  const quint32 * DownTargets () const { return Column (Sec_DownTargets); }
+  const quint32 * DownWeights () const { return Column (Sec_DownWeights); }
+  const quint32 * DownMiddles () const { return Column (Sec_DownMiddles); }
+
+  static QString FileName (const QString & geoBaseName)
+    { return geoBaseName + QString (".hierarchy"); }
+
+  static const char    Magic[8];
+  static const quint32 Version;
+  static const quint32 NoMiddle;
+
+private:
+
+  const quint32 * Column (Section section) const
+    {
+      return base ? reinterpret_cast <const quint32*>
+                         (base + sections[section].offset)
+                  : 0;
+    }
+  int  Count (Section section) const
+    { return base ? int (sections[section].count) : 0; }
+
+  QFile               file;
+  const uchar        *base;
+  const SectionEntry *sections;
+};
+
+/** @brief Point to point query on a RouteHierarchy.
+  *
+  * A forward search from the start over upward edges and a backward
+  * search from the target over downward edges take turns; each stops
+  * once its smallest key is no better than the best meeting found so
+  * far. The shortcuts on the path through the meeting node are then
+  * unpacked into road graph nodes. Per node state is marked with the
+  * query number, as in RouteSearch.
+  */
+
+class HierarchySearch
+{
+public:
+
+  HierarchySearch (const RoadGraph & roadGraph,
+                   const RouteHierarchy & routeHierarchy);
+
+  bool Route (int from, int to);
+
+  const QVector <int> & Path () const { return path; }
+  quint32 Cost () const { return cost; }
+  int     Settled () const { return settled; }
+
+  /** @brief the last route as way turns, as RouteSearch::PathTurns */
+  void PathTurns (WayTurnList & turns,
+                  const WayGeomMap & geoms = WayGeomMap ()) const;
+
+  /** @brief time random queries with the hierarchy and with A* on
+    * the same pairs, check the costs agree, and report latency
+    * percentiles for both
+    */
+  static QStringList Benchmark (const RoadGraph & graph,
+                                const RouteHierarchy & hierarchy,
+                                int queries);
+
+private:
+
+  enum Direction { Forward = 0, Backward = 1 };
+
+  struct Step {
+    quint32  from;
+    quint32  to;
+    quint32  middle;
+  };
+
+  void NewQuery ();
+  void Settle (int side);
+  void Unpack (const Step & step);
+  int  GraphEdge (int from, int to) const;
+
+  const RoadGraph       & graph;
+  const RouteHierarchy  & hierarchy;
+  QuadHeap            heap[2];
+  QVector <quint32>   seen[2];
+  QVector <quint32>   done[2];
+  QVector <quint32>   dist[2];
+  QVector <int>       parent[2];
+  QVector <quint32>   parentEdge[2];
+  QVector <Step>      stack;
+  QVector <int>       path;
+  quint32             query;
+  quint32             best;
+  int                 meet;
+  quint32             cost;
+  int                 settled;
+};
+
+} // namespace
+
+#endif
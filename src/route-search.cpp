@@ -0,0 +1,269 @@
+#include "route-search.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+#include <QtAlgorithms>
+
+namespace navi
+{
+
+void
+QuadHeap::Push (int node, quint32 key)
+{
+  Entry entry;
+  entry.key = key;
+  entry.node = node;
+  Up (count++, entry);
+}
+
+void
+QuadHeap::DecreaseKey (int node, quint32 key)
+{
+  Entry entry;
+  entry.key = key;
+  entry.node = node;
+  Up (position[node], entry);
+}
+
+int
+QuadHeap::Pop ()
+{
+  int top = entries[0].node;
+  count--;
+  if (count > 0) {
+    Down (0, entries[count]);
+  }
+  return top;
+}
+
+void
+QuadHeap::Up (int slot, Entry entry)
+{
+  while (slot > 0) {
+    int up = (slot - 1) / 4;
+    if (entries[up].key <= entry.key) {
+      break;
+    }
+    entries[slot] = entries[up];
+    position[entries[slot].node] = slot;
+    slot = up;
+  }
+  entries[slot] = entry;
+  position[entry.node] = slot;
+}
+
+void
+QuadHeap::Down (int slot, Entry entry)
+{
+  while (true) {
+    int first = 4 * slot + 1;
+    if (first >= count) {
+      break;
+    }
+    int last = qMin (first + 4, count);
+    int best = first;
+    for (int c=first+1; c<last; c++) {
+      if (entries[c].key < entries[best].key) {
+        best = c;
+      }
+    }
+    if (entries[best].key >= entry.key) {
+      break;
+    }
+    entries[slot] = entries[best];
+    position[entries[slot].node] = slot;
+    slot = best;
+  }
+  entries[slot] = entry;
+  position[entry.node] = slot;
+}
+
+/** @brief The fastest edge, measured straight between its ends, sets
+  * the time per meter of the heuristic.
+  */
+
+RouteSearch::RouteSearch (const RoadGraph & roadGraph)
+  :graph (roadGraph),
+   query (0),
+   timePerMeter (0.0),
+   cost (0),
+   settled (0)
+{
+  int nodes = graph.NodeCount ();
+  heap.Resize (nodes);
+  seen.fill (0, nodes);
+  done.fill (0, nodes);
+  dist.resize (nodes);
+  estimate.resize (nodes);
+  parent.resize (nodes);
+  parentEdge.resize (nodes);
+  path.reserve (1024);
+  const quint32 * offsets = graph.Offsets ();
+  const quint32 * targets = graph.Targets ();
+  const quint32 * weights = graph.Weights ();
+  const NaviCoord * lats = graph.Lats ();
+  const NaviCoord * lons = graph.Lons ();
+  double fastest (0.0);
+  for (int n=0; n<nodes; n++) {
+    for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+      int m = targets[e];
+      double meters = RoadGraph::Meters (lats[n], lons[n], 
+                                         lats[m], lons[m]);
+      fastest = qMax (fastest, meters / weights[e]);
+    }
+  }
+  timePerMeter = fastest > 0.0 ? 1.0 / fastest : 0.0;
+}
+
+void
+RouteSearch::NewQuery ()
+{
+  query++;
+  if (query == 0) {
+    seen.fill (0);
+    done.fill (0);
+    query = 1;
+  }
+  heap.Clear ();
+  path.resize (0);
+  cost = 0;
+  settled = 0;
+}
+
+quint32
+RouteSearch::Estimate (int node, int to) const
+{
+  const NaviCoord * lats = graph.Lats ();
+  const NaviCoord * lons = graph.Lons ();
+  return quint32 (timePerMeter * RoadGraph::Meters (lats[node], lons[node],
+                                                    lats[to], lons[to]));
+}
+
+bool
+RouteSearch::Route (int from, int to)
+{
+  NewQuery ();
+  int nodes = graph.NodeCount ();
+  if (from < 0 || to < 0 || from >= nodes || to >= nodes) {
+    return false;
+  }
+  const quint32 * offsets = graph.Offsets ();
+  const quint32 * targets = graph.Targets ();
+  const quint32 * weights = graph.Weights ();
+  seen[from] = query;
+  dist[from] = 0;
+  parent[from] = -1;
+  estimate[from] = Estimate (from, to);
+  heap.Push (from, estimate[from]);
+  bool found (false);
+  while (!heap.IsEmpty ()) {
+    int n = heap.Pop ();
+    done[n] = query;
+    settled++;
+    if (n == to) {
+      found = true;
+      break;
+    }
+    quint32 base = dist[n];
+    for (quint32 e=offsets[n]; e<offsets[n+1]; e++) {
+      int m = targets[e];
+      quint32 d = base + weights[e];
+      if (seen[m] != query) {
+        seen[m] = query;
+        dist[m] = d;
+        parent[m] = n;
+        parentEdge[m] = e;
+        estimate[m] = Estimate (m, to);
+        heap.Push (m, d + estimate[m]);
+      } else if (done[m] != query && d < dist[m]) {
+        dist[m] = d;
+        parent[m] = n;
+        parentEdge[m] = e;
+        heap.DecreaseKey (m, d + estimate[m]);
+      }
+    }
+  }
+  if (!found) {
+    return false;
+  }
+  cost = dist[to];
+  for (int n=to; n >= 0; n = parent[n]) {
+    path.append (n);
+  }
+  for (int i=0, j=path.count()-1; i<j; i++, j--) {
+    qSwap (path[i], path[j]);
+  }
+  return true;
+}
+
+/** @brief The first node has no edge leading to it, it gets the way
+  * of the edge leaving it.
+  */
+
+void
+RouteSearch::PathTurns (WayTurnList & turns, 
+                        const WayGeomMap & geoms) const
+{
+  turns.clear ();
+  const NaviId * ids = graph.NodeIds ();
+  const NaviId * ways = graph.EdgeWays ();
+  for (int p=0; p<path.count(); p++) {
+    int n = path.at(p);
+    int via = p > 0 ? n : (path.count() > 1 ? path.at(1) : -1);
+    NaviId wayId = via >= 0 ? ways[parentEdge[via]] : 0;
+    WayTurn turn (wayId, ids[n], p, 0.0, 0.0);
+    turn.SetCoords (graph.Lats()[n], graph.Lons()[n]);
+    turns.append (turn);
+  }
+  ShapeTurns (turns, geoms);
+}
+
+/** @brief Each turn carries the way of the stretch leading to it. */
+
+void
+ShapeTurns (WayTurnList & turns, const WayGeomMap & geoms)
+{
+  if (geoms.isEmpty ()) {
+    return;
+  }
+  WayTurnList shaped;
+  for (int t=0; t<turns.count(); t++) {
+    const WayTurn & turn = turns.at(t);
+    if (t > 0) {
+      NaviId wayId = turn.WayId ();
+      WayTurnList stretch = WayGeometry::Stretch (wayId, 
+                                                  geoms.value (wayId),
+                                                  turns.at(t-1).NodeId (),
+                                                  turn.NodeId ());
+      for (int s=1; s+1<stretch.count(); s++) {
+        shaped.append (stretch.at(s));
+      }
+    }
+    shaped.append (turn);
+  }
+  for (int s=0; s<shaped.count(); s++) {
+    shaped[s].SetSeq (s);
+  }
+  turns = shaped;
+}
+
+} // namespace
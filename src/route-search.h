@@ -0,0 +1,132 @@
+#ifndef ROUTE_SEARCH_H
+#define ROUTE_SEARCH_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "road-graph.h"
+#include "navi-types.h"
+#include "way-geometry.h"
+#include <QVector>
+
+namespace navi
+{
+
+/** @brief Min heap of graph nodes with four children per entry, so
+  * the heap is half as deep as a binary one and the children of an
+  * entry share a cache line. Each node has its heap position kept for
+  * DecreaseKey. Clear keeps the storage for the next query.
+  */
+
+class QuadHeap
+{
+public:
+
+  QuadHeap () : count (0) {}
+
+  void Resize (int nodes) { position.resize (nodes); entries.resize (nodes); }
+  void Clear () { count = 0; }
+  bool IsEmpty () const { return count == 0; }
+  quint32 TopKey () const { return entries[0].key; }
+
+  void Push (int node, quint32 key);
+  void DecreaseKey (int node, quint32 key);
+  int  Pop ();
+
+private:
+
+  struct Entry {
+    quint32  key;
+    int      node;
+  };
+
+  void Up (int slot, Entry entry);
+  void Down (int slot, Entry entry);
+
+  QVector <Entry>  entries;
+  QVector <int>    position;
+  int              count;
+};
+
+/** @brief A* point to point search on a RoadGraph.
+  *
+  * The heuristic is the great circle distance to the target at the
+  * highest speed any edge of the graph allows, so it never overstates
+  * the remaining time. The per node state is allocated once for the
+  * graph and marked with the query number it belongs to, so a new
+  * query starts without clearing anything.
+  */
+
+class RouteSearch
+{
+public:
+
+  RouteSearch (const RoadGraph & roadGraph);
+
+  /** @brief fastest path between graph nodes, false if to cannot
+    * be reached from from
+    */
+  bool Route (int from, int to);
+
+  /** @brief graph nodes of the last route, from first to last */
+  const QVector <int> & Path () const { return path; }
+
+  /** @brief travel time of the last route in tenths of a second */
+  quint32 Cost () const { return cost; }
+  /** @brief nodes taken off the heap by the last query */
+  int     Settled () const { return settled; }
+
+  /** @brief the last route as way turns, one per graph node, each
+    * with the way of the edge that leads to it. Given the geometry
+    * of those ways, the shape points between the graph nodes are
+    * put in as well, see ShapeTurns.
+    */
+  void PathTurns (WayTurnList & turns, 
+                  const WayGeomMap & geoms = WayGeomMap ()) const;
+
+private:
+
+  void    NewQuery ();
+  quint32 Estimate (int node, int to) const;
+
+  const RoadGraph   & graph;
+  QuadHeap            heap;
+  QVector <quint32>   seen;
+  QVector <quint32>   done;
+  QVector <quint32>   dist;
+  QVector <quint32>   estimate;
+  QVector <int>       parent;
+  QVector <quint32>   parentEdge;
+  QVector <int>       path;
+  quint32             query;
+  double              timePerMeter;
+  quint32             cost;
+  int                 settled;
+};
+
+/** @brief Put the shape points of the ways between the graph node
+  * turns of a route. A stretch whose way has no geometry in geoms
+  * stays a straight line.
+  */
+void ShapeTurns (WayTurnList & turns, const WayGeomMap & geoms);
+
+} // namespace
+
+#endif
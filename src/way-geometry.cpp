@@ -0,0 +1,173 @@
+#include "way-geometry.h"
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+
+namespace navi
+{
+
+static inline quint64
+ZigZag (qint64 value)
+{
+  return (quint64 (value) << 1) ^ quint64 (value >> 63);
+}
+
+static inline qint64
+UnZigZag (quint64 value)
+{
+  return qint64 (value >> 1) ^ -qint64 (value & 1);
+}
+
+void
+WayGeometry::AppendVarint (QByteArray & geom, quint64 value)
+{
+  while (value >= 0x80) {
+    geom.append (char ((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  geom.append (char (value));
+}
+
+QByteArray
+WayGeometry::Encode (const WayTurnList & turns)
+{
+  QByteArray geom;
+  geom.reserve (4 + turns.count () * 8);
+  AppendVarint (geom, turns.count ());
+  qint64 seq (0), node (0), lat (0), lon (0);
+  for (int t=0; t<turns.count(); t++) {
+    const WayTurn & turn = turns.at(t);
+    AppendVarint (geom, ZigZag (turn.Seq () - seq));
+    AppendVarint (geom, ZigZag (turn.NodeId () - node));
+    AppendVarint (geom, ZigZag (turn.LatCoord () - lat));
+    AppendVarint (geom, ZigZag (turn.LonCoord () - lon));
+    seq = turn.Seq ();
+    node = turn.NodeId ();
+    lat = turn.LatCoord ();
+    lon = turn.LonCoord ();
+  }
+  return geom;
+}
+
+WayTurnList
+WayGeometry::Decode (NaviId wayId, const QByteArray & geom)
+{
+  WayTurnList turns;
+  WayGeometryReader reader (geom);
+  while (reader.Next ()) {
+    WayTurn turn (wayId, reader.NodeId (), reader.Seq (), 0.0, 0.0);
+    turn.SetCoords (reader.Lat (), reader.Lon ());
+    turns.append (turn);
+  }
+  return turns;
+}
+
+WayTurnList
+WayGeometry::Stretch (NaviId wayId, const QByteArray & geom,
+                      NaviId from, NaviId to)
+{
+  WayTurnList points = Decode (wayId, geom);
+  int first (-1), last (-1);
+  for (int p=0; p<points.count(); p++) {
+    if (points.at(p).NodeId () != from) {
+      continue;
+    }
+    for (int q=0; q<points.count(); q++) {
+      if (q != p && points.at(q).NodeId () == to
+          && (first < 0 || qAbs (q - p) < qAbs (last - first))) {
+        first = p;
+        last = q;
+      }
+    }
+  }
+  WayTurnList stretch;
+  if (first < 0) {
+    return stretch;
+  }
+  int step = last > first ? 1 : -1;
+  for (int p=first; p != last + step; p += step) {
+    stretch.append (points.at(p));
+  }
+  return stretch;
+}
+
+WayGeometryReader::WayGeometryReader (const QByteArray & geom)
+  :pos (reinterpret_cast <const uchar*> (geom.constData ())),
+   end (pos + geom.size ()),
+   count (0),
+   remaining (0),
+   seq (0),
+   nodeId (0),
+   lat (0),
+   lon (0)
+{
+  quint64 n;
+  if (ReadVarint (n)) {
+    count = remaining = int (n);
+  }
+}
+
+bool
+WayGeometryReader::ReadVarint (quint64 & value)
+{
+  value = 0;
+  for (int shift = 0; pos < end && shift < 64; shift += 7) {
+    uchar byte = *pos++;
+    value |= quint64 (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+WayGeometryReader::ReadDelta (qint64 & value)
+{
+  quint64 raw;
+  if (!ReadVarint (raw)) {
+    return false;
+  }
+  value = UnZigZag (raw);
+  return true;
+}
+
+bool
+WayGeometryReader::Next ()
+{
+  if (remaining <= 0) {
+    return false;
+  }
+  qint64 dSeq, dNode, dLat, dLon;
+  if (!ReadDelta (dSeq) || !ReadDelta (dNode) 
+      || !ReadDelta (dLat) || !ReadDelta (dLon)) {
+    remaining = 0;
+    return false;
+  }
+  remaining--;
+  seq += dSeq;
+  nodeId += dNode;
+  lat += dLat;
+  lon += dLon;
+  return true;
+}
+
+} // namespace
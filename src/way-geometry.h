@@ -0,0 +1,92 @@
+#ifndef WAY_GEOMETRY_H
+#define WAY_GEOMETRY_H
+
+/****************************************************************
+ * This file is distributed under the following license:
+ *
+ * Copyright (C) 2010, Bernd Stramm
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ ****************************************************************/
+#include "navi-types.h"
+#include <QByteArray>
+#include <QMap>
+
+namespace navi
+{
+
+/** @brief A way's located nodes in one blob: a varint point count,
+  * then for each point the zigzag varint deltas of seq, node id, lat
+  * and lon from the point before. Neighbouring nodes of a way are
+  * close in id and position, so most points take a few bytes.
+  */
+
+class WayGeometry
+{
+public:
+
+  /** @brief turns of one way, in seq order */
+  static QByteArray  Encode (const WayTurnList & turns);
+  static WayTurnList Decode (NaviId wayId, const QByteArray & geom);
+  /** @brief the points from node from to node to, both included and
+    * in that direction, empty when the way does not pass both. Of
+    * several such stretches the one with the fewest points is taken.
+    */
+  static WayTurnList Stretch (NaviId wayId, const QByteArray & geom,
+                              NaviId from, NaviId to);
+
+private:
+
+  static void AppendVarint (QByteArray & geom, quint64 value);
+};
+
+/** @brief geometry blobs by way id */
+typedef QMap <NaviId, QByteArray>  WayGeomMap;
+
+/** @brief Walks the points of a geometry blob in place */
+
+class WayGeometryReader
+{
+public:
+
+  WayGeometryReader (const QByteArray & geom);
+
+  int  Count () const { return count; }
+  bool Next ();
+
+  int       Seq () const { return seq; }
+  NaviId    NodeId () const { return nodeId; }
+  NaviCoord Lat () const { return lat; }
+  NaviCoord Lon () const { return lon; }
+
+private:
+
+  bool ReadVarint (quint64 & value);
+  bool ReadDelta (qint64 & value);
+
+  const uchar  *pos;
+  const uchar  *end;
+  int           count;
+  int           remaining;
+  int           seq;
+  NaviId        nodeId;
+  NaviCoord     lat;
+  NaviCoord     lon;
+};
+
+} // namespace
+
+#endif